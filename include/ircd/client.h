@@ -32,6 +32,7 @@ struct ircd::client
 	struct conf;
 	struct settings;
 	struct request;
+	struct h2;
 
 	static log::log log;
 	static struct settings settings;
@@ -48,6 +49,7 @@ struct ircd::client
 	static void close_all();
 	static void wait_all();
 	static void spawn();
+	static void resume(std::shared_ptr<client>, std::function<void (client &)>);
 
 	struct conf *conf {&default_conf};
 	unique_buffer<mutable_buffer> head_buffer;
@@ -61,7 +63,12 @@ struct ircd::client
 	ircd::timer timer;
 	size_t head_length {0};
 	size_t content_consumed {0};
+	bool parkable {false};
+	bool parked {false};
 	resource::request request;
+	std::shared_ptr<h2> session;       // HTTP/2 connection of a stream client
+	uint32_t stream {0};               // HTTP/2 stream of this request
+	steady_point deadline;             // stream timeout of the resource method
 
 	string_view loghead() const;
 	size_t write_all(const const_buffer &);
@@ -73,6 +80,7 @@ struct ircd::client
 	bool handle_request(parse::capstan &pc);
 	bool main();
 	bool async();
+	bool park();
 
 	client(std::shared_ptr<socket>);
 	client(client &&) = delete;
@@ -42,9 +42,15 @@ struct ircd::ctx::ole::opts
 	/// Optionally give this offload task a name for any tasklist.
 	string_view name;
 
-	/// The function will be executed on each thread.
+	/// The function will be executed this many times, each on any available
+	/// worker thread; the offload returns when all of them have returned.
+	/// The function is responsible for partitioning the work among them.
 	size_t concurrency {1};
 
+	/// The pool is grown to at least this many threads for this offload, even
+	/// past ircd.ctx.ole.thread.max. Zero defers to that conf item.
+	size_t threads {0};
+
 	/// Queuing priority; in the form of a nice value.
 	int8_t prio {0};
 };
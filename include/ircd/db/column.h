@@ -61,6 +61,11 @@ namespace ircd::db
 	string_view read(column &, const string_view &key, bool &found, const mutable_buffer &, const gopts & = {});
 	std::string read(column &, const string_view &key, bool &found, const gopts & = {});
 
+	// [GET] Zero-copy read of multiple keys in parallel; the closure receives
+	// the position of each key found with its value; returns bitset.
+	using read_closure = std::function<void (const size_t &, const string_view &)>;
+	uint64_t read(column &, const vector_view<const string_view> &keys, const read_closure &, const gopts & = {});
+
 	// [SET] Write data to the db
 	void write(column &, const string_view &key, const const_buffer &value, const sopts & = {});
 
@@ -124,4 +124,16 @@ struct ircd::db::descriptor
 	{
 		60s * 60 * 24 * 21 // 21 day period
 	};
+
+	/// Compression dictionary parameters. A dictionary is sampled from the
+	/// blocks of each table file when it is written and stored in that file.
+	/// This helps small blocks of similar values which compress poorly on
+	/// their own. Training the dictionary requires zstd. see:
+	/// rocksdb/advanced_options.h CompressionOptions
+	struct compression_dict
+	{
+		size_t size {0};             ///< max_dict_bytes; 0 disables.
+		size_t train {0};            ///< zstd_max_train_bytes; 0 is no training.
+	}
+	compression_dict;
 };
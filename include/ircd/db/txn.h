@@ -26,6 +26,9 @@ namespace ircd::db
 	void for_each(database &d, const uint64_t &seq, const seq_closure &);
 	void get(database &d, const uint64_t &seq, const seq_closure &);
 	std::string debug(const txn &);
+
+	// Commit several transactions to the same database in one write.
+	void commit(const vector_view<txn *> &, const sopts & = {});
 }
 
 struct ircd::db::txn
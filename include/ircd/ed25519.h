@@ -25,6 +25,14 @@ namespace ircd::ed25519
 	struct pk;
 	struct sk;
 	struct sig;
+
+	// Batch verification of (pk, msg, sig) tuples, divided among the given
+	// number of offload threads; indexes of invalid tuples are output.
+	vector_view<size_t> verify_batch(const vector_view<size_t> &failed,
+	                                 const vector_view<const pk> &,
+	                                 const vector_view<const const_buffer> &msgs,
+	                                 const vector_view<const sig> &,
+	                                 const size_t &concurrency = 1);
 }
 
 class ircd::ed25519::sk
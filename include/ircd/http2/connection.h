@@ -0,0 +1,135 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2019 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_HTTP2_CONNECTION_H
+
+namespace ircd::http2
+{
+	struct connection;
+}
+
+/// Protocol state of one end of an HTTP/2 connection without any I/O. Bytes
+/// received from the socket are given to read(), which calls the handlers for
+/// the streams. Frames to send are appended to the output; the user writes
+/// pending() to the socket and then calls wrote().
+///
+/// Errors of the whole connection are thrown as http2::error after a GOAWAY
+/// is queued; the user should write what's pending and close. Errors of a
+/// stream reset that stream and call the reset handler.
+///
+/// Receive flow control is automatic: data is given to the handler as it
+/// arrives and the windows are replenished. Send flow control is the user's:
+/// data() accepts only what the windows allow and the window handler is
+/// called when they open again.
+struct ircd::http2::connection
+{
+	struct handlers;
+
+	using headers_view = vector_view<const http::header>;
+
+	static conf::item<size_t> header_list_max;
+	static conf::item<size_t> window_size;
+	static conf::item<size_t> connection_window_size;
+	static conf::item<size_t> streams_max;
+	static conf::item<size_t> out_max;
+
+	bool server;
+	http2::settings ours;
+	http2::settings theirs;
+	hpack::encoder encoder;
+	hpack::decoder decoder;
+	std::map<uint32_t, stream> streams;
+	int64_t send_window {65535};
+	int64_t recv_window {65535};
+	uint32_t next_id;
+	uint32_t last_id {0};
+	uint32_t goaway_id {0};
+	bool preface {false};
+	bool settings_recv {false};
+	bool goaway_sent {false};
+	bool goaway_recv {false};
+	std::string in;
+	std::string out;
+	size_t out_pos {0};
+	uint32_t cont_id {0};
+	uint8_t cont_flags {0};
+	stream cont_priority;
+	std::string cont_block;
+	unique_buffer<mutable_buffer> header_buf;
+	unique_buffer<mutable_buffer> encode_buf;
+	std::vector<http::header> header_vec;
+	const handlers *handler;
+
+	static void read_priority(stream &, const const_buffer &payload);
+
+	void queue(const enum frame::type &, const uint8_t &flags, const uint32_t &id, const const_buffer &payload = {});
+	void stream_error(const uint32_t &id, const enum error::code &);
+	void close_local(stream &);
+	void close_remote(stream &);
+	void replenish(stream *const &, const size_t &len);
+	stream *get(const uint32_t &id);
+	bool idle(const uint32_t &id) const;
+
+	void handle_headers_block(const uint32_t &id, const uint8_t &flags, const const_buffer &block, const stream &priority);
+	void handle_data(const frame::header &, const_buffer);
+	void handle_headers(const frame::header &, const_buffer);
+	void handle_priority(const frame::header &, const_buffer);
+	void handle_rst_stream(const frame::header &, const_buffer);
+	void handle_settings(const frame::header &, const_buffer);
+	void handle_push_promise(const frame::header &, const_buffer);
+	void handle_ping(const frame::header &, const_buffer);
+	void handle_goaway(const frame::header &, const_buffer);
+	void handle_window_update(const frame::header &, const_buffer);
+	void handle_continuation(const frame::header &, const_buffer);
+	void handle(const frame::header &, const const_buffer &);
+	size_t handle_preface(const const_buffer &);
+
+  public:
+	// indicator lights
+	size_t active() const;
+	bool acceptable() const;
+	int64_t window(const uint32_t &id) const;
+
+	// output
+	const_buffer pending() const;
+	void wrote(const size_t &);
+
+	// input
+	void read(const const_buffer &);
+
+	// streams
+	uint32_t open();
+	void headers(const uint32_t &id, const headers_view &, const bool &eos);
+	size_t data(const uint32_t &id, const const_buffer &, const bool &eos);
+	void reset(const uint32_t &id, const enum error::code & = error::CANCEL);
+
+	// connection
+	void ping(const uint64_t &opaque = 0);
+	void goaway(const enum error::code & = error::NO_ERROR, const string_view &debug = {});
+
+	connection(const bool &server, const handlers &);
+	connection(connection &&) = delete;
+	connection(const connection &) = delete;
+	~connection() noexcept;
+};
+
+/// Callbacks to the user of a connection. The stream reference is only valid
+/// for the duration of the call. Headers are lower-case and include the
+/// pseudo-headers; they are followed by the data when not eos. A second
+/// headers with eos are trailers.
+struct ircd::http2::connection::handlers
+{
+	std::function<void (stream &, const headers_view &, const bool &eos)> headers;
+	std::function<void (stream &, const const_buffer &, const bool &eos)> data;
+	std::function<void (stream &, const enum error::code &)> reset;
+	std::function<void (const uint32_t &last_id, const enum error::code &)> goaway;
+	std::function<void ()> window;
+};
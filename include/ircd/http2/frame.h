@@ -21,17 +21,29 @@ struct ircd::http2::frame
 	struct header;
 	struct settings;
 	enum type :uint8_t;
+	enum flag :uint8_t;
 
 	static string_view reflect(const type &);
 };
 
+/// The frame header in host order. The members are not laid out as on the
+/// wire; construct from the nine bytes received, and write() the nine bytes
+/// to send.
 struct ircd::http2::frame::header
 {
+	static constexpr const size_t SIZE {9};
+
 	uint32_t len        : 24;
 	enum type type;
 	uint8_t flags;
 	uint32_t            : 1;
 	uint32_t stream_id  : 31;
+
+	const_buffer write(const mutable_buffer &) const;
+
+	header(const enum type &, const uint8_t &flags, const uint32_t &stream_id, const size_t &len);
+	explicit header(const const_buffer &);
+	header() = default;
 }
 __attribute__((packed));
 
@@ -49,3 +61,14 @@ enum ircd::http2::frame::type
 	WINDOW_UPDATE  = 0x8,
 	CONTINUATION   = 0x9,
 };
+
+/// Flags of the frame header; the meaning of a bit depends on the type.
+enum ircd::http2::frame::flag
+:uint8_t
+{
+	END_STREAM     = (1 << 0),   ///< DATA, HEADERS
+	ACK            = (1 << 0),   ///< SETTINGS, PING
+	END_HEADERS    = (1 << 2),   ///< HEADERS, PUSH_PROMISE, CONTINUATION
+	PADDED         = (1 << 3),   ///< DATA, HEADERS, PUSH_PROMISE
+	HAS_PRIORITY   = (1 << 5),   ///< HEADERS
+};
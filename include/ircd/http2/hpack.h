@@ -0,0 +1,66 @@
+// Matrix Construct
+//
+// Copyright (C) Matrix Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2019 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_HTTP2_HPACK_H
+
+/// Header compression (RFC 7541). Each direction of a connection has its own
+/// dynamic table, so a connection has one encoder and one decoder.
+namespace ircd::http2::hpack
+{
+	struct table;
+	struct encoder;
+	struct decoder;
+
+	using closure = std::function<void (const http::header &)>;
+
+	extern const http::header static_table[61];
+
+	size_t huffman_size(const string_view &);
+	const_buffer huffman_encode(const mutable_buffer &, const string_view &);
+	string_view huffman_decode(const mutable_buffer &, const const_buffer &);
+}
+
+/// The dynamic table. Entries are indexed after the static table starting
+/// with the newest. Names are stored in lower case.
+struct ircd::http2::hpack::table
+{
+	std::deque<std::pair<std::string, std::string>> entry;
+	size_t size {0};
+	size_t max {4096};
+
+	http::header operator[](const size_t &index) const;
+	size_t find(const http::header &, bool &value) const;
+
+	void add(const string_view &name, const string_view &value);
+	void resize(const size_t &max);
+};
+
+/// Compose header blocks. Names are lower-cased as they're written. The
+/// values of sensitive headers (i.e. authorization) are never indexed.
+struct ircd::http2::hpack::encoder
+{
+	hpack::table table;
+	size_t update {size_t(-1)};
+	bool huffman {true};
+
+	const_buffer operator()(const mutable_buffer &, const vector_view<const http::header> &);
+	void resize(const size_t &max);
+};
+
+/// Parse header blocks. All strings given to the closure are copied into
+/// buf; they remain valid until the next block is decoded into buf.
+struct ircd::http2::hpack::decoder
+{
+	hpack::table table;
+	size_t limit {4096};
+
+	void operator()(const const_buffer &block, const mutable_buffer &buf, const closure &);
+};
@@ -56,11 +56,16 @@ enum ircd::http2::frame::settings::flag
 	ACK  = (1 << 0),
 };
 
+/// Values of the settings indexed by code. Unlimited values are the max of
+/// the type.
 struct ircd::http2::settings
 :std::array<uint32_t, num_of<frame::settings::code>()>
 {
 	using code = frame::settings::code;
 	using array_type = std::array<uint32_t, num_of<code>()>;
 
+	const uint32_t &operator[](const code &c) const   { return array_type::at(c - 1);              }
+	uint32_t &operator[](const code &c)               { return array_type::at(c - 1);              }
+
 	settings();
 };
@@ -16,12 +16,25 @@ namespace ircd::http2
 	struct stream;
 }
 
+/// State of a stream kept by the connection. The windows are the bytes of
+/// DATA which may be sent and received on the stream; the send window may go
+/// negative when the remote lowers its INITIAL_WINDOW_SIZE.
 struct ircd::http2::stream
 {
 	enum class state :uint8_t;
 
+	uint32_t id {0};
 	enum state state;
+	int64_t send_window {0};
+	int64_t recv_window {0};
+	uint32_t dependency {0};
+	uint16_t weight {16};
+	bool exclusive {false};
 
+	bool local_closed() const;
+	bool remote_closed() const;
+
+	stream(const uint32_t &id, const int64_t &send_window, const int64_t &recv_window);
 	stream();
 };
 
@@ -83,8 +83,8 @@
 #include "pbc.h"
 #include "fmt.h"
 #include "http.h"
-#include "http2/http2.h"
 #include "conf.h"
+#include "http2/http2.h"
 #include "magic.h"
 #include "stats.h"
 #include "prof/prof.h"
@@ -55,7 +55,7 @@ namespace ircd::log
 	void console_disable();
 	void console_enable();
 
-	void flush();
+	void flush() noexcept;
 	void close();
 	void open();
 
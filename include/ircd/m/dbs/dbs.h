@@ -47,6 +47,7 @@ namespace ircd::m::dbs::appendix
 #include "event_json.h"             // event_idx => (full JSON)
 #include "event_column.h"           // event_idx => (direct value)
 #include "event_refs.h"             // event_idx | ref_type, event_idx
+#include "event_chain.h"            // chain | event_idx || chain | chain_id, seq
 #include "event_horizon.h"          // event_id | event_idx
 #include "event_sender.h"           // sender | event_idx || hostpart | localpart, event_idx
 #include "event_type.h"             // type | event_idx
@@ -56,6 +57,7 @@ namespace ircd::m::dbs::appendix
 #include "room_state.h"             // room_id | type, state_key => event_idx
 #include "room_state_space.h"       // room_id | type, state_key, depth, event_idx
 #include "room_joined.h"            // room_id | origin, member => event_idx
+#include "room_terms.h"             // room_id | term, event_idx => --
 #include "room_head.h"              // room_id | event_id => event_idx
 
 /// Options that affect the dbs::write() of an event to the transaction.
@@ -141,6 +143,10 @@ enum ircd::m::dbs::appendix::index
 	/// types are involved.
 	EVENT_REFS,
 
+	/// Involves the event_chain column; gives state events a position in the
+	/// auth-chain cover. Can be dark during re-indexing of other columns.
+	EVENT_CHAIN,
+
 	/// Involves the event_horizon column which saves the event_id of any
 	/// unresolved event_refs at the time of the transaction. This is important
 	/// for out-of-order writes to the database. When the unresolved prev_event
@@ -184,6 +190,9 @@ enum ircd::m::dbs::appendix::index
 	/// Involves room_joined table.
 	ROOM_JOINED,
 
+	/// Involves room_terms table.
+	ROOM_TERMS,
+
 	/// Take branch to handle room redaction events.
 	ROOM_REDACT,
 };
@@ -0,0 +1,91 @@
+// The Construct
+//
+// Copyright (C) The Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2020 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_M_DBS_EVENT_CHAIN_H
+
+namespace ircd::m::dbs
+{
+	enum class chain :uint8_t;
+
+	/// Position of a state event in the auth-chain cover: the chain_id (which
+	/// is the event_idx of the first event of the chain) and the sequence
+	/// number of the event in that chain starting at 1.
+	using chain_pos = std::pair<event::idx, uint64_t>;
+
+	constexpr size_t EVENT_CHAIN_KEY_MAX_SIZE
+	{
+		sizeof(event::idx) * 3
+	};
+
+	constexpr size_t chain_shift
+	{
+		8 * (sizeof(event::idx) - sizeof(chain))
+	};
+
+	constexpr event::idx chain_mask
+	{
+		0xFFUL << chain_shift
+	};
+
+	string_view
+	event_chain_key(const mutable_buffer &out,
+	                const chain &type,
+	                const event::idx &,
+	                const uint64_t &seq = 0,
+	                const event::idx &target = 0);
+
+	std::tuple<chain, event::idx, uint64_t, event::idx>
+	event_chain_key(const string_view &amalgam);
+
+	string_view
+	reflect(const chain &);
+
+	chain_pos find_event_chain(const event::idx &, const write_opts &); // query
+
+	void _index_event_chain(db::txn &, const event &, const write_opts &);
+
+	// chain | event_idx => (chain_id, seq)
+	// chain | chain_id, seq => event_idx
+	// chain | chain_id, seq, chain_id => seq
+	extern db::domain event_chain;
+}
+
+namespace ircd::m::dbs::desc
+{
+	extern conf::item<size_t> event_chain__block__size;
+	extern conf::item<size_t> event_chain__meta_block__size;
+	extern conf::item<size_t> event_chain__cache__size;
+	extern conf::item<size_t> event_chain__cache_comp__size;
+	extern const db::prefix_transform event_chain__pfx;
+	extern const db::comparator event_chain__cmp;
+	extern const db::descriptor event_chain;
+}
+
+/// Types of records in event_chain. This is stored in the high order byte of
+/// the first integer of the key, similar to dbs::ref in event_refs.
+///
+/// NOTE: These values are written to the database and cannot be changed to
+/// maintain ABI stability.
+///
+enum class ircd::m::dbs::chain
+:uint8_t
+{
+	/// The chain position of a state event: event_idx => (chain_id, seq).
+	POSITION    = 0x00,
+
+	/// The events of a chain in sequence: (chain_id, seq) => event_idx.
+	EVENT       = 0x01,
+
+	/// An auth reference from an event to an event in another chain; the
+	/// event at (chain_id, seq) reaches the target chain_id up to the value,
+	/// which is a seq in the target chain.
+	LINK        = 0x02,
+};
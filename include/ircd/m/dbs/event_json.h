@@ -26,5 +26,7 @@ namespace ircd::m::dbs::desc
 	extern conf::item<size_t> event_json__cache__size;
 	extern conf::item<size_t> event_json__cache_comp__size;
 	extern conf::item<size_t> event_json__bloom__bits;
+	extern conf::item<size_t> event_json__compression_dict__size;
+	extern conf::item<size_t> event_json__compression_dict__train;
 	extern const db::descriptor event_json;
 }
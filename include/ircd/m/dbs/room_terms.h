@@ -0,0 +1,44 @@
+// The Construct
+//
+// Copyright (C) The Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2020 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+#pragma once
+#define HAVE_IRCD_M_DBS_ROOM_TERMS_H
+
+namespace ircd::m::dbs
+{
+	constexpr size_t ROOM_TERMS_TERM_MAX_SIZE
+	{
+		128
+	};
+
+	constexpr size_t ROOM_TERMS_KEY_MAX_SIZE
+	{
+		id::MAX_SIZE + 1 + ROOM_TERMS_TERM_MAX_SIZE + 1 + 8
+	};
+
+	string_view room_terms_key(const mutable_buffer &out, const id::room &, const string_view &term, const event::idx &);
+	string_view room_terms_key(const mutable_buffer &out, const id::room &, const string_view &term);
+	event::idx room_terms_key(const string_view &amalgam);
+
+	void _index_room_terms(db::txn &, const event &, const write_opts &);
+
+	// room_id | term, event_idx => --
+	extern db::domain room_terms;
+}
+
+namespace ircd::m::dbs::desc
+{
+	extern conf::item<size_t> room_terms__block__size;
+	extern conf::item<size_t> room_terms__meta_block__size;
+	extern conf::item<size_t> room_terms__cache__size;
+	extern conf::item<size_t> room_terms__cache_comp__size;
+	extern const db::prefix_transform room_terms__pfx;
+	extern const db::descriptor room_terms;
+}
@@ -26,6 +26,8 @@ namespace ircd::m
 
 	// parallel util; returns bitset
 	uint64_t exists(const vector_view<const id::event> &);
+	uint64_t verify_hash(const vector_view<const event> &);
+	uint64_t verify(const vector_view<const event> &); // io/yield
 
 	// Equality tests the event_id only! know this.
 	bool operator==(const event &a, const event &b);
@@ -45,6 +45,7 @@ struct ircd::m::event::fetch
 
 	using keys = event::keys;
 	using view_closure = std::function<void (const string_view &)>;
+	using each_closure = std::function<bool (const idx &, const event &)>;
 
 	static const opts default_opts;
 
@@ -70,6 +71,13 @@ struct ircd::m::event::fetch
 	fetch(const opts & = default_opts);
 };
 
+namespace ircd::m
+{
+	// Vectorized fetch of many events with batched queries; the closure is
+	// called in order for each event found; returns the number found.
+	size_t seek(std::nothrow_t, const vector_view<const event::idx> &, const event::fetch::each_closure &, const event::fetch::opts & = event::fetch::default_opts);
+}
+
 /// Event Fetch Options.
 ///
 /// Refer to the individual member documentations for details. Notes:
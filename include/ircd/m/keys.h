@@ -69,10 +69,18 @@ struct ircd::m::keys
 	using super_type::operator=;
 };
 
+/// Keys are cached as state in the node room of each server. Verify keys are
+/// also kept decoded in memory so verifying a signature does no parsing of
+/// the keys object nor any db query after the key is first used.
 struct ircd::m::keys::cache
 {
+	static conf::item<size_t> decoded_size;
+	static stats::item<uint64_t> decoded_hits;
+	static stats::item<uint64_t> decoded_misses;
+
 	static bool for_each(const string_view &server, const closure_bool &);
 	static bool has(const string_view &server, const string_view &key_id);
+	static bool get(const string_view &server, const string_view &key_id, ed25519::pk &, time_t &valid_until_ts);
 	static bool get(const string_view &server, const string_view &key_id, const closure &);
 	static size_t set(const json::object &keys);
 };
@@ -18,11 +18,14 @@ namespace ircd::m::media
 
 namespace ircd::m::media::file
 {
+	struct position;
 	using closure = std::function<void (const const_buffer &)>;
 
 	room::id room_id(room::id::buf &out, const mxc &);
 	room::id::buf room_id(const mxc &);
 
+	size_t read(const room &, const std::pair<size_t, size_t> &range, position &, const closure &);
+	size_t read(const room &, const std::pair<size_t, size_t> &range, const closure &);
 	size_t read(const room &, const closure &);
 	size_t write(const room &, const user::id &, const const_buffer &content, const string_view &content_type);
 
@@ -44,6 +47,15 @@ namespace ircd::m::media::file
 	         string_view remote = {});
 };
 
+/// The depth of an event in the file's room and the offset of the file at
+/// that event. A read starts there and leaves it at the block containing the
+/// end of the range, so successive reads of a file don't rescan its blocks.
+struct ircd::m::media::file::position
+{
+	uint64_t depth {1};
+	size_t offset {0};
+};
+
 namespace ircd::m::media::block
 {
 	using closure = std::function<void (const const_buffer &)>;
@@ -78,6 +78,8 @@ struct ircd::m::room::auth::chain
 	bool has(const string_view &type) const;
 	size_t depth() const;
 
+	static void rebuild();
+
 	chain(const event::idx &idx)
 	:idx{idx}
 	{}
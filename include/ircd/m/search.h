@@ -14,6 +14,28 @@
 namespace ircd::m::search
 {
 	struct room_events;
+
+	using terms_closure = std::function<bool (const string_view &)>;
+	using query_closure = std::function<bool (const event::idx &, const size_t &matched)>;
+
+	extern log::log log;
+	extern conf::item<size_t> terms_max;
+	extern conf::item<size_t> query_postings_max;
+	extern stats::item<uint64_t> queries;
+	extern stats::item<uint64_t> query_postings;
+	extern stats::item<uint64_t> query_usec;
+
+	// Tokenize text into lowercase terms; closure returns false to stop.
+	bool terms(const string_view &text, const terms_closure &);
+
+	// Events in the room matching any of the terms, most recent first, with
+	// the number of terms each matched. Only the query_postings_max most
+	// recent events of each term are considered. Events are not checked for
+	// visibility or redaction.
+	bool query(const room::id &, const vector_view<const string_view> &terms, const query_closure &);
+
+	// Index all existing events; returns the number of events indexed.
+	size_t rebuild();
 }
 
 struct ircd::m::search::room_events
@@ -13,10 +13,17 @@
 
 struct ircd::m::user::tokens
 {
+	struct session;
 	using closure = std::function<void (const event::idx &, const string_view &)>;
 	using closure_bool = std::function<bool (const event::idx &, const string_view &)>;
 
+	static conf::item<bool> cache_enable;
+	static conf::item<size_t> cache_size;
+	static stats::item<uint64_t> cache_hits;
+	static stats::item<uint64_t> cache_misses;
+
 	static string_view generate(const mutable_buffer &out);
+	static session find(const string_view &token);
 	static id::device::buf device(std::nothrow_t, const string_view &token);
 	static id::device::buf device(const string_view &token);
 	static id::user::buf get(std::nothrow_t, const string_view &token);
@@ -33,3 +40,18 @@ struct ircd::m::user::tokens
 	:user{user}
 	{}
 };
+
+/// The owner of an access_token. This is served from an in-memory cache of
+/// tokens which have been authenticated before, which is invalidated when
+/// a token is issued or redacted in the tokens room.
+struct ircd::m::user::tokens::session
+{
+	event::idx event_idx {0};
+	id::user::buf user_id;
+	id::device::buf device_id;
+
+	explicit operator bool() const
+	{
+		return event_idx;
+	}
+};
@@ -95,6 +95,8 @@ struct ircd::m::vm::eval
 	bool room_internal {false};
 
 	void mfetch_keys() const;
+	void mprefetch_refs() const;
+	size_t pipeline(const vector_view<m::event> &);
 
   public:
 	operator const event::id::buf &() const;
@@ -285,6 +287,12 @@ struct ircd::m::vm::opts
 	/// perform a parallel/mass fetch before proceeding with the evals.
 	bool mfetch_keys {true};
 
+	/// Whether an input vector of events is evaluated as a pipeline. The
+	/// references of all events are prefetched at once, then the CPU-bound
+	/// event_id, CONFORM and VERIFY work is conducted for the whole vector
+	/// before the events are executed in order with that work elided.
+	bool pipeline {true};
+
 	/// Throws fault::EVENT if *all* of the prev_events do not exist locally.
 	/// This is used to enforce that at least one path is traversable. This
 	/// test is conducted after waiting if fetch_prev and fetch_prev_wait.
@@ -32,6 +32,7 @@ struct ircd::net::acceptor
 	static conf::item<size_t> handshaking_max;
 	static conf::item<size_t> handshaking_max_per_peer;
 	static conf::item<milliseconds> timeout;
+	static conf::item<bool> http2_enable;
 	static conf::item<std::string> ssl_curve_list;
 	static conf::item<std::string> ssl_cipher_list;
 	static conf::item<std::string> ssl_cipher_blacklist;
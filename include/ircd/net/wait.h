@@ -34,6 +34,9 @@ namespace ircd::net
 
 	// Explicit overload to return a ctx::future
 	ctx::future<void> wait(use_future_t, socket &, const wait_opts & = wait_opts_default);
+
+	// Cancels any pending wait; the callback receives operation_canceled.
+	bool cancel(socket &) noexcept;
 }
 
 /// Types of things to wait for the socket to have "ready"
@@ -75,4 +75,9 @@ struct ircd::resource::method::stats
 	uint64_t timeouts {0};            // The method's timeout was exceeded.
 	uint64_t completions {0};         // The handler returned without throwing.
 	uint64_t internal_errors {0};     // The handler threw a very bad exception.
+
+	// Microseconds from the method being called until the handler returns.
+	ircd::stats::item<ircd::stats::histogram> usec;
+
+	stats(const method &);
 };
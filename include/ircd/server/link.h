@@ -23,6 +23,8 @@ struct ircd::server::link
 {
 	static conf::item<size_t> tag_max_default;
 	static conf::item<size_t> tag_commit_max_default;
+	static conf::item<bool> http2_enable;
+	static conf::item<size_t> http2_tag_commit_max;
 	static uint64_t ids;
 
 	uint64_t id {++ids};                         ///< unique identifier of link.
@@ -39,6 +41,9 @@ struct ircd::server::link
 	bool op_write {false};                       ///< async operation state
 	bool op_read {false};                        ///< async operation state
 	bool exclude {false};                        ///< link is excluded
+	std::unique_ptr<http2::connection> h2;       ///< HTTP/2 session if selected
+	http2::connection::handlers h2_handlers;     ///< HTTP/2 session callbacks
+	std::map<uint32_t, decltype(queue)::iterator> h2_streams; ///< HTTP/2 tags by stream
 
 	template<class F> size_t accumulate_tags(F&&) const;
 
@@ -56,6 +61,21 @@ struct ircd::server::link
 	void handle_writable(const error_code &) noexcept;
 	void wait_writable();
 
+	decltype(queue)::iterator h2_find(const uint32_t &stream);
+	decltype(queue)::iterator h2_erase(decltype(queue)::iterator);
+	void h2_feed(tag &, const_buffer, bool &done);
+	void h2_done(decltype(queue)::iterator, const bool &eos, bool &done);
+	void h2_handle_headers(http2::stream &, const http2::connection::headers_view &, const bool &eos);
+	void h2_handle_data(http2::stream &, const const_buffer &, const bool &eos);
+	void h2_handle_reset(http2::stream &, const enum http2::error::code &);
+	void h2_handle_goaway(const uint32_t &last_id, const enum http2::error::code &);
+	void h2_send_headers(tag &);
+	void h2_write(tag &);
+	void h2_flush();
+	void h2_writable();
+	void h2_readable();
+	void h2_open();
+
 	void handle_close(std::exception_ptr);
 	void handle_open(std::exception_ptr);
 	void cleanup_canceled();
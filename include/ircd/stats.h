@@ -39,6 +39,8 @@ namespace ircd::stats
 	IRCD_EXCEPTION(ircd::error, error)
 	IRCD_EXCEPTION(error, not_found)
 
+	struct histogram;
+
 	// Abstract item
 	template<class T = void> struct item;
 	template<> struct item<void>;
@@ -52,6 +54,7 @@ namespace ircd::stats
 	template<> struct item<uint64_t>;
 	template<> struct item<uint32_t>;
 	template<> struct item<uint16_t>;
+	template<> struct item<histogram>;
 
 	extern const size_t NAME_MAX_LEN;
 	extern std::map<string_view, item<void> *> items;
@@ -72,6 +75,11 @@ namespace ircd::stats
 ///
 /// Feature information can also contain a 'desc' string describing more about
 /// the value to administrators and developers.
+///
+/// Items which are one of a set distinguished by some property (i.e the
+/// column of a database) can carry a 'family' name shared by the set and a
+/// 'labels' object with the distinguishing properties; exposition formats
+/// which support labels will present them as one metric.
 template<>
 struct ircd::stats::item<void>
 {
@@ -237,3 +245,102 @@ struct ircd::stats::item<uint16_t>
 	item(const json::members &);
 	item() = default;
 };
+
+/// Log-bucketed distribution of values, typically latencies in microseconds.
+/// Bucket i counts the values having i significant bits, i.e. values from
+/// 2^(i-1) through 2^i - 1; bucket 0 counts zeroes and the last bucket has no
+/// upper bound. Increments are relaxed atomics so this can be hit from hot
+/// paths and other threads; readers may observe a count slightly ahead of the
+/// buckets.
+struct ircd::stats::histogram
+{
+	struct timer;
+
+	static constexpr const size_t BUCKETS {64};
+
+	std::array<std::atomic<uint64_t>, BUCKETS> bucket {};
+	std::atomic<uint64_t> count {0};
+	std::atomic<uint64_t> sum {0};
+
+  public:
+	static size_t bucket_of(const uint64_t &) noexcept;
+	static uint64_t bucket_max(const size_t &) noexcept;
+
+	uint64_t quantile(const double &) const noexcept;
+	histogram &operator+=(const uint64_t &) noexcept;
+};
+
+/// Adds the microseconds elapsed over its lifetime to the histogram.
+struct ircd::stats::histogram::timer
+{
+	histogram *h {nullptr};
+	ircd::timer started;
+
+  public:
+	timer(histogram &h) noexcept
+	:h{&h}
+	{}
+
+	timer(timer &&) = delete;
+	timer(const timer &) = delete;
+	~timer() noexcept
+	{
+		*h += started.at<microseconds>().count();
+	}
+};
+
+/// Histogram item. When the feature 'summary' is true exposition formats
+/// present quantiles computed from the buckets rather than the buckets.
+template<>
+struct ircd::stats::item<ircd::stats::histogram>
+:item<void>
+{
+	histogram val;
+
+  public:
+	bool operator!() const override
+	{
+		return !val.count.load(std::memory_order_relaxed);
+	}
+
+	operator const histogram &() const noexcept
+	{
+		return val;
+	}
+
+	operator histogram &() noexcept
+	{
+		return val;
+	}
+
+	item(const json::members &);
+	item() = default;
+};
+
+inline ircd::stats::histogram &
+ircd::stats::histogram::operator+=(const uint64_t &val)
+noexcept
+{
+	bucket[bucket_of(val)].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(val, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	return *this;
+}
+
+inline uint64_t
+ircd::stats::histogram::bucket_max(const size_t &i)
+noexcept
+{
+	return i < BUCKETS - 1?
+		(1UL << i) - 1:
+		std::numeric_limits<uint64_t>::max();
+}
+
+inline size_t
+ircd::stats::histogram::bucket_of(const uint64_t &val)
+noexcept
+{
+	return val?
+		std::min(size_t(64 - __builtin_clzl(val)), BUCKETS - 1):
+		0UL;
+}
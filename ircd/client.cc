@@ -323,6 +323,93 @@ ircd::remote(const client &client)
 	return client.it->first;
 }
 
+/// HTTP/2 session of a connection. Each stream is a request conducted by a
+/// client of its own sharing the socket: the session composes an HTTP/1.1
+/// request from the headers and content of the stream, which is dispatched
+/// to the request pool like any other; the response written by the resource
+/// is translated back into HEADERS and DATA frames.
+///
+/// The socket is read on the main stack and the streams respond from their
+/// contexts, waiting on the flow control windows. DATA is sent in slices in
+/// proportion to the weight of the stream, yielding in between, so streams
+/// share the connection by their priority. The socket's timer is never set
+/// as it would cancel the operations of every stream; the session's own
+/// timer enforces the deadlines of the streams and the idle timeout.
+struct ircd::client::h2
+:std::enable_shared_from_this<h2>
+{
+	struct stream;
+
+	static ircd::conf::item<size_t> content_max;
+	static ircd::conf::item<size_t> slice_size;
+	static ircd::conf::item<milliseconds> tick;
+
+	std::shared_ptr<client> origin;
+	std::shared_ptr<socket> sock;
+	http2::connection::handlers handlers;
+	http2::connection conn;
+	std::map<uint32_t, stream> streams;
+	boost::asio::steady_timer timer;
+	steady_point idle;
+	ctx::mutex write_mutex;
+	ctx::dock dock;
+	size_t running {0};                // dispatched requests not yet finished
+	bool flushing {false};
+	bool fini {false};
+
+	stream &at(const uint32_t &id);
+	void flush_async();
+	void flush();
+	void send(const uint32_t &id, const_buffer, const bool &eos);
+	void respond(const uint32_t &id);
+	void dispatch(stream &);
+	void close(const net::dc & = net::dc::SSL_NOTIFY);
+	void handle_headers(http2::stream &, const http2::connection::headers_view &, const bool &eos);
+	void handle_data(http2::stream &, const const_buffer &, const bool &eos);
+	void handle_reset(http2::stream &, const enum http2::error::code &);
+	void handle_goaway(const uint32_t &last_id, const enum http2::error::code &);
+	void handle_tick(const error_code &) noexcept;
+	void handle_ready(const error_code &) noexcept;
+	void set_tick();
+	void wait();
+
+  public:
+	size_t write(client &, const const_buffer &);
+	void finish(client &);
+
+	static bool start(std::shared_ptr<client>);
+
+	h2(std::shared_ptr<client>);
+	h2(h2 &&) = delete;
+	h2(const h2 &) = delete;
+	~h2() noexcept;
+};
+
+/// A stream of the session. The request is accumulated until the remote
+/// ends the stream; the response is then parsed as the resource writes it.
+struct ircd::client::h2::stream
+{
+	enum state :uint8_t
+	{
+		HEAD,                          // receiving the response head
+		CONTENT,                       // content of content-length
+		CHUNK_HEAD,                    // chunk size line
+		CHUNK,                         // chunk content
+		CHUNK_TAIL,                    // CRLF following chunk content
+		TRAILER,                       // trailer lines after the last chunk
+		DONE,                          // stream ended
+	};
+
+	std::shared_ptr<ircd::client> client;
+	steady_point started {now<steady_point>()};
+	std::string head;                  // request head; response head or line
+	std::string content;               // request content
+	size_t remain {0};                 // response content or chunk remaining
+	enum state state {HEAD};
+	bool head_only {false};
+	bool dispatched {false};
+};
+
 //
 // async loop
 //
@@ -337,6 +424,8 @@ namespace ircd
 
 	static void handle_client_requests(std::shared_ptr<client>);
 	static void handle_client_ready(std::shared_ptr<client>, const error_code &ec);
+	static void handle_client_resume(std::shared_ptr<client>, const std::function<void (client &)> &);
+	static void handle_client_stream(std::shared_ptr<client>);
 }
 
 /// This function is the basis for the client's request loop. We still use
@@ -355,12 +444,26 @@ namespace ircd
 bool
 ircd::client::async()
 {
+	// The stream of an HTTP/2 client is finished rather than waiting for
+	// another request; the next request is another stream.
+	if(stream)
+	{
+		assert(session);
+		session->finish(*this);
+		return true;
+	}
+
 	assert(bool(this->sock));
 	assert(bool(this->conf));
 	auto &sock(*this->sock);
 	if(unlikely(sock.fini))
 		return false;
 
+	// The connection negotiated HTTP/2 with ALPN; its session reads the
+	// socket from here on.
+	if(string_view(sock.alpn) == "h2")
+		return h2::start(shared_from(*this));
+
 	const auto &timeout
 	{
 		conf->async_timeout
@@ -383,6 +486,42 @@ ircd::client::async()
 	return true;
 }
 
+/// Called by a resource method handler on the request context to release
+/// this context and its stack without responding to the request. The client
+/// will neither read another request nor fall back to async mode; the handler
+/// must retain a reference to the client and later call client::resume() to
+/// conduct the response. Returns false if the client can't be parked, i.e.
+/// another request follows on the tape.
+bool
+ircd::client::park()
+{
+	assert(reqctx == ctx::current);
+	if(!parkable || parked)
+		return false;
+
+	if(unlikely(!sock || sock->fini))
+		return false;
+
+	parked = true;
+	return true;
+}
+
+/// Resume a parked client; the closure is conducted on a context from the
+/// request pool. This can be called from outside of any ircd::context.
+void
+ircd::client::resume(std::shared_ptr<client> client,
+                     std::function<void (ircd::client &)> closure)
+{
+	assert(client);
+	assert(client->parked);
+	auto handler
+	{
+		std::bind(ircd::handle_client_resume, std::move(client), std::move(closure))
+	};
+
+	client::pool(std::move(handler));
+}
+
 /// The client's socket is ready for reading. This intermediate handler
 /// intercepts any errors otherwise dispatches the client to the request
 /// pool to be married with a stack. Right here this handler is executing on
@@ -463,6 +602,11 @@ try
 	};
 	#endif
 
+	// A parked client is held by the resource which parked it until it is
+	// resumed; it does not go back to async mode here.
+	if(client->parked)
+		return;
+
 	client->async();
 }
 catch(const std::exception &e)
@@ -475,6 +619,116 @@ catch(const std::exception &e)
 	};
 }
 
+/// A parked request is resumed on a context from the request pool. The
+/// closure conducts the remainder of the request; it can park the client
+/// again. Otherwise the client falls back to async mode for its next request.
+void
+ircd::handle_client_resume(std::shared_ptr<client> client,
+                           const std::function<void (ircd::client &)> &closure)
+try
+{
+	assert(ctx::current);
+	assert(!client->reqctx);
+	assert(client->parked);
+	client->reqctx = ctx::current;
+	client->parked = false;
+	client->ready_count++;
+	const unwind reset{[&client]
+	{
+		assert(bool(client));
+		assert(client->reqctx);
+		assert(client->reqctx == ctx::current);
+		client->reqctx = nullptr;
+		if(client::pool.avail() <= 1)
+			client::dock.notify_all();
+	}};
+
+	const scope_restore parkable
+	{
+		client->parkable, true
+	};
+
+	closure(*client);
+	if(client->parked)
+		return;
+
+	client->async();
+}
+catch(const ctx::interrupted &e)
+{
+	log::warning
+	{
+		client::log, "%s resume interrupted :%s",
+		client->loghead(),
+		e.what()
+	};
+
+	client->close(net::dc::RST, net::close_ignore);
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		client::log, "%s resume fault :%s",
+		client->loghead(),
+		e.what()
+	};
+
+	client->close(net::dc::RST, net::close_ignore);
+}
+
+/// The request of an HTTP/2 stream is conducted here. The session composed
+/// the complete request into the head buffer before dispatch, so nothing is
+/// read from the socket. The stream is finished afterward rather than the
+/// client going back to async mode.
+void
+ircd::handle_client_stream(std::shared_ptr<client> client)
+try
+{
+	assert(ctx::current);
+	assert(!client->reqctx);
+	assert(client->stream);
+	client->reqctx = ctx::current;
+	client->ready_count++;
+	const unwind reset{[&client]
+	{
+		assert(bool(client));
+		assert(client->reqctx);
+		assert(client->reqctx == ctx::current);
+		client->reqctx = nullptr;
+		if(client::pool.avail() <= 1)
+			client::dock.notify_all();
+	}};
+
+	parse::buffer pb
+	{
+		const_buffer{data(client->head_buffer), size(client->head_buffer)}
+	};
+
+	parse::capstan pc{pb};
+	if(!client->handle_request(pc))
+	{
+		client->close(net::dc::RST, net::close_ignore);
+		return;
+	}
+
+	if(client->parked)
+		return;
+
+	client->async();
+}
+catch(const std::exception &e)
+{
+	log::derror
+	{
+		client::log, "%s stream :%s",
+		client->loghead(),
+		e.what()
+	};
+
+	client->close(net::dc::RST, net::close_ignore);
+}
+
 bool
 ircd::handle_ec(client &client,
                 const error_code &ec)
@@ -697,6 +951,11 @@ try
 		if(!handle_request(pc))
 			return false;
 
+		// The request was parked by its resource; this context is released
+		// without reading anything further from the client.
+		if(parked)
+			return true;
+
 		// After the request, the head and content has been read off the socket
 		// and the capstan has advanced to the end of the content. The catch is
 		// that reading off the socket could have read too much, bleeding into
@@ -759,10 +1018,13 @@ try
 
 	// This timeout covers the reception of a complete HTTP head. If the
 	// head was fragmented and has not entirely arrived yet this function
-	// will block this request context below. The timeout limits that.
+	// will block this request context below. The timeout limits that. The
+	// head of a stream is already complete; the socket isn't ours to time.
 	net::scope_timeout timeout
 	{
-		*sock, conf->request_timeout
+		stream?
+			net::scope_timeout{}:
+			net::scope_timeout{*sock, conf->request_timeout}
 	};
 
 	// This is the first read off the wire. The headers are entirely read and
@@ -773,6 +1035,16 @@ try
 	pc.parsed += content_consumed;
 	assert(pc.parsed <= pc.read);
 
+	// A request can only be parked when nothing follows it on the tape and
+	// the connection is to be kept alive after the response.
+	const scope_restore parkable
+	{
+		this->parkable,
+		!pc.unparsed()
+		&& head.content_length == content_consumed
+		&& !iequals(head.connection, "close"_sv)
+	};
+
 	// The resource being sought will have its own specific timeout, or none
 	// at all. This timeout is now canceled to not conflict. Note that the
 	// time spent so far is still being accumulated by client.timer.
@@ -999,6 +1271,13 @@ ircd::client::discard_unconsumed(const http::request::head &head)
 ircd::ctx::future<void>
 ircd::client::close(const net::close_opts &opts)
 {
+	// Closing a stream resets it; the connection remains for other streams.
+	if(stream)
+	{
+		session->finish(*this);
+		return ctx::already;
+	}
+
 	return likely(sock) && !sock->fini?
 		net::close(*sock, opts):
 		ctx::already;
@@ -1011,6 +1290,12 @@ ircd::client::close(const net::close_opts &opts,
 	if(!sock)
 		return;
 
+	if(stream)
+	{
+		session->finish(*this);
+		return callback({});
+	}
+
 	if(sock->fini)
 		return callback({});
 
@@ -1032,6 +1317,9 @@ ircd::client::write_all(const const_buffer &buf)
 			make_error_code(std::errc::not_connected)
 		};
 
+	if(stream)
+		return session->write(*this, buf);
+
 	return net::write_all(*sock, buf);
 }
 
@@ -1047,12 +1335,15 @@ const
 	thread_local char buf[512];
 	thread_local char rembuf[128];
 	thread_local char locbuf[128];
+	thread_local char alpnbuf[32];
 
 	const string_view alpn
 	{
+		stream?
+			string_view{fmt::sprintf{alpnbuf, "h2.%u", stream}}:
 		sock?
-			sock->alpn:
-			nullptr
+			string_view{sock->alpn}:
+			string_view{}
 	};
 
 	return fmt::sprintf
@@ -1067,3 +1358,805 @@ const
 		request_count,
 	};
 }
+
+//
+// client::h2
+//
+
+decltype(ircd::client::h2::content_max)
+ircd::client::h2::content_max
+{
+	{ "name",     "ircd.client.http2.content_max" },
+	{ "default",  long(64_MiB)                    },
+};
+
+/// DATA is sent in slices of this size multiplied by the stream weight.
+decltype(ircd::client::h2::slice_size)
+ircd::client::h2::slice_size
+{
+	{ "name",     "ircd.client.http2.slice_size" },
+	{ "default",  long(4_KiB)                    },
+};
+
+/// Interval to check the deadlines of the streams and the idle timeout.
+decltype(ircd::client::h2::tick)
+ircd::client::h2::tick
+{
+	{ "name",     "ircd.client.http2.tick" },
+	{ "default",  1000L                    },
+};
+
+bool
+ircd::client::h2::start(std::shared_ptr<client> origin)
+{
+	const auto session
+	{
+		std::make_shared<h2>(std::move(origin))
+	};
+
+	log::debug
+	{
+		log, "%s HTTP/2 session started",
+		session->origin->loghead(),
+	};
+
+	session->flush_async();
+	session->set_tick();
+	session->wait();
+	return true;
+}
+
+ircd::client::h2::h2(std::shared_ptr<client> origin)
+:origin
+{
+	std::move(origin)
+}
+,sock
+{
+	this->origin->sock
+}
+,handlers
+{
+	[this](auto&&... a) { handle_headers(a...); },
+	[this](auto&&... a) { handle_data(a...); },
+	[this](auto&&... a) { handle_reset(a...); },
+	[this](auto&&... a) { handle_goaway(a...); },
+	[this] { dock.notify_all(); },
+}
+,conn
+{
+	true, handlers
+}
+,timer
+{
+	ios::get()
+}
+,idle
+{
+	now<steady_point>()
+}
+{
+}
+
+ircd::client::h2::~h2()
+noexcept
+{
+	assert(streams.empty() || fini);
+}
+
+void
+ircd::client::h2::wait()
+{
+	const net::wait_opts opts
+	{
+		net::ready::READ
+	};
+
+	sock->wait(opts, std::bind(&h2::handle_ready, shared_from_this(), ph::_1));
+}
+
+void
+ircd::client::h2::set_tick()
+{
+	timer.expires_after(milliseconds(tick));
+	timer.async_wait(std::bind(&h2::handle_tick, shared_from_this(), ph::_1));
+}
+
+/// The socket is readable; everything available is given to the connection
+/// which calls the handlers for the streams. This is on the main stack.
+void
+ircd::client::h2::handle_ready(const error_code &ec)
+noexcept try
+{
+	if(fini)
+		return;
+
+	if(!handle_ec(*origin, ec))
+		return close();
+
+	thread_local char buf[32_KiB];
+	while(const size_t len{net::read_one(*sock, buf)})
+		conn.read(const_buffer{buf, len});
+
+	flush_async();
+	if(conn.goaway_recv && streams.empty())
+		return close();
+
+	wait();
+}
+catch(const http2::error &e)
+{
+	log::derror
+	{
+		log, "%s HTTP/2 %s :%s",
+		origin->loghead(),
+		reflect(e.code),
+		e.what(),
+	};
+
+	flush_async();
+	close();
+}
+catch(const std::system_error &e)
+{
+	handle_ec(*origin, e.code());
+	close();
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		log, "%s HTTP/2 session :%s",
+		origin->loghead(),
+		e.what(),
+	};
+
+	close(net::dc::RST);
+}
+
+/// Streams past their deadline are reset. A stream still receiving its
+/// request is limited by the request timeout; a dispatched stream by the
+/// timeout of its resource method. Without streams for the async timeout
+/// the session goes away.
+void
+ircd::client::h2::handle_tick(const error_code &ec)
+noexcept try
+{
+	if(ec || fini)
+		return;
+
+	const auto now
+	{
+		ircd::now<steady_point>()
+	};
+
+	for(auto it(begin(streams)); it != end(streams); )
+	{
+		auto &[id, stream] {*it};
+		const auto &client
+		{
+			*stream.client
+		};
+
+		const bool expired
+		{
+			stream.dispatched?
+				client.deadline != steady_point{} && client.deadline <= now:
+				stream.started + client.conf->request_timeout <= now
+		};
+
+		if(!expired)
+		{
+			++it;
+			continue;
+		}
+
+		log::derror
+		{
+			log, "%s stream timed out",
+			client.loghead(),
+		};
+
+		if(client.reqctx)
+			ctx::interrupt(*client.reqctx);
+
+		conn.reset(id, http2::error::CANCEL);
+		it = streams.erase(it);
+	}
+
+	if(streams.empty() && idle + origin->conf->async_timeout <= now)
+	{
+		log::debug
+		{
+			log, "%s HTTP/2 session idle",
+			origin->loghead(),
+		};
+
+		conn.goaway();
+		flush_async();
+		return close();
+	}
+
+	flush_async();
+	set_tick();
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		log, "%s HTTP/2 session tick :%s",
+		origin->loghead(),
+		e.what(),
+	};
+
+	close(net::dc::RST);
+}
+
+void
+ircd::client::h2::handle_headers(http2::stream &s,
+                                 const http2::connection::headers_view &headers,
+                                 const bool &eos)
+{
+	// Trailers of a request are not given to the resource.
+	const auto it
+	{
+		streams.find(s.id)
+	};
+
+	if(it != end(streams))
+	{
+		if(eos && !it->second.dispatched)
+			dispatch(it->second);
+
+		return;
+	}
+
+	// The pseudo-headers compose the request line; connection-specific
+	// headers are not allowed, and the content-length is given after the
+	// content is received.
+	string_view method, path, authority;
+	std::string fields;
+	bool valid(true);
+	for(const auto &[key, val] : headers)
+	{
+		valid &= val.find_first_of("\r\n") == val.npos;
+		if(key == ":method")
+			method = val;
+		else if(key == ":path")
+			path = val;
+		else if(key == ":authority")
+			authority = val;
+		else if(key == ":scheme")
+			continue;
+		else if(startswith(key, ':'))
+			valid = false;
+		else if(key == "connection" || key == "transfer-encoding" || key == "upgrade")
+			valid = false;
+		else if(key == "content-length")
+			continue;
+		else
+			fields.append(key).append(": ").append(val).append("\r\n");
+	}
+
+	valid &= method && path;
+	valid &= method.find_first_of(" \r\n") == method.npos;
+	valid &= path.find_first_of(" \r\n") == path.npos;
+	if(!valid)
+	{
+		conn.reset(s.id, http2::error::PROTOCOL_ERROR);
+		return;
+	}
+
+	// A request counts against the concurrent streams until its context is
+	// finished, even when the remote has reset the stream; otherwise rapid
+	// resets admit an unbounded number of requests.
+	const size_t receiving
+	{
+		size_t(std::count_if(begin(streams), end(streams), [](const auto &pair)
+		{
+			return !pair.second.dispatched;
+		}))
+	};
+
+	if(running + receiving >= conn.ours[http2::settings::code::MAX_CONCURRENT_STREAMS])
+	{
+		conn.reset(s.id, http2::error::REFUSED_STREAM);
+		return;
+	}
+
+	auto &stream
+	{
+		streams[s.id]
+	};
+
+	stream.head.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+	if(authority)
+		stream.head.append("host: ").append(authority).append("\r\n");
+
+	stream.head.append(fields);
+	stream.head_only = method == "HEAD";
+	stream.client = std::make_shared<client>(sock);
+	stream.client->session = shared_from_this();
+	stream.client->stream = s.id;
+	if(eos)
+		dispatch(stream);
+}
+
+void
+ircd::client::h2::handle_data(http2::stream &s,
+                              const const_buffer &buf,
+                              const bool &eos)
+{
+	const auto it
+	{
+		streams.find(s.id)
+	};
+
+	if(it == end(streams) || it->second.dispatched)
+		return;
+
+	auto &stream(it->second);
+	if(stream.content.size() + size(buf) > size_t(content_max))
+	{
+		log::dwarning
+		{
+			log, "%s request content exceeds %zu bytes",
+			stream.client->loghead(),
+			size_t(content_max),
+		};
+
+		conn.reset(s.id, http2::error::REFUSED_STREAM);
+		streams.erase(it);
+		return;
+	}
+
+	stream.content.append(ircd::data(buf), size(buf));
+	if(eos)
+		dispatch(stream);
+}
+
+void
+ircd::client::h2::handle_reset(http2::stream &s,
+                               const enum http2::error::code &code)
+{
+	const auto it
+	{
+		streams.find(s.id)
+	};
+
+	if(it == end(streams))
+		return;
+
+	auto &client
+	{
+		*it->second.client
+	};
+
+	log::debug
+	{
+		log, "%s stream reset :%s",
+		client.loghead(),
+		reflect(code),
+	};
+
+	if(client.reqctx)
+		ctx::interrupt(*client.reqctx);
+
+	streams.erase(it);
+	dock.notify_all();
+}
+
+void
+ircd::client::h2::handle_goaway(const uint32_t &last_id,
+                                const enum http2::error::code &code)
+{
+	log::debug
+	{
+		log, "%s HTTP/2 goaway last stream %u :%s",
+		origin->loghead(),
+		last_id,
+		reflect(code),
+	};
+}
+
+/// The request is complete. Its content-length is appended to the head and
+/// the content follows it in the head buffer as though it was read off the
+/// socket with the head.
+void
+ircd::client::h2::dispatch(stream &stream)
+{
+	assert(!stream.dispatched);
+	auto &client
+	{
+		*stream.client
+	};
+
+	stream.head.append("content-length: ").append(std::to_string(stream.content.size())).append("\r\n\r\n");
+	client.head_buffer = unique_buffer<mutable_buffer>
+	{
+		stream.head.size() + stream.content.size()
+	};
+
+	mutable_buffer buf{client.head_buffer};
+	consume(buf, copy(buf, string_view{stream.head}));
+	consume(buf, copy(buf, string_view{stream.content}));
+	std::string{}.swap(stream.head);
+	std::string{}.swap(stream.content);
+	stream.dispatched = true;
+	idle = now<steady_point>();
+
+	// The request is dropped if the stream was reset while it waited for a
+	// context of the pool.
+	++running;
+	client::pool([session(shared_from_this()), client(stream.client)]
+	{
+		const unwind finished{[&session]
+		{
+			assert(session->running);
+			--session->running;
+		}};
+
+		if(session->fini || !session->streams.count(client->stream))
+			return;
+
+		ircd::handle_client_stream(client);
+	});
+}
+
+/// Called when the request of the stream is finished; the stream is reset
+/// if the response wasn't complete.
+void
+ircd::client::h2::finish(client &client)
+{
+	const auto it
+	{
+		streams.find(client.stream)
+	};
+
+	if(it == end(streams))
+		return;
+
+	if(it->second.state != stream::DONE && !fini)
+		conn.reset(client.stream, http2::error::INTERNAL_ERROR);
+
+	streams.erase(it);
+	idle = now<steady_point>();
+	flush_async();
+	if(conn.goaway_recv && streams.empty())
+		close();
+}
+
+void
+ircd::client::h2::close(const net::dc &type)
+{
+	if(fini)
+		return;
+
+	fini = true;
+	timer.cancel();
+	for(const auto &[id, stream] : streams)
+		if(stream.client->reqctx && stream.client->reqctx != ctx::current)
+			ctx::interrupt(*stream.client->reqctx);
+
+	streams.clear();
+	dock.notify_all();
+	origin->close(type, net::close_ignore);
+}
+
+ircd::client::h2::stream &
+ircd::client::h2::at(const uint32_t &id)
+{
+	const auto it
+	{
+		streams.find(id)
+	};
+
+	if(unlikely(it == end(streams) || fini))
+		throw std::system_error
+		{
+			make_error_code(std::errc::connection_reset)
+		};
+
+	return it->second;
+}
+
+/// Translate the response written by the resource. The stream is looked up
+/// again after anything which can yield, as the remote may reset it.
+size_t
+ircd::client::h2::write(client &client,
+                        const const_buffer &buf)
+{
+	const uint32_t id(client.stream);
+	const_buffer in(buf);
+	while(!empty(in))
+	{
+		auto &stream(at(id));
+		switch(stream.state)
+		{
+			case stream::HEAD:
+			{
+				const size_t prior(stream.head.size());
+				stream.head.append(data(in), size(in));
+				const auto pos(stream.head.find("\r\n\r\n"));
+				if(pos == stream.head.npos)
+				{
+					consume(in, size(in));
+					continue;
+				}
+
+				stream.head.resize(pos + 4);
+				consume(in, pos + 4 - prior);
+				respond(id);
+				continue;
+			}
+
+			case stream::CONTENT:
+			case stream::CHUNK:
+			{
+				const const_buffer content
+				{
+					data(in), std::min(size(in), stream.remain)
+				};
+
+				const bool eos
+				{
+					stream.state == stream::CONTENT && stream.remain == size(content)
+				};
+
+				stream.remain -= size(content);
+				if(!stream.remain && stream.state == stream::CHUNK)
+					stream.state = stream::CHUNK_TAIL;
+
+				consume(in, size(content));
+				send(id, content, eos);
+				if(eos)
+					at(id).state = stream::DONE;
+
+				continue;
+			}
+
+			case stream::CHUNK_HEAD:
+			case stream::CHUNK_TAIL:
+			case stream::TRAILER:
+			{
+				const string_view str
+				{
+					data(in), size(in)
+				};
+
+				const auto pos(str.find('\n'));
+				const size_t len(pos != str.npos? pos + 1: size(str));
+				if(stream.state != stream::CHUNK_TAIL)
+					stream.head.append(data(in), len);
+
+				consume(in, len);
+				if(pos == str.npos)
+					continue;
+
+				if(stream.state == stream::CHUNK_TAIL)
+				{
+					stream.state = stream::CHUNK_HEAD;
+					continue;
+				}
+
+				const std::string line
+				{
+					std::move(stream.head)
+				};
+
+				stream.head.clear();
+				if(stream.state == stream::TRAILER)
+				{
+					if(line != "\r\n" && line != "\n")
+						continue;
+
+					send(id, {}, true);
+					at(id).state = stream::DONE;
+					continue;
+				}
+
+				stream.remain = std::strtoul(line.c_str(), nullptr, 16);
+				stream.state = stream.remain? stream::CHUNK: stream::TRAILER;
+				continue;
+			}
+
+			case stream::DONE:
+				consume(in, size(in));
+				continue;
+		}
+	}
+
+	return size(buf);
+}
+
+/// The response head is complete; it's sent as HEADERS without the headers
+/// specific to an HTTP/1.1 connection.
+void
+ircd::client::h2::respond(const uint32_t &id)
+{
+	auto &stream(at(id));
+	const std::string head
+	{
+		std::move(stream.head)
+	};
+
+	stream.head.clear();
+	parse::buffer pb
+	{
+		const_buffer{head.data(), head.size()}
+	};
+
+	parse::capstan pc{pb};
+	std::vector<http::header> headers(1);
+	const http::response::head response
+	{
+		pc, [&headers](const http::header &header)
+		{
+			const auto &[key, val] {header};
+			if(iequals(key, "connection"_sv)
+			|| iequals(key, "keep-alive"_sv)
+			|| iequals(key, "proxy-connection"_sv)
+			|| iequals(key, "transfer-encoding"_sv)
+			|| iequals(key, "upgrade"_sv))
+				return;
+
+			headers.emplace_back(header);
+		}
+	};
+
+	headers.front() = http::header
+	{
+		":status", response.status
+	};
+
+	const bool chunked
+	{
+		iequals(response.transfer_encoding, "chunked"_sv)
+	};
+
+	const bool eos
+	{
+		stream.head_only || (!chunked && !response.content_length)
+	};
+
+	stream.remain = response.content_length;
+	stream.state =
+		eos? stream::DONE:
+		chunked? stream::CHUNK_HEAD:
+		stream::CONTENT;
+
+	conn.headers(id, headers, eos);
+	flush();
+}
+
+/// Send DATA on the stream until all of the buffer is sent. Each turn sends
+/// a slice in proportion to the weight of the stream and then yields to the
+/// other streams; when the window is closed this waits for it to open.
+void
+ircd::client::h2::send(const uint32_t &id,
+                       const_buffer buf,
+                       const bool &eos)
+{
+	bool done(false); do
+	{
+		at(id);
+		const auto *const s
+		{
+			conn.get(id)
+		};
+
+		if(unlikely(!s))
+			throw std::system_error
+			{
+				make_error_code(std::errc::connection_reset)
+			};
+
+		const const_buffer slice
+		{
+			data(buf), std::min(size(buf), s->weight * size_t(slice_size))
+		};
+
+		const bool last
+		{
+			eos && size(slice) == size(buf)
+		};
+
+		const size_t sent
+		{
+			conn.data(id, slice, last)
+		};
+
+		consume(buf, sent);
+		done = empty(buf) && (!eos || (last && sent == size(slice)));
+		flush();
+		if(done)
+			break;
+
+		if(sent)
+		{
+			ctx::yield();
+			continue;
+		}
+
+		dock.wait([this, &id]
+		{
+			return fini || !streams.count(id) || conn.window(id) > 0;
+		});
+	}
+	while(!done);
+}
+
+/// Write out the pending frames; on a context this blocks until all of it
+/// is written.
+void
+ircd::client::h2::flush()
+{
+	if(!ctx::current)
+		return flush_async();
+
+	const std::lock_guard lock
+	{
+		write_mutex
+	};
+
+	while(!empty(conn.pending()))
+	{
+		if(unlikely(fini || sock->fini))
+			throw std::system_error
+			{
+				make_error_code(std::errc::not_connected)
+			};
+
+		conn.wrote(net::write_any(*sock, conn.pending()));
+		if(!empty(conn.pending()))
+			net::wait(*sock, net::ready::WRITE);
+	}
+}
+
+/// Output on the main stack is written as far as the socket takes it; the
+/// remainder is written by a context from the pool. A context already
+/// writing takes anything which was added.
+void
+ircd::client::h2::flush_async()
+try
+{
+	if(fini || sock->fini || flushing || write_mutex.locked())
+		return;
+
+	if(!empty(conn.pending()))
+		conn.wrote(net::write_any(*sock, conn.pending()));
+
+	if(empty(conn.pending()))
+		return;
+
+	flushing = true;
+	client::pool([session(shared_from_this())]
+	{
+		session->flushing = false; try
+		{
+			session->flush();
+		}
+		catch(const std::exception &e)
+		{
+			log::derror
+			{
+				log, "%s HTTP/2 write :%s",
+				session->origin->loghead(),
+				e.what(),
+			};
+
+			session->close(net::dc::RST);
+		}
+	});
+}
+catch(const std::exception &e)
+{
+	log::derror
+	{
+		log, "%s HTTP/2 write :%s",
+		origin->loghead(),
+		e.what(),
+	};
+
+	close(net::dc::RST);
+}
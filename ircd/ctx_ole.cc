@@ -12,18 +12,40 @@
 
 namespace ircd::ctx::ole
 {
+	struct worker;
+
 	extern conf::item<size_t> thread_max;
 	std::mutex mutex;
 	std::condition_variable cond;
 	std::deque<offload::function> queue;
-	std::vector<std::thread> threads;
+	std::list<worker> workers;
+	size_t running;
 	bool termination;
 
-	static offload::function pop();
-	static void push(offload::function &&);
-	static void worker() noexcept;
+	static offload::function pop(worker &);
+	static void push(offload::function &&, const size_t &threads);
 }
 
+/// Each worker thread carries its own counters. These are only written by
+/// the worker while it holds the queue mutex, between jobs.
+struct ircd::ctx::ole::worker
+{
+	static const size_t NAME_MAX_LEN {48};
+
+	size_t id {0};
+	char name[2][NAME_MAX_LEN] {{0}};
+	stats::item<uint64_t> jobs;
+	stats::item<uint64_t> cycles;
+	uint64_t started {0};
+	std::thread thread;
+
+	static void main(worker &) noexcept;
+
+	worker(const size_t &id);
+	worker(worker &&) = delete;
+	worker(const worker &) = delete;
+};
+
 decltype(ircd::ctx::ole::thread_max)
 ircd::ctx::ole::thread_max
 {
@@ -33,7 +55,8 @@ ircd::ctx::ole::thread_max
 
 ircd::ctx::ole::init::init()
 {
-	assert(threads.empty());
+	assert(workers.empty());
+	assert(!running);
 	termination = false;
 }
 
@@ -49,8 +72,15 @@ noexcept
 	cond.notify_all();
 	cond.wait(lock, []
 	{
-		return threads.empty();
+		return !running;
 	});
+
+	lock.unlock();
+	for(auto &worker : workers)
+		if(worker.thread.joinable())
+			worker.thread.join();
+
+	workers.clear();
 }
 
 ircd::ctx::ole::offload::offload(const function &func)
@@ -62,14 +92,18 @@ ircd::ctx::ole::offload::offload(const opts &opts,
                                  const function &func)
 {
 	assert(current);
-	assert(opts.concurrency == 1); // not yet implemented
+	const size_t concurrency
+	{
+		std::max(opts.concurrency, 1UL)
+	};
 
 	// Prepare the offload package on our stack here. These objects will
 	// remain here for the duration of the offload.
-	latch latch{1};
+	latch latch{concurrency};
+	std::mutex eptr_mutex;
 	std::exception_ptr eptr;
 	auto *const context(current);
-	auto closure{[&func, &latch, &eptr, &context]
+	auto closure{[&func, &latch, &eptr_mutex, &eptr, &context]
 	() noexcept
 	{
 		try
@@ -79,8 +113,11 @@ ircd::ctx::ole::offload::offload(const opts &opts,
 		catch(...)
 		{
 			// Note that the write to eptr is taking place on a different
-			// thread from where we created the eptr.
-			eptr = std::current_exception();
+			// thread from where we created the eptr; with concurrency there
+			// may be several of them.
+			const std::lock_guard lock{eptr_mutex};
+			if(!eptr)
+				eptr = std::current_exception();
 		}
 
 		// The ctx::signal() is a special device which executes the closure
@@ -101,7 +138,11 @@ ircd::ctx::ole::offload::offload(const opts &opts,
 	// capable of throwing an interrupt that was received during this scope.
 	const uninterruptible uninterruptible;
 
-	ole::push(std::move(closure));       // scope address required for clang-7
+	// The function is pushed once for each unit of concurrency; every copy
+	// of the closure references the same package on this stack.
+	for(size_t i(0); i < concurrency; ++i)
+		ole::push(offload::function{closure}, opts.threads);
+
 	latch.wait();
 
 	// Don't throw any exception if there is a pending interrupt for this ctx.
@@ -111,66 +152,42 @@ ircd::ctx::ole::offload::offload(const opts &opts,
 		if(unlikely(eptr))
 			std::rethrow_exception(eptr);
 }
-void
-ircd::ctx::ole::push(offload::function &&func)
-{
-	if(unlikely(threads.size() < size_t(thread_max)))
-		threads.emplace_back(&worker);
-
-	const std::lock_guard lock
-	{
-		mutex
-	};
-
-	queue.emplace_back(std::move(func));
-	cond.notify_all();
-}
 
 void
-ircd::ctx::ole::worker()
-noexcept try
-{
-	while(1)
-	{
-		const auto func
-		{
-			pop()
-		};
-
-		func();
-	}
-}
-catch(const interrupted &)
+ircd::ctx::ole::push(offload::function &&func,
+                     const size_t &threads)
 {
 	const std::lock_guard lock
 	{
 		mutex
 	};
 
-	const auto it
+	if(unlikely(workers.size() < std::max(size_t(thread_max), threads)))
 	{
-		std::find_if(begin(threads), end(threads), []
-		(const auto &thread)
-		{
-			return thread.get_id() == std::this_thread::get_id();
-		})
-	};
+		workers.emplace_back(workers.size());
+		++running;
+	}
 
-	assert(it != end(threads));
-	auto &this_thread(*it);
-	this_thread.detach();
-	threads.erase(it);
-	cond.notify_all();
+	queue.emplace_back(std::move(func));
+	cond.notify_one();
 }
 
 ircd::ctx::ole::offload::function
-ircd::ctx::ole::pop()
+ircd::ctx::ole::pop(worker &worker)
 {
 	std::unique_lock lock
 	{
 		mutex
 	};
 
+	// Account for the job this worker just completed, if any.
+	if(likely(worker.started))
+	{
+		++worker.jobs;
+		worker.cycles += prof::cycles() - worker.started;
+		worker.started = 0;
+	}
+
 	cond.wait(lock, []
 	{
 		if(!queue.empty())
@@ -188,5 +205,64 @@ ircd::ctx::ole::pop()
 	};
 
 	queue.pop_front();
+	worker.started = prof::cycles();
 	return function;
 }
+
+//
+// worker
+//
+
+ircd::ctx::ole::worker::worker(const size_t &id)
+:id
+{
+	id
+}
+,jobs
+{
+	json::members
+	{
+		{ "name", string_view{fmt::sprintf{name[0], "ircd.ctx.ole.worker.%zu.jobs", id}} },
+		{ "desc", "Number of offloaded functions executed by this worker" },
+	}
+}
+,cycles
+{
+	json::members
+	{
+		{ "name", string_view{fmt::sprintf{name[1], "ircd.ctx.ole.worker.%zu.cycles", id}} },
+		{ "desc", "Reference cycles this worker spent executing functions" },
+	}
+}
+,thread
+{
+	&worker::main, std::ref(*this)
+}
+{
+}
+
+void
+ircd::ctx::ole::worker::main(worker &worker)
+noexcept try
+{
+	while(1)
+	{
+		const auto func
+		{
+			pop(worker)
+		};
+
+		func();
+	}
+}
+catch(const interrupted &)
+{
+	const std::lock_guard lock
+	{
+		mutex
+	};
+
+	assert(running > 0);
+	--running;
+	cond.notify_all();
+}
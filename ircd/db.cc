@@ -2068,7 +2068,11 @@ ircd::db::database::column::column(database &d,
 
 	// Compression options
 	this->options.compression_opts.enabled = true;
-	this->options.compression_opts.max_dict_bytes = 0;//8_MiB;
+	this->options.compression_opts.max_dict_bytes = this->descriptor->compression_dict.size;
+	#ifdef IRCD_DB_HAS_ZSTD_TRAIN
+	if(this->options.compression == rocksdb::kZSTD)
+		this->options.compression_opts.zstd_max_train_bytes = this->descriptor->compression_dict.train;
+	#endif
 
 	// Mimic the above for bottommost compression.
 	//this->options.bottommost_compression = this->options.compression;
@@ -2213,7 +2217,7 @@ ircd::db::database::column::column(database &d,
 
 	log::debug
 	{
-		log, "schema '%s' column [%s => %s] cmp[%s] pfx[%s] lru:%s:%s bloom:%zu compression:%d %s",
+		log, "schema '%s' column [%s => %s] cmp[%s] pfx[%s] lru:%s:%s bloom:%zu compression:%d dict:%zu %s",
 		db::name(d),
 		demangle(key_type.name()),
 		demangle(mapped_type.name()),
@@ -2223,6 +2227,7 @@ ircd::db::database::column::column(database &d,
 		cache_size_comp? "YES": "NO",
 		bloom_bits,
 		int(this->options.compression),
+		size_t(this->options.compression_opts.max_dict_bytes),
 		this->descriptor->name
 	};
 }
@@ -2650,6 +2655,17 @@ ircd::db::database::stats::stats(database *const &d,
 	{ "name", make_name("multiget.referenced")                          },
 	{ "desc", "Number of DB::MultiGet() results adhering to zero-copy." },
 }
+,get_usec
+{
+	{ "name",    make_name("get.usec")                                  },
+	{ "family",  c? "ircd.db.column.get.usec"_sv: "ircd.db.get.usec"_sv },
+	{ "desc",    "Time in microseconds for point reads."                },
+	{ "labels",  json::members
+	{
+		{ "db",      db::name(*d)                                       },
+		{ "column",  c? string_view{db::name(*c)}: "*"_sv               },
+	}},
+}
 {
 	assert(item.size() == ticker.size());
 	for(size_t i(0); i < item.size(); ++i)
@@ -4628,6 +4644,80 @@ ircd::db::for_each(database &d,
 	return true;
 }
 
+void
+ircd::db::commit(const vector_view<txn *> &txns,
+                 const sopts &opts)
+{
+	if(txns.empty())
+		return;
+
+	// Should the write fail the transactions are left as they were found.
+	const unwind_exceptional restore{[&txns]
+	{
+		for(auto *const &t : txns)
+			t->state = txn::state::BUILD;
+	}};
+
+	if(txns.size() == 1)
+		return (*txns.at(0))(opts);
+
+	assert(txns.at(0) && txns.at(0)->d);
+	database &d
+	{
+		*txns.at(0)->d
+	};
+
+	size_t bytes(0);
+	for(const auto *const &t : txns)
+	{
+		assert(t && bool(t->wb));
+		assert(t->d == &d);
+		assert(t->state == txn::state::BUILD);
+		bytes += t->bytes();
+	}
+
+	// The updates of each transaction are appended to one transaction in
+	// their order, which is written at once.
+	txn group
+	{
+		d, txn::opts
+		{
+			bytes, // reserve_bytes
+		}
+	};
+
+	for(auto *const &t : txns)
+	{
+		t->state = txn::state::COMMIT;
+		const bool appended
+		{
+			for_each(*t, delta_closure_bool{[&group]
+			(const delta &delta)
+			{
+				txn::append
+				{
+					group, delta
+				};
+
+				return true;
+			}})
+		};
+
+		if(unlikely(!appended))
+			throw error
+			{
+				"Failed to group transaction of %zu updates into %zu",
+				t->size(),
+				group.size(),
+			};
+	}
+
+	group(opts);
+
+	for(auto *const &t : txns)
+		t->state = txn::state::COMMITTED;
+}
+
 std::string
 ircd::db::debug(const txn &t)
 {
@@ -6104,6 +6194,43 @@ ircd::db::read(column &column,
 	return ret;
 }
 
+uint64_t
+ircd::db::read(column &column,
+               const vector_view<const string_view> &key,
+               const read_closure &closure,
+               const gopts &gopts)
+{
+	const size_t num(key.size());
+	if(unlikely(!num || num > 64))
+		throw std::out_of_range
+		{
+			"db::read() :too many keys or vector size mismatch"
+		};
+
+	_read_op op[num];
+	for(size_t i(0); i < num; ++i)
+		op[i] =
+		{
+			column, key[i]
+		};
+
+	uint64_t i(0), ret(0);
+	_read({op, num}, make_opts(gopts), [&i, &ret, &closure]
+	(db::column &, const column::delta &delta, const rocksdb::Status &s)
+	{
+		if(s.ok())
+		{
+			closure(i, std::get<column::delta::VAL>(delta));
+			ret |= (1UL << i);
+		}
+
+		++i;
+		return true;
+	});
+
+	return ret;
+}
+
 rocksdb::Cache *
 ircd::db::cache(column &column)
 {
@@ -8050,11 +8177,20 @@ ircd::db::_read(column &column,
 	};
 
 	database::column &c(column);
+	database &d(column);
+	const ircd::timer timer;
 	const rocksdb::Status ret
 	{
 		_seek(c, ps, key, opts)
 	};
 
+	const uint64_t usec
+	{
+		uint64_t(timer.at<microseconds>().count())
+	};
+
+	c.stats->get_usec.val += usec;
+	d.stats->get_usec.val += usec;
 	if(!valid(ret))
 		return ret;
 
@@ -8068,7 +8204,6 @@ ircd::db::_read(column &column,
 
 	// Update stats about whether the pinnable slices we obtained have internal
 	// copies or referencing the cache copy.
-	database &d(column);
 	c.stats->get_referenced += buf.empty();
 	d.stats->get_referenced += buf.empty();
 	c.stats->get_copied += !buf.empty();
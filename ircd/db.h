@@ -329,6 +329,7 @@ struct ircd::db::database::stats final
 	ircd::stats::item<uint64_t> get_referenced;
 	ircd::stats::item<uint64_t> multiget_copied;
 	ircd::stats::item<uint64_t> multiget_referenced;
+	ircd::stats::item<ircd::stats::histogram> get_usec;
 
 	string_view make_name(const string_view &ticker_name) const; // tls buffer
 
@@ -8,6 +8,11 @@
 // copyright notice and this permission notice is present in all copies. The
 // full license for this software is available in the LICENSE file.
 
+#if ROCKSDB_MAJOR > 5 \
+|| (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 14)
+	#define IRCD_DB_HAS_ZSTD_TRAIN
+#endif
+
 #if ROCKSDB_MAJOR > 5 \
 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 18)
 	#define IRCD_DB_HAS_ALLOCATOR
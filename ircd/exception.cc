@@ -298,6 +298,7 @@ noexcept
 {
 	static char buf[512];
 	strlcpy(buf, str);
+	log::flush();
 	fprintf(stderr, "\nIRCd Terminated :%s\n", buf);
 	::fflush(stderr);
 	std::terminate();
@@ -315,6 +316,7 @@ noexcept
 		terminate{e};
 	}
 
+	log::flush();
 	fputs("\nIRCd Terminated.\n", stderr);
 	::fflush(stderr);
 	std::terminate();
@@ -323,6 +325,7 @@ noexcept
 ircd::terminate::terminate(const std::exception &e)
 noexcept
 {
+	log::flush();
 	fprintf(stderr, "\nIRCd Terminated :%s\n", e.what());
 	::fflush(stderr);
 	std::terminate();
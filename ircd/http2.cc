@@ -14,11 +14,1995 @@ ircd::http2::connection_preface
 	"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
 };
 
+namespace ircd::http2
+{
+	static uint32_t read32(const const_buffer &);
+	static void write32(char *const &, const uint32_t &);
+	static const_buffer unpad(const frame::header &, const const_buffer &);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// connection.h
+//
+
+decltype(ircd::http2::connection::header_list_max)
+ircd::http2::connection::header_list_max
+{
+	{ "name",     "ircd.http2.header_list_max" },
+	{ "default",  long(64_KiB)                  },
+};
+
+decltype(ircd::http2::connection::window_size)
+ircd::http2::connection::window_size
+{
+	{ "name",     "ircd.http2.window_size" },
+	{ "default",  long(1_MiB)               },
+};
+
+decltype(ircd::http2::connection::connection_window_size)
+ircd::http2::connection::connection_window_size
+{
+	{ "name",     "ircd.http2.connection_window_size" },
+	{ "default",  long(16_MiB)                         },
+};
+
+decltype(ircd::http2::connection::streams_max)
+ircd::http2::connection::streams_max
+{
+	{ "name",     "ircd.http2.streams_max" },
+	{ "default",  128L                      },
+};
+
+decltype(ircd::http2::connection::out_max)
+ircd::http2::connection::out_max
+{
+	{ "name",     "ircd.http2.out_max" },
+	{ "default",  long(4_MiB)           },
+};
+
+/// The preface is queued for output here; the user should write it as soon
+/// as the socket is ready.
+ircd::http2::connection::connection(const bool &server,
+                                    const handlers &handler)
+:server
+{
+	server
+}
+,next_id
+{
+	server? 2U: 1U
+}
+,header_buf
+{
+	size_t(header_list_max)
+}
+,encode_buf
+{
+	size_t(header_list_max)
+}
+,handler
+{
+	&handler
+}
+{
+	using code = http2::settings::code;
+
+	ours[code::INITIAL_WINDOW_SIZE] = std::min(size_t(window_size), size_t(0x7fffffffUL));
+	ours[code::MAX_HEADER_LIST_SIZE] = size(header_buf);
+	if(server)
+		ours[code::MAX_CONCURRENT_STREAMS] = streams_max;
+	else
+		ours[code::ENABLE_PUSH] = 0;
+
+	// Client is first to speak; the server's preface is the SETTINGS alone.
+	preface = !server;
+	if(!server)
+		out.append(connection_preface);
+
+	size_t len(0);
+	char buf[6 * 4];
+	const auto param{[&buf, &len]
+	(const code &id, const uint32_t &value)
+	{
+		buf[len++] = uint16_t(id) >> 8;
+		buf[len++] = uint16_t(id) & 0xff;
+		write32(buf + len, value);
+		len += 4;
+	}};
+
+	if(server)
+		param(code::MAX_CONCURRENT_STREAMS, ours[code::MAX_CONCURRENT_STREAMS]);
+	else
+		param(code::ENABLE_PUSH, ours[code::ENABLE_PUSH]);
+
+	param(code::INITIAL_WINDOW_SIZE, ours[code::INITIAL_WINDOW_SIZE]);
+	param(code::MAX_HEADER_LIST_SIZE, ours[code::MAX_HEADER_LIST_SIZE]);
+	queue(frame::SETTINGS, 0, 0, const_buffer{buf, len});
+
+	// The connection's window can only be changed by WINDOW_UPDATE.
+	const int64_t window
+	{
+		std::min(int64_t(connection_window_size), int64_t(0x7fffffffL))
+	};
+
+	if(window > recv_window)
+	{
+		char inc[4];
+		write32(inc, window - recv_window);
+		queue(frame::WINDOW_UPDATE, 0, 0, inc);
+		recv_window = window;
+	}
+}
+
+ircd::http2::connection::~connection()
+noexcept
+{
+}
+
+void
+ircd::http2::connection::goaway(const enum error::code &code,
+                                const string_view &debug)
+{
+	if(goaway_sent)
+		return;
+
+	char buf[512];
+	write32(buf, last_id);
+	write32(buf + 4, code);
+	const size_t len
+	{
+		8 + copy(mutable_buffer{buf + 8, sizeof(buf) - 8}, debug)
+	};
+
+	goaway_sent = true;
+	queue(frame::GOAWAY, 0, 0, const_buffer{buf, len});
+}
+
+void
+ircd::http2::connection::ping(const uint64_t &opaque)
+{
+	queue(frame::PING, 0, 0, const_buffer
+	{
+		reinterpret_cast<const char *>(&opaque), sizeof(opaque)
+	});
+}
+
+/// Closes the stream from this side in any state. The reset handler is not
+/// called.
+void
+ircd::http2::connection::reset(const uint32_t &id,
+                               const enum error::code &code)
+{
+	char buf[4];
+	write32(buf, code);
+	queue(frame::RST_STREAM, 0, id, buf);
+	streams.erase(id);
+}
+
+/// Send as much of the data on the stream as the flow control windows allow;
+/// returns the number of bytes accepted. When eos is given the stream is
+/// ended with the last of the data, so only once all of it is accepted.
+size_t
+ircd::http2::connection::data(const uint32_t &id,
+                              const const_buffer &buf,
+                              const bool &eos)
+{
+	auto *const s
+	{
+		get(id)
+	};
+
+	if(unlikely(!s || s->local_closed()))
+		throw error
+		{
+			error::STREAM_CLOSED, "Cannot send DATA on stream %u", id
+		};
+
+	const size_t allow
+	{
+		std::min(size(buf), size_t(std::max(window(id), int64_t(0))))
+	};
+
+	const size_t frame_max
+	{
+		theirs[http2::settings::code::MAX_FRAME_SIZE]
+	};
+
+	size_t sent(0);
+	do
+	{
+		const size_t len
+		{
+			std::min(allow - sent, frame_max)
+		};
+
+		const bool fin
+		{
+			eos && sent + len == size(buf)
+		};
+
+		if(!len && !fin)
+			break;
+
+		queue(frame::DATA, fin? frame::END_STREAM: 0, id, const_buffer
+		{
+			ircd::data(buf) + sent, len
+		});
+
+		sent += len;
+	}
+	while(sent < allow);
+
+	send_window -= sent;
+	s->send_window -= sent;
+	if(eos && sent == size(buf))
+		close_local(*s);
+
+	return sent;
+}
+
+/// Send the header block on the stream; this opens the stream when it's
+/// idle. Names must be lower-case for HTTP/2 and connection-specific headers
+/// must not be given.
+void
+ircd::http2::connection::headers(const uint32_t &id,
+                                 const headers_view &headers,
+                                 const bool &eos)
+{
+	auto *const s
+	{
+		get(id)
+	};
+
+	if(unlikely(!s || s->local_closed()))
+		throw error
+		{
+			error::STREAM_CLOSED, "Cannot send HEADERS on stream %u", id
+		};
+
+	const const_buffer block
+	{
+		encoder(encode_buf, headers)
+	};
+
+	const size_t frame_max
+	{
+		theirs[http2::settings::code::MAX_FRAME_SIZE]
+	};
+
+	size_t sent(0);
+	do
+	{
+		const size_t len
+		{
+			std::min(size(block) - sent, frame_max)
+		};
+
+		const bool first(sent == 0), last(sent + len == size(block));
+		const uint8_t flags
+		(
+			(first && eos? frame::END_STREAM: 0) |
+			(last? frame::END_HEADERS: 0)
+		);
+
+		queue(first? frame::HEADERS: frame::CONTINUATION, flags, id, const_buffer
+		{
+			ircd::data(block) + sent, len
+		});
+
+		sent += len;
+	}
+	while(sent < size(block));
+
+	if(s->state == stream::state::IDLE)
+		s->state = stream::state::OPEN;
+
+	if(eos)
+		close_local(*s);
+}
+
+/// Allocate the next stream from this side. The stream is idle until its
+/// headers are sent.
+uint32_t
+ircd::http2::connection::open()
+{
+	if(unlikely(!acceptable()))
+		throw error
+		{
+			error::REFUSED_STREAM, "Connection cannot open another stream."
+		};
+
+	const auto id
+	{
+		next_id
+	};
+
+	next_id += 2;
+	streams.emplace(id, stream
+	{
+		id,
+		theirs[http2::settings::code::INITIAL_WINDOW_SIZE],
+		ours[http2::settings::code::INITIAL_WINDOW_SIZE],
+	});
+
+	return id;
+}
+
+void
+ircd::http2::connection::read(const const_buffer &buf_)
+try
+{
+	const_buffer buf{buf_};
+	if(!in.empty())
+	{
+		in.append(ircd::data(buf), size(buf));
+		buf = const_buffer{in.data(), in.size()};
+	}
+
+	size_t pos(0);
+	if(!preface)
+		pos += handle_preface(buf);
+
+	while(preface && size(buf) - pos >= frame::header::SIZE)
+	{
+		const frame::header header
+		{
+			const_buffer{ircd::data(buf) + pos, frame::header::SIZE}
+		};
+
+		if(unlikely(header.len > ours[http2::settings::code::MAX_FRAME_SIZE]))
+			throw error
+			{
+				error::FRAME_SIZE_ERROR, "Frame of %u bytes exceeds the maximum.",
+				uint(header.len),
+			};
+
+		if(size(buf) - pos < frame::header::SIZE + header.len)
+			break;
+
+		const const_buffer payload
+		{
+			ircd::data(buf) + pos + frame::header::SIZE, header.len
+		};
+
+		pos += frame::header::SIZE + header.len;
+		handle(header, payload);
+		if(unlikely(out.size() - out_pos > size_t(out_max)))
+			throw error
+			{
+				error::ENHANCE_YOUR_CALM, "Output of %zu bytes is not being read.",
+				out.size() - out_pos,
+			};
+	}
+
+	// Keep the incomplete frame for the next read.
+	if(ircd::data(buf) == in.data())
+		in.erase(0, pos);
+	else
+		in.assign(ircd::data(buf) + pos, size(buf) - pos);
+}
+catch(const error &e)
+{
+	in.clear();
+	goaway(e.code, e.what());
+	throw;
+}
+
+size_t
+ircd::http2::connection::handle_preface(const const_buffer &buf)
+{
+	assert(server);
+	const string_view &magic
+	{
+		connection_preface
+	};
+
+	const string_view received
+	{
+		ircd::data(buf), std::min(size(buf), size(magic))
+	};
+
+	if(unlikely(!startswith(magic, received)))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "Invalid connection preface."
+		};
+
+	if(size(received) < size(magic))
+		return 0;
+
+	preface = true;
+	return size(magic);
+}
+
+void
+ircd::http2::connection::handle(const frame::header &header,
+                                const const_buffer &payload)
+{
+	if(unlikely(cont_id && header.type != frame::CONTINUATION))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "Expected CONTINUATION on stream %u", cont_id
+		};
+
+	if(unlikely(!settings_recv && header.type != frame::SETTINGS))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "Expected SETTINGS to begin the connection."
+		};
+
+	switch(header.type)
+	{
+		case frame::DATA:             return handle_data(header, payload);
+		case frame::HEADERS:          return handle_headers(header, payload);
+		case frame::PRIORITY:         return handle_priority(header, payload);
+		case frame::RST_STREAM:       return handle_rst_stream(header, payload);
+		case frame::SETTINGS:         return handle_settings(header, payload);
+		case frame::PUSH_PROMISE:     return handle_push_promise(header, payload);
+		case frame::PING:             return handle_ping(header, payload);
+		case frame::GOAWAY:           return handle_goaway(header, payload);
+		case frame::WINDOW_UPDATE:    return handle_window_update(header, payload);
+		case frame::CONTINUATION:     return handle_continuation(header, payload);
+	}
+
+	// Frames of unknown type are ignored.
+}
+
+void
+ircd::http2::connection::handle_continuation(const frame::header &header,
+                                             const_buffer payload)
+{
+	if(unlikely(!cont_id || header.stream_id != cont_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "Unexpected CONTINUATION on stream %u",
+			uint(header.stream_id),
+		};
+
+	cont_block.append(ircd::data(payload), size(payload));
+	if(unlikely(cont_block.size() > size(header_buf)))
+		throw error
+		{
+			error::ENHANCE_YOUR_CALM, "Header block exceeds %zu bytes.",
+			size(header_buf),
+		};
+
+	if(!(header.flags & frame::END_HEADERS))
+		return;
+
+	const auto id(cont_id);
+	cont_id = 0;
+	const unwind clear{[this]
+	{
+		cont_block.clear();
+	}};
+
+	handle_headers_block(id, cont_flags, const_buffer{cont_block}, cont_priority);
+}
+
+void
+ircd::http2::connection::handle_window_update(const frame::header &header,
+                                              const_buffer payload)
+{
+	if(unlikely(header.len != 4))
+		throw error
+		{
+			error::FRAME_SIZE_ERROR, "WINDOW_UPDATE must be 4 bytes."
+		};
+
+	const uint32_t inc
+	{
+		read32(payload) & 0x7fffffffU
+	};
+
+	if(!header.stream_id)
+	{
+		if(unlikely(!inc))
+			throw error
+			{
+				error::PROTOCOL_ERROR, "WINDOW_UPDATE of zero on the connection."
+			};
+
+		send_window += inc;
+		if(unlikely(send_window > 0x7fffffffL))
+			throw error
+			{
+				error::FLOW_CONTROL_ERROR, "Connection window overflow."
+			};
+	}
+	else
+	{
+		auto *const s
+		{
+			get(header.stream_id)
+		};
+
+		if(!s && idle(header.stream_id))
+			throw error
+			{
+				error::PROTOCOL_ERROR, "WINDOW_UPDATE on idle stream %u",
+				uint(header.stream_id),
+			};
+
+		if(!s)
+			return;
+
+		if(unlikely(!inc))
+			return stream_error(header.stream_id, error::PROTOCOL_ERROR);
+
+		s->send_window += inc;
+		if(unlikely(s->send_window > 0x7fffffffL))
+			return stream_error(header.stream_id, error::FLOW_CONTROL_ERROR);
+	}
+
+	if(handler->window)
+		handler->window();
+}
+
+void
+ircd::http2::connection::handle_goaway(const frame::header &header,
+                                       const_buffer payload)
+{
+	if(unlikely(header.stream_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "GOAWAY on stream %u", uint(header.stream_id)
+		};
+
+	if(unlikely(header.len < 8))
+		throw error
+		{
+			error::FRAME_SIZE_ERROR, "GOAWAY must be at least 8 bytes."
+		};
+
+	goaway_recv = true;
+	goaway_id = read32(payload) & 0x7fffffffU;
+	const auto code
+	{
+		static_cast<enum error::code>(read32(payload + 4))
+	};
+
+	if(handler->goaway)
+		handler->goaway(goaway_id, code);
+}
+
+void
+ircd::http2::connection::handle_ping(const frame::header &header,
+                                     const_buffer payload)
+{
+	if(unlikely(header.stream_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "PING on stream %u", uint(header.stream_id)
+		};
+
+	if(unlikely(header.len != 8))
+		throw error
+		{
+			error::FRAME_SIZE_ERROR, "PING must be 8 bytes."
+		};
+
+	if(header.flags & frame::ACK)
+		return;
+
+	queue(frame::PING, frame::ACK, 0, payload);
+}
+
+void
+ircd::http2::connection::handle_push_promise(const frame::header &header,
+                                             const_buffer payload)
+{
+	throw error
+	{
+		error::PROTOCOL_ERROR, "PUSH_PROMISE is not enabled."
+	};
+}
+
+void
+ircd::http2::connection::handle_settings(const frame::header &header,
+                                         const_buffer payload)
+{
+	using code = http2::settings::code;
+
+	if(unlikely(header.stream_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "SETTINGS on stream %u", uint(header.stream_id)
+		};
+
+	if(header.flags & frame::ACK)
+	{
+		if(unlikely(header.len))
+			throw error
+			{
+				error::FRAME_SIZE_ERROR, "SETTINGS acknowledgement with payload."
+			};
+
+		return;
+	}
+
+	if(unlikely(header.len % 6))
+		throw error
+		{
+			error::FRAME_SIZE_ERROR, "SETTINGS payload of %u bytes.", uint(header.len)
+		};
+
+	bool window_opened(false);
+	for(; !empty(payload); consume(payload, 6))
+	{
+		const auto id
+		{
+			uint16_t(uint8_t(ircd::data(payload)[0]) << 8 | uint8_t(ircd::data(payload)[1]))
+		};
+
+		const uint32_t value
+		{
+			read32(payload + 2)
+		};
+
+		switch(id)
+		{
+			case code::HEADER_TABLE_SIZE:
+			{
+				const size_t max(std::min(value, 4096U));
+				if(max != encoder.table.max)
+					encoder.resize(max);
+
+				break;
+			}
+
+			case code::ENABLE_PUSH:
+				if(unlikely(value > 1))
+					throw error
+					{
+						error::PROTOCOL_ERROR, "ENABLE_PUSH of %u", value
+					};
+
+				break;
+
+			case code::INITIAL_WINDOW_SIZE:
+			{
+				if(unlikely(value > 0x7fffffffU))
+					throw error
+					{
+						error::FLOW_CONTROL_ERROR, "INITIAL_WINDOW_SIZE of %u", value
+					};
+
+				const int64_t delta
+				{
+					int64_t(value) - int64_t(theirs[code::INITIAL_WINDOW_SIZE])
+				};
+
+				for(auto &[id, stream] : streams)
+				{
+					stream.send_window += delta;
+					if(unlikely(stream.send_window > 0x7fffffffL))
+						throw error
+						{
+							error::FLOW_CONTROL_ERROR, "Window overflow on stream %u", id
+						};
+				}
+
+				window_opened |= delta > 0;
+				break;
+			}
+
+			case code::MAX_FRAME_SIZE:
+				if(unlikely(value < 16384 || value > 16777215))
+					throw error
+					{
+						error::PROTOCOL_ERROR, "MAX_FRAME_SIZE of %u", value
+					};
+
+				break;
+
+			case code::MAX_CONCURRENT_STREAMS:
+			case code::MAX_HEADER_LIST_SIZE:
+				break;
+
+			// Settings of unknown code are ignored.
+			default:
+				continue;
+		}
+
+		theirs[code(id)] = value;
+	}
+
+	settings_recv = true;
+	queue(frame::SETTINGS, frame::ACK, 0);
+	if(window_opened && handler->window)
+		handler->window();
+}
+
+void
+ircd::http2::connection::handle_rst_stream(const frame::header &header,
+                                           const_buffer payload)
+{
+	if(unlikely(!header.stream_id || idle(header.stream_id)))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "RST_STREAM on stream %u", uint(header.stream_id)
+		};
+
+	if(unlikely(header.len != 4))
+		throw error
+		{
+			error::FRAME_SIZE_ERROR, "RST_STREAM must be 4 bytes."
+		};
+
+	auto *const s
+	{
+		get(header.stream_id)
+	};
+
+	if(!s)
+		return;
+
+	const auto code
+	{
+		static_cast<enum error::code>(read32(payload))
+	};
+
+	const auto id(s->id);
+	const unwind erase{[this, &id]
+	{
+		streams.erase(id);
+	}};
+
+	if(handler->reset)
+		handler->reset(*s, code);
+}
+
+void
+ircd::http2::connection::handle_priority(const frame::header &header,
+                                         const_buffer payload)
+{
+	if(unlikely(!header.stream_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "PRIORITY on stream 0."
+		};
+
+	if(unlikely(header.len != 5))
+		return stream_error(header.stream_id, error::FRAME_SIZE_ERROR);
+
+	stream priority;
+	read_priority(priority, payload);
+	if(unlikely(priority.dependency == header.stream_id))
+		return stream_error(header.stream_id, error::PROTOCOL_ERROR);
+
+	auto *const s
+	{
+		get(header.stream_id)
+	};
+
+	if(!s)
+		return;
+
+	s->dependency = priority.dependency;
+	s->weight = priority.weight;
+	s->exclusive = priority.exclusive;
+}
+
+void
+ircd::http2::connection::handle_headers(const frame::header &header,
+                                        const_buffer payload)
+{
+	if(unlikely(!header.stream_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "HEADERS on stream 0."
+		};
+
+	payload = unpad(header, payload);
+	stream priority;
+	if(header.flags & frame::HAS_PRIORITY)
+	{
+		if(unlikely(size(payload) < 5))
+			throw error
+			{
+				error::FRAME_SIZE_ERROR, "HEADERS too short for priority."
+			};
+
+		read_priority(priority, payload);
+		consume(payload, 5);
+	}
+
+	if(header.flags & frame::END_HEADERS)
+		return handle_headers_block(header.stream_id, header.flags, payload, priority);
+
+	cont_id = header.stream_id;
+	cont_flags = header.flags;
+	cont_priority = priority;
+	cont_block.assign(ircd::data(payload), size(payload));
+}
+
+void
+ircd::http2::connection::handle_headers_block(const uint32_t &id,
+                                              const uint8_t &flags,
+                                              const const_buffer &block,
+                                              const stream &priority)
+{
+	// The block is decoded even when the stream is refused to keep the
+	// decoder's table in sync with the remote's encoder.
+	header_vec.clear();
+	decoder(block, header_buf, [this]
+	(const http::header &header)
+	{
+		header_vec.emplace_back(header);
+	});
+
+	const headers_view headers
+	{
+		header_vec.data(), header_vec.data() + header_vec.size()
+	};
+
+	const bool eos
+	{
+		flags & frame::END_STREAM
+	};
+
+	auto *s
+	{
+		get(id)
+	};
+
+	// New stream from the client.
+	if(!s && server && (id & 1) && id > last_id)
+	{
+		last_id = id;
+		if(goaway_sent)
+			return;
+
+		if(streams.size() >= ours[http2::settings::code::MAX_CONCURRENT_STREAMS])
+			return stream_error(id, error::REFUSED_STREAM);
+
+		s = &streams.emplace(id, stream
+		{
+			id,
+			theirs[http2::settings::code::INITIAL_WINDOW_SIZE],
+			ours[http2::settings::code::INITIAL_WINDOW_SIZE],
+		})
+		.first->second;
+
+		s->state = stream::state::OPEN;
+	}
+
+	if(!s && idle(id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "HEADERS on idle stream %u", id
+		};
+
+	if(!s || s->remote_closed())
+		return stream_error(id, error::STREAM_CLOSED);
+
+	if(flags & frame::HAS_PRIORITY)
+	{
+		if(unlikely(priority.dependency == id))
+			return stream_error(id, error::PROTOCOL_ERROR);
+
+		s->dependency = priority.dependency;
+		s->weight = priority.weight;
+		s->exclusive = priority.exclusive;
+	}
+
+	if(handler->headers)
+		handler->headers(*s, headers, eos);
+
+	// The handler may have reset the stream.
+	if(eos && (s = get(id)))
+		close_remote(*s);
+}
+
+void
+ircd::http2::connection::handle_data(const frame::header &header,
+                                     const_buffer payload)
+{
+	if(unlikely(!header.stream_id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "DATA on stream 0."
+		};
+
+	// The whole payload counts against the windows including padding.
+	recv_window -= header.len;
+	if(unlikely(recv_window < 0))
+		throw error
+		{
+			error::FLOW_CONTROL_ERROR, "Connection window exceeded."
+		};
+
+	const auto id(header.stream_id);
+	auto *s
+	{
+		get(id)
+	};
+
+	if(!s && idle(id))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "DATA on idle stream %u", id
+		};
+
+	payload = unpad(header, payload);
+	if(!s || s->remote_closed())
+	{
+		replenish(nullptr, header.len);
+		return stream_error(id, error::STREAM_CLOSED);
+	}
+
+	s->recv_window -= header.len;
+	if(unlikely(s->recv_window < 0))
+	{
+		replenish(nullptr, header.len);
+		return stream_error(id, error::FLOW_CONTROL_ERROR);
+	}
+
+	const bool eos
+	{
+		header.flags & frame::END_STREAM
+	};
+
+	if(handler->data)
+		handler->data(*s, payload, eos);
+
+	// The handler may have reset the stream.
+	s = get(id);
+	if(s && eos)
+		close_remote(*s);
+
+	replenish(s && !eos? s: nullptr, header.len);
+}
+
+/// Data is given to the handler as it arrives, so the windows are opened as
+/// soon as they fall to half.
+void
+ircd::http2::connection::replenish(stream *const &s,
+                                   const size_t &len)
+{
+	const int64_t window
+	{
+		std::min(int64_t(connection_window_size), int64_t(0x7fffffffL))
+	};
+
+	char buf[4];
+	if(recv_window < window / 2)
+	{
+		write32(buf, window - recv_window);
+		queue(frame::WINDOW_UPDATE, 0, 0, buf);
+		recv_window = window;
+	}
+
+	const int64_t initial
+	{
+		ours[http2::settings::code::INITIAL_WINDOW_SIZE]
+	};
+
+	if(s && s->recv_window < initial / 2)
+	{
+		write32(buf, initial - s->recv_window);
+		queue(frame::WINDOW_UPDATE, 0, s->id, buf);
+		s->recv_window = initial;
+	}
+}
+
+void
+ircd::http2::connection::stream_error(const uint32_t &id,
+                                      const enum error::code &code)
+{
+	char buf[4];
+	write32(buf, code);
+	queue(frame::RST_STREAM, 0, id, buf);
+
+	auto *const s
+	{
+		get(id)
+	};
+
+	if(!s)
+		return;
+
+	const unwind erase{[this, &id]
+	{
+		streams.erase(id);
+	}};
+
+	if(handler->reset)
+		handler->reset(*s, code);
+}
+
+void
+ircd::http2::connection::close_remote(stream &s)
+{
+	switch(s.state)
+	{
+		case stream::state::HALF_CLOSED_LOCAL:
+			streams.erase(s.id);
+			return;
+
+		default:
+			s.state = stream::state::HALF_CLOSED_REMOTE;
+			return;
+	}
+}
+
+void
+ircd::http2::connection::close_local(stream &s)
+{
+	switch(s.state)
+	{
+		case stream::state::HALF_CLOSED_REMOTE:
+			streams.erase(s.id);
+			return;
+
+		default:
+			s.state = stream::state::HALF_CLOSED_LOCAL;
+			return;
+	}
+}
+
+void
+ircd::http2::connection::queue(const enum frame::type &type,
+                               const uint8_t &flags,
+                               const uint32_t &id,
+                               const const_buffer &payload)
+{
+	char buf[frame::header::SIZE];
+	const frame::header header
+	{
+		type, flags, id, size(payload)
+	};
+
+	out.append(ircd::data(header.write(buf)), frame::header::SIZE);
+	out.append(ircd::data(payload), size(payload));
+}
+
+void
+ircd::http2::connection::read_priority(stream &s,
+                                       const const_buffer &payload)
+{
+	assert(size(payload) >= 5);
+	const uint32_t dep
+	{
+		read32(payload)
+	};
+
+	s.exclusive = dep & 0x80000000U;
+	s.dependency = dep & 0x7fffffffU;
+	s.weight = uint8_t(ircd::data(payload)[4]) + 1;
+}
+
+ircd::http2::stream *
+ircd::http2::connection::get(const uint32_t &id)
+{
+	const auto it
+	{
+		streams.find(id)
+	};
+
+	return it != end(streams)?
+		&it->second:
+		nullptr;
+}
+
+void
+ircd::http2::connection::wrote(const size_t &bytes)
+{
+	assert(out_pos + bytes <= out.size());
+	out_pos += bytes;
+	if(out_pos == out.size())
+	{
+		out.clear();
+		out_pos = 0;
+	}
+	else if(out_pos >= 64_KiB)
+	{
+		out.erase(0, out_pos);
+		out_pos = 0;
+	}
+}
+
+ircd::const_buffer
+ircd::http2::connection::pending()
+const
+{
+	return const_buffer
+	{
+		out.data() + out_pos, out.size() - out_pos
+	};
+}
+
+/// The number of bytes of DATA which can be sent on the stream now.
+int64_t
+ircd::http2::connection::window(const uint32_t &id)
+const
+{
+	const auto it
+	{
+		streams.find(id)
+	};
+
+	if(it == end(streams))
+		return 0;
+
+	return std::min(send_window, it->second.send_window);
+}
+
+/// Whether another stream can be opened from this side.
+bool
+ircd::http2::connection::acceptable()
+const
+{
+	return !goaway_sent
+	&& !goaway_recv
+	&& next_id <= 0x7fffffffU
+	&& streams.size() < theirs[http2::settings::code::MAX_CONCURRENT_STREAMS];
+}
+
+size_t
+ircd::http2::connection::active()
+const
+{
+	return streams.size();
+}
+
+/// Whether the stream has never been opened by either side.
+bool
+ircd::http2::connection::idle(const uint32_t &id)
+const
+{
+	const bool ours
+	{
+		bool(id & 1) != server
+	};
+
+	return ours?
+		id >= next_id:
+		id > last_id;
+}
+
+ircd::const_buffer
+ircd::http2::unpad(const frame::header &header,
+                   const const_buffer &payload)
+{
+	if(!(header.flags & frame::PADDED))
+		return payload;
+
+	if(unlikely(empty(payload)))
+		throw error
+		{
+			error::FRAME_SIZE_ERROR, "Padded frame is empty."
+		};
+
+	const uint8_t pad
+	(
+		data(payload)[0]
+	);
+
+	if(unlikely(pad >= size(payload)))
+		throw error
+		{
+			error::PROTOCOL_ERROR, "Padding exceeds the payload."
+		};
+
+	return const_buffer
+	{
+		data(payload) + 1, size(payload) - 1 - pad
+	};
+}
+
+uint32_t
+ircd::http2::read32(const const_buffer &buf)
+{
+	assert(size(buf) >= 4);
+	const auto *const b
+	{
+		reinterpret_cast<const uint8_t *>(data(buf))
+	};
+
+	return uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | b[3];
+}
+
+void
+ircd::http2::write32(char *const &buf,
+                     const uint32_t &val)
+{
+	buf[0] = val >> 24;
+	buf[1] = val >> 16;
+	buf[2] = val >> 8;
+	buf[3] = val;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// hpack.h
+//
+
+namespace ircd::http2::hpack
+{
+	struct huffman_code
+	{
+		uint32_t code;
+		uint8_t len;
+	};
+
+	struct huffman_node
+	{
+		uint16_t child[2] {0, 0};
+		int16_t sym {-1};
+	};
+
+	static std::vector<huffman_node> huffman_tree();
+	static void encode_int(mutable_buffer &, const uint8_t &bits, const uint8_t &prefix, uint64_t value);
+	static uint64_t decode_int(const_buffer &, const uint8_t &prefix);
+	static void encode_str(mutable_buffer &, const string_view &, const bool &huffman);
+	static string_view decode_str(const_buffer &, mutable_buffer &);
+	static string_view copy_str(mutable_buffer &, const string_view &);
+	static bool sensitive(const string_view &name);
+	static bool indexable(const http::header &, const size_t &max);
+
+	extern const huffman_code huffman_table[257];
+}
+
+decltype(ircd::http2::hpack::static_table)
+ircd::http2::hpack::static_table
+{
+	{ ":authority",                   ""               },
+	{ ":method",                      "GET"            },
+	{ ":method",                      "POST"           },
+	{ ":path",                        "/"              },
+	{ ":path",                        "/index.html"    },
+	{ ":scheme",                      "http"           },
+	{ ":scheme",                      "https"          },
+	{ ":status",                      "200"            },
+	{ ":status",                      "204"            },
+	{ ":status",                      "206"            },
+	{ ":status",                      "304"            },
+	{ ":status",                      "400"            },
+	{ ":status",                      "404"            },
+	{ ":status",                      "500"            },
+	{ "accept-charset",               ""               },
+	{ "accept-encoding",              "gzip, deflate"  },
+	{ "accept-language",              ""               },
+	{ "accept-ranges",                ""               },
+	{ "accept",                       ""               },
+	{ "access-control-allow-origin",  ""               },
+	{ "age",                          ""               },
+	{ "allow",                        ""               },
+	{ "authorization",                ""               },
+	{ "cache-control",                ""               },
+	{ "content-disposition",          ""               },
+	{ "content-encoding",             ""               },
+	{ "content-language",             ""               },
+	{ "content-length",               ""               },
+	{ "content-location",             ""               },
+	{ "content-range",                ""               },
+	{ "content-type",                 ""               },
+	{ "cookie",                       ""               },
+	{ "date",                         ""               },
+	{ "etag",                         ""               },
+	{ "expect",                       ""               },
+	{ "expires",                      ""               },
+	{ "from",                         ""               },
+	{ "host",                         ""               },
+	{ "if-match",                     ""               },
+	{ "if-modified-since",            ""               },
+	{ "if-none-match",                ""               },
+	{ "if-range",                     ""               },
+	{ "if-unmodified-since",          ""               },
+	{ "last-modified",                ""               },
+	{ "link",                         ""               },
+	{ "location",                     ""               },
+	{ "max-forwards",                 ""               },
+	{ "proxy-authenticate",           ""               },
+	{ "proxy-authorization",          ""               },
+	{ "range",                        ""               },
+	{ "referer",                      ""               },
+	{ "refresh",                      ""               },
+	{ "retry-after",                  ""               },
+	{ "server",                       ""               },
+	{ "set-cookie",                   ""               },
+	{ "strict-transport-security",    ""               },
+	{ "transfer-encoding",            ""               },
+	{ "user-agent",                   ""               },
+	{ "vary",                         ""               },
+	{ "via",                          ""               },
+	{ "www-authenticate",             ""               },
+};
+
+/// RFC 7541 Appendix B; the last is EOS.
+decltype(ircd::http2::hpack::huffman_table)
+ircd::http2::hpack::huffman_table
+{
+	{ 0x00001ff8, 13 }, { 0x007fffd8, 23 }, { 0x0fffffe2, 28 }, { 0x0fffffe3, 28 },
+	{ 0x0fffffe4, 28 }, { 0x0fffffe5, 28 }, { 0x0fffffe6, 28 }, { 0x0fffffe7, 28 },
+	{ 0x0fffffe8, 28 }, { 0x00ffffea, 24 }, { 0x3ffffffc, 30 }, { 0x0fffffe9, 28 },
+	{ 0x0fffffea, 28 }, { 0x3ffffffd, 30 }, { 0x0fffffeb, 28 }, { 0x0fffffec, 28 },
+	{ 0x0fffffed, 28 }, { 0x0fffffee, 28 }, { 0x0fffffef, 28 }, { 0x0ffffff0, 28 },
+	{ 0x0ffffff1, 28 }, { 0x0ffffff2, 28 }, { 0x3ffffffe, 30 }, { 0x0ffffff3, 28 },
+	{ 0x0ffffff4, 28 }, { 0x0ffffff5, 28 }, { 0x0ffffff6, 28 }, { 0x0ffffff7, 28 },
+	{ 0x0ffffff8, 28 }, { 0x0ffffff9, 28 }, { 0x0ffffffa, 28 }, { 0x0ffffffb, 28 },
+	{ 0x00000014,  6 }, { 0x000003f8, 10 }, { 0x000003f9, 10 }, { 0x00000ffa, 12 },
+	{ 0x00001ff9, 13 }, { 0x00000015,  6 }, { 0x000000f8,  8 }, { 0x000007fa, 11 },
+	{ 0x000003fa, 10 }, { 0x000003fb, 10 }, { 0x000000f9,  8 }, { 0x000007fb, 11 },
+	{ 0x000000fa,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+	{ 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+	{ 0x0000001a,  6 }, { 0x0000001b,  6 }, { 0x0000001c,  6 }, { 0x0000001d,  6 },
+	{ 0x0000001e,  6 }, { 0x0000001f,  6 }, { 0x0000005c,  7 }, { 0x000000fb,  8 },
+	{ 0x00007ffc, 15 }, { 0x00000020,  6 }, { 0x00000ffb, 12 }, { 0x000003fc, 10 },
+	{ 0x00001ffa, 13 }, { 0x00000021,  6 }, { 0x0000005d,  7 }, { 0x0000005e,  7 },
+	{ 0x0000005f,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+	{ 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+	{ 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006a,  7 },
+	{ 0x0000006b,  7 }, { 0x0000006c,  7 }, { 0x0000006d,  7 }, { 0x0000006e,  7 },
+	{ 0x0000006f,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+	{ 0x000000fc,  8 }, { 0x00000073,  7 }, { 0x000000fd,  8 }, { 0x00001ffb, 13 },
+	{ 0x0007fff0, 19 }, { 0x00001ffc, 13 }, { 0x00003ffc, 14 }, { 0x00000022,  6 },
+	{ 0x00007ffd, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+	{ 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+	{ 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+	{ 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002a,  6 }, { 0x00000007,  5 },
+	{ 0x0000002b,  6 }, { 0x00000076,  7 }, { 0x0000002c,  6 }, { 0x00000008,  5 },
+	{ 0x00000009,  5 }, { 0x0000002d,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+	{ 0x00000079,  7 }, { 0x0000007a,  7 }, { 0x0000007b,  7 }, { 0x00007ffe, 15 },
+	{ 0x000007fc, 11 }, { 0x00003ffd, 14 }, { 0x00001ffd, 13 }, { 0x0ffffffc, 28 },
+	{ 0x000fffe6, 20 }, { 0x003fffd2, 22 }, { 0x000fffe7, 20 }, { 0x000fffe8, 20 },
+	{ 0x003fffd3, 22 }, { 0x003fffd4, 22 }, { 0x003fffd5, 22 }, { 0x007fffd9, 23 },
+	{ 0x003fffd6, 22 }, { 0x007fffda, 23 }, { 0x007fffdb, 23 }, { 0x007fffdc, 23 },
+	{ 0x007fffdd, 23 }, { 0x007fffde, 23 }, { 0x00ffffeb, 24 }, { 0x007fffdf, 23 },
+	{ 0x00ffffec, 24 }, { 0x00ffffed, 24 }, { 0x003fffd7, 22 }, { 0x007fffe0, 23 },
+	{ 0x00ffffee, 24 }, { 0x007fffe1, 23 }, { 0x007fffe2, 23 }, { 0x007fffe3, 23 },
+	{ 0x007fffe4, 23 }, { 0x001fffdc, 21 }, { 0x003fffd8, 22 }, { 0x007fffe5, 23 },
+	{ 0x003fffd9, 22 }, { 0x007fffe6, 23 }, { 0x007fffe7, 23 }, { 0x00ffffef, 24 },
+	{ 0x003fffda, 22 }, { 0x001fffdd, 21 }, { 0x000fffe9, 20 }, { 0x003fffdb, 22 },
+	{ 0x003fffdc, 22 }, { 0x007fffe8, 23 }, { 0x007fffe9, 23 }, { 0x001fffde, 21 },
+	{ 0x007fffea, 23 }, { 0x003fffdd, 22 }, { 0x003fffde, 22 }, { 0x00fffff0, 24 },
+	{ 0x001fffdf, 21 }, { 0x003fffdf, 22 }, { 0x007fffeb, 23 }, { 0x007fffec, 23 },
+	{ 0x001fffe0, 21 }, { 0x001fffe1, 21 }, { 0x003fffe0, 22 }, { 0x001fffe2, 21 },
+	{ 0x007fffed, 23 }, { 0x003fffe1, 22 }, { 0x007fffee, 23 }, { 0x007fffef, 23 },
+	{ 0x000fffea, 20 }, { 0x003fffe2, 22 }, { 0x003fffe3, 22 }, { 0x003fffe4, 22 },
+	{ 0x007ffff0, 23 }, { 0x003fffe5, 22 }, { 0x003fffe6, 22 }, { 0x007ffff1, 23 },
+	{ 0x03ffffe0, 26 }, { 0x03ffffe1, 26 }, { 0x000fffeb, 20 }, { 0x0007fff1, 19 },
+	{ 0x003fffe7, 22 }, { 0x007ffff2, 23 }, { 0x003fffe8, 22 }, { 0x01ffffec, 25 },
+	{ 0x03ffffe2, 26 }, { 0x03ffffe3, 26 }, { 0x03ffffe4, 26 }, { 0x07ffffde, 27 },
+	{ 0x07ffffdf, 27 }, { 0x03ffffe5, 26 }, { 0x00fffff1, 24 }, { 0x01ffffed, 25 },
+	{ 0x0007fff2, 19 }, { 0x001fffe3, 21 }, { 0x03ffffe6, 26 }, { 0x07ffffe0, 27 },
+	{ 0x07ffffe1, 27 }, { 0x03ffffe7, 26 }, { 0x07ffffe2, 27 }, { 0x00fffff2, 24 },
+	{ 0x001fffe4, 21 }, { 0x001fffe5, 21 }, { 0x03ffffe8, 26 }, { 0x03ffffe9, 26 },
+	{ 0x0ffffffd, 28 }, { 0x07ffffe3, 27 }, { 0x07ffffe4, 27 }, { 0x07ffffe5, 27 },
+	{ 0x000fffec, 20 }, { 0x00fffff3, 24 }, { 0x000fffed, 20 }, { 0x001fffe6, 21 },
+	{ 0x003fffe9, 22 }, { 0x001fffe7, 21 }, { 0x001fffe8, 21 }, { 0x007ffff3, 23 },
+	{ 0x003fffea, 22 }, { 0x003fffeb, 22 }, { 0x01ffffee, 25 }, { 0x01ffffef, 25 },
+	{ 0x00fffff4, 24 }, { 0x00fffff5, 24 }, { 0x03ffffea, 26 }, { 0x007ffff4, 23 },
+	{ 0x03ffffeb, 26 }, { 0x07ffffe6, 27 }, { 0x03ffffec, 26 }, { 0x03ffffed, 26 },
+	{ 0x07ffffe7, 27 }, { 0x07ffffe8, 27 }, { 0x07ffffe9, 27 }, { 0x07ffffea, 27 },
+	{ 0x07ffffeb, 27 }, { 0x0ffffffe, 28 }, { 0x07ffffec, 27 }, { 0x07ffffed, 27 },
+	{ 0x07ffffee, 27 }, { 0x07ffffef, 27 }, { 0x07fffff0, 27 }, { 0x03ffffee, 26 },
+	{ 0x3fffffff, 30 },
+};
+
+//
+// decoder
+//
+
+void
+ircd::http2::hpack::decoder::operator()(const const_buffer &block,
+                                        const mutable_buffer &buf_,
+                                        const closure &closure)
+{
+	const_buffer in{block};
+	mutable_buffer buf{buf_};
+	bool headers(false);
+	while(!empty(in))
+	{
+		const uint8_t c(data(in)[0]);
+
+		// Indexed header field
+		if(c & 0x80)
+		{
+			const auto header
+			{
+				table[decode_int(in, 7)]
+			};
+
+			const string_view name(copy_str(buf, header.first));
+			const string_view value(copy_str(buf, header.second));
+			closure(http::header{name, value});
+			headers = true;
+			continue;
+		}
+
+		// Dynamic table size update
+		if((c & 0xe0) == 0x20)
+		{
+			const size_t max
+			{
+				decode_int(in, 5)
+			};
+
+			if(unlikely(headers || max > limit))
+				throw error
+				{
+					error::COMPRESSION_ERROR, "Invalid table size update to %zu", max
+				};
+
+			table.resize(max);
+			continue;
+		}
+
+		// Literal header field; with incremental indexing, without indexing
+		// or never indexed.
+		const bool incremental
+		{
+			(c & 0xc0) == 0x40
+		};
+
+		const size_t index
+		{
+			decode_int(in, incremental? 6: 4)
+		};
+
+		const string_view name
+		{
+			index?
+				copy_str(buf, table[index].first):
+				decode_str(in, buf)
+		};
+
+		const string_view value
+		{
+			decode_str(in, buf)
+		};
+
+		if(incremental)
+			table.add(name, value);
+
+		closure(http::header{name, value});
+		headers = true;
+	}
+}
+
+//
+// encoder
+//
+
+void
+ircd::http2::hpack::encoder::resize(const size_t &max)
+{
+	table.resize(max);
+	update = max;
+}
+
+ircd::const_buffer
+ircd::http2::hpack::encoder::operator()(const mutable_buffer &buf,
+                                        const vector_view<const http::header> &headers)
+{
+	mutable_buffer out{buf};
+	if(update != size_t(-1))
+	{
+		encode_int(out, 0x20, 5, update);
+		update = size_t(-1);
+	}
+
+	for(const auto &header : headers)
+	{
+		bool value(false);
+		const size_t index
+		{
+			table.find(header, value)
+		};
+
+		if(index && value)
+		{
+			encode_int(out, 0x80, 7, index);
+			continue;
+		}
+
+		const bool never
+		{
+			sensitive(header.first)
+		};
+
+		const bool incremental
+		{
+			!never && indexable(header, table.max)
+		};
+
+		if(incremental)
+			encode_int(out, 0x40, 6, index);
+		else
+			encode_int(out, never? 0x10: 0x00, 4, index);
+
+		if(!index)
+		{
+			char lower[256];
+			if(unlikely(size(header.first) > sizeof(lower)))
+				throw error
+				{
+					error::INTERNAL_ERROR, "Header name of %zu bytes is too long.",
+					size(header.first),
+				};
+
+			encode_str(out, tolower(lower, header.first), huffman);
+		}
+
+		encode_str(out, header.second, huffman);
+		if(incremental)
+			table.add(header.first, header.second);
+	}
+
+	return const_buffer
+	{
+		data(buf), data(out)
+	};
+}
+
+//
+// table
+//
+
+void
+ircd::http2::hpack::table::resize(const size_t &max)
+{
+	this->max = max;
+	while(size > max)
+	{
+		assert(!entry.empty());
+		size -= entry.back().first.size() + entry.back().second.size() + 32;
+		entry.pop_back();
+	}
+}
+
+/// The name and value may be in the table already; they're copied before
+/// any entries are evicted.
+void
+ircd::http2::hpack::table::add(const string_view &name,
+                               const string_view &value)
+{
+	std::string name_(ircd::size(name), char{}), value_(value);
+	tolower(mutable_buffer{name_.data(), name_.size()}, name);
+
+	const size_t sz
+	{
+		name_.size() + value_.size() + 32
+	};
+
+	// Evict enough for the new entry; an entry larger than the table
+	// empties it and is not added.
+	const size_t max_(max);
+	resize(sz < max_? max_ - sz: 0);
+	max = max_;
+	if(sz > max)
+		return;
+
+	entry.emplace_front(std::move(name_), std::move(value_));
+	size += sz;
+}
+
+/// Index of an entry matching the name and value; otherwise of an entry
+/// matching the name only, with value set false. Zero if the name is not
+/// found at all.
+size_t
+ircd::http2::hpack::table::find(const http::header &header,
+                                bool &value)
+const
+{
+	size_t ret(0);
+	for(size_t i(0); i < std::size(static_table); ++i)
+		if(iequals(static_table[i].first, header.first))
+		{
+			if(static_table[i].second == header.second)
+			{
+				value = true;
+				return i + 1;
+			}
+
+			ret = ret?: i + 1;
+		}
+
+	for(size_t i(0); i < entry.size(); ++i)
+		if(iequals(entry[i].first, header.first))
+		{
+			if(entry[i].second == header.second)
+			{
+				value = true;
+				return std::size(static_table) + 1 + i;
+			}
+
+			ret = ret?: std::size(static_table) + 1 + i;
+		}
+
+	value = false;
+	return ret;
+}
+
+ircd::http::header
+ircd::http2::hpack::table::operator[](const size_t &index)
+const
+{
+	if(unlikely(!index))
+		throw error
+		{
+			error::COMPRESSION_ERROR, "Header index of zero."
+		};
+
+	if(index <= std::size(static_table))
+		return static_table[index - 1];
+
+	const size_t i
+	{
+		index - std::size(static_table) - 1
+	};
+
+	if(unlikely(i >= entry.size()))
+		throw error
+		{
+			error::COMPRESSION_ERROR, "Header index %zu out of range.", index
+		};
+
+	return http::header
+	{
+		entry[i].first, entry[i].second
+	};
+}
+
+//
+// hpack util
+//
+
+bool
+ircd::http2::hpack::indexable(const http::header &header,
+                              const size_t &max)
+{
+	// These vary with every message, so indexing would only churn the table.
+	static const string_view unique[]
+	{
+		":path", "content-length", "date", "etag", "last-modified", "age",
+		"content-range", "x-matrix-origin",
+	};
+
+	if(size(header.first) + size(header.second) + 32 > max / 2)
+		return false;
+
+	return std::none_of(std::begin(unique), std::end(unique), [&header]
+	(const string_view &name)
+	{
+		return iequals(name, header.first);
+	});
+}
+
+bool
+ircd::http2::hpack::sensitive(const string_view &name)
+{
+	return iequals(name, "authorization"_sv)
+	|| iequals(name, "proxy-authorization"_sv)
+	|| iequals(name, "cookie"_sv)
+	|| iequals(name, "set-cookie"_sv);
+}
+
+ircd::string_view
+ircd::http2::hpack::copy_str(mutable_buffer &buf,
+                             const string_view &str)
+{
+	if(unlikely(size(str) > size(buf)))
+		throw error
+		{
+			error::ENHANCE_YOUR_CALM, "Header list too large."
+		};
+
+	const string_view ret
+	{
+		data(buf), copy(buf, str)
+	};
+
+	consume(buf, size(ret));
+	return ret;
+}
+
+ircd::string_view
+ircd::http2::hpack::decode_str(const_buffer &in,
+                               mutable_buffer &buf)
+{
+	if(unlikely(empty(in)))
+		throw error
+		{
+			error::COMPRESSION_ERROR, "Truncated string."
+		};
+
+	const bool huffman
+	{
+		bool(data(in)[0] & 0x80)
+	};
+
+	const size_t len
+	{
+		decode_int(in, 7)
+	};
+
+	if(unlikely(len > size(in)))
+		throw error
+		{
+			error::COMPRESSION_ERROR, "Truncated string of %zu bytes.", len
+		};
+
+	const string_view str
+	{
+		data(in), len
+	};
+
+	consume(in, len);
+	if(!huffman)
+		return copy_str(buf, str);
+
+	const string_view ret
+	{
+		huffman_decode(buf, str)
+	};
+
+	consume(buf, size(ret));
+	return ret;
+}
+
+void
+ircd::http2::hpack::encode_str(mutable_buffer &out,
+                               const string_view &str,
+                               const bool &huffman)
+{
+	const size_t len
+	{
+		huffman?
+			huffman_size(str):
+			size(str)
+	};
+
+	if(len < size(str))
+	{
+		encode_int(out, 0x80, 7, len);
+		consume(out, size(huffman_encode(out, str)));
+		return;
+	}
+
+	encode_int(out, 0x00, 7, size(str));
+	if(unlikely(size(out) < size(str)))
+		throw error
+		{
+			error::INTERNAL_ERROR, "Header block buffer too small."
+		};
+
+	consume(out, copy(out, str));
+}
+
+uint64_t
+ircd::http2::hpack::decode_int(const_buffer &in,
+                               const uint8_t &prefix)
+{
+	if(unlikely(empty(in)))
+		throw error
+		{
+			error::COMPRESSION_ERROR, "Truncated integer."
+		};
+
+	const uint8_t max((1U << prefix) - 1);
+	uint64_t ret(uint8_t(data(in)[0]) & max);
+	consume(in, 1);
+	if(ret < max)
+		return ret;
+
+	for(uint shift(0);; shift += 7)
+	{
+		if(unlikely(empty(in) || shift > 56))
+			throw error
+			{
+				error::COMPRESSION_ERROR, "Truncated or overflowing integer."
+			};
+
+		const uint8_t c(data(in)[0]);
+		consume(in, 1);
+		ret += uint64_t(c & 0x7f) << shift;
+		if(!(c & 0x80))
+			return ret;
+	}
+}
+
+void
+ircd::http2::hpack::encode_int(mutable_buffer &out,
+                               const uint8_t &bits,
+                               const uint8_t &prefix,
+                               uint64_t value)
+{
+	const auto put{[&out](const uint8_t &c)
+	{
+		if(unlikely(empty(out)))
+			throw error
+			{
+				error::INTERNAL_ERROR, "Header block buffer too small."
+			};
+
+		data(out)[0] = c;
+		consume(out, 1);
+	}};
+
+	const uint8_t max((1U << prefix) - 1);
+	if(value < max)
+		return put(bits | value);
+
+	put(bits | max);
+	for(value -= max; value >= 128; value >>= 7)
+		put((value & 0x7f) | 0x80);
+
+	put(value);
+}
+
+//
+// huffman
+//
+
+ircd::string_view
+ircd::http2::hpack::huffman_decode(const mutable_buffer &out,
+                                   const const_buffer &in)
+{
+	static const auto tree
+	{
+		huffman_tree()
+	};
+
+	size_t pos(0), node(0), depth(0);
+	bool ones(true);
+	for(size_t i(0); i < size(in); ++i)
+		for(int j(7); j >= 0; --j)
+		{
+			const bool bit
+			{
+				bool((uint8_t(data(in)[i]) >> j) & 1)
+			};
+
+			node = tree[node].child[bit];
+			ones &= bit;
+			++depth;
+			if(tree[node].sym < 0)
+				continue;
+
+			if(unlikely(tree[node].sym == 256))
+				throw error
+				{
+					error::COMPRESSION_ERROR, "EOS in string literal."
+				};
+
+			if(unlikely(pos >= size(out)))
+				throw error
+				{
+					error::ENHANCE_YOUR_CALM, "Header list too large."
+				};
+
+			data(out)[pos++] = tree[node].sym;
+			node = 0;
+			depth = 0;
+			ones = true;
+		}
+
+	// Padding is the most significant bits of EOS; less than a byte.
+	if(unlikely(depth > 7 || !ones))
+		throw error
+		{
+			error::COMPRESSION_ERROR, "Invalid string literal padding."
+		};
+
+	return string_view
+	{
+		data(out), pos
+	};
+}
+
+ircd::const_buffer
+ircd::http2::hpack::huffman_encode(const mutable_buffer &out,
+                                   const string_view &str)
+{
+	size_t pos(0);
+	uint64_t acc(0);
+	uint bits(0);
+	const auto put{[&out, &pos](const uint8_t &c)
+	{
+		if(unlikely(pos >= size(out)))
+			throw error
+			{
+				error::INTERNAL_ERROR, "Header block buffer too small."
+			};
+
+		data(out)[pos++] = c;
+	}};
+
+	for(const char &c : str)
+	{
+		const auto &code
+		{
+			huffman_table[uint8_t(c)]
+		};
+
+		acc = (acc << code.len) | code.code;
+		for(bits += code.len; bits >= 8; bits -= 8)
+			put(acc >> (bits - 8));
+
+		acc &= (1UL << bits) - 1;
+	}
+
+	if(bits)
+		put((acc << (8 - bits)) | (0xff >> bits));
+
+	return const_buffer
+	{
+		data(out), pos
+	};
+}
+
+size_t
+ircd::http2::hpack::huffman_size(const string_view &str)
+{
+	size_t bits(0);
+	for(const char &c : str)
+		bits += huffman_table[uint8_t(c)].len;
+
+	return (bits + 7) / 8;
+}
+
+std::vector<ircd::http2::hpack::huffman_node>
+ircd::http2::hpack::huffman_tree()
+{
+	std::vector<huffman_node> ret(1);
+	for(size_t sym(0); sym < std::size(huffman_table); ++sym)
+	{
+		const auto &code
+		{
+			huffman_table[sym]
+		};
+
+		size_t node(0);
+		for(int i(code.len - 1); i >= 0; --i)
+		{
+			const bool bit((code.code >> i) & 1);
+			if(!ret[node].child[bit])
+			{
+				ret[node].child[bit] = ret.size();
+				ret.emplace_back();
+			}
+
+			node = ret[node].child[bit];
+		}
+
+		ret[node].sym = sym;
+	}
+
+	return ret;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // stream.h
 //
 
+ircd::http2::stream::stream(const uint32_t &id,
+                            const int64_t &send_window,
+                            const int64_t &recv_window)
+:id
+{
+	id
+}
+,state
+{
+	state::IDLE
+}
+,send_window
+{
+	send_window
+}
+,recv_window
+{
+	recv_window
+}
+{
+}
+
 ircd::http2::stream::stream()
 :state
 {
@@ -27,6 +2011,22 @@ ircd::http2::stream::stream()
 {
 }
 
+bool
+ircd::http2::stream::remote_closed()
+const
+{
+	return state == state::HALF_CLOSED_REMOTE
+	|| state == state::CLOSED;
+}
+
+bool
+ircd::http2::stream::local_closed()
+const
+{
+	return state == state::HALF_CLOSED_LOCAL
+	|| state == state::CLOSED;
+}
+
 ircd::string_view
 ircd::http2::reflect(const enum stream::state &state)
 {
@@ -54,12 +2054,12 @@ ircd::http2::reflect(const enum stream::state &state)
 ircd::http2::settings::settings()
 :array_type
 {
-	4096,    // HEADER_TABLE_SIZE
-	1,       // ENABLE_PUSH
-	0,       // MAX_CONCURRENT_STREAMS (unlimited)
-	65535,   // INITIAL_WINDOW_SIZE
-	16384,   // MAX_FRAME_SIZE
-	0,       // MAX_HEADER_LIST_SIZE (unlimited)
+	4096,          // HEADER_TABLE_SIZE
+	1,             // ENABLE_PUSH
+	UINT32_MAX,    // MAX_CONCURRENT_STREAMS (unlimited)
+	65535,         // INITIAL_WINDOW_SIZE
+	16384,         // MAX_FRAME_SIZE
+	UINT32_MAX,    // MAX_HEADER_LIST_SIZE (unlimited)
 }
 {
 }
@@ -91,6 +2091,90 @@ static_assert
     sizeof(ircd::http2::frame::header) == 9
 );
 
+ircd::http2::frame::header::header(const enum type &type,
+                                   const uint8_t &flags,
+                                   const uint32_t &stream_id,
+                                   const size_t &len)
+:len
+{
+	uint32_t(len)
+}
+,type
+{
+	type
+}
+,flags
+{
+	flags
+}
+,stream_id
+{
+	stream_id
+}
+{
+	assert(len < (1UL << 24));
+	assert(stream_id < (1UL << 31));
+}
+
+ircd::http2::frame::header::header(const const_buffer &buf)
+{
+	assert(size(buf) >= SIZE);
+	const auto *const b
+	{
+		reinterpret_cast<const uint8_t *>(data(buf))
+	};
+
+	len = uint32_t(b[0]) << 16 | uint32_t(b[1]) << 8 | b[2];
+	type = frame::type(b[3]);
+	flags = b[4];
+	stream_id = uint32_t(b[5] & 0x7f) << 24 | uint32_t(b[6]) << 16 | uint32_t(b[7]) << 8 | b[8];
+}
+
+ircd::const_buffer
+ircd::http2::frame::header::write(const mutable_buffer &buf)
+const
+{
+	assert(size(buf) >= SIZE);
+	auto *const b
+	{
+		reinterpret_cast<uint8_t *>(data(buf))
+	};
+
+	b[0] = len >> 16;
+	b[1] = len >> 8;
+	b[2] = len;
+	b[3] = type;
+	b[4] = flags;
+	b[5] = (stream_id >> 24) & 0x7f;
+	b[6] = stream_id >> 16;
+	b[7] = stream_id >> 8;
+	b[8] = stream_id;
+	return const_buffer
+	{
+		data(buf), SIZE
+	};
+}
+
+ircd::string_view
+ircd::http2::frame::reflect(const type &type)
+{
+	switch(type)
+	{
+		case type::DATA:             return "DATA";
+		case type::HEADERS:          return "HEADERS";
+		case type::PRIORITY:         return "PRIORITY";
+		case type::RST_STREAM:       return "RST_STREAM";
+		case type::SETTINGS:         return "SETTINGS";
+		case type::PUSH_PROMISE:     return "PUSH_PROMISE";
+		case type::PING:             return "PING";
+		case type::GOAWAY:           return "GOAWAY";
+		case type::WINDOW_UPDATE:    return "WINDOW_UPDATE";
+		case type::CONTINUATION:     return "CONTINUATION";
+	}
+
+	return "??????";
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //
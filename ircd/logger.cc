@@ -11,6 +11,7 @@
 #include <RB_INC_IOSTREAM
 // <iostream> inclusion here runs std::ios_base::Init() statically as this unit
 // is initialized (GNU initialization order given in Makefile).
+#include <RB_INC_SYS_UIO_H
 
 namespace ircd::log
 {
@@ -34,13 +35,62 @@ namespace ircd::log
 	extern conf::item<std::string> unmask_console;
 	extern conf::item<std::string> mask_file;
 	extern conf::item<std::string> mask_console;
-	extern std::array<std::ofstream, num_of<level>()> file;
+	extern std::array<fs::fd, num_of<level>()> file;
 	extern std::array<ulong, num_of<level>()> console_quiet_stdout;
 	extern std::array<ulong, num_of<level>()> console_quiet_stderr;
 	std::ostream &out_console{std::cout};
 	std::ostream &err_console{std::cerr};
 }
 
+/// The file and console hooks write through a ring of formatted lines when
+/// the writer thread is running. Any number of threads may push into the
+/// ring without locking; the writer thread (or a caller of log::flush())
+/// takes the mutex and drains it in batches with writev(2). When the writer
+/// isn't running the hooks write directly on the calling thread.
+namespace ircd::log::async
+{
+	struct writer;
+	struct record;
+
+	enum dest :uint8_t
+	{
+		FILE    = 0x01,
+		STDOUT  = 0x02,
+		STDERR  = 0x04,
+	};
+
+	static bool try_push(const level &, const uint8_t &dest, const string_view &) noexcept;
+	static bool push(const level &, const uint8_t &dest, const string_view &, const bool &urgent) noexcept;
+	static void write(const int &fd, struct ::iovec *, size_t) noexcept;
+	static size_t drain() noexcept;
+	static void flush() noexcept;
+	static void wake() noexcept;
+	static void worker() noexcept;
+	static void start();
+	static void stop() noexcept;
+
+	constexpr const size_t BATCH_MAX {64};
+
+	extern conf::item<bool> enable;
+	extern conf::item<size_t> slots;
+	extern conf::item<milliseconds> interval;
+	extern conf::item<std::string> overflow;
+	extern stats::item<uint64_t> dropped;
+	extern stats::item<uint64_t> batches;
+	extern struct writer writer;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::unique_ptr<record[]> ring;
+	size_t mask;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+	std::atomic<bool> wakeup;
+	bool overflow_block;
+	bool running;
+	bool termination;
+}
+
 struct ircd::log::confs
 {
 	conf::item<bool> file_enable;
@@ -142,12 +192,16 @@ ircd::log::init()
 		open();
 	}
 
+	if(async::enable)
+		async::start();
+
 	ircd::log::ready = true;
 }
 
 void
 ircd::log::fini()
 {
+	async::stop();
 	flush();
 	close();
 }
@@ -166,13 +220,17 @@ ircd::log::mkdir()
 void
 ircd::log::open()
 {
-	for_each<level>([](const level &lev)
+	// The writer is held off while the descriptors are replaced; anything
+	// queued for the old files is written to them first.
+	const std::lock_guard lock
 	{
-		if(file[lev].is_open())
-			file[lev].close();
+		async::mutex
+	};
 
-		file[lev].clear();
-		file[lev].exceptions(std::ios::badbit | std::ios::failbit);
+	async::drain();
+	for_each<level>([](const level &lev)
+	{
+		file[lev] = fs::fd{};
 		open(lev);
 	});
 }
@@ -180,21 +238,26 @@ ircd::log::open()
 void
 ircd::log::close()
 {
+	const std::lock_guard lock
+	{
+		async::mutex
+	};
+
+	async::drain();
 	for_each<level>([](const level &lev)
 	{
-		if(file[lev].is_open())
-			file[lev].close();
+		file[lev] = fs::fd{};
 	});
 }
 
+/// Writes everything queued for the writer thread on the calling thread
+/// before returning. The files are unbuffered; the console streams are
+/// flushed for any direct writes to them.
 void
 ircd::log::flush()
+noexcept
 {
-	for_each<level>([](const level &lev)
-	{
-		file[lev].flush();
-	});
-
+	async::flush();
 	std::flush(out_console);
 	std::flush(err_console);
 }
@@ -203,9 +266,18 @@ void
 ircd::log::open(const level &lev)
 try
 {
-	const auto &mode(std::ios::app);
+	// Errors aren't logged by fs:: while the files are being replaced.
+	fs::fd::opts opts
+	{
+		std::ios::out | std::ios::app
+	};
+
+	opts.errlog = false;
 	const auto &path(file_path(lev));
-	file[lev].open(path.c_str(), mode);
+	file[lev] = fs::fd
+	{
+		path, opts
+	};
 }
 catch(const std::exception &e)
 {
@@ -658,7 +730,7 @@ noexcept
 	const bool copy_to_file
 	{
 		bool(conf.file_enable)
-		&& file[lev].is_open()
+		&& bool(file[lev])
 		&& (log.fmasked || lev == level::CRITICAL)
 	};
 
@@ -666,11 +738,18 @@ noexcept
 	if(!copy_to_file || !msg)
 		return;
 
-	file[lev].clear();
-	check(file[lev]);
-	file[lev].write(data(msg), size(msg));
-	if(conf.file_flush)
-		std::flush(file[lev]);
+	if(likely(async::running))
+	{
+		async::push(lev, async::FILE, msg, conf.file_flush);
+		return;
+	}
+
+	struct ::iovec iov
+	{
+		const_cast<char *>(data(msg)), size(msg)
+	};
+
+	async::write(file[lev], &iov, 1);
 }
 
 decltype(ircd::log::log_to_stdout)
@@ -710,6 +789,18 @@ noexcept
 	if((!copy_to_stdout && !copy_to_stderr) || !msg)
 		return;
 
+	if(likely(async::running))
+	{
+		const uint8_t dest
+		(
+			(copy_to_stdout? async::STDOUT : 0) |
+			(copy_to_stderr? async::STDERR : 0)
+		);
+
+		async::push(lev, dest, msg, conf.console_flush);
+		return;
+	}
+
 	if(unlikely(copy_to_stderr))
 	{
 		err_console.clear();
@@ -727,6 +818,405 @@ noexcept
 	}
 }
 
+//
+// async
+//
+
+/// Joins the writer thread at static destruction if it's still running.
+struct ircd::log::async::writer
+{
+	std::thread thread;
+
+	~writer() noexcept;
+};
+
+/// A line in the ring. The sequence number is the position at which the
+/// slot can next be claimed by a producer; it is one past that position
+/// once the line has been written into the slot for the consumer.
+struct ircd::log::async::record
+{
+	std::atomic<size_t> seq;
+	level lev;
+	uint8_t dest;
+	uint16_t len;
+	char buf[LOG_BUFSIZE];
+};
+
+decltype(ircd::log::async::enable)
+ircd::log::async::enable
+{
+	{
+		{ "name",     "ircd.log.async.enable" },
+		{ "default",  true                    },
+	}, []
+	{
+		if(!ircd::log::ready)
+			return;
+
+		if(enable)
+			start();
+		else
+			stop();
+	}
+};
+
+decltype(ircd::log::async::slots)
+ircd::log::async::slots
+{
+	{ "name",     "ircd.log.async.slots" },
+	{ "default",  1024L                  },
+};
+
+decltype(ircd::log::async::interval)
+ircd::log::async::interval
+{
+	{ "name",     "ircd.log.async.interval" },
+	{ "default",  50L                       },
+};
+
+/// Either "drop" to discard lines when the ring is full, counting them in
+/// the dropped stat, or "block" to wait for the ring to be drained. CRITICAL
+/// lines always block.
+decltype(ircd::log::async::overflow)
+ircd::log::async::overflow
+{
+	{
+		{ "name",     "ircd.log.async.overflow" },
+		{ "default",  "drop"                    },
+	}, []
+	{
+		overflow_block = string_view(overflow) == "block";
+	}
+};
+
+decltype(ircd::log::async::dropped)
+ircd::log::async::dropped
+{
+	{ "name", "ircd.log.async.dropped" },
+};
+
+decltype(ircd::log::async::batches)
+ircd::log::async::batches
+{
+	{ "name", "ircd.log.async.batches" },
+};
+
+decltype(ircd::log::async::writer)
+ircd::log::async::writer;
+
+ircd::log::async::writer::~writer()
+noexcept
+{
+	stop();
+}
+
+void
+ircd::log::async::start()
+{
+	if(running)
+		return;
+
+	assert(!ring);
+	assert(!writer.thread.joinable());
+	std::flush(out_console);
+	std::flush(err_console);
+	size_t count(2);
+	while(count < size_t(slots))
+		count <<= 1;
+
+	ring.reset(new record[count]);
+	for(size_t i(0); i < count; ++i)
+		ring[i].seq.store(i, std::memory_order_relaxed);
+
+	mask = count - 1;
+	head.store(0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+	termination = false;
+	writer.thread = std::thread
+	{
+		&worker
+	};
+
+	running = true;
+}
+
+void
+ircd::log::async::stop()
+noexcept
+{
+	if(!writer.thread.joinable())
+		return;
+
+	// New lines are written directly from here; the writer drains whatever
+	// was queued before it exits.
+	running = false;
+	{
+		const std::lock_guard lock
+		{
+			mutex
+		};
+
+		termination = true;
+	}
+
+	cond.notify_all();
+	writer.thread.join();
+
+	const std::lock_guard lock
+	{
+		mutex
+	};
+
+	drain();
+	ring.reset();
+}
+
+void
+ircd::log::async::worker()
+noexcept
+{
+	std::unique_lock lock
+	{
+		mutex
+	};
+
+	while(!termination)
+	{
+		// Producers notify without the mutex; a wakeup missed between the
+		// predicate and the wait is made up by the interval.
+		cond.wait_for(lock, milliseconds(interval), []
+		{
+			return termination || wakeup.load(std::memory_order_relaxed);
+		});
+
+		wakeup.store(false, std::memory_order_relaxed);
+		drain();
+	}
+
+	drain();
+}
+
+void
+ircd::log::async::flush()
+noexcept
+{
+	if(!ring)
+		return;
+
+	const std::lock_guard lock
+	{
+		mutex
+	};
+
+	drain();
+}
+
+void
+ircd::log::async::wake()
+noexcept
+{
+	wakeup.store(true, std::memory_order_relaxed);
+	cond.notify_one();
+}
+
+bool
+ircd::log::async::push(const level &lev,
+                       const uint8_t &dest,
+                       const string_view &msg,
+                       const bool &urgent)
+noexcept
+{
+	// The caller may be about to abort after a CRITICAL line; it is never
+	// dropped and it reaches the descriptors before returning.
+	const bool critical
+	{
+		lev == level::CRITICAL
+	};
+
+	while(!try_push(lev, dest, msg))
+	{
+		if(!overflow_block && !critical)
+		{
+			++dropped;
+			return false;
+		}
+
+		// Blocking drains the ring on this thread unless the writer is
+		// already at it.
+		wake();
+		std::unique_lock lock
+		{
+			mutex, std::try_to_lock
+		};
+
+		if(lock.owns_lock())
+			drain();
+		else
+			std::this_thread::yield();
+	}
+
+	const size_t pending
+	{
+		head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed)
+	};
+
+	if(critical)
+		flush();
+	else if(urgent || pending > (mask + 1) / 2)
+		wake();
+
+	return true;
+}
+
+bool
+ircd::log::async::try_push(const level &lev,
+                           const uint8_t &dest,
+                           const string_view &msg)
+noexcept
+{
+	size_t pos
+	{
+		head.load(std::memory_order_relaxed)
+	};
+
+	for(;;)
+	{
+		auto &rec
+		{
+			ring[pos & mask]
+		};
+
+		const size_t seq
+		{
+			rec.seq.load(std::memory_order_acquire)
+		};
+
+		const ssize_t diff
+		(
+			seq - pos
+		);
+
+		// The slot is still held by the consumer from the last lap.
+		if(diff < 0)
+			return false;
+
+		// Another producer claimed this position; try again from the head.
+		if(diff > 0)
+		{
+			pos = head.load(std::memory_order_relaxed);
+			continue;
+		}
+
+		if(!head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			continue;
+
+		rec.lev = lev;
+		rec.dest = dest;
+		rec.len = copy(rec.buf, msg);
+		rec.seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+}
+
+/// Writes the lines ready at the tail of the ring in batches; each batch
+/// makes one writev(2) for each descriptor with lines in it. The caller
+/// holds the mutex.
+size_t
+ircd::log::async::drain()
+noexcept
+{
+	if(!ring)
+		return 0;
+
+	// Descriptors are stdout, stderr, then the file of each level.
+	static constexpr const size_t targets
+	{
+		2 + num_of<level>()
+	};
+
+	struct ::iovec iov[targets][BATCH_MAX];
+	size_t ret(0), count(BATCH_MAX);
+	while(count == BATCH_MAX)
+	{
+		size_t cnt[targets] {0};
+		const size_t pos
+		{
+			tail.load(std::memory_order_relaxed)
+		};
+
+		for(count = 0; count < BATCH_MAX; ++count)
+		{
+			const auto &rec
+			{
+				ring[(pos + count) & mask]
+			};
+
+			if(rec.seq.load(std::memory_order_acquire) != pos + count + 1)
+				break;
+
+			const struct ::iovec line
+			{
+				const_cast<char *>(rec.buf), rec.len
+			};
+
+			if(rec.dest & STDOUT)
+				iov[0][cnt[0]++] = line;
+
+			if(rec.dest & STDERR)
+				iov[1][cnt[1]++] = line;
+
+			if(rec.dest & FILE)
+				iov[2 + rec.lev][cnt[2 + rec.lev]++] = line;
+		}
+
+		for(size_t i(0); i < targets; ++i)
+			if(cnt[i])
+				write(i == 0? STDOUT_FILENO: i == 1? STDERR_FILENO: int(file[i - 2]), iov[i], cnt[i]);
+
+		// Release the slots to the producers for the next lap.
+		for(size_t i(0); i < count; ++i)
+			ring[(pos + i) & mask].seq.store(pos + i + mask + 1, std::memory_order_release);
+
+		tail.store(pos + count, std::memory_order_relaxed);
+		batches += bool(count);
+		ret += count;
+	}
+
+	return ret;
+}
+
+/// Errors aren't reported; there's nowhere left to report them. The iovecs
+/// are consumed.
+void
+ircd::log::async::write(const int &fd,
+                        struct ::iovec *iov,
+                        size_t cnt)
+noexcept
+{
+	while(cnt)
+	{
+		ssize_t ret
+		{
+			::writev(fd, iov, cnt)
+		};
+
+		if(ret < 0 && errno == EINTR)
+			continue;
+
+		if(ret <= 0)
+			return;
+
+		for(; cnt && size_t(ret) >= iov->iov_len; ++iov, --cnt)
+			ret -= iov->iov_len;
+
+		if(cnt)
+		{
+			iov->iov_base = static_cast<char *>(iov->iov_base) + ret;
+			iov->iov_len -= ret;
+		}
+	}
+}
+
 //
 // ircd::log util
 //
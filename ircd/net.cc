@@ -567,6 +567,13 @@ ircd::net::wait(socket &socket,
 	socket.wait(wait_opts, std::move(callback));
 }
 
+bool
+ircd::net::cancel(socket &socket)
+noexcept
+{
+	return socket.cancel();
+}
+
 ircd::string_view
 ircd::net::reflect(const ready &type)
 {
@@ -1296,6 +1303,9 @@ ircd::net::socket::handshake(const open_opts &opts,
 	if(opts.send_sni && server_name(opts))
 		openssl::server_name(*this, server_name(opts));
 
+	if(!empty(opts.alpn))
+		openssl::alpn(*this, opts.alpn);
+
 	ssl.set_verify_callback(std::move(verify_handler));
 	ssl.async_handshake(handshake_type::client, ios::handle(desc, std::move(handshake_handler)));
 }
@@ -2226,6 +2236,9 @@ noexcept try
 	if(!ec)
 		blocking(*this, false);
 
+	if(!ec)
+		strlcpy(alpn, openssl::alpn(*this));
+
 	// This is the end of the asynchronous call chain; the user is called
 	// back with or without error here.
 	call_user(callback, ec);
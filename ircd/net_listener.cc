@@ -233,6 +233,15 @@ ircd::net::acceptor::timeout
 	{ "default",  12000L                      },
 };
 
+/// Offer HTTP/2 to clients which propose it with ALPN; the client is given
+/// the first of h2 and http/1.1 it proposed.
+decltype(ircd::net::acceptor::http2_enable)
+ircd::net::acceptor::http2_enable
+{
+	{ "name",     "ircd.net.acceptor.http2.enable" },
+	{ "default",  false                            },
+};
+
 /// The number of simultaneous handshakes we conduct across all clients.
 decltype(ircd::net::acceptor::handshaking_max)
 ircd::net::acceptor::handshaking_max
@@ -851,9 +860,8 @@ ircd::net::acceptor::handle_alpn(socket &socket,
 	}
 	#endif IRCD_NET_ACCEPTOR_DEBUG_ALPN
 
-	//NOTE: proto == "h2" condition goes here
 	for(const auto &proto : in)
-		if(proto == "http/1.1")
+		if(proto == "http/1.1" || (proto == "h2" && http2_enable))
 		{
 			strlcpy(socket.alpn, proto);
 			return proto;
@@ -886,7 +894,7 @@ noexcept try
 	while(i < inlen && p < PROTOS_MAX)
 	{
 		const uint8_t &len(in[i++]);
-		if(unlikely(!len || i + len >= inlen))
+		if(unlikely(!len || i + len > inlen))
 			break;
 
 		protos[p++] = ircd::string_view
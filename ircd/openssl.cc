@@ -96,6 +96,48 @@ ircd::openssl::server_name(const SSL &ssl)
 	return ::SSL_get_servername(&ssl, type);
 }
 
+//
+// ALPN
+//
+
+void
+ircd::openssl::alpn(SSL &ssl,
+                    const vector_view<const string_view> &protos)
+{
+	size_t len(0);
+	unsigned char buf[256];
+	for(const auto &proto : protos)
+	{
+		if(unlikely(empty(proto) || size(proto) > 255 || len + 1 + size(proto) > sizeof(buf)))
+			throw error
+			{
+				"Invalid ALPN protocol list."
+			};
+
+		buf[len++] = size(proto);
+		len += copy(mutable_buffer{reinterpret_cast<char *>(buf + len), size(proto)}, proto);
+	}
+
+	// Unlike the rest of the API this returns zero on success.
+	if(unlikely(::SSL_set_alpn_protos(&ssl, buf, len) != 0))
+		throw error
+		{
+			"Failed to set ALPN protocol list."
+		};
+}
+
+ircd::string_view
+ircd::openssl::alpn(const SSL &ssl)
+{
+	uint len(0);
+	const unsigned char *data(nullptr);
+	::SSL_get0_alpn_selected(&ssl, &data, &len);
+	return string_view
+	{
+		reinterpret_cast<const char *>(data), len
+	};
+}
+
 //
 // Cipher suite
 //
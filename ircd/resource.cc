@@ -385,7 +385,7 @@ ircd::resource::method::method(struct resource &resource,
 }
 ,stats
 {
-	std::make_unique<struct stats>()
+	std::make_unique<struct stats>(*this)
 }
 ,methods_it{[this, &name]
 {
@@ -447,6 +447,11 @@ try
 		stats->pending
 	};
 
+	const ircd::stats::histogram::timer usec
+	{
+		stats->usec
+	};
+
 	// Bail out if the method limited the amount of content and it was exceeded.
 	if(!content_length_acceptable(head))
 		throw http::error
@@ -474,12 +479,26 @@ try
 
 	const net::scope_timeout timeout
 	{
-		*client.sock, method_timeout, [this, &client]
-		(const bool &timed_out)
-		{
-			if(timed_out)
-				this->handle_timeout(client);
-		}
+		client.stream?
+			net::scope_timeout{}:
+			net::scope_timeout
+			{
+				*client.sock, method_timeout, [this, &client]
+				(const bool &timed_out)
+				{
+					if(timed_out)
+						this->handle_timeout(client);
+				}
+			}
+	};
+
+	// The socket of an HTTP/2 stream is shared with the other streams; its
+	// timer isn't ours to set. The session enforces this deadline instead.
+	const scope_restore deadline
+	{
+		client.deadline, client.stream && method_timeout >= 0s?
+			now<steady_point>() + method_timeout:
+			steady_point{}
 	};
 
 	// Content that hasn't yet arrived is remaining
@@ -683,6 +702,46 @@ const
 	return head.content_length <= payload_max;
 }
 
+//
+// method::stats
+//
+
+ircd::resource::method::stats::stats(const method &method)
+:usec{[&method]
+{
+	assert(method.resource);
+	// The path is truncated to keep the name within stats::NAME_MAX_LEN.
+	char buf[128];
+	const string_view name
+	{
+		fmt::sprintf
+		{
+			buf, "ircd.resource.%s.%s.usec",
+			trunc(method.resource->path, 96),
+			trunc(method.name, 8),
+		}
+	};
+
+	const json::members labels
+	{
+		{ "path",    method.resource->path },
+		{ "method",  method.name           },
+	};
+
+	return ircd::stats::item<ircd::stats::histogram>
+	{
+		json::members
+		{
+			{ "name",    name                                       },
+			{ "family",  "ircd.resource.method.usec"                },
+			{ "desc",    "Time in microseconds to handle requests." },
+			{ "labels",  labels                                     },
+		}
+	};
+}()}
+{
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // resource/response.h
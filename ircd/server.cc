@@ -12,6 +12,7 @@ namespace ircd::server
 {
 	// Internal state
 	ctx::dock dock;     // internal semaphore
+	extern const string_view link_alpn[2];
 
 	// Internal util
 	template<class F> static size_t accumulate_peers(F&&);
@@ -662,6 +663,12 @@ ircd::server::peer::link_max_default
 decltype(ircd::server::peer::ids)
 ircd::server::peer::ids;
 
+decltype(ircd::server::link_alpn)
+ircd::server::link_alpn
+{
+	"h2", "http/1.1"
+};
+
 //
 // peer::peer
 //
@@ -693,6 +700,10 @@ ircd::server::peer::peer(const net::hostport &hostport,
 	// Cert verify this name.
 	this->open_opts.common_name = host(canon);
 
+	// Offer HTTP/2; links fall back to HTTP/1.1 unless the remote selects it.
+	if(link::http2_enable)
+		this->open_opts.alpn = link_alpn;
+
 	if(rfc3986::valid(std::nothrow, rfc3986::parser::ip_address, host(canon)))
 		this->remote =
 		{
@@ -1220,7 +1231,7 @@ ircd::server::peer::disperse_uncommitted(link &link)
 		}
 
 		submit(*tag.request);
-		it = queue.erase(it);
+		it = link.h2_erase(it);
 	}
 	catch(const std::exception &e)
 	{
@@ -1233,7 +1244,7 @@ ircd::server::peer::disperse_uncommitted(link &link)
 			e.what()
 		};
 
-		it = queue.erase(it);
+		it = link.h2_erase(it);
 	}
 }
 
@@ -1821,6 +1832,20 @@ ircd::server::link::tag_commit_max_default
 	{ "default",  3L                                }
 };
 
+decltype(ircd::server::link::http2_enable)
+ircd::server::link::http2_enable
+{
+	{ "name",     "ircd.server.link.http2.enable" },
+	{ "default",  false                           },
+};
+
+decltype(ircd::server::link::http2_tag_commit_max)
+ircd::server::link::http2_tag_commit_max
+{
+	{ "name",     "ircd.server.link.http2.tag_commit_max" },
+	{ "default",  256L                                    },
+};
+
 decltype(ircd::server::link::ids)
 ircd::server::link::ids;
 
@@ -1908,7 +1933,7 @@ ircd::server::link::submit(request &request)
 void
 ircd::server::link::cancel_all(std::exception_ptr eptr)
 {
-	for(auto it(begin(queue)); it != end(queue); it = queue.erase(it))
+	for(auto it(begin(queue)); it != end(queue); it = h2_erase(it))
 	{
 		auto &tag{*it};
 		if(!tag.request)
@@ -1921,7 +1946,7 @@ ircd::server::link::cancel_all(std::exception_ptr eptr)
 void
 ircd::server::link::cancel_committed(std::exception_ptr eptr)
 {
-	for(auto it(begin(queue)); it != end(queue); it = queue.erase(it))
+	for(auto it(begin(queue)); it != end(queue); it = h2_erase(it))
 	{
 		auto &tag{*it};
 		if(!tag.request)
@@ -1948,7 +1973,7 @@ ircd::server::link::cancel_uncommitted(std::exception_ptr eptr)
 		}
 
 		tag.set_exception(eptr);
-		it = queue.erase(it);
+		it = h2_erase(it);
 	}
 }
 
@@ -1959,6 +1984,16 @@ ircd::server::link::cleanup_canceled()
 	for(auto it(begin(queue)); it != end(queue); )
 	{
 		const auto &tag{*it};
+
+		// Streams are independent; a canceled stream is reset without
+		// disrupting the others on the connection.
+		if(h2 && tag.committed() && tag.canceled())
+		{
+			h2->reset(tag.state.stream);
+			it = h2_erase(it);
+			continue;
+		}
+
 		if(tag.committed() || tag.request)
 		{
 			dead += tag.committed() && tag.canceled();
@@ -1975,9 +2010,12 @@ ircd::server::link::cleanup_canceled()
 		};
 		#endif
 
-		it = queue.erase(it);
+		it = h2_erase(it);
 	}
 
+	if(h2 && !empty(h2->pending()) && ready())
+		wait_writable();
+
 	// If every committed tag in the pipe is canceled we can close this link
 	// to quickly disperse any queued tags to another link or simply kill this
 	// link if it's timing out.
@@ -2036,6 +2074,9 @@ ircd::server::link::handle_open(std::exception_ptr eptr)
 	op_init = false;
 	synack_ts = time<seconds>();
 
+	if(!eptr && !op_fini && string_view{socket->alpn} == "h2")
+		h2_open();
+
 	if(!eptr && !op_fini)
 		wait_writable();
 
@@ -2152,6 +2193,9 @@ void
 ircd::server::link::handle_writable_success()
 {
 	assert(socket);
+	if(h2)
+		return h2_writable();
+
 	auto it(begin(queue));
 	while(it != end(queue))
 	{
@@ -2340,6 +2384,9 @@ void
 ircd::server::link::handle_readable_success()
 {
 	assert(socket);
+	if(h2)
+		return h2_readable();
+
 	if(!tag_committed())
 	{
 		discard_read();
@@ -2560,6 +2607,502 @@ ircd::server::link::discard_read()
 	};
 }
 
+//
+// link::h2
+//
+// An HTTP/2 link carries its tags as concurrent streams. The request head
+// composed by the user for HTTP/1.1 is translated to a header block; the
+// response is translated back to HTTP/1.1 as it's received so the tag reads
+// it exactly as it would off an HTTP/1.1 socket. Responses without a
+// content-length are given to the tag in chunked encoding.
+//
+
+void
+ircd::server::link::h2_open()
+{
+	h2_handlers.headers = std::bind(&link::h2_handle_headers, this, ph::_1, ph::_2, ph::_3);
+	h2_handlers.data = std::bind(&link::h2_handle_data, this, ph::_1, ph::_2, ph::_3);
+	h2_handlers.reset = std::bind(&link::h2_handle_reset, this, ph::_1, ph::_2);
+	h2_handlers.goaway = std::bind(&link::h2_handle_goaway, this, ph::_1, ph::_2);
+	h2_handlers.window = std::bind(&link::wait_writable, this);
+	h2 = std::make_unique<http2::connection>(false, h2_handlers);
+
+	log::debug
+	{
+		log, "%s negotiated HTTP/2",
+		loghead(*this),
+	};
+
+	// Frames arrive from the remote independently of our requests.
+	wait_readable();
+}
+
+void
+ircd::server::link::h2_readable()
+try
+{
+	assert(h2);
+	char buf[16_KiB];
+	for(const_buffer view(read(buf)); !empty(view) && !op_fini; view = read(buf))
+		h2->read(view);
+
+	h2_flush();
+	if(op_fini)
+		return;
+
+	// Once the remote has gone away the link closes after the last stream.
+	if(h2->goaway_recv && !tag_committed())
+	{
+		close();
+		return;
+	}
+
+	if(queue.empty())
+	{
+		assert(peer);
+		peer->handle_link_done(*this);
+		return;
+	}
+
+	wait_readable();
+}
+catch(const http2::error &e)
+{
+	// The GOAWAY has been queued; give it a chance to leave before the
+	// link is closed by the error handler.
+	const const_buffer pending
+	{
+		h2->pending()
+	};
+
+	if(!empty(pending) && !op_fini)
+		write_any(*socket, pending);
+
+	throw;
+}
+
+void
+ircd::server::link::h2_writable()
+{
+	assert(h2);
+	auto it(begin(queue));
+	while(it != end(queue))
+	{
+		auto &tag{*it};
+		if((tag.abandoned() || tag.canceled()) && !tag.committed())
+		{
+			it = h2_erase(it);
+			continue;
+		}
+
+		if(tag.canceled())
+		{
+			h2->reset(tag.state.stream);
+			it = h2_erase(it);
+			continue;
+		}
+
+		const bool open
+		{
+			tag.committed() ||
+			(h2->acceptable() && tag_committed() < tag_commit_max())
+		};
+
+		if(open && tag.write_remaining())
+			h2_write(tag);
+
+		if(tag.state.stream)
+			h2_streams.emplace(tag.state.stream, it);
+
+		++it;
+	}
+
+	h2_flush();
+}
+
+void
+ircd::server::link::h2_write(tag &tag)
+{
+	assert(tag.request);
+	if(!tag.committed())
+	{
+		tag.state.stream = h2->open();
+		log::debug
+		{
+			request::log, "%s wt:%zu on %s stream:%u",
+			loghead(*tag.request),
+			tag.write_size(),
+			loghead(*this),
+			tag.state.stream,
+		};
+
+		h2_send_headers(tag);
+	}
+
+	// The content is sent as the flow control windows allow; the window
+	// handler makes the link writable again when they open.
+	const const_buffer content
+	{
+		tag.make_write_buffer()
+	};
+
+	if(empty(content))
+		return;
+
+	const size_t sent
+	{
+		h2->data(tag.state.stream, content, true)
+	};
+
+	if(sent)
+		tag.wrote_buffer(const_buffer{content, sent});
+}
+
+/// Translate the HTTP/1.1 request head into the stream's header block.
+void
+ircd::server::link::h2_send_headers(tag &tag)
+{
+	assert(tag.request);
+	const const_buffer &out_head
+	{
+		tag.request->out.head
+	};
+
+	size_t count(4);
+	http::header headers[64];
+	parse::buffer pb{mutable_buffer{const_cast<char *>(data(out_head)), size(out_head)}};
+	parse::capstan pc{pb};
+	pc.read += size(out_head);
+	const http::request::head head
+	{
+		pc, [&headers, &count](const http::header &header)
+		{
+			static const string_view specific[]
+			{
+				"host", "connection", "keep-alive", "proxy-connection",
+				"transfer-encoding", "upgrade", "te",
+			};
+
+			const bool skip
+			{
+				std::any_of(std::begin(specific), std::end(specific), [&header]
+				(const string_view &name)
+				{
+					return iequals(name, header.first);
+				})
+			};
+
+			if(skip)
+				return;
+
+			if(unlikely(count >= std::size(headers)))
+				throw error
+				{
+					"Too many headers for HTTP/2 request."
+				};
+
+			headers[count++] = header;
+		}
+	};
+
+	headers[0] = { ":method",     head.method   };
+	headers[1] = { ":scheme",     "https"       };
+	headers[2] = { ":authority",  head.host     };
+	headers[3] = { ":path",       head.uri      };
+
+	const bool eos
+	{
+		empty(tag.request->out.content)
+	};
+
+	h2->headers(tag.state.stream, {headers, count}, eos);
+	tag.wrote_buffer(out_head);
+}
+
+void
+ircd::server::link::h2_flush()
+{
+	assert(h2);
+	const const_buffer pending
+	{
+		h2->pending()
+	};
+
+	if(empty(pending) || op_fini)
+		return;
+
+	const const_buffer written
+	{
+		process_write_next(pending)
+	};
+
+	h2->wrote(size(written));
+	if(!empty(h2->pending()))
+		wait_writable();
+}
+
+void
+ircd::server::link::h2_handle_goaway(const uint32_t &last_id,
+                                     const enum http2::error::code &code)
+{
+	log::dwarning
+	{
+		log, "%s GOAWAY last stream:%u :%s",
+		loghead(*this),
+		last_id,
+		http2::reflect(code),
+	};
+
+	// Streams after the last one were not processed by the remote; they're
+	// safe to retry on another link.
+	for(auto &tag : queue)
+		if(tag.state.stream > last_id && tag.state.status == http::code(0))
+		{
+			tag.state.written = 0;
+			tag.state.stream = 0;
+		}
+
+	exclude = true;
+	assert(peer);
+	peer->disperse_uncommitted(*this);
+}
+
+void
+ircd::server::link::h2_handle_reset(http2::stream &stream,
+                                    const enum http2::error::code &code)
+{
+	const auto it
+	{
+		h2_find(stream.id)
+	};
+
+	if(it == end(queue))
+		return;
+
+	auto &tag{*it};
+
+	// The remote didn't process the request; it's sent again once there's
+	// room for another stream.
+	if(code == http2::error::REFUSED_STREAM && tag.state.status == http::code(0) && !tag.canceled())
+	{
+		h2_streams.erase(tag.state.stream);
+		tag.state.written = 0;
+		tag.state.stream = 0;
+		wait_writable();
+		return;
+	}
+
+	tag.set_exception<http2::error>
+	(
+		code, "Stream %u reset by remote :%s",
+		stream.id,
+		http2::reflect(code)
+	);
+
+	h2_erase(it);
+}
+
+void
+ircd::server::link::h2_handle_data(http2::stream &stream,
+                                   const const_buffer &buf,
+                                   const bool &eos)
+{
+	const auto it
+	{
+		h2_find(stream.id)
+	};
+
+	if(it == end(queue))
+		return;
+
+	auto &tag{*it};
+	bool done{false};
+	try
+	{
+		char head[24];
+		if(tag.state.rechunk && !empty(buf))
+			h2_feed(tag, string_view{fmt::sprintf{head, "%zx\r\n", size(buf)}}, done);
+
+		h2_feed(tag, buf, done);
+		if(tag.state.rechunk && !empty(buf))
+			h2_feed(tag, "\r\n"_sv, done);
+	}
+	catch(const std::exception &e)
+	{
+		tag.set_exception(std::current_exception());
+		h2->reset(stream.id);
+		h2_erase(it);
+		return;
+	}
+
+	h2_done(it, eos, done);
+}
+
+void
+ircd::server::link::h2_handle_headers(http2::stream &stream,
+                                      const http2::connection::headers_view &headers,
+                                      const bool &eos)
+{
+	const auto it
+	{
+		h2_find(stream.id)
+	};
+
+	if(it == end(queue))
+		return;
+
+	auto &tag{*it};
+	bool done{false};
+	try
+	{
+		// Trailers are dropped; the end of the stream is all that matters.
+		if(tag.state.status != http::code(0))
+			return h2_done(it, eos, done);
+
+		string_view status;
+		bool content_length{false};
+		for(const auto &[name, value] : headers)
+		{
+			status = name == ":status"? value: status;
+			content_length |= name == "content-length";
+		}
+
+		if(unlikely(size(status) != 3))
+			throw http2::error
+			{
+				http2::error::PROTOCOL_ERROR, "Response on stream %u without status.",
+				stream.id,
+			};
+
+		// Informational responses precede the actual response.
+		if(status[0] == '1' && !eos)
+			return;
+
+		const auto code
+		{
+			http::code(lex_cast<ushort>(status))
+		};
+
+		std::string head;
+		head.reserve(512);
+		head += "HTTP/1.1 ";
+		head += status;
+		head += ' ';
+		head += http::status(code);
+		head += "\r\n";
+		for(const auto &[name, value] : headers)
+		{
+			if(startswith(name, ':'))
+				continue;
+
+			head += name;
+			head += ": ";
+			head += value;
+			head += "\r\n";
+		}
+
+		tag.state.rechunk = !content_length && !eos;
+		if(!content_length && eos)
+			head += "content-length: 0\r\n";
+		else if(tag.state.rechunk)
+			head += "transfer-encoding: chunked\r\n";
+
+		head += "\r\n";
+		h2_feed(tag, string_view{head}, done);
+	}
+	catch(const std::exception &e)
+	{
+		tag.set_exception(std::current_exception());
+		h2->reset(stream.id);
+		h2_erase(it);
+		return;
+	}
+
+	h2_done(it, eos, done);
+}
+
+void
+ircd::server::link::h2_done(decltype(queue)::iterator it,
+                            const bool &eos,
+                            bool &done)
+{
+	auto &tag{*it};
+	if(eos && !done && tag.state.rechunk)
+		h2_feed(tag, "0\r\n\r\n"_sv, done);
+
+	if(eos && !done)
+	{
+		tag.set_exception<http2::error>
+		(
+			http2::error::PROTOCOL_ERROR, "Stream %u ended before the content.",
+			tag.state.stream
+		);
+
+		h2_erase(it);
+		return;
+	}
+
+	if(!done)
+		return;
+
+	assert(peer);
+	peer->handle_tag_done(*this, tag);
+	h2_erase(it);
+	++tag_done;
+}
+
+/// Give the tag a buffer of the translated response as if it was read from
+/// the socket.
+void
+ircd::server::link::h2_feed(tag &tag,
+                            const_buffer in,
+                            bool &done)
+{
+	while(!empty(in) && !done)
+	{
+		const mutable_buffer buf
+		{
+			tag.make_read_buffer()
+		};
+
+		const size_t copied
+		{
+			copy(buf, in)
+		};
+
+		if(unlikely(!copied))
+			throw buffer_overrun
+			{
+				"No buffer to receive stream %u", tag.state.stream
+			};
+
+		consume(in, copied);
+		tag.read_buffer(const_buffer{buf, copied}, done, *this);
+	}
+}
+
+decltype(ircd::server::link::queue)::iterator
+ircd::server::link::h2_find(const uint32_t &stream)
+{
+	const auto it
+	{
+		h2_streams.find(stream)
+	};
+
+	return it != end(h2_streams)? it->second: end(queue);
+}
+
+/// Tags leave the queue here so the index of streams never refers to an
+/// erased tag.
+decltype(ircd::server::link::queue)::iterator
+ircd::server::link::h2_erase(decltype(queue)::iterator it)
+{
+	if(it->state.stream)
+		h2_streams.erase(it->state.stream);
+
+	return queue.erase(it);
+}
+
 size_t
 ircd::server::link::tag_uncommitted()
 const
@@ -2693,6 +3236,13 @@ size_t
 ircd::server::link::tag_commit_max()
 const
 {
+	if(h2)
+		return std::min
+		(
+			size_t(http2_tag_commit_max),
+			size_t(h2->theirs[http2::settings::code::MAX_CONCURRENT_STREAMS])
+		);
+
 	return tag_commit_max_default;
 }
 
@@ -4179,7 +4729,10 @@ const
 	};
 
 	assert(remaining <= state.content_length);
-	thread_local char buffer[512];
+
+	// Sized for users streaming truncated content through the progress
+	// callback rather than discarding it.
+	thread_local char buffer[32_KiB];
 	const size_t buffer_max
 	{
 		std::min(remaining, sizeof(buffer))
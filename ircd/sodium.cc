@@ -230,6 +230,65 @@ const
 	};
 }
 
+/// Batch verification. libsodium offers no multi-scalar batch equation, so
+/// the tuples are verified singly; what's amortized is the round trip to the
+/// offload threads, which divide the tuples between them when called on a
+/// context with a concurrency greater than one. Each tuple is verified once;
+/// the indexes of the invalid tuples are written to the output in ascending
+/// order, truncated to its capacity.
+ircd::vector_view<size_t>
+ircd::ed25519::verify_batch(const vector_view<size_t> &failed,
+                            const vector_view<const pk> &pks,
+                            const vector_view<const const_buffer> &msgs,
+                            const vector_view<const sig> &sigs,
+                            const size_t &concurrency)
+{
+	assert(pks.size() == msgs.size());
+	assert(pks.size() == sigs.size());
+	const size_t num
+	{
+		std::min({pks.size(), msgs.size(), sigs.size()})
+	};
+
+	// Each result is written by the one thread which took its index.
+	std::vector<char> valid(num, false);
+	std::atomic<size_t> next {0};
+	const auto func{[&pks, &msgs, &sigs, &num, &valid, &next]
+	{
+		for(size_t i(next++); i < num; i = next++) try
+		{
+			valid[i] = pks[i].verify(msgs[i], sigs[i]);
+		}
+		catch(const nacl::error &)
+		{
+			continue;
+		}
+	}};
+
+	if(ctx::current && concurrency > 1 && num > 1)
+	{
+		ctx::ole::opts opts;
+		opts.name = "ed25519.verify";
+		opts.concurrency = std::min(concurrency, num);
+		opts.threads = concurrency;
+		ctx::offload
+		{
+			opts, func
+		};
+	}
+	else func();
+
+	size_t ret(0);
+	for(size_t i(0); i < num && ret < failed.size(); ++i)
+		if(!valid[i])
+			failed[ret++] = i;
+
+	return vector_view<size_t>
+	{
+		failed.data(), ret
+	};
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Internal
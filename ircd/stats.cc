@@ -70,6 +70,23 @@ ircd::stats::string(const mutable_buffer &buf,
 			buf, "%u", *item.val
 		};
 	}
+	else if(item_.type == typeid(histogram))
+	{
+		const auto &item
+		{
+			dynamic_cast<const stats::item<histogram> &>(item_)
+		};
+
+		return fmt::sprintf
+		{
+			buf, "count:%lu sum:%lu p50:%lu p90:%lu p99:%lu",
+			item.val.count.load(std::memory_order_relaxed),
+			item.val.sum.load(std::memory_order_relaxed),
+			item.val.quantile(0.50),
+			item.val.quantile(0.90),
+			item.val.quantile(0.99),
+		};
+	}
 	else throw error
 	{
 		"Unsupported value type '%s'",
@@ -261,3 +278,72 @@ ircd::stats::item<uint16_t>::item(const json::members &feature)
 }
 {
 }
+
+//
+// item<histogram>
+//
+
+ircd::stats::item<ircd::stats::histogram>::item(const json::members &feature)
+:item<void>
+{
+	typeid(histogram), feature
+}
+{
+}
+
+//
+// histogram
+//
+
+/// Estimate of the value at quantile q (0.0 to 1.0) by interpolating within
+/// the bucket where it falls. The last bucket reports its lower bound.
+uint64_t
+ircd::stats::histogram::quantile(const double &q)
+const noexcept
+{
+	const uint64_t total
+	{
+		count.load(std::memory_order_relaxed)
+	};
+
+	if(!total)
+		return 0;
+
+	const uint64_t rank
+	(
+		std::max(std::ceil(q * total), 1.0)
+	);
+
+	uint64_t cum(0);
+	for(size_t i(0); i < BUCKETS; ++i)
+	{
+		const uint64_t num
+		{
+			bucket[i].load(std::memory_order_relaxed)
+		};
+
+		if(cum + num < rank)
+		{
+			cum += num;
+			continue;
+		}
+
+		const uint64_t min
+		{
+			i? bucket_max(i - 1) + 1: 0UL
+		};
+
+		if(i == BUCKETS - 1)
+			return min;
+
+		const double frac
+		(
+			double(rank - cum) / num
+		);
+
+		return min + uint64_t(frac * (bucket_max(i) - min));
+	}
+
+	// The count was observed ahead of the buckets.
+	return bucket_max(BUCKETS - 2);
+}
@@ -118,6 +118,7 @@ ircd::m::dbs::init::init(const string_view &servername,
 	event_idx = db::column{*events, desc::event_idx.name};
 	event_json = db::column{*events, desc::event_json.name};
 	event_refs = db::domain{*events, desc::event_refs.name};
+	event_chain = db::domain{*events, desc::event_chain.name};
 	event_horizon = db::domain{*events, desc::event_horizon.name};
 	event_sender = db::domain{*events, desc::event_sender.name};
 	event_type = db::domain{*events, desc::event_type.name};
@@ -126,6 +127,7 @@ ircd::m::dbs::init::init(const string_view &servername,
 	room_events = db::domain{*events, desc::room_events.name};
 	room_type = db::domain{*events, desc::room_type.name};
 	room_joined = db::domain{*events, desc::room_joined.name};
+	room_terms = db::domain{*events, desc::room_terms.name};
 	room_state = db::domain{*events, desc::room_state.name};
 	room_state_space = db::domain{*events, desc::room_state_space.name};
 }
@@ -283,6 +285,9 @@ ircd::m::dbs::_index_event(db::txn &txn,
 	if(opts.appendix.test(appendix::EVENT_REFS) && opts.event_refs.any())
 		_index_event_refs(txn, event, opts);
 
+	if(opts.appendix.test(appendix::EVENT_CHAIN))
+		_index_event_chain(txn, event, opts);
+
 	if(opts.appendix.test(appendix::EVENT_HORIZON_RESOLVE) && opts.horizon_resolve.any())
 		_index_event_horizon_resolve(txn, event, opts);
 }
@@ -318,6 +323,9 @@ ircd::m::dbs::_index_room(db::txn &txn,
 			_index_room_joined(txn, event, opts);
 	}
 
+	if(opts.appendix.test(appendix::ROOM_TERMS))
+		_index_room_terms(txn, event, opts);
+
 	if(opts.appendix.test(appendix::ROOM_REDACT) && json::get<"type"_>(event) == "m.room.redaction")
 		_index_room_redact(txn, event, opts);
 }
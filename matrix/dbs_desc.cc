@@ -489,6 +489,10 @@ ircd::m::dbs::desc::events
 	// Reverse mapping of the event reference graph.
 	event_refs,
 
+	// chain | event_idx || chain | chain_id, seq
+	// Auth-chain cover positions and links of state events.
+	event_chain,
+
 	// event_idx | event_idx
 	// Mapping of unresolved event refs.
 	event_horizon,
@@ -517,6 +521,10 @@ ircd::m::dbs::desc::events
 	// Sequence of all PRESENTLY JOINED joined for a room.
 	room_joined,
 
+	// (room_id, (term, block)) => (postings)
+	// Inverted index of the words of the room.
+	room_terms,
+
 	// (room_id, (type, state_key)) => (event_idx)
 	// Sequence of the PRESENT STATE of the room.
 	room_state,
@@ -0,0 +1,526 @@
+// The Construct
+//
+// Copyright (C) The Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2020 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+namespace ircd::m::dbs
+{
+	static bool _event_chain_tail(const chain_pos &, const write_opts &); //query
+	static bool _event_chain_cell(const event &, const event::idx &); //query
+	static void _index_event_chain_del(db::txn &, const event &, const write_opts &); //query
+	static bool event_chain__cmp_less(const string_view &a, const string_view &b);
+}
+
+decltype(ircd::m::dbs::event_chain)
+ircd::m::dbs::event_chain;
+
+decltype(ircd::m::dbs::desc::event_chain__block__size)
+ircd::m::dbs::desc::event_chain__block__size
+{
+	{ "name",     "ircd.m.dbs._event_chain.block.size" },
+	{ "default",  512L                                 },
+};
+
+decltype(ircd::m::dbs::desc::event_chain__meta_block__size)
+ircd::m::dbs::desc::event_chain__meta_block__size
+{
+	{ "name",     "ircd.m.dbs._event_chain.meta_block.size" },
+	{ "default",  512L                                      },
+};
+
+decltype(ircd::m::dbs::desc::event_chain__cache__size)
+ircd::m::dbs::desc::event_chain__cache__size
+{
+	{
+		{ "name",     "ircd.m.dbs._event_chain.cache.size" },
+		{ "default",  long(16_MiB)                         },
+	}, []
+	{
+		const size_t &value{event_chain__cache__size};
+		db::capacity(db::cache(dbs::event_chain), value);
+	}
+};
+
+decltype(ircd::m::dbs::desc::event_chain__cache_comp__size)
+ircd::m::dbs::desc::event_chain__cache_comp__size
+{
+	{
+		{ "name",     "ircd.m.dbs._event_chain.cache_comp.size" },
+		{ "default",  long(0_MiB)                               },
+	}, []
+	{
+		const size_t &value{event_chain__cache_comp__size};
+		db::capacity(db::cache_compressed(dbs::event_chain), value);
+	}
+};
+
+const ircd::db::prefix_transform
+ircd::m::dbs::desc::event_chain__pfx
+{
+	"_event_chain",
+	[](const string_view &key)
+	{
+		return size(key) >= sizeof(event::idx) * 2;
+	},
+
+	[](const string_view &key)
+	{
+		assert(size(key) >= sizeof(event::idx));
+		return string_view
+		{
+			data(key), data(key) + sizeof(event::idx)
+		};
+	}
+};
+
+const ircd::db::comparator
+ircd::m::dbs::desc::event_chain__cmp
+{
+	"_event_chain",
+	event_chain__cmp_less,
+	std::equal_to<string_view>{},
+};
+
+const ircd::db::descriptor
+ircd::m::dbs::desc::event_chain
+{
+	// name
+	"_event_chain",
+
+	// explanation
+	R"(Auth-chain cover of state events.
+
+	chain | event_idx => chain_id, seq
+	chain | chain_id, seq => event_idx
+	chain | chain_id, seq, chain_id => seq
+
+	Every state event has a position in a chain. A chain is a sequence of
+	events where each event references the previous one in its auth_events;
+	the chain_id is the event_idx of the first event in the chain. An event
+	continues the chain of the auth event for the same (type, state_key) cell
+	when that auth event is the last in its chain; otherwise it starts a
+	new chain. References from an event to auth events in other chains are
+	stored as links.
+
+	The auth chain of an event is every event up to some seq in each chain
+	reachable through the links, starting from the chains of its auth events.
+	These are found with range scans rather than a walk of the auth graph.
+
+	The type of the record is stored in the high order byte of the first
+	integer of the key. The prefix transform is in effect for the first
+	integer of the key.
+
+	)",
+
+	// typing (key, value)
+	{
+		typeid(uint64_t), typeid(string_view)
+	},
+
+	// options
+	{},
+
+	// comparator
+	event_chain__cmp,
+
+	// prefix transform
+	event_chain__pfx,
+
+	// drop column
+	false,
+
+	// cache size
+	bool(cache_enable)? -1 : 0, //uses conf item
+
+	// cache size for compressed assets
+	bool(cache_comp_enable)? -1 : 0,
+
+	// bloom filter bits
+	0,
+
+	// expect queries hit
+	false,
+
+	// block size
+	size_t(event_chain__block__size),
+
+	// meta_block size
+	size_t(event_chain__meta_block__size),
+
+	// compression
+	{}, // no compression for this column
+
+	// compactor
+	{},
+
+	// compaction priority algorithm
+	"kOldestSmallestSeqFirst"s,
+};
+
+//
+// indexer
+//
+
+// NOTE: QUERY
+void
+ircd::m::dbs::_index_event_chain(db::txn &txn,
+                                 const event &event,
+                                 const write_opts &opts)
+{
+	assert(opts.appendix.test(appendix::EVENT_CHAIN));
+
+	// Only state events can be auth events.
+	if(!defined(json::get<"state_key"_>(event)))
+		return;
+
+	if(opts.op != db::op::SET)
+		return _index_event_chain_del(txn, event, opts);
+
+	// When this event was already indexed (i.e. by a rebuild) it is skipped,
+	// otherwise it would be appended to a chain a second time.
+	if(find_event_chain(opts.event_idx, opts).first)
+		return;
+
+	const event::prev prev{event};
+	std::vector<chain_pos> auth_pos;
+	auth_pos.reserve(prev.auth_events_count());
+
+	chain_pos pos {0, 0};
+	for(size_t i(0); i < prev.auth_events_count(); ++i)
+	{
+		const event::id &auth_id
+		{
+			prev.auth_event(i)
+		};
+
+		const event::idx &auth_idx
+		{
+			find_event_idx(auth_id, opts)
+		};
+
+		// The auth event is missing; the chain of this event can't be
+		// produced from the index. Queries for it and for events which
+		// reference it will fall back to walking the auth graph.
+		if(!auth_idx)
+		{
+			log::dwarning
+			{
+				log, "Missing %s AUTH of %s; not indexed.",
+				string_view{auth_id},
+				string_view{event.event_id},
+			};
+
+			return;
+		}
+
+		const auto &auth
+		{
+			find_event_chain(auth_idx, opts)
+		};
+
+		// The auth event is present but not indexed. This event can't be
+		// given a position without losing part of its chain; queries for it
+		// will fall back to walking the auth graph.
+		if(unlikely(!auth.first))
+		{
+			log::dwarning
+			{
+				log, "No chain position for %s AUTH of %s; not indexed.",
+				string_view{auth_id},
+				string_view{event.event_id},
+			};
+
+			return;
+		}
+
+		auth_pos.emplace_back(auth);
+		if(!pos.first && _event_chain_cell(event, auth_idx) && _event_chain_tail(auth, opts))
+			pos = { auth.first, auth.second + 1 };
+	}
+
+	// Start a new chain
+	if(!pos.first)
+		pos = { opts.event_idx, 1 };
+
+	thread_local char buf[EVENT_CHAIN_KEY_MAX_SIZE];
+	const event::idx position[2]
+	{
+		pos.first, pos.second
+	};
+
+	db::txn::append
+	{
+		txn, dbs::event_chain,
+		{
+			opts.op,
+			event_chain_key(buf, chain::POSITION, opts.event_idx),
+			string_view
+			{
+				reinterpret_cast<const char *>(position), sizeof(position)
+			},
+		}
+	};
+
+	db::txn::append
+	{
+		txn, dbs::event_chain,
+		{
+			opts.op,
+			event_chain_key(buf, chain::EVENT, pos.first, pos.second),
+			byte_view<string_view>(opts.event_idx),
+		}
+	};
+
+	for(size_t i(0); i < auth_pos.size(); ++i)
+	{
+		const auto &[chain_id, seq]
+		{
+			auth_pos[i]
+		};
+
+		if(chain_id == pos.first)
+			continue;
+
+		// Only the greatest seq into each other chain is linked.
+		const auto dominated
+		{
+			std::any_of(begin(auth_pos), end(auth_pos), [&](const auto &other)
+			{
+				return other.first == chain_id
+				&& (other.second > seq || (other.second == seq && &other < &auth_pos[i]));
+			})
+		};
+
+		if(dominated)
+			continue;
+
+		db::txn::append
+		{
+			txn, dbs::event_chain,
+			{
+				opts.op,
+				event_chain_key(buf, chain::LINK, pos.first, pos.second, chain_id),
+				byte_view<string_view>(seq),
+			}
+		};
+	}
+}
+
+// NOTE: QUERY
+void
+ircd::m::dbs::_index_event_chain_del(db::txn &txn,
+                                     const event &event,
+                                     const write_opts &opts)
+{
+	const auto pos
+	{
+		find_event_chain(opts.event_idx, opts)
+	};
+
+	if(!pos.first)
+		return;
+
+	thread_local char buf[EVENT_CHAIN_KEY_MAX_SIZE];
+	db::txn::append
+	{
+		txn, dbs::event_chain,
+		{
+			opts.op,
+			event_chain_key(buf, chain::POSITION, opts.event_idx),
+		}
+	};
+
+	db::txn::append
+	{
+		txn, dbs::event_chain,
+		{
+			opts.op,
+			event_chain_key(buf, chain::EVENT, pos.first, pos.second),
+		}
+	};
+}
+
+/// Whether the event at the position is the last in its chain, so the next
+/// event may continue it. Positions appended to the same txn are considered.
+// NOTE: QUERY
+bool
+ircd::m::dbs::_event_chain_tail(const chain_pos &pos,
+                                const write_opts &opts)
+{
+	thread_local char buf[EVENT_CHAIN_KEY_MAX_SIZE];
+	const string_view &key
+	{
+		event_chain_key(buf, chain::EVENT, pos.first, pos.second + 1)
+	};
+
+	if(opts.interpose && opts.interpose->has(db::op::SET, desc::event_chain.name, key))
+		return false;
+
+	if(!opts.allow_queries)
+		return false;
+
+	return !db::has(dbs::event_chain, key);
+}
+
+/// Whether the auth event is a prior state of the same (type, state_key)
+/// cell as the event.
+// NOTE: QUERY
+bool
+ircd::m::dbs::_event_chain_cell(const event &event,
+                                const event::idx &auth_idx)
+{
+	bool ret(false);
+	m::get(std::nothrow, auth_idx, "type", [&event, &ret]
+	(const string_view &type)
+	{
+		ret = type == json::get<"type"_>(event);
+	});
+
+	if(ret)
+		m::get(std::nothrow, auth_idx, "state_key", [&event, &ret]
+		(const string_view &state_key)
+		{
+			ret = state_key == json::get<"state_key"_>(event);
+		});
+
+	return ret;
+}
+
+// NOTE: QUERY
+ircd::m::dbs::chain_pos
+ircd::m::dbs::find_event_chain(const event::idx &event_idx,
+                               const write_opts &wopts)
+{
+	chain_pos ret {0, 0};
+	const auto closure{[&ret]
+	(const string_view &val)
+	{
+		assert(size(val) >= sizeof(event::idx) * 2);
+		const event::idx *const &pos
+		{
+			reinterpret_cast<const event::idx *>(data(val))
+		};
+
+		ret = { pos[0], pos[1] };
+	}};
+
+	thread_local char buf[EVENT_CHAIN_KEY_MAX_SIZE];
+	const string_view &key
+	{
+		event_chain_key(buf, chain::POSITION, event_idx)
+	};
+
+	if(wopts.interpose)
+		wopts.interpose->get(db::op::SET, desc::event_chain.name, key, closure);
+
+	if(wopts.allow_queries && !ret.first)
+		event_chain(key, std::nothrow, closure); // query
+
+	return ret;
+}
+
+bool
+ircd::m::dbs::event_chain__cmp_less(const string_view &a,
+                                    const string_view &b)
+{
+	static const size_t word(sizeof(event::idx));
+	assert(size(a) >= word && size(a) % word == 0);
+	assert(size(b) >= word && size(b) % word == 0);
+	const event::idx *const key[2]
+	{
+		reinterpret_cast<const event::idx *>(data(a)),
+		reinterpret_cast<const event::idx *>(data(b)),
+	};
+
+	const size_t len[2]
+	{
+		size(a) / word,
+		size(b) / word,
+	};
+
+	for(size_t i(0); i < len[0] && i < len[1]; ++i)
+		if(key[0][i] != key[1][i])
+			return key[0][i] < key[1][i];
+
+	return len[0] < len[1];
+}
+
+//
+// key
+//
+
+std::tuple<ircd::m::dbs::chain, ircd::m::event::idx, uint64_t, ircd::m::event::idx>
+ircd::m::dbs::event_chain_key(const string_view &amalgam)
+{
+	assert(size(amalgam) >= sizeof(event::idx));
+	const event::idx *const &key
+	{
+		reinterpret_cast<const event::idx *>(data(amalgam))
+	};
+
+	const size_t len
+	{
+		size(amalgam) / sizeof(event::idx)
+	};
+
+	return
+	{
+		chain(key[0] >> chain_shift),
+		key[0] & ~chain_mask,
+		len > 1? key[1] : 0UL,
+		len > 2? key[2] : 0UL,
+	};
+}
+
+ircd::string_view
+ircd::m::dbs::event_chain_key(const mutable_buffer &out,
+                              const chain &type,
+                              const event::idx &idx,
+                              const uint64_t &seq,
+                              const event::idx &target)
+{
+	assert((idx & chain_mask) == 0);
+	assert(size(out) >= EVENT_CHAIN_KEY_MAX_SIZE);
+	event::idx *const &key
+	{
+		reinterpret_cast<event::idx *>(data(out))
+	};
+
+	const size_t len
+	{
+		type == chain::POSITION? 1UL:
+		type == chain::EVENT?    2UL:
+		                         3UL
+	};
+
+	key[0] = idx;
+	key[0] |= uint64_t(type) << chain_shift;
+	key[1] = seq;
+	key[2] = target;
+	return string_view
+	{
+		data(out), data(out) + sizeof(event::idx) * len
+	};
+}
+
+//
+// util
+//
+
+ircd::string_view
+ircd::m::dbs::reflect(const chain &type)
+{
+	switch(type)
+	{
+		case chain::POSITION:            return "POSITION";
+		case chain::EVENT:               return "EVENT";
+		case chain::LINK:                return "LINK";
+	}
+
+	return "????";
+}
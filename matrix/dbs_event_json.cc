@@ -58,6 +58,23 @@ ircd::m::dbs::desc::event_json__bloom__bits
 	{ "default",  0L                                  },
 };
 
+/// Event JSON repeats the same keys, hashes, signatures and server names
+/// from one event to the next; a dictionary captures these so each small
+/// block doesn't have to.
+decltype(ircd::m::dbs::desc::event_json__compression_dict__size)
+ircd::m::dbs::desc::event_json__compression_dict__size
+{
+	{ "name",     "ircd.m.dbs._event_json.compression.dict.size" },
+	{ "default",  long(16_KiB)                                   },
+};
+
+decltype(ircd::m::dbs::desc::event_json__compression_dict__train)
+ircd::m::dbs::desc::event_json__compression_dict__train
+{
+	{ "name",     "ircd.m.dbs._event_json.compression.dict.train" },
+	{ "default",  long(1_MiB + 512_KiB)                           },
+};
+
 const ircd::db::descriptor
 ircd::m::dbs::desc::event_json
 {
@@ -107,7 +124,7 @@ ircd::m::dbs::desc::event_json
 	size_t(event_json__meta_block__size),
 
 	// compression
-	"kLZ4Compression;kSnappyCompression"s,
+	"kZSTD;kLZ4Compression;kSnappyCompression"s,
 
 	// compactor
 	{},
@@ -132,6 +149,15 @@ ircd::m::dbs::desc::event_json
 		{      0L,   15L }, // max_bytes_for_level[5]
 		{      0L,   31L }, // max_bytes_for_level[6]
 	},
+
+	// compaction_period
+	60s * 60 * 24 * 21,
+
+	// compression_dict
+	{
+		size_t(event_json__compression_dict__size),
+		size_t(event_json__compression_dict__train),
+	},
 };
 
 //
@@ -0,0 +1,258 @@
+// The Construct
+//
+// Copyright (C) The Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2020 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+decltype(ircd::m::dbs::room_terms)
+ircd::m::dbs::room_terms;
+
+decltype(ircd::m::dbs::desc::room_terms__block__size)
+ircd::m::dbs::desc::room_terms__block__size
+{
+	{ "name",     "ircd.m.dbs._room_terms.block.size" },
+	{ "default",  long(16_KiB)                        },
+};
+
+decltype(ircd::m::dbs::desc::room_terms__meta_block__size)
+ircd::m::dbs::desc::room_terms__meta_block__size
+{
+	{ "name",     "ircd.m.dbs._room_terms.meta_block.size" },
+	{ "default",  long(4_KiB)                              },
+};
+
+decltype(ircd::m::dbs::desc::room_terms__cache__size)
+ircd::m::dbs::desc::room_terms__cache__size
+{
+	{
+		{ "name",     "ircd.m.dbs._room_terms.cache.size" },
+		{ "default",  long(16_MiB)                        },
+	}, []
+	{
+		const size_t &value{room_terms__cache__size};
+		db::capacity(db::cache(dbs::room_terms), value);
+	}
+};
+
+decltype(ircd::m::dbs::desc::room_terms__cache_comp__size)
+ircd::m::dbs::desc::room_terms__cache_comp__size
+{
+	{
+		{ "name",     "ircd.m.dbs._room_terms.cache_comp.size" },
+		{ "default",  long(0_MiB)                              },
+	}, []
+	{
+		const size_t &value{room_terms__cache_comp__size};
+		db::capacity(db::cache_compressed(dbs::room_terms), value);
+	}
+};
+
+/// Prefix transform for the room_terms. The prefix is the room_id and the
+/// term; the suffix is the event_idx.
+const ircd::db::prefix_transform
+ircd::m::dbs::desc::room_terms__pfx
+{
+	"_room_terms",
+	[](const string_view &key)
+	{
+		return std::count(begin(key), end(key), '\0') >= 2;
+	},
+
+	[](const string_view &key)
+	{
+		const auto &[room_id, post]
+		{
+			split(key, '\0')
+		};
+
+		return string_view
+		{
+			begin(key), begin(split(post, '\0').second) - 1
+		};
+	}
+};
+
+const ircd::db::descriptor
+ircd::m::dbs::desc::room_terms
+{
+	// name
+	"_room_terms",
+
+	// explanation
+	R"(Inverted index of the words of messages, names and topics in a room.
+
+	[room_id | term \0 event_idx] => --
+
+	The words of content.body, content.name and content.topic are lowercased
+	into terms. Each key is a posting of the term for one event; nothing is
+	ever read to write one, so concurrent writers can't lose each other's
+	postings and writing one twice is harmless. The event_idx is inverted
+	and big-endian so the postings of a term iterate most recent first.
+
+	)",
+
+	// typing (key, value)
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	// options
+	{},
+
+	// comparator
+	{},
+
+	// prefix transform
+	room_terms__pfx,
+
+	// drop column
+	false,
+
+	// cache size
+	bool(cache_enable)? -1 : 0, //uses conf item
+
+	// cache size for compressed assets
+	bool(cache_comp_enable)? -1 : 0,
+
+	// bloom filter bits
+	0,
+
+	// expect queries hit
+	false,
+
+	// block size
+	size_t(room_terms__block__size),
+
+	// meta_block size
+	size_t(room_terms__meta_block__size),
+
+	// compression
+	"kLZ4Compression;kSnappyCompression"s,
+
+	// compactor
+	{},
+
+	// compaction priority algorithm
+	"kOldestSmallestSeqFirst"s,
+};
+
+//
+// indexer
+//
+
+void
+ircd::m::dbs::_index_room_terms(db::txn &txn,
+                                const event &event,
+                                const write_opts &opts)
+{
+	assert(opts.appendix.test(appendix::ROOM_TERMS));
+
+	const json::object &content
+	{
+		json::get<"content"_>(event)
+	};
+
+	std::string arena;
+	std::vector<size_t> terms;
+	for(const auto &key : {"body"_sv, "name"_sv, "topic"_sv})
+	{
+		const json::string &text
+		{
+			content[key]
+		};
+
+		m::search::terms(text, [&arena, &terms]
+		(const string_view &term)
+		{
+			terms.emplace_back(arena.size());
+			arena.append(term);
+			arena.push_back('\0');
+			return terms.size() < size_t(m::search::terms_max);
+		});
+	}
+
+	std::vector<string_view> unique(terms.size());
+	std::transform(begin(terms), end(terms), begin(unique), [&arena]
+	(const size_t &pos)
+	{
+		return string_view{arena.data() + pos};
+	});
+
+	std::sort(begin(unique), end(unique));
+	unique.erase(std::unique(begin(unique), end(unique)), end(unique));
+	for(const auto &term : unique)
+	{
+		char buf[ROOM_TERMS_KEY_MAX_SIZE];
+		db::txn::append
+		{
+			txn, room_terms,
+			{
+				opts.op,
+				room_terms_key(buf, at<"room_id"_>(event), term, opts.event_idx),
+			}
+		};
+	}
+}
+
+//
+// key
+//
+
+ircd::m::event::idx
+ircd::m::dbs::room_terms_key(const string_view &amalgam)
+{
+	assert(size(amalgam) >= 8);
+	const uint64_t &inverse
+	{
+		ntoh(byte_view<uint64_t>(amalgam.substr(size(amalgam) - 8)))
+	};
+
+	return ~inverse;
+}
+
+ircd::string_view
+ircd::m::dbs::room_terms_key(const mutable_buffer &out_,
+                             const id::room &room_id,
+                             const string_view &term)
+{
+	mutable_buffer out{out_};
+	consume(out, copy(out, room_id));
+	consume(out, copy(out, '\0'));
+	consume(out, copy(out, trunc(term, ROOM_TERMS_TERM_MAX_SIZE)));
+	consume(out, copy(out, '\0'));
+	const mutable_buffer ret
+	{
+		data(out_), data(out)
+	};
+
+	return ret;
+}
+
+/// The event_idx is inverted and written big-endian so the postings of a
+/// term are ordered most recent first by the default comparator; domain
+/// iterators are not good at reverse iteration.
+ircd::string_view
+ircd::m::dbs::room_terms_key(const mutable_buffer &out_,
+                             const id::room &room_id,
+                             const string_view &term,
+                             const event::idx &event_idx)
+{
+	const uint64_t inverse
+	{
+		hton(~uint64_t(event_idx))
+	};
+
+	mutable_buffer out{out_};
+	consume(out, size(room_terms_key(out, room_id, term)));
+	consume(out, copy(out, byte_view<string_view>(inverse)));
+	const mutable_buffer ret
+	{
+		data(out_), data(out)
+	};
+
+	return ret;
+}
@@ -10,9 +10,43 @@
 
 namespace ircd::m
 {
+	static void verify_offload(const size_t &num, const std::function<void ()> &);
 	static json::object make_hashes(const mutable_buffer &out, const sha256::buf &hash);
+
+	extern conf::item<size_t> verify_offload_min;
+	extern conf::item<size_t> verify_offload_concurrency;
 }
 
+decltype(ircd::m::verify_offload_min)
+ircd::m::verify_offload_min
+{
+	{ "name",         "ircd.m.event.verify.offload.min" },
+	{ "default",      8L                                },
+	{ "description",
+
+	R"(
+	The minimum number of events in a batch of hash or signature checks
+	before the work is offloaded to the ctx::ole thread pool. Smaller batches
+	are checked on the calling thread, where a few checks cost less than the
+	round trip to another thread. 0 disables the offload.
+	)"},
+};
+
+decltype(ircd::m::verify_offload_concurrency)
+ircd::m::verify_offload_concurrency
+{
+	{ "name",         "ircd.m.event.verify.offload.concurrency" },
+	{ "default",      4L                                        },
+	{ "description",
+
+	R"(
+	The maximum number of offload workers which may divide a batch of hash
+	or signature checks between them. The offload thread pool is grown to
+	this many threads for verification independently of the pool size used
+	by everything else (ircd.ctx.ole.thread.max).
+	)"},
+};
+
 /// The maximum size of an event we will create. This may also be used in
 /// some contexts for what we will accept, but the protocol limit and hard
 /// worst-case buffer size is still event::MAX_SIZE.
@@ -502,6 +536,167 @@ ircd::m::event::sign(const string_view &event,
 
 	return sig;
 }
+/// Verify the content hash of up to 64 events; the results are returned in
+/// the bitset. The work may be divided among the offload threads.
+uint64_t
+ircd::m::verify_hash(const vector_view<const event> &events)
+{
+	const size_t num
+	{
+		std::min(events.size(), 64UL)
+	};
+
+	std::atomic<uint64_t> ret {0};
+	std::atomic<size_t> next {0};
+	verify_offload(num, [&events, &num, &ret, &next]
+	{
+		for(size_t i(next++); i < num; i = next++) try
+		{
+			if(verify_hash(events[i]))
+				ret |= (1UL << i);
+		}
+		catch(...)
+		{
+			continue;
+		}
+	});
+
+	return ret;
+}
+
+/// Verify the origin signature of up to 64 events; the results are returned
+/// in the bitset. The public keys are found on this thread, which may
+/// conduct I/O; a key is only found once for the events of the batch signed
+/// with it. The verifications may be divided among the offload threads.
+/// Events for which no key can be found have a false result.
+uint64_t
+ircd::m::verify(const vector_view<const event> &events)
+{
+	const size_t num
+	{
+		std::min(events.size(), 64UL)
+	};
+
+	uint64_t ready(0);
+	ed25519::pk pk[64];
+	ed25519::sig sig[64];
+	string_view origins[64], keyids[64];
+	for(size_t i(0); i < num; ++i) try
+	{
+		const auto &event
+		{
+			events[i]
+		};
+
+		const string_view &origin
+		{
+			at<"origin"_>(event)
+		};
+
+		const json::object &origin_sigs
+		{
+			at<"signatures"_>(event).at(origin)
+		};
+
+		const m::node::keys node_keys
+		{
+			origin
+		};
+
+		for(const auto &[keyid, sig_] : origin_sigs)
+		{
+			// A key already found for an earlier event of the batch is reused.
+			size_t j(0);
+			while(j < i && (keyids[j] != keyid || origins[j] != origin))
+				++j;
+
+			bool found(j < i);
+			if(found)
+				pk[i] = pk[j];
+			else
+				found = node_keys.get(json::string(keyid), [&pk, &i]
+				(const ed25519::pk &pk_)
+				{
+					pk[i] = pk_;
+				});
+
+			if(!found)
+				continue;
+
+			origins[i] = origin;
+			keyids[i] = keyid;
+
+			sig[i] = ed25519::sig
+			{
+				[&sig_](auto &buf)
+				{
+					b64decode(buf, json::string(sig_));
+				}
+			};
+
+			ready |= (1UL << i);
+			break;
+		}
+	}
+	catch(const ctx::interrupted &)
+	{
+		throw;
+	}
+	catch(const std::exception &e)
+	{
+		log::derror
+		{
+			log, "Failed to find key to verify %s :%s",
+			string_view{events[i].event_id},
+			e.what(),
+		};
+	}
+
+	std::atomic<uint64_t> ret {0};
+	std::atomic<size_t> next {0};
+	verify_offload(__builtin_popcountl(ready), [&events, &num, &ready, &pk, &sig, &ret, &next]
+	{
+		for(size_t i(next++); i < num; i = next++) try
+		{
+			if(ready & (1UL << i))
+				if(verify(events[i], pk[i], sig[i]))
+					ret |= (1UL << i);
+		}
+		catch(...)
+		{
+			continue;
+		}
+	});
+
+	return ret;
+}
+
+/// Conduct the function on the offload threads if the work is large enough;
+/// the function must divide the work among concurrent instances of itself.
+void
+ircd::m::verify_offload(const size_t &num,
+                        const std::function<void ()> &func)
+{
+	const bool offload
+	{
+		ctx::current
+		&& size_t(verify_offload_min)
+		&& num >= size_t(verify_offload_min)
+	};
+
+	if(!offload)
+		return func();
+
+	ctx::ole::opts opts;
+	opts.name = "m.event.verify";
+	opts.concurrency = std::clamp(size_t(verify_offload_concurrency), 1UL, num);
+	opts.threads = size_t(verify_offload_concurrency);
+	ctx::offload
+	{
+		opts, func
+	};
+}
+
 bool
 ircd::m::verify(const event &event)
 {
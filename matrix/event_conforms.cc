@@ -252,16 +252,20 @@ ircd::m::event::conforms::reflect(const string_view &name)
 	return code(std::distance(begin(event_conforms_reflects), it));
 }
 
-ircd::m::event::conforms::conforms(const event &e,
-                                   const uint64_t &skip)
-:conforms{e}
+ircd::m::event::conforms::conforms(const event &e)
+:conforms{e, 0UL}
 {
-	report &= ~skip;
 }
 
-ircd::m::event::conforms::conforms(const event &e)
+ircd::m::event::conforms::conforms(const event &e,
+                                   const uint64_t &skip)
 try
-:report{0}
+:report
+{
+	// Expensive checks which are skipped are preset here so they're elided
+	// below; everything else is still checked and masked at the end.
+	skip & (1UL << MISMATCH_HASHES)
+}
 {
 	if(!e.event_id)
 		set(INVALID_OR_MISSING_EVENT_ID);
@@ -399,6 +403,8 @@ try
 				if(event_id == prev.prev_event(j))
 					set(DUP_PREV_EVENT);
 	}
+
+	report &= ~skip;
 }
 catch(const std::exception &_e)
 {
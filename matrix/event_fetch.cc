@@ -97,6 +97,161 @@ ircd::m::seek(std::nothrow_t,
 	return fetch.valid;
 }
 
+namespace ircd::m
+{
+	static bool seek_page(const vector_view<const event::idx> &, const event::fetch::each_closure &, const event::fetch::opts &, size_t &);
+}
+
+/// The events are read from event_json with one batched query for each page
+/// of up to 64 events rather than one query per event; any events without a
+/// JSON value fall back to the row query of event::fetch. When the selected
+/// keys all have direct columns the row query is made instead, as it is for
+/// a single event. Events not found are skipped. The closure can return
+/// false to stop the iteration.
+size_t
+ircd::m::seek(std::nothrow_t,
+              const vector_view<const event::idx> &event_idx,
+              const event::fetch::each_closure &closure,
+              const event::fetch::opts &opts)
+{
+	size_t ret(0);
+	if(!event::fetch::should_seek_json(opts))
+	{
+		event::fetch event
+		{
+			opts
+		};
+
+		for(const auto &idx : event_idx)
+			if(idx && seek(std::nothrow, event, idx))
+			{
+				++ret;
+				if(!closure(idx, event))
+					break;
+			}
+
+		return ret;
+	}
+
+	for(size_t i(0); i < event_idx.size(); i += 64)
+	{
+		const vector_view<const event::idx> page
+		{
+			event_idx.data() + i, std::min(event_idx.size() - i, 64UL)
+		};
+
+		if(!seek_page(page, closure, opts, ret))
+			break;
+	}
+
+	return ret;
+}
+
+bool
+ircd::m::seek_page(const vector_view<const event::idx> &event_idx,
+                   const event::fetch::each_closure &closure,
+                   const event::fetch::opts &opts,
+                   size_t &ret)
+{
+	const size_t num
+	{
+		event_idx.size()
+	};
+
+	string_view key[num];
+	for(size_t i(0); i < num; ++i)
+		key[i] = byte_view<string_view>(event_idx[i]);
+
+	// The event_id is not found in the JSON for room versions 3+; they're
+	// gathered in a batch beforehand rather than a query for each event.
+	std::vector<event::id::buf> event_id(num);
+	auto &event_id_column
+	{
+		dbs::event_column.at(json::indexof<event, "event_id"_>())
+	};
+
+	db::read(event_id_column, {key, num}, [&event_id]
+	(const size_t &i, const string_view &val)
+	{
+		event_id[i] = event::id{val};
+	},
+	opts.gopts);
+
+	// Events missing from event_json are fetched singularly; this is done
+	// from the closure below to maintain the order of the input.
+	size_t pos(0);
+	bool cont(true);
+	event::fetch fallback
+	{
+		opts
+	};
+
+	const auto fall_to{[&](const size_t &end)
+	{
+		for(; pos < end && cont; ++pos)
+			if(event_idx[pos] && seek(std::nothrow, fallback, event_idx[pos], event_id[pos]))
+			{
+				cont = closure(event_idx[pos], fallback);
+				++ret;
+			}
+	}};
+
+	db::read(dbs::event_json, {key, num}, [&](const size_t &i, const string_view &val)
+	{
+		fall_to(i);
+		if(!cont)
+			return;
+
+		assert(pos == i);
+		const unwind next{[&pos]
+		{
+			++pos;
+		}};
+
+		const json::object source
+		{
+			val
+		};
+
+		const event::id id
+		{
+			event_id[i]?
+				event::id{event_id[i]}:
+			source.has("event_id")?
+				event::id{json::string(source.at("event_id"))}:
+				event::id{}
+		};
+
+		m::event event;
+		try
+		{
+			event = m::event
+			{
+				source, id, event::keys{opts.keys}
+			};
+		}
+		catch(const json::parse_error &e)
+		{
+			log::critical
+			{
+				m::log, "Fetching event:%lu %s JSON from local database :%s",
+				event_idx[i],
+				string_view{id},
+				e.what(),
+			};
+
+			return;
+		}
+
+		cont = closure(event_idx[i], event);
+		++ret;
+	},
+	opts.gopts);
+
+	fall_to(num);
+	return cont;
+}
+
 //
 // event::fetch
 //
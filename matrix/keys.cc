@@ -194,6 +194,8 @@ ircd::m::expired(const m::keys &keys)
 
 namespace ircd::m
 {
+	static size_t keys_decode(const json::object &keys);
+
 	extern conf::item<milliseconds> keys_query_timeout;
 }
 
@@ -308,7 +310,17 @@ ircd::m::keys::get(const string_view &server_name,
 try
 {
 	assert(!server_name.empty());
-	if(cache::get(server_name, key_id, closure))
+	const bool cached
+	{
+		cache::get(server_name, key_id, [&closure]
+		(const json::object &keys)
+		{
+			keys_decode(keys);
+			closure(keys);
+		})
+	};
+
+	if(cached)
 		return true;
 
 	if(server_name == my_host())
@@ -509,6 +521,198 @@ ircd::m::keys::get(const queries &queries,
 // m::keys::cache
 //
 
+namespace ircd::m
+{
+	struct keys_decoded
+	{
+		ed25519::pk pk;
+		time_t valid_until_ts {0};
+	};
+
+	static string_view keys_decoded_key(const mutable_buffer &, const string_view &server, const string_view &key_id);
+	static void keys_decoded_erase(const json::object &keys, const string_view &key_id);
+	static void keys_decoded_handle_redact(const event &, vm::eval &);
+	static void keys_decoded_handle_key(const event &, vm::eval &);
+
+	extern hookfn<vm::eval &> keys_decoded_hook_redact;
+	extern hookfn<vm::eval &> keys_decoded_hook_key;
+	static std::map<std::string, keys_decoded, std::less<>> keys_decoded_cache;
+}
+
+decltype(ircd::m::keys::cache::decoded_size)
+ircd::m::keys::cache::decoded_size
+{
+	{ "name",     "ircd.keys.cache.decoded.size" },
+	{ "default",  65536L                         },
+};
+
+decltype(ircd::m::keys::cache::decoded_hits)
+ircd::m::keys::cache::decoded_hits
+{
+	{ "name", "ircd.keys.cache.decoded.hits" },
+};
+
+decltype(ircd::m::keys::cache::decoded_misses)
+ircd::m::keys::cache::decoded_misses
+{
+	{ "name", "ircd.keys.cache.decoded.misses" },
+};
+
+/// Invalidates a decoded key when its ircd.key state is replaced in a node
+/// room; cache::set() decodes the new keys after they are written.
+decltype(ircd::m::keys_decoded_hook_key)
+ircd::m::keys_decoded_hook_key
+{
+	keys_decoded_handle_key,
+	{
+		{ "_site",   "vm.effect"  },
+		{ "type",    "ircd.key"   },
+		{ "origin",  my_host()    },
+	}
+};
+
+/// Invalidates a decoded key when its ircd.key state is redacted.
+decltype(ircd::m::keys_decoded_hook_redact)
+ircd::m::keys_decoded_hook_redact
+{
+	keys_decoded_handle_redact,
+	{
+		{ "_site",   "vm.effect"         },
+		{ "type",    "m.room.redaction"  },
+		{ "origin",  my_host()           },
+	}
+};
+
+void
+ircd::m::keys_decoded_handle_key(const event &event,
+                                 vm::eval &eval)
+{
+	keys_decoded_erase(json::get<"content"_>(event), json::get<"state_key"_>(event));
+}
+
+void
+ircd::m::keys_decoded_handle_redact(const event &event,
+                                    vm::eval &eval)
+{
+	const auto &target(json::get<"redacts"_>(event));
+	if(!target)
+		return;
+
+	char type_buf[event::TYPE_MAX_SIZE];
+	if(m::get(std::nothrow, target, "type", type_buf) != "ircd.key"_sv)
+		return;
+
+	char key_id_buf[event::STATE_KEY_MAX_SIZE];
+	const string_view &key_id
+	{
+		m::get(std::nothrow, target, "state_key", key_id_buf)
+	};
+
+	m::get(std::nothrow, target, "content", [&key_id]
+	(const json::object &keys)
+	{
+		keys_decoded_erase(keys, key_id);
+	});
+}
+
+void
+ircd::m::keys_decoded_erase(const json::object &keys,
+                            const string_view &key_id)
+{
+	const json::string &server_name
+	{
+		keys["server_name"]
+	};
+
+	char buf[rfc3986::DOMAIN_BUFSIZE + event::STATE_KEY_MAX_SIZE];
+	const auto it
+	{
+		keys_decoded_cache.find(keys_decoded_key(buf, server_name, key_id))
+	};
+
+	if(it != end(keys_decoded_cache))
+		keys_decoded_cache.erase(it);
+}
+
+/// Decode the verify keys and old verify keys in the keys object into the
+/// in-memory cache. The keys are expected to be verified already.
+size_t
+ircd::m::keys_decode(const json::object &keys)
+{
+	const json::string &server_name
+	{
+		keys["server_name"]
+	};
+
+	const auto add{[&server_name]
+	(const string_view &key_id, const json::object &verify_key, const time_t &valid_until_ts)
+	{
+		const json::string &key
+		{
+			verify_key["key"]
+		};
+
+		if(!key)
+			return false;
+
+		char buf[rfc3986::DOMAIN_BUFSIZE + event::STATE_KEY_MAX_SIZE];
+		const string_view &cache_key
+		{
+			keys_decoded_key(buf, server_name, key_id)
+		};
+
+		auto it(keys_decoded_cache.lower_bound(cache_key));
+		if(it == end(keys_decoded_cache) || it->first != cache_key)
+		{
+			if(keys_decoded_cache.size() >= size_t(keys::cache::decoded_size) && !keys_decoded_cache.empty())
+			{
+				const auto victim(begin(keys_decoded_cache));
+				if(victim == it)
+					++it;
+
+				keys_decoded_cache.erase(victim);
+			}
+
+			it = keys_decoded_cache.emplace_hint(it, std::string{cache_key}, keys_decoded{});
+		}
+
+		it->second.pk = ed25519::pk
+		{
+			[&key](auto &buf)
+			{
+				b64decode(buf, key);
+			}
+		};
+
+		it->second.valid_until_ts = valid_until_ts;
+		return true;
+	}};
+
+	size_t ret(0);
+	const json::object &old_vks{keys["old_verify_keys"]};
+	for(const auto &[key_id, old_vk] : old_vks)
+		ret += add(key_id, old_vk, json::object(old_vk).get<time_t>("expired_ts", 0L));
+
+	const json::object &vks{keys["verify_keys"]};
+	for(const auto &[key_id, vk] : vks)
+		ret += add(key_id, vk, keys.get<time_t>("valid_until_ts", 0L));
+
+	return ret;
+}
+
+ircd::string_view
+ircd::m::keys_decoded_key(const mutable_buffer &buf,
+                          const string_view &server_name,
+                          const string_view &key_id)
+{
+	return fmt::sprintf
+	{
+		buf, "%s %s",
+		server_name,
+		key_id,
+	};
+}
+
 size_t
 ircd::m::keys::cache::set(const json::object &keys)
 {
@@ -542,9 +746,37 @@ ircd::m::keys::cache::set(const json::object &keys)
 	for(auto it(begin(vks)); it != end(vks) && ret < max; ++it, ++ret)
 		send_to_cache(*it);
 
+	keys_decode(keys);
 	return ret;
 }
 
+/// Find a decoded verify key; the validity is the valid_until_ts of the
+/// keys object, or the expired_ts for an old verify key. This does not
+/// query the node room; on a miss use keys::get(), which will populate it.
+bool
+ircd::m::keys::cache::get(const string_view &server_name,
+                          const string_view &key_id,
+                          ed25519::pk &pk,
+                          time_t &valid_until_ts)
+{
+	char buf[rfc3986::DOMAIN_BUFSIZE + event::STATE_KEY_MAX_SIZE];
+	const auto it
+	{
+		keys_decoded_cache.find(keys_decoded_key(buf, server_name, key_id))
+	};
+
+	if(it == end(keys_decoded_cache))
+	{
+		++decoded_misses;
+		return false;
+	}
+
+	pk = it->second.pk;
+	valid_until_ts = it->second.valid_until_ts;
+	++decoded_hits;
+	return true;
+}
+
 bool
 ircd::m::keys::cache::get(const string_view &server_name,
                           const string_view &key_id,
@@ -98,6 +98,14 @@ ircd::m::node::keys::get(const string_view &key_id,
                          const ed25519_closure &closure)
 const
 {
+	ed25519::pk pk;
+	time_t valid_until_ts;
+	if(m::keys::cache::get(node.node_id, key_id, pk, valid_until_ts))
+	{
+		closure(pk);
+		return true;
+	}
+
 	return get(key_id, key_closure{[&closure]
 	(const json::string &keyb64)
 	{
@@ -211,25 +211,15 @@ ircd::m::authenticate_user(const resource::method &method,
 	if(startswith(request.access_token, "bridge_"))
 		return {};
 
-	const m::room::id::buf tokens_room_id
+	const auto session
 	{
-		"tokens", origin(my())
-	};
-
-	const m::room::state tokens
-	{
-		tokens_room_id
-	};
-
-	const event::idx event_idx
-	{
-		tokens.get(std::nothrow, "ircd.access_token", request.access_token)
+		m::user::tokens::find(request.access_token)
 	};
 
 	// The sender of the token is the user being authenticated.
 	const string_view sender
 	{
-		m::get(std::nothrow, event_idx, "sender", request.id_buf)
+		strlcpy(request.id_buf, session.user_id)
 	};
 
 	// Note that if the endpoint does not require auth and we were not
@@ -260,26 +250,16 @@ ircd::m::authenticate_bridge(const resource::method &method,
 	if(!startswith(request.access_token, "bridge_"))
 		return {};
 
-	const m::room::id::buf tokens_room_id
-	{
-		"tokens", origin(my())
-	};
-
-	const m::room::state tokens
-	{
-		tokens_room_id
-	};
-
-	const event::idx event_idx
+	const auto session
 	{
-		tokens.get(std::nothrow, "ircd.access_token", request.access_token)
+		m::user::tokens::find(request.access_token)
 	};
 
 	// The sender of the token is the bridge's user_id, where the bridge_id
 	// is the localpart, but none of this is a puppetting/target user_id.
 	const string_view sender
 	{
-		m::get(std::nothrow, event_idx, "sender", request.id_buf)
+		strlcpy(request.id_buf, session.user_id)
 	};
 
 	// Note that unlike authenticate_user, if an as_token was proffered but is
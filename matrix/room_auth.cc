@@ -16,6 +16,9 @@ namespace ircd::m
 	static void check_room_auth_rule_3(const m::event &, room::auth::hookdata &);
 	static void check_room_auth_rule_2(const m::event &, room::auth::hookdata &);
 
+	static bool chain_for_each_walk(const event::idx &, const room::auth::chain::closure &);
+	static int chain_for_each_cover(const event::idx &, const room::auth::chain::closure &);
+
 	extern hook::site<room::auth::hookdata &> room_auth_hook;
 }
 
@@ -838,9 +841,187 @@ const
 	return ret;
 }
 
+void
+ircd::m::room::auth::chain::rebuild()
+{
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	dbs::write_opts wopts;
+	wopts.appendix.reset();
+	wopts.appendix.set(dbs::appendix::EVENT_CHAIN);
+	wopts.interpose = &txn;
+
+	// Events are indexed in sequence so the auth events of each event are
+	// indexed before it. The txn is committed often because the indexer
+	// queries the txn for positions not yet written to the database.
+	size_t ret(0);
+	m::events::for_each(m::events::range{0, -1UL}, [&txn, &wopts, &ret]
+	(const event::idx &event_idx, const m::event &event)
+	{
+		if(!defined(json::get<"state_key"_>(event)))
+			return true;
+
+		wopts.event_idx = event_idx;
+		dbs::write(txn, event, wopts);
+		if(++ret % 1024UL != 0UL)
+			return true;
+
+		txn();
+		txn.clear();
+		if(ret % 65536UL == 0UL)
+			log::info
+			{
+				log, "Auth chain rebuild events %zu of %zu num:%zu",
+				event_idx,
+				vm::sequence::retired,
+				ret,
+			};
+
+		return true;
+	});
+
+	txn();
+	log::notice
+	{
+		log, "Auth chain rebuild complete num:%zu",
+		ret,
+	};
+}
+
 bool
 ircd::m::room::auth::chain::for_each(const closure &closure)
 const
+{
+	// The auth chain is found with range scans of the chain cover index;
+	// when the auth events of the event weren't indexed the auth graph is
+	// walked instead.
+	const int indexed
+	{
+		chain_for_each_cover(idx, closure)
+	};
+
+	if(indexed >= 0)
+		return indexed;
+
+	return chain_for_each_walk(idx, closure);
+}
+
+int
+ircd::m::chain_for_each_cover(const event::idx &event_idx,
+                              const room::auth::chain::closure &closure)
+{
+	static const dbs::write_opts wopts;
+	const m::event::fetch event
+	{
+		std::nothrow, event_idx
+	};
+
+	if(!event.valid)
+		return -1;
+
+	// Each chain reached and the greatest seq reached in it.
+	std::map<event::idx, uint64_t> reach;
+	std::deque<dbs::chain_pos> queue;
+	const m::event::prev prev{event};
+	for(size_t i(0); i < prev.auth_events_count(); ++i)
+	{
+		const auto &auth_event_idx
+		{
+			m::index(std::nothrow, prev.auth_event(i))
+		};
+
+		// The chain through a missing auth event isn't in the index.
+		if(!auth_event_idx)
+			return -1;
+
+		const auto pos
+		{
+			dbs::find_event_chain(auth_event_idx, wopts)
+		};
+
+		if(!pos.first)
+			return -1;
+
+		queue.emplace_back(pos);
+	}
+
+	char buf[dbs::EVENT_CHAIN_KEY_MAX_SIZE];
+	while(!queue.empty())
+	{
+		const auto [chain_id, seq]
+		{
+			queue.front()
+		};
+
+		queue.pop_front();
+		auto &reached
+		{
+			reach[chain_id]
+		};
+
+		if(reached >= seq)
+			continue;
+
+		// Only the links from the part of the chain not reached before.
+		const string_view &key
+		{
+			dbs::event_chain_key(buf, dbs::chain::LINK, chain_id, reached + 1)
+		};
+
+		reached = seq;
+		for(auto it(dbs::event_chain.begin(key)); it; ++it)
+		{
+			const auto &[type, link_chain, link_seq, target]
+			{
+				dbs::event_chain_key(it->first)
+			};
+
+			assert(type == dbs::chain::LINK);
+			assert(link_chain == chain_id);
+			if(link_seq > seq)
+				break;
+
+			queue.emplace_back(target, byte_view<uint64_t>(it->second));
+		}
+	}
+
+	std::vector<event::idx> ret;
+	for(const auto &[chain_id, seq] : reach)
+	{
+		const string_view &key
+		{
+			dbs::event_chain_key(buf, dbs::chain::EVENT, chain_id, 1)
+		};
+
+		for(auto it(dbs::event_chain.begin(key)); it; ++it)
+		{
+			const auto &[type, _chain_id, event_seq, _]
+			{
+				dbs::event_chain_key(it->first)
+			};
+
+			assert(type == dbs::chain::EVENT);
+			if(event_seq > seq)
+				break;
+
+			ret.emplace_back(byte_view<event::idx>(it->second));
+		}
+	}
+
+	std::sort(begin(ret), end(ret));
+	for(const auto &idx : ret)
+		if(!closure(idx))
+			return false;
+
+	return true;
+}
+
+bool
+ircd::m::chain_for_each_walk(const event::idx &idx,
+                             const room::auth::chain::closure &closure)
 {
 	m::event::fetch e, a;
 	std::set<event::idx> ae;
@@ -8,6 +8,12 @@
 // copyright notice and this permission notice is present in all copies. The
 // full license for this software is available in the LICENSE file.
 
+namespace ircd::m
+{
+	using state_iterate = std::function<bool (const event::closure_idx_bool &)>;
+	static bool for_each_fetch(const event::fetch::opts *const &, const event::closure_bool &, const state_iterate &);
+}
+
 decltype(ircd::m::room::state::enable_history)
 ircd::m::room::state::enable_history
 {
@@ -391,20 +397,11 @@ bool
 ircd::m::room::state::for_each(const event::closure_bool &closure)
 const
 {
-	event::fetch event
+	return for_each_fetch(fopts, closure, [this]
+	(const event::closure_idx_bool &closure)
 	{
-		fopts? *fopts : event::fetch::default_opts
-	};
-
-	return for_each(event::closure_idx_bool{[&event, &closure]
-	(const event::idx &event_idx)
-	{
-		if(seek(std::nothrow, event, event_idx))
-			if(!closure(event))
-				return false;
-
-		return true;
-	}});
+		return for_each(closure);
+	});
 }
 
 void
@@ -603,20 +600,11 @@ ircd::m::room::state::for_each(const string_view &type,
                                const event::closure_bool &closure)
 const
 {
-	event::fetch event
-	{
-		fopts? *fopts : event::fetch::default_opts
-	};
-
-	return for_each(type, state_key_lb, event::closure_idx_bool{[&event, &closure]
-	(const event::idx &event_idx)
+	return for_each_fetch(fopts, closure, [this, &type, &state_key_lb]
+	(const event::closure_idx_bool &closure)
 	{
-		if(seek(std::nothrow, event, event_idx))
-			if(!closure(event))
-				return false;
-
-		return true;
-	}});
+		return for_each(type, state_key_lb, closure);
+	});
 }
 
 bool
@@ -1016,3 +1004,43 @@ ircd::m::room::state::rebuild::rebuild(const room::id &room_id)
 
 	txn();
 }
+
+/// Conducts the iteration of indexes gathering them into pages so the events
+/// can be fetched with batched queries.
+bool
+ircd::m::for_each_fetch(const event::fetch::opts *const &fopts,
+                        const event::closure_bool &closure,
+                        const state_iterate &iterate)
+{
+	size_t num(0);
+	event::idx page[64];
+	const auto flush{[&]
+	{
+		const vector_view<const event::idx> idxs
+		{
+			page, num
+		};
+
+		bool ret(true);
+		seek(std::nothrow, idxs, [&closure, &ret]
+		(const event::idx &event_idx, const event &event)
+		{
+			return ret = closure(event);
+		},
+		fopts? *fopts : event::fetch::default_opts);
+		num = 0;
+		return ret;
+	}};
+
+	const bool ret
+	{
+		iterate([&page, &num, &flush]
+		(const event::idx &event_idx)
+		{
+			page[num++] = event_idx;
+			return num < 64 || flush();
+		})
+	};
+
+	return ret && (!num || flush());
+}
@@ -0,0 +1,199 @@
+// The Construct
+//
+// Copyright (C) The Construct Developers, Authors & Contributors
+// Copyright (C) 2016-2020 Jason Volk <jason@zemos.net>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice is present in all copies. The
+// full license for this software is available in the LICENSE file.
+
+decltype(ircd::m::search::log)
+ircd::m::search::log
+{
+	"m.search"
+};
+
+decltype(ircd::m::search::terms_max)
+ircd::m::search::terms_max
+{
+	{ "name",     "ircd.m.search.terms.max" },
+	{ "default",  512L                      },
+};
+
+decltype(ircd::m::search::query_postings_max)
+ircd::m::search::query_postings_max
+{
+	{ "name",     "ircd.m.search.query.postings.max" },
+	{ "default",  4096L                              },
+};
+
+decltype(ircd::m::search::queries)
+ircd::m::search::queries
+{
+	{ "name", "ircd.m.search.queries" },
+};
+
+decltype(ircd::m::search::query_postings)
+ircd::m::search::query_postings
+{
+	{ "name", "ircd.m.search.query.postings" },
+};
+
+decltype(ircd::m::search::query_usec)
+ircd::m::search::query_usec
+{
+	{ "name", "ircd.m.search.query.usec" },
+};
+
+size_t
+ircd::m::search::rebuild()
+{
+	db::txn txn
+	{
+		*m::dbs::events
+	};
+
+	dbs::write_opts wopts;
+	wopts.appendix.reset();
+	wopts.appendix.set(dbs::appendix::ROOM_TERMS);
+
+	// Each posting is its own key, so events already indexed are written
+	// again to the same keys and not duplicated.
+	size_t ret(0);
+	m::events::for_each(m::events::range{0, -1UL}, [&txn, &wopts, &ret]
+	(const event::idx &event_idx, const m::event &event)
+	{
+		if(!json::get<"room_id"_>(event))
+			return true;
+
+		wopts.event_idx = event_idx;
+		dbs::write(txn, event, wopts);
+		if(++ret % 1024UL != 0UL)
+			return true;
+
+		txn();
+		txn.clear();
+		if(ret % 65536UL == 0UL)
+			log::info
+			{
+				log, "Search index rebuild events %zu of %zu num:%zu",
+				event_idx,
+				vm::sequence::retired,
+				ret,
+			};
+
+		return true;
+	});
+
+	txn();
+	log::notice
+	{
+		log, "Search index rebuild complete num:%zu",
+		ret,
+	};
+
+	return ret;
+}
+
+bool
+ircd::m::search::query(const room::id &room_id,
+                       const vector_view<const string_view> &terms,
+                       const query_closure &closure)
+{
+	const ircd::timer timer;
+	const unwind account{[&timer]
+	{
+		++queries;
+		query_usec += timer.at<microseconds>().count();
+	}};
+
+	// The most recent postings of each term are merged into the count of
+	// terms matched by each event.
+	std::map<event::idx, size_t, std::greater<event::idx>> matches;
+	for(const auto &term : terms)
+	{
+		char buf[dbs::ROOM_TERMS_KEY_MAX_SIZE];
+		const string_view &key
+		{
+			dbs::room_terms_key(buf, room_id, term)
+		};
+
+		size_t i(0);
+		auto it(dbs::room_terms.begin(key));
+		for(; bool(it) && i < size_t(query_postings_max); ++it, ++i)
+		{
+			const event::idx &event_idx
+			{
+				dbs::room_terms_key(it->first)
+			};
+
+			++query_postings;
+			++matches[event_idx];
+		}
+	}
+
+	for(const auto &[event_idx, matched] : matches)
+		if(!closure(event_idx, matched))
+			return false;
+
+	return true;
+}
+
+/// Words are runs of letters and numbers; everything else separates words.
+/// Terms are lowercased and truncated to the maximum term size.
+bool
+ircd::m::search::terms(const string_view &text,
+                       const terms_closure &closure)
+{
+	static const auto is_word{[]
+	(const char32_t &ch)
+	{
+		const auto category(icu::category(ch));
+		return category >= 1 && category <= 11; // letters, marks and numbers
+	}};
+
+	char32_t word[dbs::ROOM_TERMS_TERM_MAX_SIZE / 4];
+	size_t len(0);
+	const auto flush{[&word, &len, &closure]
+	{
+		if(!len)
+			return true;
+
+		char buf[dbs::ROOM_TERMS_TERM_MAX_SIZE];
+		const string_view &term
+		{
+			icu::utf8::encode(buf, vector_view<const char32_t>(word, len))
+		};
+
+		len = 0;
+		return closure(term);
+	}};
+
+	for(string_view in(text); !empty(in); )
+	{
+		const int32_t ch
+		{
+			int32_t(icu::utf8::get(in))
+		};
+
+		const size_t consumed
+		{
+			ch >= 0? icu::utf8::length(char32_t(ch)): 1UL
+		};
+
+		in.remove_prefix(std::min(consumed, size(in)));
+		if(ch >= 0 && is_word(ch))
+		{
+			if(len < std::size(word))
+				word[len++] = icu::tolower(ch);
+
+			continue;
+		}
+
+		if(!flush())
+			return false;
+	}
+
+	return flush();
+}
@@ -8,6 +8,257 @@
 // copyright notice and this permission notice is present in all copies. The
 // full license for this software is available in the LICENSE file.
 
+namespace ircd::m
+{
+	struct tokens_cache_entry
+	{
+		std::string token;
+		event::idx event_idx;
+		std::string user_id;
+		std::string device_id;
+	};
+
+	/// The cache is split by the token's hash. Each shard holds its entries
+	/// in the order of their use and is bounded to its share of the size;
+	/// the least recently used entry of a shard is dropped for a new one.
+	struct tokens_cache_shard
+	{
+		std::list<tokens_cache_entry> lru;
+		std::unordered_map<size_t, std::list<tokens_cache_entry>::iterator> map;
+	};
+
+	static tokens_cache_shard &tokens_cache_select(const size_t &hash);
+	static void tokens_cache_erase(const string_view &token);
+	static void tokens_cache_handle(const event &, vm::eval &);
+
+	extern hookfn<vm::eval &> tokens_cache_hook;
+	extern hookfn<vm::eval &> tokens_cache_written_hook;
+	static std::array<tokens_cache_shard, 16> tokens_cache;
+	static uint64_t tokens_cache_gen;
+}
+
+decltype(ircd::m::user::tokens::cache_enable)
+ircd::m::user::tokens::cache_enable
+{
+	{ "name",     "ircd.m.user.tokens.cache.enable" },
+	{ "default",  true                              },
+};
+
+decltype(ircd::m::user::tokens::cache_size)
+ircd::m::user::tokens::cache_size
+{
+	{ "name",     "ircd.m.user.tokens.cache.size" },
+	{ "default",  16384L                          },
+};
+
+decltype(ircd::m::user::tokens::cache_hits)
+ircd::m::user::tokens::cache_hits
+{
+	{ "name", "ircd.m.user.tokens.cache.hits" },
+};
+
+decltype(ircd::m::user::tokens::cache_misses)
+ircd::m::user::tokens::cache_misses
+{
+	{ "name", "ircd.m.user.tokens.cache.misses" },
+};
+
+/// Invalidates the cached session of a token when it is issued or redacted;
+/// this is before the event is written, so no request is authenticated by
+/// the cache once the write has landed.
+decltype(ircd::m::tokens_cache_hook)
+ircd::m::tokens_cache_hook
+{
+	tokens_cache_handle,
+	{
+		{ "_site",    "vm.post"    },
+		{ "room_id",  "!tokens"    },
+	}
+};
+
+/// Invalidates again after the write; a lookup between the two could have
+/// found the token in the state before the write.
+decltype(ircd::m::tokens_cache_written_hook)
+ircd::m::tokens_cache_written_hook
+{
+	tokens_cache_handle,
+	{
+		{ "_site",    "vm.effect"  },
+		{ "room_id",  "!tokens"    },
+	}
+};
+
+void
+ircd::m::tokens_cache_handle(const event &event,
+                             vm::eval &eval)
+{
+	const auto &type
+	{
+		json::get<"type"_>(event)
+	};
+
+	if(type == "ircd.access_token")
+		return tokens_cache_erase(json::get<"state_key"_>(event));
+
+	if(type != "m.room.redaction" || !json::get<"redacts"_>(event))
+		return;
+
+	// The state_key of the redacted token event is the token.
+	char buf[event::STATE_KEY_MAX_SIZE];
+	const string_view &token
+	{
+		m::get(std::nothrow, json::get<"redacts"_>(event), "state_key", buf)
+	};
+
+	if(token)
+		tokens_cache_erase(token);
+}
+
+void
+ircd::m::tokens_cache_erase(const string_view &token)
+{
+	// Lookups in progress which began before this point will not populate
+	// the cache with their possibly stale result.
+	++tokens_cache_gen;
+	const auto hash
+	{
+		std::hash<string_view>{}(token)
+	};
+
+	auto &shard
+	{
+		tokens_cache_select(hash)
+	};
+
+	const auto it
+	{
+		shard.map.find(hash)
+	};
+
+	if(it == end(shard.map))
+		return;
+
+	shard.lru.erase(it->second);
+	shard.map.erase(it);
+}
+
+ircd::m::tokens_cache_shard &
+ircd::m::tokens_cache_select(const size_t &hash)
+{
+	return tokens_cache.at(hash % tokens_cache.size());
+}
+
+/// Find the owner of an access_token. The result is empty when the token
+/// does not exist. Found tokens are cached, so the common case is a single
+/// hash probe rather than queries of the tokens room state.
+ircd::m::user::tokens::session
+ircd::m::user::tokens::find(const string_view &token)
+{
+	session ret;
+	const auto hash
+	{
+		std::hash<string_view>{}(token)
+	};
+
+	auto &shard
+	{
+		tokens_cache_select(hash)
+	};
+
+	const auto it
+	{
+		shard.map.find(hash)
+	};
+
+	if(it != end(shard.map) && it->second->token == token)
+	{
+		shard.lru.splice(end(shard.lru), shard.lru, it->second);
+		const auto &entry(*it->second);
+		ret.event_idx = entry.event_idx;
+		ret.user_id = entry.user_id;
+		ret.device_id = entry.device_id;
+		++cache_hits;
+		return ret;
+	}
+
+	++cache_misses;
+	const auto gen
+	{
+		tokens_cache_gen
+	};
+
+	const m::room::id::buf tokens_room_id
+	{
+		"tokens", origin(my())
+	};
+
+	const m::room::state tokens
+	{
+		tokens_room_id
+	};
+
+	const event::idx event_idx
+	{
+		tokens.get(std::nothrow, "ircd.access_token", token)
+	};
+
+	m::get(std::nothrow, event_idx, "sender", [&ret]
+	(const string_view &sender)
+	{
+		ret.user_id = sender;
+	});
+
+	if(!ret.user_id)
+		return {};
+
+	m::get(std::nothrow, event_idx, "content", [&ret]
+	(const json::object &content)
+	{
+		ret.device_id = json::string
+		{
+			content.get("device_id")
+		};
+	});
+
+	ret.event_idx = event_idx;
+	if(!cache_enable || gen != tokens_cache_gen || size_t(cache_size) == 0)
+		return ret;
+
+	// An entry of another token under the same hash is replaced.
+	const auto existing
+	{
+		shard.map.find(hash)
+	};
+
+	if(existing != end(shard.map))
+	{
+		shard.lru.erase(existing->second);
+		shard.map.erase(existing);
+	}
+
+	const size_t max
+	{
+		std::max(size_t(cache_size) / tokens_cache.size(), 1UL)
+	};
+
+	while(shard.map.size() >= max && !shard.lru.empty())
+	{
+		shard.map.erase(std::hash<string_view>{}(shard.lru.front().token));
+		shard.lru.pop_front();
+	}
+
+	shard.lru.emplace_back(tokens_cache_entry
+	{
+		std::string(token),
+		ret.event_idx,
+		std::string(ret.user_id),
+		std::string(ret.device_id),
+	});
+
+	shard.map.emplace(hash, std::prev(end(shard.lru)));
+	return ret;
+}
+
 size_t
 ircd::m::user::tokens::del(const string_view &reason)
 const
@@ -158,29 +409,7 @@ ircd::m::user::id::buf
 ircd::m::user::tokens::get(std::nothrow_t,
                            const string_view &token)
 {
-	const m::room::id::buf tokens_room_id
-	{
-		"tokens", origin(my())
-	};
-
-	const m::room tokens
-	{
-		tokens_room_id
-	};
-
-	const event::idx event_idx
-	{
-		tokens.get(std::nothrow, "ircd.access_token", token)
-	};
-
-	m::user::id::buf ret;
-	m::get(std::nothrow, event_idx, "sender", [&ret]
-	(const string_view &sender)
-	{
-		ret = sender;
-	});
-
-	return ret;
+	return find(token).user_id;
 }
 
 ircd::m::device::id::buf
@@ -204,34 +433,7 @@ ircd::m::device::id::buf
 ircd::m::user::tokens::device(std::nothrow_t,
                               const string_view &token)
 {
-	const m::room::id::buf tokens_room_id
-	{
-		"tokens", origin(my())
-	};
-
-	const m::room tokens
-	{
-		tokens_room_id
-	};
-
-	const event::idx event_idx
-	{
-		tokens.get(std::nothrow, "ircd.access_token", token)
-	};
-
-	device::id::buf ret;
-	m::get(std::nothrow, event_idx, "content", [&ret]
-	(const json::object &content)
-	{
-		const json::string &device_id
-		{
-			content.at("device_id")
-		};
-
-		ret = device_id;
-	});
-
-	return ret;
+	return find(token).device_id;
 }
 
 ircd::string_view
@@ -406,6 +406,9 @@ ircd::m::vm::eval::operator()(const vector_view<m::event> &events)
 	if(likely(opts->phase[phase::VERIFY] && opts->mfetch_keys))
 		mfetch_keys();
 
+	if(opts->pipeline && !opts->edu && events.size() > 1)
+		return pipeline(events);
+
 	// Conduct each eval without letting any one exception ruin things for the
 	// others, including an interrupt. The only exception is a termination.
 	size_t ret(0);
@@ -435,6 +438,254 @@ ircd::m::vm::eval::operator()(const vector_view<m::event> &events)
 	return ret;
 }
 
+/// Pipelined evaluation of a vector. The I/O for the references of every
+/// event is issued first; while it's underway the CPU-bound work of every
+/// event is conducted: event_id generation, the conformity report (which
+/// includes the content hash) and signature verification. The events are
+/// then executed in order with that work elided through the options. Events
+/// which don't pass the early stages are executed without elision so their
+/// faults are reported exactly as they would be otherwise.
+size_t
+ircd::m::vm::eval::pipeline(const vector_view<m::event> &events)
+{
+	assert(opts);
+	const auto &opts
+	{
+		*this->opts
+	};
+
+	const size_t num
+	{
+		events.size()
+	};
+
+	std::vector<event::id::buf> ids(num);
+	std::vector<event::conforms> reports(num);
+	std::vector<bool> conformed(num), verified(num);
+
+	// Event ID's generated here are left on the event for the ordered stage
+	// (and for other evals looking for dependencies in this vector). Any left
+	// over after execute() are unset when this frame goes out of scope.
+	const unwind restore_event_ids{[&events]
+	{
+		for(const auto &event : events)
+			if(!json::get<"event_id"_>(event))
+				const_cast<m::event &>(event).event_id = m::event::id{};
+	}};
+
+	// Generate the event_id for each event in the room version (the same as
+	// execute() would) so everything below can find what it's looking for.
+	// The version of a room created in this vector is in its create event;
+	// the version of a room we don't know is unknown, and its event_id's are
+	// left for execute().
+	std::map<string_view, std::string, std::less<>> versions;
+	for(const auto &event : events)
+	{
+		if(json::get<"type"_>(event) != "m.room.create")
+			continue;
+
+		if(json::get<"state_key"_>(event) != "")
+			continue;
+
+		const json::string &room_version
+		{
+			json::get<"content"_>(event).get("room_version", "1")
+		};
+
+		versions.emplace(json::get<"room_id"_>(event), room_version);
+	}
+
+	for(size_t i(0); i < num; ++i) try
+	{
+		auto &event
+		{
+			const_cast<m::event &>(events[i])
+		};
+
+		const string_view &room_id
+		{
+			json::get<"room_id"_>(event)
+		};
+
+		if(event.event_id || !valid(id::ROOM, room_id))
+			continue;
+
+		auto it
+		{
+			versions.lower_bound(room_id)
+		};
+
+		if(it == end(versions) || it->first != room_id)
+		{
+			char buf[room::VERSION_MAX_SIZE];
+			it = versions.emplace_hint(it, room_id, opts.room_version?
+				std::string(opts.room_version):
+			m::exists(room::id(room_id))?
+				std::string(m::version(buf, room{room_id}, std::nothrow)):
+				std::string{});
+		}
+
+		// Versions before 3 carry the event_id in the event.
+		if(it->second.empty() || it->second == "1" || it->second == "2")
+			continue;
+
+		event.event_id = it->second == "3"?
+			event::id{event::id::v3{ids[i], event}}:
+			event::id{event::id::v4{ids[i], event}};
+	}
+	catch(const ctx::interrupted &)
+	{
+		throw;
+	}
+	catch(const std::exception &e)
+	{
+		continue;
+	}
+
+	// Issue the I/O for every reference at once. This will be underway for
+	// the duration of the CPU-bound stages below.
+	if(opts.fetch)
+		mprefetch_refs();
+
+	// Generate the conformity report for every event. The content hashes
+	// are first verified in batches (possibly on other threads) so the report
+	// can elide that check. Only a clean report is carried into the ordered
+	// stage; otherwise the report is generated again by the CONFORM phase
+	// with all of its other considerations.
+	if(opts.phase[phase::CONFORM] && opts.conforming && !opts.conformed)
+		for(size_t i(0); i < num; i += 64)
+		{
+			const vector_view<const m::event> batch
+			{
+				std::addressof(events[i]), std::min(num - i, 64UL)
+			};
+
+			const uint64_t hashed
+			{
+				verify_hash(batch)
+			};
+
+			for(size_t j(0); j < batch.size(); ++j) try
+			{
+				const uint64_t skip
+				{
+					opts.non_conform.report |
+					(hashed & (1UL << j)? (1UL << event::conforms::MISMATCH_HASHES): 0UL)
+				};
+
+				reports[i + j] = event::conforms
+				{
+					batch[j], skip
+				};
+
+				conformed[i + j] = reports[i + j].clean();
+			}
+			catch(const ctx::interrupted &)
+			{
+				throw;
+			}
+			catch(const std::exception &e)
+			{
+				continue;
+			}
+		}
+
+	// Verify the signature of every event in batches (possibly on other
+	// threads). Events which have already been evaluated are skipped here;
+	// by now the prefetch will have usually brought their index into cache.
+	std::vector<m::event> batch;
+	std::vector<size_t> batch_idx;
+	batch.reserve(64);
+	batch_idx.reserve(64);
+	if(opts.phase[phase::VERIFY])
+		for(size_t i(0); i < num; )
+		{
+			batch.clear();
+			batch_idx.clear();
+			for(; i < num && batch.size() < 64; ++i) try
+			{
+				const auto &event
+				{
+					events[i]
+				};
+
+				if(!event.event_id || (!opts.conformed && !conformed[i]))
+					continue;
+
+				if(!opts.replays && m::exists(event.event_id))
+					continue;
+
+				batch.emplace_back(event);
+				batch_idx.emplace_back(i);
+			}
+			catch(const ctx::interrupted &)
+			{
+				throw;
+			}
+			catch(const std::exception &e)
+			{
+				continue;
+			}
+
+			const uint64_t sigs
+			{
+				!batch.empty()?
+					verify(vector_view<const m::event>(batch)):
+					0UL
+			};
+
+			for(size_t j(0); j < batch_idx.size(); ++j)
+				verified[batch_idx[j]] = sigs & (1UL << j);
+		}
+
+	// The ordered stage conducts each eval with a copy of the options where
+	// the completed work is elided for the event at issue.
+	vm::opts popts
+	{
+		opts
+	};
+
+	const scope_restore eval_opts
+	{
+		this->opts, std::addressof(popts)
+	};
+
+	size_t ret(0), elided(0);
+	for(size_t i(0); i < num; ++i) try
+	{
+		popts.conformed = opts.conformed || conformed[i];
+		popts.report = conformed[i]? reports[i]: opts.report;
+		popts.phase.set(phase::VERIFY, opts.phase[phase::VERIFY] && !verified[i]);
+		elided += conformed[i] || verified[i];
+
+		const auto status
+		{
+			operator()(events[i])
+		};
+
+		ret += status == fault::ACCEPT;
+	}
+	catch(const ctx::interrupted &e)
+	{
+		throw;
+	}
+	catch(const std::exception &e)
+	{
+		continue;
+	}
+
+	log::debug
+	{
+		log, "%s pipelined %zu events; elided %zu accepted %zu",
+		loghead(*this),
+		num,
+		elided,
+		ret,
+	};
+
+	return ret;
+}
+
 /// Inject a new event originating from this server.
 ///
 ircd::m::vm::fault
@@ -523,3 +774,37 @@ const
 			this->pdus.size(),
 		};
 }
+
+void
+ircd::m::vm::eval::mprefetch_refs()
+const
+{
+	// Prefetch the index of every event in the vector and every event they
+	// reference. The fetch phases and the existence checks will find these
+	// in cache rather than waiting on a read for each one in turn.
+	size_t prefetched(0);
+	for(const auto &event : this->pdus)
+	{
+		if(event.event_id)
+			prefetched += db::prefetch(dbs::event_idx, event.event_id);
+
+		const event::prev prev
+		{
+			event
+		};
+
+		for(size_t i(0); i < prev.auth_events_count(); ++i)
+			prefetched += db::prefetch(dbs::event_idx, prev.auth_event(i));
+
+		for(size_t i(0); i < prev.prev_events_count(); ++i)
+			prefetched += db::prefetch(dbs::event_idx, prev.prev_event(i));
+	}
+
+	log::debug
+	{
+		log, "%s prefetching %zu references from %zu events",
+		loghead(*this),
+		prefetched,
+		this->pdus.size(),
+	};
+}
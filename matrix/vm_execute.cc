@@ -10,9 +10,15 @@
 
 namespace ircd::m::vm
 {
+	struct writer;
+	struct phase_scope;
+
 	template<class... args> static fault handle_error(const opts &, const fault &, const string_view &fmt, args&&... a);
 	template<class T> static void call_hook(hook::site<T> &, eval &, const event &, T&& data);
 	static size_t calc_txn_reserve(const opts &, const event &);
+	static bool write_commit_conflict(const eval &);
+	static void write_commit_lead(writer &);
+	static void write_commit_group(eval &);
 	static void write_commit(eval &);
 	static void write_append(eval &, const event &);
 	static fault execute_edu(eval &, const event &);
@@ -37,8 +43,39 @@ namespace ircd::m::vm
 	extern conf::item<bool> log_commit_debug;
 	extern conf::item<bool> log_accept_debug;
 	extern conf::item<bool> log_accept_info;
+	extern conf::item<size_t> commit_group_max;
+	extern conf::item<milliseconds> commit_group_linger;
+	extern stats::item<uint64_t> commit_group_writes;
+	extern stats::item<uint64_t> commit_group_evals;
+	extern std::array<std::unique_ptr<stats::item<stats::histogram>>, num_of<phase>()> phase_usec;
+
+	static std::deque<writer *> commit_queue;
+	static std::vector<const eval *> commit_inflight;
+	static writer *commit_leader;
 }
 
+/// Group commit slot. One of these lives on the stack of each eval waiting
+/// in the WRITE phase; the leader fills in the result for the whole group.
+struct ircd::m::vm::writer
+{
+	vm::eval *eval {nullptr};
+	std::exception_ptr eptr;
+	bool done {false};
+};
+
+/// Sets the phase of the eval for the scope and adds the time spent in the
+/// scope, including any phases nested within it, to the phase's histogram.
+struct ircd::m::vm::phase_scope
+{
+	scope_restore<enum phase> restore;
+	stats::histogram::timer timer;
+
+	phase_scope(eval &eval, const enum phase &phase)
+	:restore{eval.phase, phase}
+	,timer{*phase_usec.at(phase)}
+	{}
+};
+
 decltype(ircd::m::vm::log_commit_debug)
 ircd::m::vm::log_commit_debug
 {
@@ -60,6 +97,86 @@ ircd::m::vm::log_accept_info
 	{ "default",  false                       },
 };
 
+decltype(ircd::m::vm::commit_group_max)
+ircd::m::vm::commit_group_max
+{
+	{ "name",         "ircd.m.vm.commit.group.max" },
+	{ "default",      64L                          },
+	{ "description",
+
+	R"(
+	Maximum number of sequenced evals which may be merged into a single
+	database write at the WRITE phase. A value of 1 disables group commit
+	and each eval writes its own transaction.
+	)"},
+};
+
+decltype(ircd::m::vm::commit_group_linger)
+ircd::m::vm::commit_group_linger
+{
+	{ "name",         "ircd.m.vm.commit.group.linger" },
+	{ "default",      2L                              },
+	{ "description",
+
+	R"(
+	Maximum time in milliseconds the leader of a group commit will wait for
+	more evals to arrive at the WRITE phase. The leader only waits while
+	there are evals sequenced after it which have yet to arrive; an idle
+	server never waits. Evals for a room with a write in flight are held
+	until it lands, so only evals for different rooms share a write.
+	)"},
+};
+
+decltype(ircd::m::vm::commit_group_writes)
+ircd::m::vm::commit_group_writes
+{
+	{ "name", "ircd.m.vm.commit.group.writes" },
+};
+
+decltype(ircd::m::vm::commit_group_evals)
+ircd::m::vm::commit_group_evals
+{
+	{ "name", "ircd.m.vm.commit.group.evals" },
+};
+
+decltype(ircd::m::vm::phase_usec)
+ircd::m::vm::phase_usec{[]
+{
+	decltype(phase_usec) ret;
+	for(size_t i(0); i < ret.size(); ++i)
+	{
+		char buf[2][64];
+		const string_view phase_name
+		{
+			reflect(phase(i))
+		};
+
+		const string_view name
+		{
+			fmt::sprintf
+			{
+				buf[0], "ircd.m.vm.phase.%s.usec", tolower(buf[1], phase_name)
+			}
+		};
+
+		const json::members labels
+		{
+			{ "phase", phase_name },
+		};
+
+		ret[i] = std::make_unique<stats::item<stats::histogram>>(json::members
+		{
+			{ "name",     name                                              },
+			{ "family",   "ircd.m.vm.phase.usec"                            },
+			{ "desc",     "Time in microseconds evals spent in each phase." },
+			{ "summary",  true                                              },
+			{ "labels",   labels                                            },
+		});
+	}
+
+	return ret;
+}()};
+
 decltype(ircd::m::vm::issue_hook)
 ircd::m::vm::issue_hook
 {
@@ -143,9 +260,9 @@ try
 		eval::executing
 	};
 
-	const scope_restore eval_phase
+	const phase_scope eval_phase
 	{
-		eval.phase, phase::EXECUTE
+		eval, phase::EXECUTE
 	};
 
 	const scope_notify notify
@@ -237,9 +354,9 @@ try
 	// this evaluator might be using different options/credentials.
 	if(likely(opts.phase[phase::DUPCHK] && opts.unique) && event.event_id)
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::DUPCHK
+			eval, phase::DUPCHK
 		};
 
 		sequence::dock.wait([&event]
@@ -351,9 +468,9 @@ try
 	// created event.
 	if(opts.phase[phase::ISSUE] && eval.copts && eval.copts->issue)
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::ISSUE
+			eval, phase::ISSUE
 		};
 
 		call_hook(issue_hook, eval, event, eval);
@@ -382,9 +499,9 @@ try
 	// include notifying client `/sync` and the federation sender.
 	if(likely(opts.phase[phase::NOTIFY]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::NOTIFY
+			eval, phase::NOTIFY
 		};
 
 		call_hook(notify_hook, eval, event, eval);
@@ -396,9 +513,9 @@ try
 	// notify for the event at issue here has already been made.
 	if(likely(opts.phase[phase::EFFECTS]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::EFFECTS
+			eval, phase::EFFECTS
 		};
 
 		call_hook(effect_hook, eval, event, eval);
@@ -482,9 +599,9 @@ ircd::m::vm::execute_edu(eval &eval,
 {
 	if(likely(eval.opts->phase[phase::EVALUATE]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::EVALUATE
+			eval, phase::EVALUATE
 		};
 
 		call_hook(eval_hook, eval, event, eval);
@@ -492,9 +609,9 @@ ircd::m::vm::execute_edu(eval &eval,
 
 	if(likely(eval.opts->phase[phase::POST]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::POST
+			eval, phase::POST
 		};
 
 		call_hook(post_hook, eval, event, eval);
@@ -552,9 +669,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// composure; these checks only require the event data itself.
 	if(likely(opts.phase[phase::CONFORM]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::CONFORM
+			eval, phase::CONFORM
 		};
 
 		const ctx::critical_assertion ca;
@@ -571,9 +688,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	assert(eval::count(event_id));
 	if(likely(opts.phase[phase::DUPCHK] && opts.unique))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::DUPCHK
+			eval, phase::DUPCHK
 		};
 
 		sequence::dock.wait([&event_id]
@@ -596,9 +713,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 
 	if(likely(opts.phase[phase::ACCESS]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::ACCESS
+			eval, phase::ACCESS
 		};
 
 		call_hook(access_hook, eval, event, eval);
@@ -606,9 +723,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 
 	if(likely(opts.phase[phase::VERIFY]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::VERIFY
+			eval, phase::VERIFY
 		};
 
 		if(!verify(event))
@@ -620,9 +737,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 
 	if(likely(opts.phase[phase::FETCH_AUTH] && opts.fetch))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::FETCH_AUTH
+			eval, phase::FETCH_AUTH
 		};
 
 		call_hook(fetch_auth_hook, eval, event, eval);
@@ -631,9 +748,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// Evaluation by auth system; throws
 	if(likely(opts.phase[phase::AUTH_STATIC]) && authenticate)
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::AUTH_STATIC
+			eval, phase::AUTH_STATIC
 		};
 
 		const auto &[pass, fail]
@@ -651,9 +768,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 
 	if(likely(opts.phase[phase::FETCH_PREV] && opts.fetch))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::FETCH_PREV
+			eval, phase::FETCH_PREV
 		};
 
 		call_hook(fetch_prev_hook, eval, event, eval);
@@ -661,9 +778,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 
 	if(likely(opts.phase[phase::FETCH_STATE] && opts.fetch))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::FETCH_STATE
+			eval, phase::FETCH_STATE
 		};
 
 		call_hook(fetch_state_hook, eval, event, eval);
@@ -698,9 +815,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 		&& eval.parent->event_->event_id
 	};
 
-	const scope_restore eval_phase_precommit
+	const phase_scope eval_phase_precommit
 	{
-		eval.phase, phase::PRECOMMIT
+		eval, phase::PRECOMMIT
 	};
 
 	// Wait until this is the lowest sequence number
@@ -715,9 +832,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 
 	if(likely(opts.phase[phase::AUTH_RELA] && authenticate))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::AUTH_RELA
+			eval, phase::AUTH_RELA
 		};
 
 		const auto &[pass, fail]
@@ -740,26 +857,28 @@ ircd::m::vm::execute_pdu(eval &eval,
 	assert(sequence::retired < sequence::get(eval));
 	sequence::uncommitted = std::max(sequence::get(eval), sequence::uncommitted);
 
-	const scope_restore eval_phase_commit
+	const phase_scope eval_phase_commit
 	{
-		eval.phase, phase::COMMIT
+		eval, phase::COMMIT
 	};
 
-	// Wait until this is the lowest sequence number
+	// Wait until this is the lowest sequence number. The predecessors may
+	// still be waiting to write; everything from here on reads the room as
+	// they left it, so an eval for the same room waits for them to land.
 	sequence::dock.wait([&eval, &parent_post]
 	{
 		return false
 		|| parent_post
-		|| eval::seqnext(sequence::committed) == &eval
+		|| (eval::seqnext(sequence::committed) == &eval && !write_commit_conflict(eval))
 		;
 	});
 
 	// Reevaluation of auth against the present state of the room.
 	if(likely(opts.phase[phase::AUTH_PRES] && authenticate))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::AUTH_PRES
+			eval, phase::AUTH_PRES
 		};
 
 		room::auth::check_present(event);
@@ -768,9 +887,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// Evaluation by module hooks
 	if(likely(opts.phase[phase::EVALUATE]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::EVALUATE
+			eval, phase::EVALUATE
 		};
 
 		call_hook(eval_hook, eval, event, eval);
@@ -796,9 +915,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// Transaction composition.
 	if(likely(opts.phase[phase::INDEX]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::INDEX
+			eval, phase::INDEX
 		};
 
 		write_append(eval, event);
@@ -808,9 +927,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// an entire eval of several more events recursively before returning.
 	if(likely(opts.phase[phase::POST]))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::POST
+			eval, phase::POST
 		};
 
 		call_hook(post_hook, eval, event, eval);
@@ -825,11 +944,24 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// Commit the transaction to database iff this eval is at the stack base.
 	if(likely(opts.phase[phase::WRITE] && !parent_post))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::WRITE
+			eval, phase::WRITE
 		};
 
+		commit_inflight.emplace_back(&eval);
+		const unwind landed{[&eval]
+		{
+			const auto it
+			{
+				std::find(begin(commit_inflight), end(commit_inflight), &eval)
+			};
+
+			assert(it != end(commit_inflight));
+			commit_inflight.erase(it);
+			sequence::dock.notify_all();
+		}};
+
 		write_commit(eval);
 	}
 
@@ -837,9 +969,9 @@ ircd::m::vm::execute_pdu(eval &eval,
 	// never return back to that stack base.
 	if(likely(!parent_post))
 	{
-		const scope_restore eval_phase
+		const phase_scope eval_phase
 		{
-			eval.phase, phase::RETIRE
+			eval, phase::RETIRE
 		};
 
 		sequence::dock.wait([&eval]
@@ -988,7 +1120,10 @@ ircd::m::vm::write_commit(eval &eval)
 	const auto db_seq_before(db::sequence(*m::dbs::events));
 	#endif
 
-	txn();
+	if(size_t(commit_group_max) > 1)
+		write_commit_group(eval);
+	else
+		txn();
 
 	#ifdef RB_DEBUG
 	const auto db_seq_after(db::sequence(*m::dbs::events));
@@ -1006,6 +1141,146 @@ ircd::m::vm::write_commit(eval &eval)
 	#endif
 }
 
+/// Evals arriving at the WRITE phase queue up in sequence order. The first
+/// to find no leader commits everything queued as one database write while
+/// the others wait for it; retirement then proceeds in order as usual.
+void
+ircd::m::vm::write_commit_group(eval &eval)
+{
+	// The slot is referenced by the queue and the leader; it cannot be
+	// abandoned until the result is in.
+	const ctx::uninterruptible::nothrow ui;
+
+	writer self
+	{
+		&eval
+	};
+
+	assert(commit_queue.empty() || commit_queue.back()->eval->sequence < eval.sequence);
+	commit_queue.emplace_back(&self);
+	sequence::dock.notify_all();
+
+	while(!self.done)
+	{
+		if(!commit_leader)
+		{
+			write_commit_lead(self);
+			continue;
+		}
+
+		sequence::dock.wait([&self]
+		{
+			return self.done || !commit_leader;
+		});
+	}
+
+	if(unlikely(self.eptr))
+		std::rethrow_exception(self.eptr);
+}
+
+void
+ircd::m::vm::write_commit_lead(writer &self)
+{
+	const scope_restore leader
+	{
+		commit_leader, std::addressof(self)
+	};
+
+	const scope_notify notify
+	{
+		sequence::dock, scope_notify::all
+	};
+
+	const size_t max
+	{
+		std::max(size_t(commit_group_max), 1UL)
+	};
+
+	// Anything sequenced beyond the committed counter has yet to arrive
+	// here; it's worth holding the write open a little for it, unless it's
+	// for a room in this group and waits for the write itself.
+	const milliseconds linger(commit_group_linger);
+	if(linger > 0ms)
+		sequence::dock.wait_for(linger, [&max]
+		{
+			const auto *const next
+			{
+				eval::seqnext(sequence::committed)
+			};
+
+			return false
+			|| commit_queue.size() >= max
+			|| !next
+			|| write_commit_conflict(*next)
+			;
+		});
+
+	assert(!commit_queue.empty());
+	const size_t count
+	{
+		std::min(commit_queue.size(), max)
+	};
+
+	std::vector<writer *> group(count);
+	std::vector<db::txn *> txns(count);
+	for(size_t i(0); i < count; ++i)
+	{
+		group[i] = commit_queue.front();
+		commit_queue.pop_front();
+		assert(group[i]->eval && group[i]->eval->txn);
+		txns[i] = group[i]->eval->txn.get();
+	}
+
+	std::exception_ptr eptr; try
+	{
+		db::commit(txns);
+	}
+	catch(const std::exception &e)
+	{
+		log::error
+		{
+			log, "%s group commit of %zu evals :%s",
+			loghead(*self.eval),
+			count,
+			e.what(),
+		};
+
+		eptr = std::current_exception();
+	}
+
+	for(auto *const &writer : group)
+	{
+		writer->eptr = eptr;
+		writer->done = true;
+	}
+
+	++commit_group_writes;
+	commit_group_evals += count;
+
+	log::debug
+	{
+		log, "%s group committed %zu evals %lu:%lu",
+		loghead(*self.eval),
+		count,
+		sequence::get(*group.front()->eval),
+		sequence::get(*group.back()->eval),
+	};
+}
+
+/// Whether a write in flight is for the same room as the eval; the eval
+/// can't be evaluated until it lands. Evals without a room conflict with
+/// everything.
+bool
+ircd::m::vm::write_commit_conflict(const eval &eval)
+{
+	return std::any_of(begin(commit_inflight), end(commit_inflight), [&eval]
+	(const auto *const &other)
+	{
+		return other != &eval
+		&& (!other->room_id || !eval.room_id || other->room_id == eval.room_id);
+	});
+}
+
 size_t
 ircd::m::vm::calc_txn_reserve(const opts &opts,
                               const event &event)
@@ -10,10 +10,93 @@
 
 using namespace ircd;
 
+/// An entry in the user directory. The profile fields are held here so the
+/// results of a search don't have to query each profile.
+struct directory_user
+{
+	std::string user_id;
+	std::string displayname;
+	std::string avatar_url;
+};
+
+using directory_closure = std::function<bool (const directory_user &)>;
+using directory_gram_closure = std::function<void (const uint32_t &)>;
+
+static void fini();
+static void directory_terms(const directory_user &, const m::search::terms_closure &);
+static void directory_grams(const string_view &term, const directory_gram_closure &);
+static void directory_index(const uint32_t &ordinal, const bool &add);
+static void directory_set(const m::user::id &, const string_view &key, const string_view &val, const bool &replace);
+static size_t directory_search(const string_view &search_term, const size_t &limit, const directory_closure &);
+static void directory_load();
+static void handle_profile(const m::event &, m::vm::eval &);
+static void handle_member(const m::event &, m::vm::eval &);
+
 mapi::header
 IRCD_MODULE
 {
-	"Client 8.1 :User Directory"
+	"Client 8.1 :User Directory",
+	nullptr,
+	fini,
+};
+
+log::log
+directory_log
+{
+	"m.directory.user"
+};
+
+conf::item<bool>
+directory_enable
+{
+	{ "name",     "ircd.client.directory.user.index.enable" },
+	{ "default",  true                                      },
+};
+
+conf::item<size_t>
+directory_candidates_max
+{
+	{ "name",     "ircd.client.directory.user.search.candidates.max" },
+	{ "default",  4096L                                              },
+};
+
+/// Users in the order they were added; the ordinals in the posting lists
+/// index this vector.
+std::vector<directory_user>
+directory_users;
+
+std::unordered_map<std::string, uint32_t>
+directory_ordinal;
+
+/// Gram => ascending ordinals of the users with a term containing the gram.
+std::unordered_map<uint32_t, std::vector<uint32_t>>
+directory_postings;
+
+ctx::context
+directory_loader
+{
+	"directory.user", 512_KiB, &directory_load, context::POST
+};
+
+m::hookfn<m::vm::eval &>
+profile_hook
+{
+	handle_profile,
+	{
+		{ "_site",  "vm.effect"     },
+		{ "type",   "ircd.profile"  },
+	}
+};
+
+m::hookfn<m::vm::eval &>
+member_hook
+{
+	handle_member,
+	{
+		{ "_site",       "vm.effect"      },
+		{ "type",        "m.room.member"  },
+		{ "membership",  "join"           },
+	}
 };
 
 m::resource
@@ -25,6 +108,13 @@ search_resource
 	}
 };
 
+void
+fini()
+{
+	directory_loader.terminate();
+	directory_loader.join();
+}
+
 m::resource::response
 post__search(client &client,
              const m::resource::request &request)
@@ -39,18 +129,6 @@ post__search(client &client,
 		request.get<ushort>("limit", 16)
 	};
 
-	// Search term in this endpoint comes in as-is from Riot. Our query
-	// is a lower_bound of a user_id, so we have to prefix the '@'.
-	char qbuf[256] {"@"};
-	const string_view &query
-	{
-		startswith(search_term, ':')?
-			string_view{search_term}:
-		!startswith(search_term, '@')?
-			string_view{ircd::strlcat{qbuf, search_term}}:
-			string_view{search_term}
-	};
-
 	const unique_buffer<mutable_buffer> buf
 	{
 		16_KiB
@@ -59,59 +137,47 @@ post__search(client &client,
 	json::stack out{buf};
 	json::stack::object top{out};
 
-	size_t count(0);
-	bool limited{false};
 	json::stack::array results
 	{
 		top, "results"
 	};
 
-	const m::users::opts opts{query};
-	m::users::for_each(opts, [&results, &limit, &limited, &count]
-	(const m::user::id &user_id)
+	const size_t count
 	{
-		json::stack::object result
-		{
-			results
-		};
-
-		json::stack::member
-		{
-			result, "user_id", user_id
-		};
-
-		const m::user::profile profile
-		{
-			user_id
-		};
-
-		profile.get(std::nothrow, "avatar_url", [&result]
-		(const string_view &key, const string_view &val)
+		directory_search(search_term, limit, [&results]
+		(const directory_user &user)
 		{
-			json::stack::member
+			json::stack::object result
 			{
-				result, key, val
+				results
 			};
-		});
 
-		// spec inconsistent
-		profile.get(std::nothrow, "displayname", [&result]
-		(const string_view &key, const string_view &val)
-		{
 			json::stack::member
 			{
-				result, "display_name", val
+				result, "user_id", string_view{user.user_id}
 			};
-		});
 
-		limited = ++count >= limit;
-		return !limited;
-	});
+			if(!user.avatar_url.empty())
+				json::stack::member
+				{
+					result, "avatar_url", string_view{user.avatar_url}
+				};
+
+			// spec inconsistent
+			if(!user.displayname.empty())
+				json::stack::member
+				{
+					result, "display_name", string_view{user.displayname}
+				};
+
+			return true;
+		})
+	};
 
 	results.~array();
 	json::stack::member
 	{
-		top, "limited", json::value{limited}
+		top, "limited", json::value{count > limit}
 	};
 
 	top.~object();
@@ -133,3 +199,345 @@ search_post
 		search_post.RATE_LIMITED
 	}
 };
+
+/// Search for users with a term containing each of the terms of the
+/// search_term. The candidates are found by intersecting the postings of
+/// the grams of the terms, then verified. Returns the number of matches,
+/// which may exceed the limit (but not the candidates::max).
+size_t
+directory_search(const string_view &search_term_,
+                 const size_t &limit,
+                 const directory_closure &closure)
+{
+	// Search term in this endpoint comes in as-is from Riot. The hostpart of
+	// a full mxid is not indexed.
+	const string_view &search_term
+	{
+		startswith(search_term_, '@')?
+			split(search_term_, ':').first:
+			search_term_
+	};
+
+	std::vector<std::string> terms;
+	m::search::terms(search_term, [&terms]
+	(const string_view &term)
+	{
+		terms.emplace_back(term);
+		return terms.size() < 8;
+	});
+
+	if(terms.empty())
+		return 0;
+
+	bool missing{false};
+	std::vector<const std::vector<uint32_t> *> lists;
+	for(const auto &term : terms)
+		directory_grams(term, [&lists, &missing]
+		(const uint32_t &gram)
+		{
+			const auto it
+			{
+				directory_postings.find(gram)
+			};
+
+			if(it != end(directory_postings))
+				lists.emplace_back(&it->second);
+			else
+				missing = true;
+		});
+
+	if(missing || lists.empty())
+		return 0;
+
+	std::sort(begin(lists), end(lists), []
+	(const auto *const &a, const auto *const &b)
+	{
+		return a->size() < b->size();
+	});
+
+	std::vector<uint32_t> candidates(*lists.front()), next;
+	for(auto it(begin(lists) + 1); it != end(lists) && !candidates.empty(); ++it)
+	{
+		next.clear();
+		std::set_intersection(begin(candidates), end(candidates), begin(**it), end(**it), std::back_inserter(next));
+		std::swap(candidates, next);
+	}
+
+	// Grams can match at different positions than the term; each term must
+	// be found in a term of the user. Users with terms starting with the
+	// search terms rank first, then local users.
+	std::vector<std::pair<size_t, uint32_t>> matches;
+	for(size_t i(0); i < candidates.size() && i < size_t(directory_candidates_max); ++i)
+	{
+		const auto &user
+		{
+			directory_users.at(candidates[i])
+		};
+
+		size_t found(0), prefix(0);
+		for(const auto &term : terms)
+		{
+			bool has(false), starts(false);
+			directory_terms(user, [&term, &has, &starts]
+			(const string_view &user_term)
+			{
+				has |= user_term.find(term) != user_term.npos;
+				starts |= startswith(user_term, term);
+				return !starts;
+			});
+
+			found += has;
+			prefix += starts;
+		}
+
+		if(found < terms.size())
+			continue;
+
+		const bool mine
+		{
+			m::my_host(m::user::id(user.user_id).host())
+		};
+
+		matches.emplace_back(prefix * 2 + mine, candidates[i]);
+	}
+
+	std::stable_sort(begin(matches), end(matches), []
+	(const auto &a, const auto &b)
+	{
+		return a.first > b.first;
+	});
+
+	for(size_t i(0); i < matches.size() && i < limit; ++i)
+		if(!closure(directory_users.at(matches[i].second)))
+			break;
+
+	return matches.size();
+}
+
+/// The terms of a user are the words of their localpart and displayname.
+void
+directory_terms(const directory_user &user,
+                const m::search::terms_closure &closure)
+{
+	const m::user::id &user_id
+	{
+		user.user_id
+	};
+
+	if(m::search::terms(user_id.localname(), closure))
+		m::search::terms(user.displayname, closure);
+}
+
+/// Short terms are indexed by their length and bytes so they match the
+/// prefix of any term; longer terms by each trigram.
+void
+directory_grams(const string_view &term,
+                const directory_gram_closure &closure)
+{
+	const auto gram{[](const string_view &s)
+	{
+		uint32_t ret(size(s) << 24);
+		for(size_t i(0); i < size(s) && i < 3; ++i)
+			ret |= uint32_t(uint8_t(s[i])) << (16 - i * 8);
+
+		return ret;
+	}};
+
+	if(size(term) < 3)
+		return closure(gram(term));
+
+	for(size_t i(0); i + 3 <= size(term); ++i)
+		closure(gram(term.substr(i, 3)));
+}
+
+/// Add or remove the user from the postings of their grams.
+void
+directory_index(const uint32_t &ordinal,
+                const bool &add)
+{
+	const auto &user
+	{
+		directory_users.at(ordinal)
+	};
+
+	directory_terms(user, [&ordinal, &add]
+	(const string_view &term)
+	{
+		const auto each{[&ordinal, &add]
+		(const uint32_t &gram)
+		{
+			auto &list
+			{
+				directory_postings[gram]
+			};
+
+			const auto it
+			{
+				std::lower_bound(begin(list), end(list), ordinal)
+			};
+
+			if(add && (it == end(list) || *it != ordinal))
+				list.emplace(it, ordinal);
+
+			if(!add && it != end(list) && *it == ordinal)
+				list.erase(it);
+		}};
+
+		// Prefixes of one and two characters are indexed for each term.
+		for(size_t i(1); i < 3 && i <= size(term); ++i)
+			directory_grams(term.substr(0, i), each);
+
+		if(size(term) >= 3)
+			directory_grams(term, each);
+
+		return true;
+	});
+}
+
+/// Set a profile field of the user, adding the user if not yet present.
+/// When not replacing, only fields which are empty are set.
+void
+directory_set(const m::user::id &user_id,
+              const string_view &key,
+              const string_view &val,
+              const bool &replace)
+{
+	auto it
+	{
+		directory_ordinal.find(std::string(user_id))
+	};
+
+	if(it == end(directory_ordinal))
+	{
+		const uint32_t ordinal(directory_users.size());
+		directory_users.emplace_back(directory_user{user_id});
+		it = directory_ordinal.emplace(user_id, ordinal).first;
+		directory_index(ordinal, true);
+	}
+
+	const auto &ordinal(it->second);
+	auto &user(directory_users.at(ordinal));
+	if(key == "avatar_url" && (replace || user.avatar_url.empty()))
+		user.avatar_url = val;
+
+	if(key != "displayname" || (!replace && !user.displayname.empty()))
+		return;
+
+	if(user.displayname == val)
+		return;
+
+	directory_index(ordinal, false);
+	user.displayname = val;
+	directory_index(ordinal, true);
+}
+
+/// Load the directory from the users and their profiles. This runs once in
+/// the background; the hooks keep the directory current after that.
+void
+directory_load()
+{
+	if(!directory_enable)
+		return;
+
+	size_t count(0);
+	m::users::for_each([&count]
+	(const m::user::id &user_id)
+	{
+		ctx::interruption_point();
+		directory_set(user_id, {}, {}, false);
+		if(m::exists(m::user(user_id)))
+			m::user::profile(user_id).for_each([&user_id]
+			(const string_view &key, const string_view &val)
+			{
+				directory_set(user_id, key, val, true);
+				return true;
+			});
+
+		++count;
+		return true;
+	});
+
+	log::info
+	{
+		directory_log, "Loaded %zu users; %zu grams.",
+		count,
+		directory_postings.size(),
+	};
+}
+
+void
+handle_profile(const m::event &event,
+               m::vm::eval &eval)
+try
+{
+	if(!directory_enable)
+		return;
+
+	const m::user::id &sender
+	{
+		at<"sender"_>(event)
+	};
+
+	// The profile of a user is only found in their user room.
+	const m::user::room user_room
+	{
+		sender
+	};
+
+	if(json::get<"room_id"_>(event) != user_room.room_id)
+		return;
+
+	const json::object &content
+	{
+		json::get<"content"_>(event)
+	};
+
+	directory_set(sender, at<"state_key"_>(event), json::string(content["text"]), true);
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		directory_log, "Failed to update profile from %s :%s",
+		string_view{event.event_id},
+		e.what(),
+	};
+}
+
+/// Users joining rooms are added to the directory; the profile in the
+/// membership is used for users who don't have one here.
+void
+handle_member(const m::event &event,
+              m::vm::eval &eval)
+try
+{
+	if(!directory_enable)
+		return;
+
+	const m::user::id &user_id
+	{
+		at<"state_key"_>(event)
+	};
+
+	const json::object &content
+	{
+		json::get<"content"_>(event)
+	};
+
+	const bool replace
+	{
+		!m::my(user_id)
+	};
+
+	directory_set(user_id, "displayname", json::string(content["displayname"]), replace);
+	directory_set(user_id, "avatar_url", json::string(content["avatar_url"]), replace);
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		directory_log, "Failed to update member from %s :%s",
+		string_view{event.event_id},
+		e.what(),
+	};
+}
@@ -168,15 +168,18 @@ get__context(client &client,
 		if(before)
 			--before;
 
+		std::vector<m::event::idx> idxs;
+		idxs.reserve(limit);
 		for(size_t i(0); i < limit && before; --before, ++i)
+			idxs.emplace_back(before.event_idx());
+
+		m::seek(std::nothrow, idxs, [&](const auto &event_idx, const m::event &event)
 		{
-			const m::event &event{*before};
-			start = event.event_id;
-			if(!visible(event, request.user_id))
-				continue;
+			if(visible(event, request.user_id))
+				counts.before += _append(array, event, event_idx, user_room, room_depth);
 
-			counts.before += _append(array, event, before.event_idx(), user_room, room_depth);
-		}
+			return true;
+		});
 
 		if(before && limit > 0)
 			--before;
@@ -208,15 +211,18 @@ get__context(client &client,
 		if(after)
 			++after;
 
+		std::vector<m::event::idx> idxs;
+		idxs.reserve(limit);
 		for(size_t i(0); i < limit && after; ++after, ++i)
+			idxs.emplace_back(after.event_idx());
+
+		m::seek(std::nothrow, idxs, [&](const auto &event_idx, const m::event &event)
 		{
-			const m::event &event{*after};
-			end = event.event_id;
-			if(!visible(event, request.user_id))
-				continue;
+			if(visible(event, request.user_id))
+				counts.after += _append(array, event, event_idx, user_room, room_depth);
 
-			counts.after += _append(array, event, after.event_idx(), user_room, room_depth);
-		}
+			return true;
+		});
 
 		if(after && limit > 0)
 			++after;
@@ -245,11 +251,9 @@ get__context(client &client,
 			room
 		};
 
-		// Setup the event::fetch instance outside of the closure to avoid
-		// underlying reconstruction costs for now.
-		m::event::fetch event;
-
-		// Iterate the state.
+		// Gather the state indexes first so the events can be fetched with
+		// batched queries.
+		std::vector<m::event::idx> idxs;
 		state.for_each([&]
 		(const string_view &type, const string_view &state_key, const m::event::idx &event_idx)
 		{
@@ -264,16 +268,17 @@ get__context(client &client,
 				type == "m.room.member"
 			};
 
-			if(lazy_loaded)
-				return true;
+			if(!lazy_loaded)
+				idxs.emplace_back(event_idx);
 
-			if(!seek(std::nothrow, event, event_idx))
-				return true;
+			return true;
+		});
 
-			if(!visible(event, request.user_id))
-				return true;
+		m::seek(std::nothrow, idxs, [&](const auto &event_idx, const m::event &event)
+		{
+			if(visible(event, request.user_id))
+				counts.state += _append(array, event, event_idx, user_room, room_depth, false);
 
-			counts.state += _append(array, event, event_idx, user_room, room_depth, false);
 			return true;
 		});
 	}
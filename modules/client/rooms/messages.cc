@@ -138,38 +138,55 @@ get__messages(client &client,
 		room
 	};
 
-	for(; it; page.dir == 'b'? --it : ++it)
+	// The iteration gathers a page of indexes at a time so the events can be
+	// fetched with batched queries. Each page is sized for the hits remaining
+	// plus the event following them which becomes the end token.
+	bool stopped {false};
+	std::vector<m::event::idx> idxs;
+	idxs.reserve(64);
+	while(it && !stopped)
 	{
-		const m::event &event
+		const size_t want
 		{
-			*it
+			std::min(size_t(page.limit) - hit + 1, 64UL)
 		};
 
-		end = event.event_id;
-		if(hit >= page.limit || miss >= size_t(max_filter_miss))
-			break;
+		idxs.clear();
+		for(; it && idxs.size() < want; page.dir == 'b'? --it : ++it)
+			idxs.emplace_back(it.event_idx());
 
-		const bool ok
+		m::seek(std::nothrow, idxs, [&](const auto &event_idx, const m::event &event)
 		{
-			(empty(filter_json) || match(filter, event))
-
-			&& visible(event, request.user_id)
-
-			&& _append(chunk, event, it.event_idx(), user_room, room_depth)
-		};
-
-		hit += ok;
-		miss += !ok;
+			end = event.event_id;
+			if(hit >= page.limit || miss >= size_t(max_filter_miss))
+			{
+				stopped = true;
+				return false;
+			}
+
+			const bool ok
+			{
+				(empty(filter_json) || match(filter, event))
+
+				&& visible(event, request.user_id)
+
+				&& _append(chunk, event, event_idx, user_room, room_depth)
+			};
+
+			hit += ok;
+			miss += !ok;
+			return true;
+		});
 	}
 	chunk.~array();
 
-	if(it || page.dir == 'b')
+	if(stopped || it || page.dir == 'b')
 		json::stack::member
 		{
 			top, "start", json::value{start}
 		};
 
-	if(it || page.dir != 'b')
+	if(stopped || it || page.dir != 'b')
 		json::stack::member
 		{
 			top, "end", json::value{end}
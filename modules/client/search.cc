@@ -16,7 +16,37 @@ IRCD_MODULE
 	"Client 11.14 :Server Side Search"
 };
 
-ircd::resource
+conf::item<size_t>
+search_terms_max
+{
+	{ "name",     "ircd.client.search.terms.max" },
+	{ "default",  16L                            },
+};
+
+conf::item<size_t>
+search_limit_default
+{
+	{ "name",     "ircd.client.search.limit.default" },
+	{ "default",  10L                                },
+};
+
+conf::item<size_t>
+search_limit_max
+{
+	{ "name",     "ircd.client.search.limit.max" },
+	{ "default",  100L                           },
+};
+
+/// The best candidates kept from the index for a search; everything the
+/// search reports, including the count, is from these.
+conf::item<size_t>
+search_candidates_max
+{
+	{ "name",     "ircd.client.search.candidates.max" },
+	{ "default",  1024L                               },
+};
+
+m::resource
 search_resource
 {
 	"/_matrix/client/r0/search",
@@ -29,16 +59,27 @@ search_resource
 	}
 };
 
+struct search_result
+{
+	m::event::idx event_idx;
+	size_t matched;
+};
+
+static size_t
+search_matched(const m::event &,
+               const json::array &keys,
+               const vector_view<const string_view> &terms);
+
 static void
 handle_room_events(client &client,
-                   const resource::request &request,
+                   const m::resource::request &request,
                    const json::object &,
                    json::stack::object &);
 
-static resource::response
-post__search(client &client, const resource::request &request);
+static m::resource::response
+post__search(client &client, const m::resource::request &request);
 
-resource::method
+m::resource::method
 post_method
 {
 	search_resource, "POST", post__search,
@@ -47,14 +88,9 @@ post_method
 	}
 };
 
-resource::response
-post__search(client &client, const resource::request &request)
+m::resource::response
+post__search(client &client, const m::resource::request &request)
 {
-	const auto &batch
-	{
-		request.query["next_batch"]
-	};
-
 	const json::object &search_categories
 	{
 		request["search_categories"]
@@ -86,7 +122,7 @@ post__search(client &client, const resource::request &request)
 
 void
 handle_room_events(client &client,
-                   const resource::request &request,
+                   const m::resource::request &request,
                    const json::object &search_categories,
                    json::stack::object &result_categories)
 try
@@ -94,38 +130,199 @@ try
 	if(!search_categories.has("room_events"))
 		return;
 
-	const m::search::room_events room_events
+	const json::object &room_events_object
 	{
 		search_categories["room_events"]
 	};
 
-	json::stack::object room_events_result
+	const m::search::room_events room_events
 	{
-		result_categories, "room_events"
+		room_events_object
 	};
 
-	json::stack::array results
+	const json::string &search_term
 	{
-		room_events_result, "results"
+		at<"search_term"_>(room_events)
 	};
 
-	const json::string &search_term
+	const json::array &keys
 	{
-		at<"search_term"_>(room_events)
+		room_events_object["keys"]
 	};
 
+	const string_view &order_by
+	{
+		json::get<"order_by"_>(room_events)?
+			string_view{json::get<"order_by"_>(room_events)}:
+			"rank"_sv
+	};
+
+	const auto &filter
+	{
+		json::get<"filter"_>(room_events)
+	};
+
+	const size_t limit
+	{
+		std::clamp
+		(
+			json::get<"limit"_>(filter)?
+				size_t(json::get<"limit"_>(filter)):
+				size_t(search_limit_default),
+			1UL,
+			size_t(search_limit_max)
+		)
+	};
+
+	const size_t offset
+	{
+		lex_castable<size_t>(request.query["next_batch"])?
+			lex_cast<size_t>(request.query["next_batch"]):
+			0UL
+	};
+
+	// The search_term is tokenized the same way as the index.
+	std::vector<std::string> terms;
+	m::search::terms(search_term, [&terms]
+	(const string_view &term)
+	{
+		if(std::find(begin(terms), end(terms), term) == end(terms))
+			terms.emplace_back(term);
+
+		return terms.size() < size_t(search_terms_max);
+	});
+
+	const std::vector<string_view> terms_view
+	(
+		begin(terms), end(terms)
+	);
+
+	// Rooms are from the filter or else any room the user has been in.
+	std::vector<m::room::id::buf> rooms;
+	if(json::get<"rooms"_>(filter))
+		for(const json::string room_id : json::get<"rooms"_>(filter))
+			rooms.emplace_back(room_id);
+	else
+		for(const auto &membership : {"join"_sv, "leave"_sv})
+			m::user::rooms(request.user_id).for_each(membership, [&rooms]
+			(const m::room &room, const string_view &)
+			{
+				rooms.emplace_back(room.room_id);
+			});
+
+	// Candidates ranked by the number of terms matched then by recency;
+	// or only by recency.
+	const auto ranked{[&order_by]
+	(const auto &a, const auto &b)
+	{
+		if(order_by == "rank" && a.matched != b.matched)
+			return a.matched > b.matched;
+
+		return a.event_idx > b.event_idx;
+	}};
+
+	// Only the best candidates are kept as the rooms are queried.
+	const size_t candidates_max
+	{
+		std::max(size_t(search_candidates_max), 1UL)
+	};
+
+	const auto trim{[&ranked, &candidates_max]
+	(auto &candidates)
+	{
+		if(candidates.size() <= candidates_max)
+			return;
+
+		const auto nth(begin(candidates) + candidates_max);
+		std::nth_element(begin(candidates), nth, end(candidates), ranked);
+		candidates.erase(nth, end(candidates));
+	}};
+
+	std::vector<search_result> candidates;
+	for(const auto &room_id : rooms)
+	{
+		m::search::query(room_id, terms_view, [&candidates]
+		(const m::event::idx &event_idx, const size_t &matched)
+		{
+			candidates.emplace_back(search_result{event_idx, matched});
+			return true;
+		});
+
+		if(candidates.size() >= candidates_max * 2)
+			trim(candidates);
+	}
+
+	trim(candidates);
+	std::sort(begin(candidates), end(candidates), ranked);
+
 	log::debug
 	{
-		//TODO: search::log
-		m::log, "Search [%s] keys:%s order_by:%s inc_state:%b user:%s",
+		m::search::log, "Search [%s] keys:%s order_by:%s inc_state:%b user:%s terms:%zu rooms:%zu candidates:%zu offset:%zu",
 		search_term,
-		json::get<"keys"_>(room_events),
-		json::get<"order_by"_>(room_events),
+		string_view{keys},
+		order_by,
 		json::get<"include_state"_>(room_events),
+		request.user_id,
+		terms.size(),
+		rooms.size(),
+		candidates.size(),
+		offset,
+	};
+
+	json::stack::object room_events_result
+	{
+		result_categories, "room_events"
 	};
 
-	long count(0);
+	json::stack::array results
 	{
+		room_events_result, "results"
+	};
+
+	// Every candidate is verified so the count is only of results the user
+	// can see; the index is not aware of the visibility, redaction, or the
+	// keys the client asked for. The results are those after the offset up
+	// to the limit.
+	size_t next(candidates.size()), count(0), total(0);
+	for(size_t i(0); i < candidates.size(); ++i)
+	{
+		const auto &event_idx
+		{
+			candidates[i].event_idx
+		};
+
+		const m::event::fetch event
+		{
+			std::nothrow, event_idx
+		};
+
+		if(!event.valid)
+			continue;
+
+		if(m::redacted(event_idx))
+			continue;
+
+		if(!m::visible(event, request.user_id))
+			continue;
+
+		const size_t matched
+		{
+			search_matched(event, keys, terms_view)
+		};
+
+		if(!matched)
+			continue;
+
+		++total;
+		if(i < offset)
+			continue;
+
+		if(count >= limit)
+		{
+			next = std::min(next, i);
+			continue;
+		}
+
 		json::stack::object result
 		{
 			results
@@ -133,7 +330,10 @@ try
 
 		json::stack::member
 		{
-			result, "rank", json::value(0L)
+			result, "rank", json::value
+			{
+				double(matched) / std::max(terms.size(), 1UL)
+			}
 		};
 
 		json::stack::object result_event
@@ -141,25 +341,47 @@ try
 			result, "result"
 		};
 
-		//m::event::append::opts opts;
-		//m::append(result_event, event, opts);
+		m::event::append::opts opts;
+		opts.event_idx = &event_idx;
+		opts.user_id = &request.user_id;
+		m::event::append
+		{
+			result_event, event, opts
+		};
+
+		++count;
 	}
 	results.~array();
 
 	json::stack::member
 	{
-		room_events_result, "count", json::value(count)
+		room_events_result, "count", json::value
+		{
+			long(total)
+		}
 	};
 
-	json::stack::array
+	json::stack::array highlights
 	{
 		room_events_result, "highlights"
 	};
 
-	json::stack::object
-	{
-		room_events_result, "state"
-	};
+	for(const auto &term : terms)
+		highlights.append(json::value
+		{
+			term, json::STRING
+		});
+
+	highlights.~array();
+
+	if(next < candidates.size())
+		json::stack::member
+		{
+			room_events_result, "next_batch", json::value
+			{
+				lex_cast(next), json::STRING
+			}
+		};
 }
 catch(const std::system_error &)
 {
@@ -169,7 +391,53 @@ catch(const std::exception &e)
 {
 	log::error
 	{
-		//TODO: search::log
-		m::log, "Search error :%s", e.what()
+		m::search::log, "Search error :%s", e.what()
 	};
 }
+
+size_t
+search_matched(const m::event &event,
+               const json::array &keys,
+               const vector_view<const string_view> &terms)
+{
+	static const string_view keys_all[]
+	{
+		"content.body", "content.name", "content.topic"
+	};
+
+	const json::object &content
+	{
+		json::get<"content"_>(event)
+	};
+
+	std::vector<bool> found(terms.size(), false);
+	const auto match{[&content, &terms, &found]
+	(const string_view &key)
+	{
+		const auto &[prefix, prop]
+		{
+			split(key, '.')
+		};
+
+		if(prefix != "content")
+			return;
+
+		m::search::terms(json::string(content[prop]), [&terms, &found]
+		(const string_view &term)
+		{
+			for(size_t i(0); i < terms.size(); ++i)
+				found[i] = found[i] || terms[i] == term;
+
+			return true;
+		});
+	}};
+
+	if(!empty(keys))
+		for(const json::string key : keys)
+			match(key);
+	else
+		for(const auto &key : keys_all)
+			match(key);
+
+	return std::count(begin(found), end(found), true);
+}
@@ -35,15 +35,44 @@ namespace ircd::m::sync
 
 namespace ircd::m::sync::longpoll
 {
+	static bool park(ircd::client &, const data &);
 	static void fini() noexcept;
 }
 
+namespace ircd::m::sync::snapshot
+{
+	static string_view make_key(const mutable_buffer &, const data &);
+	static string_view strip(const mutable_buffer &, const json::object &);
+	static void evict(const data &, const string_view &key);
+	static std::string get(const data &);
+	static void set(const data &, const string_view &);
+	static bool compose(data &, json::stack::object &, const m::room &);
+	static bool handle(data &, const string_view &, bool &refresh);
+	static void init();
+	static void fini() noexcept;
+
+	extern conf::item<bool> enable;
+	extern conf::item<size_t> size_max;
+	extern conf::item<size_t> delta_max;
+	extern ircd::stats::item<uint64_t> hits;
+	extern ircd::stats::item<uint64_t> misses;
+	extern ircd::stats::item<uint64_t> stores;
+	extern const db::descriptor descriptor;
+	extern const db::description description;
+	extern std::shared_ptr<db::database> database;
+	extern db::column column;
+}
+
 ircd::mapi::header
 IRCD_MODULE
 {
-	"Client 6.2.1 :Sync", nullptr, []
+	"Client 6.2.1 :Sync", []
+	{
+		ircd::m::sync::snapshot::init();
+	}, []
 	{
 		ircd::m::sync::longpoll::fini();
+		ircd::m::sync::snapshot::fini();
 	}
 };
 
@@ -252,12 +281,84 @@ ircd::m::sync::handle_get(client &client,
 		)
 	};
 
+	// Pre-determine if longpoll sync mode should be used. This may
+	// indicate false now but after conducting a linear or even polylog
+	// sync if we don't find any events for the client then we might
+	// longpoll later.
+	const bool should_longpoll
+	{
+		// longpoll can be disabled by a conf item (for developers).
+		longpoll_enable
+
+		// polylog-phased sync and longpoll are totally exclusive.
+		&& !data.phased
+
+		// initial_sync cannot hang on a longpoll otherwise bad things clients
+		&& !initial_sync
+
+		// When the since token is in advance of the vm sequence number
+		// there's no events to consider for a sync.
+		&& range.first > vm::sequence::retired
+
+		// Spec sez that when ?full_state=1 to return immediately, so
+		// that rules out longpoll
+		&& !args.full_state
+	};
+
+	// An idle longpoll is parked off of this context until there's something
+	// for it to do. Nothing has been sent to the client yet.
+	if(should_longpoll && longpoll::park(client, data))
+		return {};
+
+	// Determine if the initial sync snapshot can be used. A phased initial
+	// sync is satisfied all at once by a snapshot; there's no snapshot of
+	// the phases themselves.
+	const bool should_snapshot
+	{
+		snapshot::enable
+		&& initial_sync
+		&& !std::get<1>(args.since)
+		&& !args.semaphore
+		&& !polylog_only
+	};
+
+	// The stored snapshot is read up front; when it's close enough to the
+	// present it is patched forward with a linear sync of the difference.
+	const std::string snapshot
+	{
+		should_snapshot?
+			snapshot::get(data):
+			std::string{}
+	};
+
+	// Captures the response as it's flushed to become the next snapshot.
+	std::string capture;
+	bool capturing
+	{
+		should_snapshot
+	};
+
 	// Start the chunked encoded response.
 	resource::response::chunked response
 	{
 		client, http::OK, buffer_size
 	};
 
+	const auto flusher{[&data, &response, &capture, &capturing]
+	(const const_buffer &buf)
+	{
+		const auto wrote
+		{
+			sync::flush(data, response, buf)
+		};
+
+		capturing &= size(capture) + size(wrote) <= size_t(snapshot::size_max);
+		if(capturing)
+			capture.append(begin(wrote), end(wrote));
+
+		return wrote;
+	}};
+
 	// Start the JSON stream for this response. As the sync items are iterated
 	// the supplied response buffer will be flushed out to the supplied
 	// callback; in this case, both are provided by the chunked encoding
@@ -267,7 +368,7 @@ ircd::m::sync::handle_get(client &client,
 	json::stack out
 	{
 		response.buf,
-		std::bind(sync::flush, std::ref(data), std::ref(response), ph::_1),
+		flusher,
 		size_t(flush_hiwat)
 	};
 	data.out = &out;
@@ -277,29 +378,18 @@ ircd::m::sync::handle_get(client &client,
 		log, "request %s", loghead(data)
 	};
 
-	// Pre-determine if longpoll sync mode should be used. This may
-	// indicate false now but after conducting a linear or even polylog
-	// sync if we don't find any events for the client then we might
-	// longpoll later.
-	const bool should_longpoll
+	bool refresh(false);
+	if(!empty(snapshot) && snapshot::handle(data, snapshot, refresh))
 	{
-		// longpoll can be disabled by a conf item (for developers).
-		longpoll_enable
-
-		// polylog-phased sync and longpoll are totally exclusive.
-		&& !data.phased
-
-		// initial_sync cannot hang on a longpoll otherwise bad things clients
-		&& !initial_sync
+		out.flush(true);
+		if(capturing && refresh)
+			snapshot::set(data, capture);
 
-		// When the since token is in advance of the vm sequence number
-		// there's no events to consider for a sync.
-		&& range.first > vm::sequence::retired
+		return std::move(response);
+	}
 
-		// Spec sez that when ?full_state=1 to return immediately, so
-		// that rules out longpoll
-		&& !args.full_state
-	};
+	// Nothing of a phased initial sync is stored.
+	capturing &= !data.phased;
 
 	// Determine if linear sync mode should be used. If this is not used, and
 	// longpoll mode is not used, then polylog mode must be used.
@@ -352,6 +442,14 @@ ircd::m::sync::handle_get(client &client,
 			false
 	};
 
+	// A phased initial sync only produces a part of the whole.
+	if(complete && should_polylog && capturing && !data.phased)
+	{
+		out.flush(true);
+		if(capturing)
+			snapshot::set(data, capture);
+	}
+
 	if(complete)
 		return std::move(response);
 
@@ -442,17 +540,149 @@ namespace ircd::m::sync
 
 namespace ircd::m::sync::longpoll
 {
-	static bool polled(data &, const args &);
-	static int poll(data &);
+	struct waiter;
+	struct parked;
+	using index_map = std::multimap<std::string, waiter *, std::less<>>;
+	using parking_map = std::multimap<system_point, std::shared_ptr<parked>>;
+	using open_closure = std::function<void (data &)>;
+
+	static event::idx notified_mark();
+	static size_t wake(const string_view &key, const m::event &, const event::idx &);
+	static size_t wake_members(const string_view &room_id, const m::event &, const event::idx &);
+	static bool ready(const data &, waiter &);
+	static void advance(data &, waiter &);
+	static bool polled(data &, const args &, const open_closure & = {});
+	static int poll(data &, waiter &);
+	static void resume(parked &);
+	static void unpark(parked &);
+	static void watch(parked &);
+	static void handle_closed(const std::weak_ptr<parked> &, const error_code &);
+	static void reaper_worker();
 	static void handle_notify(const m::event &, m::vm::eval &);
-	static void fini() noexcept;
 
+	extern conf::item<bool> park_enable;
 	extern m::hookfn<m::vm::eval &> notified;
-	extern ctx::dock dock;
+	extern ircd::stats::item<uint64_t> notifies;
+	extern ircd::stats::item<uint64_t> wakeups;
+	extern ircd::stats::item<uint64_t> broadcasts;
+	extern ircd::stats::item<uint64_t> parks;
+	extern ircd::stats::item<uint64_t> unparks;
+	extern index_map index;
+	extern parking_map parking;
+	extern ctx::dock reaper_dock;
+	extern ctx::context reaper;
 }
 
-decltype(ircd::m::sync::longpoll::dock)
-ircd::m::sync::longpoll::dock;
+/// A longpolling request registers itself in the index under its user and
+/// its user's room; registration is constant regardless of the rooms of the
+/// user. The notify hook resolves the local users an event concerns (i.e the
+/// local members of its room) and only queues the event to their waiters;
+/// events for another device are filtered by the waiter.
+struct ircd::m::sync::longpoll::waiter
+:instance_list<waiter>
+{
+	device::id::buf device_id;
+	ctx::dock dock;
+	std::deque<event::idx> queue;
+	index_map::iterator keys[2];
+	std::function<void ()> unpark;
+	event::idx floor {0};
+
+	bool push(const m::event &, const event::idx &);
+
+	waiter(const m::user &, const string_view &device_id);
+	waiter(waiter &&) = delete;
+	waiter(const waiter &) = delete;
+	~waiter() noexcept;
+};
+
+/// An idle longpoll request parked without a context. Nothing of the request
+/// remains on any stack; this record has what's needed to resume it when its
+/// waiter is notified or it times out.
+struct ircd::m::sync::longpoll::parked
+:std::enable_shared_from_this<parked>
+{
+	std::shared_ptr<ircd::client> client;
+	m::user::id::buf user_id;
+	std::string filter_id;
+	sync::args args;
+	m::events::range range;
+	longpoll::waiter waiter;
+	parking_map::iterator it;
+
+	parked(ircd::client &, const data &);
+};
+
+template<>
+decltype(ircd::util::instance_list<ircd::m::sync::longpoll::waiter>::allocator)
+ircd::util::instance_list<ircd::m::sync::longpoll::waiter>::allocator
+{};
+
+template<>
+decltype(ircd::util::instance_list<ircd::m::sync::longpoll::waiter>::list)
+ircd::util::instance_list<ircd::m::sync::longpoll::waiter>::list
+{
+	allocator
+};
+
+decltype(ircd::m::sync::longpoll::index)
+ircd::m::sync::longpoll::index;
+
+decltype(ircd::m::sync::longpoll::parking)
+ircd::m::sync::longpoll::parking;
+
+decltype(ircd::m::sync::longpoll::reaper_dock)
+ircd::m::sync::longpoll::reaper_dock;
+
+decltype(ircd::m::sync::longpoll::reaper)
+ircd::m::sync::longpoll::reaper
+{
+	"m.sync.reaper", 128_KiB, &reaper_worker, context::POST,
+};
+
+decltype(ircd::m::sync::longpoll::park_enable)
+ircd::m::sync::longpoll::park_enable
+{
+	{ "name",     "ircd.client.sync.longpoll.park" },
+	{ "default",  true                             },
+	{ "description",
+
+	R"(
+	Park idle longpoll requests off of their context until a relevant event
+	arrives or they time out. This releases the context and its stack back
+	to the client request pool while the request is idle.
+	)"}
+};
+
+decltype(ircd::m::sync::longpoll::notifies)
+ircd::m::sync::longpoll::notifies
+{
+	{ "name", "ircd.client.sync.longpoll.notifies" },
+};
+
+decltype(ircd::m::sync::longpoll::wakeups)
+ircd::m::sync::longpoll::wakeups
+{
+	{ "name", "ircd.client.sync.longpoll.wakeups" },
+};
+
+decltype(ircd::m::sync::longpoll::broadcasts)
+ircd::m::sync::longpoll::broadcasts
+{
+	{ "name", "ircd.client.sync.longpoll.broadcasts" },
+};
+
+decltype(ircd::m::sync::longpoll::parks)
+ircd::m::sync::longpoll::parks
+{
+	{ "name", "ircd.client.sync.longpoll.parks" },
+};
+
+decltype(ircd::m::sync::longpoll::unparks)
+ircd::m::sync::longpoll::unparks
+{
+	{ "name", "ircd.client.sync.longpoll.unparks" },
+};
 
 decltype(ircd::m::sync::longpoll::notified)
 ircd::m::sync::longpoll::notified
@@ -467,14 +697,27 @@ void
 ircd::m::sync::longpoll::fini()
 noexcept
 {
-	if(!dock.empty())
+	reaper.terminate();
+	reaper.join();
+
+	if(!waiter::list.empty())
 		log::warning
 		{
-			log, "Interrupting %zu longpolling clients...",
-			dock.size(),
+			log, "Interrupting %zu longpolling clients (%zu parked)...",
+			waiter::list.size(),
+			parking.size(),
 		};
 
-	interrupt(dock);
+	for(auto *const &waiter : waiter::list)
+	{
+		waiter->unpark = nullptr;
+		interrupt(waiter->dock);
+	}
+
+	for(const auto &[timesout, parked] : parking)
+		parked->client->close(net::dc::SSL_NOTIFY, net::close_ignore);
+
+	parking.clear();
 }
 
 void
@@ -486,7 +729,45 @@ try
 	if(!eval.opts->notify_clients)
 		return;
 
-	dock.notify_all();
+	const auto &event_idx
+	{
+		eval.sequence
+	};
+
+	if(!event_idx)
+		return;
+
+	const auto &type
+	{
+		json::get<"type"_>(event)
+	};
+
+	size_t woken(0);
+	if(type == "ircd.presence")
+	{
+		for(auto *const &waiter : waiter::list)
+			woken += waiter->push(event, event_idx);
+
+		++broadcasts;
+	}
+	else if(!index.empty())
+	{
+		// Events in a user's room are found by the user's room; events in
+		// any other room by its local members.
+		woken += wake(json::get<"room_id"_>(event), event, event_idx);
+		woken += wake_members(json::get<"room_id"_>(event), event, event_idx);
+
+		// The target of membership; and the user of a receipt.
+		if(type == "m.room.member" || type == "ircd.read")
+			woken += wake(json::get<"state_key"_>(event), event, event_idx);
+
+		// Typing is sent to the sender's room and concerns the target room.
+		if(type == "ircd.typing")
+			woken += wake_members(json::string(json::get<"content"_>(event).get("room_id")), event, event_idx);
+	}
+
+	++notifies;
+	wakeups += woken;
 }
 catch(const ctx::interrupted &)
 {
@@ -502,310 +783,1403 @@ catch(const std::exception &e)
 	};
 }
 
-/// Longpolling blocks the client's request until a relevant event is processed
-/// by the m::vm. If no event is processed by a timeout this returns false.
-bool
-ircd::m::sync::longpoll_handle(data &data)
-try
+size_t
+ircd::m::sync::longpoll::wake(const string_view &key,
+                              const m::event &event,
+                              const event::idx &event_idx)
 {
-	int ret;
-	while((ret = longpoll::poll(data)) == -1)
-	{
-		// When the client explicitly gives a next_batch token we have to
-		// adhere to it and return an empty response before going past their
-		// desired upper-bound for this /sync.
-		assert(data.args);
-		if(int64_t(data.args->next_batch) > 0)
-			if(data.range.first >= data.range.second || data.range.second >= vm::sequence::retired)
-				return false;
+	if(!key)
+		return 0;
 
-		++data.range.second;
-		assert(data.range.first <= data.range.second);
-	}
+	size_t ret(0);
+	auto pit(index.equal_range(key));
+	for(; pit.first != pit.second; ++pit.first)
+		ret += pit.first->second->push(event, event_idx);
 
 	return ret;
 }
-catch(const std::system_error &e)
+
+size_t
+ircd::m::sync::longpoll::wake_members(const string_view &room_id,
+                                      const m::event &event,
+                                      const event::idx &event_idx)
 {
-	log::derror
+	if(!room_id || !valid(m::id::ROOM, room_id))
+		return 0;
+
+	const m::room::members members
 	{
-		log, "longpoll %s failed :%s",
-		loghead(data),
-		e.what()
+		m::room::id{room_id}
 	};
 
-	throw;
-}
-catch(const std::exception &e)
-{
-	log::error
+	size_t ret(0);
+	members.for_each("join", my_host(), [&event, &event_idx, &ret]
+	(const m::user::id &user_id)
 	{
-		log, "longpoll %s FAILED :%s",
-		loghead(data),
-		e.what()
-	};
+		ret += wake(user_id, event, event_idx);
+		return true;
+	});
 
-	throw;
+	return ret;
 }
 
-/// When the vm's sequence number is incremented our dock is notified and the
-/// event at that next sequence number is fetched. That event gets proffered
-/// around the linear sync handlers for whether it's relevant to the user
-/// making the request on this stack.
-///
-/// If relevant, we respond immediately with that one event and finish the
-/// request right there, providing them the next since token of one-past the
-/// event_idx that was just synchronized.
-///
-/// If not relevant, we send nothing and continue checking events that come
-/// through until the timeout. This will be an empty response providing the
-/// client with the next since token of one past where we left off (vm's
-/// current sequence number) to start the next /sync.
-///
-/// @returns
-/// - true if a relevant event was hit and output to the client. If so, this
-/// request is finished and nothing else can be sent to the client.
-/// - false if a timeout occurred. Nothing was sent to the client so the
-/// request must be finished upstack, or an exception may be thrown, etc.
-/// - -1 to continue the polling loop when no relevant event was hit. Nothing
-/// has been sent to the client yet here either.
-///
-int
-ircd::m::sync::longpoll::poll(data &data)
+/// The highest event_idx below which all events have been presented to the
+/// notify hook. Events retired by the vm which are yet to be notified are
+/// found among the evals still in progress.
+ircd::m::event::idx
+ircd::m::sync::longpoll::notified_mark()
 {
-	const auto ready{[&data]
+	event::idx ret
 	{
-		assert(data.range.second <= m::vm::sequence::retired + 1);
-		return data.range.second <= m::vm::sequence::retired;
-	}};
-
-	assert(data.args);
-	if(!dock.wait_until(data.args->timesout, ready))
-		return false;
+		vm::sequence::retired
+	};
 
-	// Check if client went away while we were sleeping,
-	// if so, just returning true is the easiest way out w/o throwing
-	assert(data.client && data.client->sock);
-	if(unlikely(!data.client || !data.client->sock))
-		return true;
+	for(const auto *const &eval : vm::eval::list)
+		if(eval->sequence && eval->sequence <= ret && eval->phase <= vm::phase::NOTIFY)
+			ret = eval->sequence - 1;
 
-	// slightly more involved check of the socket before
-	// we waste resources on the operation; throws.
-	const auto &client(*data.client);
-	net::check(*client.sock);
+	return ret;
+}
 
-	// Keep in mind if the handler returns true that means
-	// it made a hit and we can return true to exit longpoll
-	// and end the request cleanly.
-	if(polled(data, *data.args))
-		return true;
+//
+// waiter::waiter
+//
 
-	return -1;
+ircd::m::sync::longpoll::waiter::waiter(const m::user &user,
+                                        const string_view &device_id)
+:device_id
+{
+	device_id
 }
-
-/// Evaluate the event indexed by data.range.second (the upper-bound). The
-/// sync system sees a data.range window of [since, U] where U is a counter
-/// that starts at the `vm::sequence::retired` event_idx
-bool
-ircd::m::sync::longpoll::polled(data &data,
-                                const args &args)
 {
-	const m::event::fetch event
+	const m::user::room user_room
 	{
-		std::nothrow, data.range.second
+		user
 	};
 
-	if(!event.valid)
-		return false;
+	keys[0] = index.emplace(std::string(user.user_id), this);
+	keys[1] = index.emplace(std::string(user_room.room_id), this);
 
-	const scope_restore their_event
-	{
-		data.event, &event
-	};
+	// Events retired before the registration above completed were not
+	// necessarily queued; they are evaluated in sequence instead.
+	floor = vm::sequence::retired + 1;
+}
 
-	const scope_restore their_event_idx
-	{
-		data.event_idx, event.event_idx
-	};
+ircd::m::sync::longpoll::waiter::~waiter()
+noexcept
+{
+	for(const auto &it : keys)
+		index.erase(it);
+}
 
-	const unique_buffer<mutable_buffer> scratch
+bool
+ircd::m::sync::longpoll::waiter::push(const m::event &event,
+                                      const event::idx &event_idx)
+{
+	// Device-specific events in the user's room only concern that device.
+	const auto &type
 	{
-		128_KiB
+		json::get<"type"_>(event)
 	};
 
-	const size_t consumed
+	if(type == "ircd.to_device")
 	{
-		linear_proffer_event(data, scratch)
-	};
+		const json::string device_id
+		{
+			json::get<"content"_>(event).get("device_id")
+		};
 
-	// In semaphore-mode we're just here to ride the longpoll's blocking
-	// behavior. We want the client to get an empty response.
-	if(args.semaphore)
-		return false;
+		if(device_id != "*" && device_id != this->device_id)
+			return false;
+	}
 
-	if(!consumed && !data.reflow_full_state)
+	if(!queue.empty() && queue.back() >= event_idx)
 		return false;
 
-	assert(!data.reflow_full_state || data.event_idx);
-	const auto next
+	queue.emplace_back(event_idx);
+	if(unpark)
 	{
-		data.event_idx && data.reflow_full_state?
-			std::min(data.event_idx, vm::sequence::retired + 1):
-		data.event_idx?
-			std::min(data.event_idx + 1, vm::sequence::retired + 1):
-			std::min(data.range.second + 1, vm::sequence::retired + 1)
-	};
+		const auto unpark(std::move(this->unpark));
+		this->unpark = nullptr;
+		unpark();
+	}
+	else dock.notify_one();
+
+	return true;
+}
+
+//
+// parked::parked
+//
+
+ircd::m::sync::longpoll::parked::parked(ircd::client &client,
+                                        const data &data)
+:client
+{
+	shared_from(client)
+}
+,user_id
+{
+	data.user.user_id
+}
+,filter_id
+{
+	data.args->filter_id
+}
+,args
+{
+	*data.args
+}
+,range
+{
+	data.range
+}
+,waiter
+{
+	m::user{user_id}, data.device_id
+}
+{
+	args.filter_id = filter_id;
+}
+
+/// Park the request off of its context. This must be called before anything
+/// is sent to the client; returns false if the request can't be parked, in
+/// which case it continues on this context.
+bool
+ircd::m::sync::longpoll::park(ircd::client &client,
+                              const data &data)
+{
+	if(!park_enable)
+		return false;
+
+	assert(data.args);
+	auto parked
+	{
+		std::make_shared<longpoll::parked>(client, data)
+	};
+
+	if(!client.park())
+		return false;
+
+	auto &p(*parked);
+	p.it = parking.emplace(p.args.timesout, std::move(parked));
+	p.waiter.unpark = [&p]
+	{
+		longpoll::unpark(p);
+	};
+
+	++parks;
+	watch(p);
+	reaper_dock.notify_all();
+
+	// Events which arrived during registration are handled straight away.
+	if(!p.waiter.queue.empty() || p.range.second < p.waiter.floor)
+		longpoll::unpark(p);
+
+	return true;
+}
+
+/// Dispatch a parked request to a context from the client request pool. This
+/// is called by the notify hook or the reaper; the record is removed from
+/// the parking and owned by the resumption.
+void
+ircd::m::sync::longpoll::unpark(parked &p)
+{
+	assert(p.it != end(parking));
+	auto parked
+	{
+		std::move(p.it->second)
+	};
+
+	parking.erase(p.it);
+	p.it = end(parking);
+	p.waiter.unpark = nullptr;
+	++unparks;
+
+	// The socket is used by the request again; the watch is canceled.
+	if(!p.client->stream && p.client->sock && net::opened(*p.client->sock))
+		net::cancel(*p.client->sock);
+
+	auto client(p.client);
+	client::resume(std::move(client), [parked(std::move(parked))]
+	(ircd::client &)
+	{
+		resume(*parked);
+	});
+}
+
+/// A parked request on a context again. Queued events are proffered without
+/// blocking; the response is only started once there is something to send.
+/// Without a hit the request is parked again until it times out.
+void
+ircd::m::sync::longpoll::resume(parked &p)
+{
+	auto &client(*p.client);
+	sync::stats stats;
+	std::optional<resource::response::chunked> response;
+	std::optional<json::stack> out;
+	sync::data data
+	{
+		m::user{p.user_id},
+		p.range,
+		&client,
+		nullptr,
+		&stats,
+		&p.args,
+		p.waiter.device_id,
+	};
+
+	const auto open{[&response, &out, &client]
+	(sync::data &data)
+	{
+		response.emplace(client, http::OK, size_t(buffer_size));
+		out.emplace
+		(
+			response->buf,
+			std::bind(sync::flush, std::ref(data), std::ref(*response), ph::_1),
+			size_t(flush_hiwat)
+		);
+
+		data.out = std::addressof(*out);
+	}};
+
+	bool bounded(false);
+	while(ready(data, p.waiter))
+	{
+		// The client went away; this is not a fault of the server.
+		if(const auto ec{net::check(std::nothrow, *client.sock)})
+		{
+			log::derror
+			{
+				log, "longpoll %s resume :%s",
+				loghead(data),
+				string(ec),
+			};
+
+			client.close(net::dc::RST, net::close_ignore);
+			return;
+		}
+
+		advance(data, p.waiter);
+		if(polled(data, p.args, open))
+			return;
+
+		// The client's explicit next_batch bounds the longpoll as well.
+		if(int64_t(p.args.next_batch) > 0)
+			if(data.range.first >= data.range.second || data.range.second >= vm::sequence::retired)
+			{
+				bounded = true;
+				break;
+			}
+
+		++data.range.second;
+	}
+
+	p.range = data.range;
+	const bool timedout
+	{
+		bounded || ircd::now<system_point>() >= p.args.timesout
+	};
+
+	if(!timedout && client.park())
+	{
+		p.it = parking.emplace(p.args.timesout, shared_from(p));
+		p.waiter.unpark = [&p]
+		{
+			longpoll::unpark(p);
+		};
+
+		++parks;
+		watch(p);
+		if(!p.waiter.queue.empty())
+			longpoll::unpark(p);
+
+		return;
+	}
+
+	// Advance past the events which were not queued to this waiter.
+	if(!bounded && data.range.second >= p.waiter.floor)
+		data.range.second = std::max(data.range.second, notified_mark() + 1);
+
+	open(data);
+	empty_response(data, polylog_only? data.range.first: data.range.second);
+}
+
+/// The socket of a parked request is waited on so the request is removed
+/// when the client goes away rather than when it times out. Nothing is read;
+/// a client sending anything else while parked is left alone. The socket of
+/// an HTTP/2 stream belongs to its session and isn't waited on here.
+void
+ircd::m::sync::longpoll::watch(parked &p)
+{
+	auto &client(*p.client);
+	if(client.stream || !client.sock || !net::opened(*client.sock))
+		return;
+
+	const net::wait_opts opts
+	{
+		net::ready::READ
+	};
+
+	net::wait(*client.sock, opts, net::wait_callback_ec{[wp(weak_from(p))]
+	(const error_code &ec)
+	{
+		handle_closed(wp, ec);
+	}});
+}
+
+void
+ircd::m::sync::longpoll::handle_closed(const std::weak_ptr<parked> &wp,
+                                       const error_code &ec)
+{
+	const auto p
+	{
+		wp.lock()
+	};
+
+	// The request was resumed in the meantime.
+	if(!p || p->it == end(parking))
+		return;
+
+	auto &client(*p->client);
+	const error_code err
+	{
+		ec? ec: net::check(std::nothrow, *client.sock)
+	};
+
+	if(!err)
+		return;
+
+	log::dwarning
+	{
+		log, "%s parked longpoll closed :%s",
+		client.loghead(),
+		string(err),
+	};
+
+	parking.erase(p->it);
+	p->it = end(parking);
+	p->waiter.unpark = nullptr;
+	client.close(net::dc::RST, net::close_ignore);
+}
+
+void
+ircd::m::sync::longpoll::reaper_worker()
+{
+	while(1)
+	{
+		reaper_dock.wait([]
+		{
+			return !parking.empty();
+		});
+
+		// Sleep until the earliest timeout; an earlier timeout parked in the
+		// interim will wake us to reconsider.
+		const auto timesout
+		{
+			begin(parking)->first
+		};
+
+		reaper_dock.wait_until(timesout, [&timesout]
+		{
+			return !parking.empty() && begin(parking)->first < timesout;
+		});
+
+		const auto now
+		{
+			ircd::now<system_point>()
+		};
+
+		while(!parking.empty() && begin(parking)->first <= now)
+			unpark(*begin(parking)->second);
+	}
+}
+
+/// Longpolling blocks the client's request until a relevant event is processed
+/// by the m::vm. If no event is processed by a timeout this returns false.
+bool
+ircd::m::sync::longpoll_handle(data &data)
+try
+{
+	longpoll::waiter waiter
+	{
+		data.user, data.device_id
+	};
+
+	int ret;
+	while((ret = longpoll::poll(data, waiter)) == -1)
+	{
+		// When the client explicitly gives a next_batch token we have to
+		// adhere to it and return an empty response before going past their
+		// desired upper-bound for this /sync.
+		assert(data.args);
+		if(int64_t(data.args->next_batch) > 0)
+			if(data.range.first >= data.range.second || data.range.second >= vm::sequence::retired)
+				return false;
+
+		++data.range.second;
+		assert(data.range.first <= data.range.second);
+	}
+
+	return ret;
+}
+catch(const std::system_error &e)
+{
+	log::derror
+	{
+		log, "longpoll %s failed :%s",
+		loghead(data),
+		e.what()
+	};
+
+	throw;
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		log, "longpoll %s FAILED :%s",
+		loghead(data),
+		e.what()
+	};
+
+	throw;
+}
+
+/// The waiter is notified when an event which might concern it is processed
+/// by the vm. The next event queued to the waiter is fetched. That event gets
+/// proffered around the linear sync handlers for whether it's relevant to the
+/// user making the request on this stack. Events which were not queued to
+/// this waiter are skipped once the notify hook has seen them; those which
+/// it has not seen yet are proffered in sequence as well.
+///
+/// If relevant, we respond immediately with that one event and finish the
+/// request right there, providing them the next since token of one-past the
+/// event_idx that was just synchronized.
+///
+/// If not relevant, we send nothing and continue checking events that come
+/// through until the timeout. This will be an empty response providing the
+/// client with the next since token of one past where we left off (vm's
+/// current sequence number) to start the next /sync.
+///
+/// @returns
+/// - true if a relevant event was hit and output to the client. If so, this
+/// request is finished and nothing else can be sent to the client.
+/// - false if a timeout occurred. Nothing was sent to the client so the
+/// request must be finished upstack, or an exception may be thrown, etc.
+/// - -1 to continue the polling loop when no relevant event was hit. Nothing
+/// has been sent to the client yet here either.
+///
+int
+ircd::m::sync::longpoll::poll(data &data,
+                              waiter &waiter)
+{
+	assert(data.args);
+	if(!waiter.dock.wait_until(data.args->timesout, [&data, &waiter]
+	{
+		return ready(data, waiter);
+	}))
+	{
+		// Advance past the events which were not queued to this waiter.
+		if(data.range.second >= waiter.floor)
+			data.range.second = std::max(data.range.second, notified_mark() + 1);
+
+		return false;
+	}
+
+	// Check if client went away while we were sleeping,
+	// if so, just returning true is the easiest way out w/o throwing
+	assert(data.client && data.client->sock);
+	if(unlikely(!data.client || !data.client->sock))
+		return true;
+
+	// slightly more involved check of the socket before
+	// we waste resources on the operation; throws.
+	const auto &client(*data.client);
+	net::check(*client.sock);
+
+	// Keep in mind if the handler returns true that means
+	// it made a hit and we can return true to exit longpoll
+	// and end the request cleanly.
+	advance(data, waiter);
+	if(polled(data, *data.args))
+		return true;
+
+	return -1;
+}
+
+/// Whether there is an event to proffer: either one queued to the waiter or
+/// one retired before the waiter was registered.
+bool
+ircd::m::sync::longpoll::ready(const data &data,
+                               waiter &waiter)
+{
+	auto &queue
+	{
+		waiter.queue
+	};
+
+	assert(data.range.second <= m::vm::sequence::retired + 1);
+	while(!queue.empty() && queue.front() < data.range.second)
+		queue.pop_front();
+
+	return !queue.empty() || data.range.second < waiter.floor;
+}
+
+/// Skip to the next queued event unless there are events before it which
+/// have not been seen by the notify hook yet.
+void
+ircd::m::sync::longpoll::advance(data &data,
+                                 waiter &waiter)
+{
+	auto &queue
+	{
+		waiter.queue
+	};
+
+	if(data.range.second < waiter.floor || queue.empty())
+		return;
+
+	const auto mark
+	{
+		notified_mark()
+	};
+
+	if(data.range.second <= mark)
+		data.range.second = std::min(queue.front(), mark + 1);
+
+	if(data.range.second == queue.front())
+		queue.pop_front();
+}
+
+/// Evaluate the event indexed by data.range.second (the upper-bound). The
+/// sync system sees a data.range window of [since, U] where U is a counter
+/// that starts at the `vm::sequence::retired` event_idx
+bool
+ircd::m::sync::longpoll::polled(data &data,
+                                const args &args,
+                                const open_closure &open)
+{
+	const m::event::fetch event
+	{
+		std::nothrow, data.range.second
+	};
+
+	if(!event.valid)
+		return false;
+
+	const scope_restore their_event
+	{
+		data.event, &event
+	};
+
+	const scope_restore their_event_idx
+	{
+		data.event_idx, event.event_idx
+	};
+
+	const unique_buffer<mutable_buffer> scratch
+	{
+		128_KiB
+	};
+
+	const size_t consumed
+	{
+		linear_proffer_event(data, scratch)
+	};
+
+	// In semaphore-mode we're just here to ride the longpoll's blocking
+	// behavior. We want the client to get an empty response.
+	if(args.semaphore)
+		return false;
+
+	if(!consumed && !data.reflow_full_state)
+		return false;
+
+	assert(!data.reflow_full_state || data.event_idx);
+	const auto next
+	{
+		data.event_idx && data.reflow_full_state?
+			std::min(data.event_idx, vm::sequence::retired + 1):
+		data.event_idx?
+			std::min(data.event_idx + 1, vm::sequence::retired + 1):
+			std::min(data.range.second + 1, vm::sequence::retired + 1)
+	};
+
+	const auto &flags
+	{
+		data.reflow_full_state?
+			"P"_sv:
+			string_view{}
+	};
+
+	const json::vector vector
+	{
+		string_view
+		{
+			buffer::data(scratch), consumed
+		}
+	};
+
+	// A resumed request starts its response only now.
+	if(open)
+		open(data);
+
+	json::stack::object top
+	{
+		*data.out
+	};
+
+	if(likely(consumed))
+		json::merge(top, vector);
+
+	char since_buf[64];
+	json::stack::member
+	{
+		top, "next_batch", json::value
+		{
+			make_since(since_buf, next, flags), json::STRING
+		}
+	};
+
+	log::debug
+	{
+		log, "request %s longpoll hit:%lu consumed:%zu complete @%lu",
+		loghead(data),
+		event.event_idx,
+		consumed,
+		next
+	};
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// linear
+//
+
+// Approach for small `since` ranges. The range of events is iterated and
+// the event itself is presented to each handler in the schema. This also
+// involves a json::stack trace of the schema so that if the handler determines
+// the event is appropriate for syncing to the user the output buffer will
+// contain a residue of a /sync response with a single event.
+//
+// After the iteration of events is complete we are left with several buffers
+// of properly formatted individual /sync responses which we rewrite into a
+// single response to overcome the inefficiency of request ping-pong under
+// heavy load.
+
+namespace ircd::m::sync
+{
+	static bool linear_proffer_event_one(data &);
+	static size_t linear_proffer_event(data &, const mutable_buffer &);
+	static std::pair<event::idx, bool> linear_proffer(data &, window_buffer &);
+}
+
+bool
+ircd::m::sync::linear_handle(data &data)
+try
+{
+	json::stack::checkpoint checkpoint
+	{
+		*data.out
+	};
+
+	json::stack::object top
+	{
+		*data.out
+	};
+
+	const unique_buffer<mutable_buffer> buf
+	{
+		// must be at least worst-case size of m::event plus some.
+		std::max(size_t(linear_buffer_size), size_t(128_KiB))
+	};
+
+	window_buffer wb{buf};
+	const auto &[last, completed]
+	{
+		linear_proffer(data, wb)
+	};
+
+	const json::vector vector
+	{
+		wb.completed()
+	};
+
+	const auto next
+	{
+		last && completed?
+			data.range.second:
+		last && data.reflow_full_state?
+			std::min(last, data.range.second):
+		last?
+			std::min(last + 1, data.range.second):
+			0UL
+	};
+
+	assert(!data.reflow_full_state || (last && !completed));
+
+	if(last)
+	{
+		const auto &flags
+		{
+			data.reflow_full_state?
+				"P"_sv:
+				string_view{}
+		};
+
+		char buf[64];
+		json::stack::member
+		{
+			top, "next_batch", json::value
+			{
+				make_since(buf, next, flags), json::STRING
+			}
+		};
+
+		json::merge(top, vector);
+	}
+	else checkpoint.committing(false);
+
+	log::debug
+	{
+		log, "request %s linear last:%lu %s@%lu events:%zu",
+		loghead(data),
+		last,
+		completed? "complete "_sv : string_view{},
+		next,
+		vector.size(),
+	};
+
+	return last;
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		log, "linear %s FAILED :%s",
+		loghead(data),
+		e.what()
+	};
+
+	throw;
+}
+
+/// Iterates the events in the data.range and creates a json::vector in
+/// the supplied window_buffer. The return value is the event_idx of the
+/// last event which fit in the buffer, or 0 of nothing was of interest
+/// to our client in the event iteration.
+std::pair<ircd::m::event::idx, bool>
+ircd::m::sync::linear_proffer(data &data,
+                              window_buffer &wb)
+{
+	event::idx ret(0);
+	const auto closure{[&data, &wb, &ret]
+	(const m::event::idx &event_idx, const m::event &event)
+	{
+		const scope_restore their_event
+		{
+			data.event, &event
+		};
+
+		const scope_restore their_event_idx
+		{
+			data.event_idx, event_idx
+		};
+
+		wb([&data, &ret, &event_idx]
+		(const mutable_buffer &buf)
+		{
+			const auto consumed
+			{
+				linear_proffer_event(data, buf)
+			};
+
+			if(consumed)
+				ret = event_idx;
+
+			return consumed;
+		});
+
+		const bool enough_space_for_more
+		{
+			// The buffer must have at least this much more space
+			// to continue with the iteration. Otherwise if the next
+			// worst-case event does not fit, bad things.
+			wb.remaining() >= 68_KiB
+
+			// When the handler reports this special-case we have
+			// to stop at this iteration.
+			&& !data.reflow_full_state
+		};
+
+		return enough_space_for_more;
+	}};
+
+	const auto completed
+	{
+		m::events::for_each(data.range, closure)
+	};
+
+	return
+	{
+		ret, completed
+	};
+}
+
+/// Sets up a json::stack for the iteration of handlers for
+/// one event.
+size_t
+ircd::m::sync::linear_proffer_event(data &data,
+                                    const mutable_buffer &buf)
+{
+	json::stack out{buf};
+	const scope_restore their_out
+	{
+		data.out, &out
+	};
+
+	json::stack::object top
+	{
+		*data.out
+	};
+
+	const bool success
+	{
+		linear_proffer_event_one(data)
+	};
+
+	top.~object();
+	return success?
+		size(out.completed()):
+		0UL;
+}
+
+/// Generates a candidate /sync response for a single event by
+/// iterating all of the handlers.
+bool
+ircd::m::sync::linear_proffer_event_one(data &data)
+{
+	bool ret{false};
+	m::sync::for_each(string_view{}, [&data, &ret]
+	(item &item)
+	{
+		json::stack::checkpoint checkpoint
+		{
+			*data.out
+		};
+
+		if(item.linear(data))
+			ret = true;
+		else
+			checkpoint.rollback();
+
+		return true;
+	});
+
+	return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// polylog
+//
+
+// Random access approach for large `since` ranges. The /sync schema itself is
+// recursed. For every component in the schema, the handler seeks the events
+// appropriate for the user and appends it to the output. Concretely, this
+// involves a full iteration of the rooms a user is a member of, and a full
+// iteration of the presence status for all users visible to a user, etc.
+//
+// This entire process occurs in a single pass. The schema is traced with
+// json::stack and its buffer is flushed to the client periodically with
+// chunked encoding.
+
+bool
+ircd::m::sync::polylog_handle(data &data)
+try
+{
+	json::stack::checkpoint checkpoint
+	{
+		*data.out
+	};
+
+	json::stack::object top
+	{
+		*data.out
+	};
+
+	// Prefetch loop
+	if(data.range.first == 0)
+	{
+		const scope_restore prefetching
+		{
+			data.prefetch, true
+		};
+
+		m::sync::for_each(string_view{}, [&data]
+		(item &item)
+		{
+			json::stack::checkpoint checkpoint
+			{
+				*data.out
+			};
+
+			json::stack::object object
+			{
+				*data.out, item.member_name()
+			};
+
+			item.polylog(data);
+			checkpoint.committing(false);
+			return true;
+		});
+	}
+
+	// Output loop
+	bool ret{false};
+	m::sync::for_each(string_view{}, [&data, &ret]
+	(item &item)
+	{
+		json::stack::checkpoint checkpoint
+		{
+			*data.out
+		};
+
+		json::stack::object object
+		{
+			*data.out, item.member_name()
+		};
 
-	const auto &flags
-	{
-		data.reflow_full_state?
-			"P"_sv:
-			string_view{}
-	};
+		if(item.polylog(data))
+		{
+			ret = true;
+			data.out->invalidate_checkpoints();
+		}
+		else checkpoint.committing(false);
 
-	const json::vector vector
+		return true;
+	});
+
+	if(ret)
 	{
-		string_view
+		const int64_t next_batch
 		{
-			buffer::data(scratch), consumed
-		}
-	};
+			data.phased?
+				int64_t(data.range.first) - 1L:
+				int64_t(data.range.second)
+		};
 
-	json::stack::object top
+		char buf[64];
+		assert(data.phased || next_batch >= 0L);
+		const string_view &next_batch_token
+		{
+			// The polylog phased since token. We pack two numbers separted by a '_'
+			// character which cannot be urlencoded atm. The first is the usual
+			// since token integer, which is negative for phased initial sync. The
+			// second part is the next_batch upper-bound integer which is a snapshot
+			// of the server's sequence number when the phased sync started.
+			data.phased?
+				make_since(buf, m::events::range{uint64_t(next_batch), data.range.second}):
+
+			// The normal integer since token.
+				make_since(buf, next_batch)
+		};
+
+		json::stack::member
+		{
+			*data.out, "next_batch", json::value
+			{
+				next_batch_token, json::STRING
+			}
+		};
+	}
+
+	if(!ret)
+		checkpoint.committing(false);
+
+	const auto &log_level
 	{
-		*data.out
+		!data.phased && stats::info?
+			log::level::INFO:
+			log::level::DEBUG
 	};
 
-	if(likely(consumed))
-		json::merge(top, vector);
-
-	char since_buf[64];
-	json::stack::member
+	log::logf
 	{
-		top, "next_batch", json::value
-		{
-			make_since(since_buf, next, flags), json::STRING
-		}
+		log, log_level,
+		"request %s polylog commit:%b complete @%ld",
+		loghead(data),
+		ret,
+		data.phased?
+			data.range.first:
+			data.range.second
 	};
 
-	log::debug
+	return ret;
+}
+catch(const std::exception &e)
+{
+	log::error
 	{
-		log, "request %s longpoll hit:%lu consumed:%zu complete @%lu",
+		log, "polylog %s FAILED :%s",
 		loghead(data),
-		event.event_idx,
-		consumed,
-		next
+		e.what()
 	};
 
-	return true;
+	throw;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// linear
+// snapshot
 //
 
-// Approach for small `since` ranges. The range of events is iterated and
-// the event itself is presented to each handler in the schema. This also
-// involves a json::stack trace of the schema so that if the handler determines
-// the event is appropriate for syncing to the user the output buffer will
-// contain a residue of a /sync response with a single event.
-//
-// After the iteration of events is complete we are left with several buffers
-// of properly formatted individual /sync responses which we rewrite into a
-// single response to overcome the inefficiency of request ping-pong under
-// heavy load.
+// Initial sync responses are stored for each user, device and filter. An
+// initial sync with a stored snapshot scans linearly from the snapshot's
+// next_batch to the present for what concerns the user. Rooms and sections
+// found in that delta are composed again with polylog sync, replacing their
+// entries in the snapshot whole; everything else is a sequential read of
+// the snapshot. The result is stored again when anything was replaced or
+// the snapshot is getting old. Only the latest filter of a device is kept,
+// and the snapshots of deleted devices are dropped as they're found.
+
+decltype(ircd::m::sync::snapshot::enable)
+ircd::m::sync::snapshot::enable
+{
+	{ "name",     "ircd.client.sync.snapshot.enable" },
+	{ "default",  true                               },
+};
 
-namespace ircd::m::sync
+decltype(ircd::m::sync::snapshot::size_max)
+ircd::m::sync::snapshot::size_max
 {
-	static bool linear_proffer_event_one(data &);
-	static size_t linear_proffer_event(data &, const mutable_buffer &);
-	static std::pair<event::idx, bool> linear_proffer(data &, window_buffer &);
+	{ "name",     "ircd.client.sync.snapshot.size.max" },
+	{ "default",  long(32_MiB)                         },
+	{ "help",
+
+	R"(
+	Maximum size of a stored initial sync snapshot. A response larger than
+	this is not stored, and a snapshot patched beyond this size is dropped
+	so the next initial sync rebuilds it with polylog sync.
+	)"}
+};
+
+decltype(ircd::m::sync::snapshot::delta_max)
+ircd::m::sync::snapshot::delta_max
+{
+	{ "name",     "ircd.client.sync.snapshot.delta.max" },
+	{ "default",  8192L                                 },
+	{ "help",
+
+	R"(
+	Maximum number of events between a stored snapshot and the present
+	to scan linearly for anything of interest to the user. Snapshots
+	further behind than this are rebuilt with polylog sync.
+	)"}
+};
+
+decltype(ircd::m::sync::snapshot::hits)
+ircd::m::sync::snapshot::hits
+{
+	{ "name", "ircd.client.sync.snapshot.hits" },
+};
+
+decltype(ircd::m::sync::snapshot::misses)
+ircd::m::sync::snapshot::misses
+{
+	{ "name", "ircd.client.sync.snapshot.misses" },
+};
+
+decltype(ircd::m::sync::snapshot::stores)
+ircd::m::sync::snapshot::stores
+{
+	{ "name", "ircd.client.sync.snapshot.stores" },
+};
+
+decltype(ircd::m::sync::snapshot::descriptor)
+ircd::m::sync::snapshot::descriptor
+{
+	// name
+	"snapshot",
+
+	// explain
+	R"(
+	Rendered initial sync responses. The key is the user_id, device_id and
+	filter of the request separated by spaces. The value is the JSON of the
+	response, which contains its next_batch.
+	)",
+
+	// typing
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	{},      // options
+	{},      // comparator
+	{},      // prefix transform
+	false,   // drop column
+
+	// cache size; values are read once per initial sync
+	0,
+
+	// cache size for compressed assets
+	0,
+
+	// bloom_bits
+	10,
+
+	// expect hit
+	false,
+
+	// block_size
+	64_KiB,
+
+	// meta block size
+	512,
+
+	// compression
+	"kLZ4Compression;kSnappyCompression"s,
+};
+
+decltype(ircd::m::sync::snapshot::description)
+ircd::m::sync::snapshot::description
+{
+	{ "default" }, // requirement of RocksDB
+
+	descriptor,
+};
+
+decltype(ircd::m::sync::snapshot::database)
+ircd::m::sync::snapshot::database;
+
+decltype(ircd::m::sync::snapshot::column)
+ircd::m::sync::snapshot::column;
+
+void
+ircd::m::sync::snapshot::init()
+{
+	static const std::string dbopts;
+	database = std::make_shared<db::database>("sync", dbopts, description);
+	column = db::column{*database, "snapshot"};
+}
+
+void
+ircd::m::sync::snapshot::fini()
+noexcept
+{
+	// The database close contains pthread_join()'s within RocksDB which
+	// deadlock under certain conditions when called during a dlclose()
+	// (i.e static destruction of this module). Therefor we must manually
+	// close the db here first.
+	column = db::column{};
+	database = std::shared_ptr<db::database>{};
 }
 
+/// Serve the snapshot patched forward to data.range.second. Returns false
+/// without any output when the snapshot is too far behind or the delta is too
+/// large; the request then continues with polylog sync. The refresh flag is
+/// set when the output differs enough from the stored snapshot to store it.
 bool
-ircd::m::sync::linear_handle(data &data)
+ircd::m::sync::snapshot::handle(data &data,
+                                const string_view &snapshot,
+                                bool &refresh)
 try
 {
-	json::stack::checkpoint checkpoint
+	const json::object object
 	{
-		*data.out
+		snapshot
 	};
 
-	json::stack::object top
+	const auto since
 	{
-		*data.out
+		std::get<0>(make_since(json::string(object.get("next_batch"))))
+	};
+
+	const bool usable
+	{
+		since > 0
+		&& since <= data.range.second
+		&& data.range.second - since <= size_t(delta_max)
+	};
+
+	if(!usable)
+	{
+		++misses;
+		return false;
+	}
+
+	const scope_restore phased
+	{
+		data.phased, false
+	};
+
+	const scope_restore reflow
+	{
+		data.reflow_full_state, false
 	};
 
+	// The linear handlers compose the delta into this buffer; it's only used
+	// to find what the delta concerns.
 	const unique_buffer<mutable_buffer> buf
 	{
-		// must be at least worst-case size of m::event plus some.
 		std::max(size_t(linear_buffer_size), size_t(128_KiB))
 	};
 
 	window_buffer wb{buf};
-	const auto &[last, completed]
 	{
-		linear_proffer(data, wb)
+		const scope_restore range
+		{
+			data.range.first, since
+		};
+
+		const auto &[last, completed]
+		{
+			linear_proffer(data, wb)
+		};
+
+		if(!completed)
+		{
+			++misses;
+			return false;
+		}
+	}
+
+	std::set<string_view> sections, rooms;
+	for(const json::object delta : json::vector{wb.completed()})
+		for(const auto &[key, val] : delta)
+		{
+			if(key != "rooms")
+			{
+				sections.emplace(key);
+				continue;
+			}
+
+			for(const auto &[membership, rooms_] : json::object(val))
+				for(const auto &[room_id, room] : json::object(rooms_))
+					rooms.emplace(room_id);
+		}
+
+	const scope_restore range
+	{
+		data.range.first, 0UL
 	};
 
-	const json::vector vector
+	json::stack::object top
 	{
-		wb.completed()
+		*data.out
 	};
 
-	const auto next
+	for(const auto &[key, val] : object)
+		if(key != "next_batch" && key != "rooms" && !sections.count(key))
+			json::stack::member
+			{
+				top, key, val
+			};
+
+	m::sync::for_each(string_view{}, [&data, &sections]
+	(item &item)
 	{
-		last && completed?
-			data.range.second:
-		last && data.reflow_full_state?
-			std::min(last, data.range.second):
-		last?
-			std::min(last + 1, data.range.second):
-			0UL
+		if(item.member_name() == "rooms" || !sections.count(item.member_name()))
+			return true;
+
+		json::stack::checkpoint checkpoint
+		{
+			*data.out
+		};
+
+		json::stack::object object
+		{
+			*data.out, item.member_name()
+		};
+
+		if(item.polylog(data))
+			data.out->invalidate_checkpoints();
+		else
+			checkpoint.committing(false);
+
+		return true;
+	});
+
+	// A room of the delta is composed under its present membership and is
+	// omitted from wherever it was in the snapshot.
+	const json::object rooms_
+	{
+		object.get("rooms", "{}"_sv)
 	};
 
-	assert(!data.reflow_full_state || (last && !completed));
+	json::stack::object rooms_out
+	{
+		top, "rooms"
+	};
 
-	if(last)
+	for(const auto &membership : {"join"_sv, "invite"_sv, "leave"_sv, "ban"_sv})
 	{
-		const auto &flags
+		json::stack::object category
 		{
-			data.reflow_full_state?
-				"P"_sv:
-				string_view{}
+			rooms_out, membership
 		};
 
-		char buf[64];
-		json::stack::member
+		for(const auto &[room_id, room] : json::object(rooms_.get(membership, "{}"_sv)))
+			if(!rooms.count(room_id))
+				json::stack::member
+				{
+					category, room_id, room
+				};
+
+		const scope_restore their_membership
 		{
-			top, "next_batch", json::value
-			{
-				make_since(buf, next, flags), json::STRING
-			}
+			data.membership, membership
 		};
 
-		json::merge(top, vector);
+		for(const auto &room_id : rooms)
+		{
+			const m::room room
+			{
+				m::room::id{room_id}
+			};
+
+			char membuf[room::MEMBERSHIP_MAX_SIZE];
+			if(m::membership(membuf, room, data.user) == membership)
+				compose(data, category, room);
+		}
 	}
-	else checkpoint.committing(false);
 
+	rooms_out.~object();
+	char since_buf[64];
+	json::stack::member
+	{
+		top, "next_batch", json::value
+		{
+			make_since(since_buf, data.range.second), json::STRING
+		}
+	};
+
+	refresh =
+		!rooms.empty()
+		|| !sections.empty()
+		|| data.range.second - since > size_t(delta_max) / 2;
+
+	++hits;
 	log::debug
 	{
-		log, "request %s linear last:%lu %s@%lu events:%zu",
+		log, "request %s snapshot @%lu delta:%lu rooms:%zu sections:%zu",
 		loghead(data),
-		last,
-		completed? "complete "_sv : string_view{},
-		next,
-		vector.size(),
+		since,
+		data.range.second - since,
+		rooms.size(),
+		sections.size(),
 	};
 
-	return last;
+	return true;
 }
 catch(const std::exception &e)
 {
 	log::error
 	{
-		log, "linear %s FAILED :%s",
+		log, "snapshot %s FAILED :%s",
 		loghead(data),
 		e.what()
 	};
@@ -813,103 +2187,44 @@ catch(const std::exception &e)
 	throw;
 }
 
-/// Iterates the events in the data.range and creates a json::vector in
-/// the supplied window_buffer. The return value is the event_idx of the
-/// last event which fit in the buffer, or 0 of nothing was of interest
-/// to our client in the event iteration.
-std::pair<ircd::m::event::idx, bool>
-ircd::m::sync::linear_proffer(data &data,
-                              window_buffer &wb)
+/// Compose one room of the user with polylog sync as an initial sync would.
+bool
+ircd::m::sync::snapshot::compose(data &data,
+                                 json::stack::object &category,
+                                 const m::room &room)
 {
-	event::idx ret(0);
-	const auto closure{[&data, &wb, &ret]
-	(const m::event::idx &event_idx, const m::event &event)
+	const scope_restore their_room
 	{
-		const scope_restore their_event
-		{
-			data.event, &event
-		};
-
-		const scope_restore their_event_idx
-		{
-			data.event_idx, event_idx
-		};
-
-		wb([&data, &ret, &event_idx]
-		(const mutable_buffer &buf)
-		{
-			const auto consumed
-			{
-				linear_proffer_event(data, buf)
-			};
-
-			if(consumed)
-				ret = event_idx;
-
-			return consumed;
-		});
-
-		const bool enough_space_for_more
-		{
-			// The buffer must have at least this much more space
-			// to continue with the iteration. Otherwise if the next
-			// worst-case event does not fit, bad things.
-			wb.remaining() >= 68_KiB
-
-			// When the handler reports this special-case we have
-			// to stop at this iteration.
-			&& !data.reflow_full_state
-		};
-
-		return enough_space_for_more;
-	}};
+		data.room, &room
+	};
 
-	const auto completed
+	const auto &[top_event_id, top_depth, top_event_idx]
 	{
-		m::events::for_each(data.range, closure)
+		m::top(std::nothrow, room)
 	};
 
-	return
+	const scope_restore their_head
 	{
-		ret, completed
+		data.room_head, top_event_idx
 	};
-}
 
-/// Sets up a json::stack for the iteration of handlers for
-/// one event.
-size_t
-ircd::m::sync::linear_proffer_event(data &data,
-                                    const mutable_buffer &buf)
-{
-	json::stack out{buf};
-	const scope_restore their_out
+	const scope_restore their_depth
 	{
-		data.out, &out
+		data.room_depth, top_depth
 	};
 
-	json::stack::object top
+	json::stack::checkpoint checkpoint
 	{
 		*data.out
 	};
 
-	const bool success
+	json::stack::object object
 	{
-		linear_proffer_event_one(data)
+		category, room.room_id
 	};
 
-	top.~object();
-	return success?
-		size(out.completed()):
-		0UL;
-}
-
-/// Generates a candidate /sync response for a single event by
-/// iterating all of the handlers.
-bool
-ircd::m::sync::linear_proffer_event_one(data &data)
-{
 	bool ret{false};
-	m::sync::for_each(string_view{}, [&data, &ret]
+	m::sync::for_each("rooms", [&data, &ret]
 	(item &item)
 	{
 		json::stack::checkpoint checkpoint
@@ -917,163 +2232,229 @@ ircd::m::sync::linear_proffer_event_one(data &data)
 			*data.out
 		};
 
-		if(item.linear(data))
+		json::stack::object object
+		{
+			*data.out, item.member_name()
+		};
+
+		if(item.polylog(data))
+		{
 			ret = true;
-		else
-			checkpoint.rollback();
+			data.out->invalidate_checkpoints();
+		}
+		else checkpoint.committing(false);
 
 		return true;
 	});
 
+	if(!ret)
+		checkpoint.committing(false);
+
 	return ret;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// polylog
-//
-
-// Random access approach for large `since` ranges. The /sync schema itself is
-// recursed. For every component in the schema, the handler seeks the events
-// appropriate for the user and appends it to the output. Concretely, this
-// involves a full iteration of the rooms a user is a member of, and a full
-// iteration of the presence status for all users visible to a user, etc.
-//
-// This entire process occurs in a single pass. The schema is traced with
-// json::stack and its buffer is flushed to the client periodically with
-// chunked encoding.
-
-bool
-ircd::m::sync::polylog_handle(data &data)
-try
+std::string
+ircd::m::sync::snapshot::get(const data &data)
 {
-	json::stack::checkpoint checkpoint
+	char buf[768];
+	const string_view &key
 	{
-		*data.out
+		make_key(buf, data)
 	};
 
-	json::stack::object top
+	if(!key || !column)
+		return {};
+
+	bool found;
+	std::string ret
 	{
-		*data.out
+		db::read(column, key, found)
 	};
 
-	// Prefetch loop
-	if(data.range.first == 0)
+	if(!found)
+		++misses;
+
+	return ret;
+}
+
+void
+ircd::m::sync::snapshot::set(const data &data,
+                             const string_view &snapshot)
+{
+	char buf[768];
+	const string_view &key
 	{
-		const scope_restore prefetching
-		{
-			data.prefetch, true
-		};
+		make_key(buf, data)
+	};
 
-		m::sync::for_each(string_view{}, [&data]
-		(item &item)
-		{
-			json::stack::checkpoint checkpoint
-			{
-				*data.out
-			};
+	if(!key || !column)
+		return;
 
-			json::stack::object object
-			{
-				*data.out, item.member_name()
-			};
+	evict(data, key);
 
-			item.polylog(data);
-			checkpoint.committing(false);
-			return true;
-		});
+	// Drop a snapshot which grew too large; the next initial sync will
+	// rebuild it.
+	if(size(snapshot) >= size_t(size_max))
+	{
+		db::del(column, key);
+		return;
 	}
 
-	// Output loop
-	bool ret{false};
-	m::sync::for_each(string_view{}, [&data, &ret]
-	(item &item)
+	const unique_buffer<mutable_buffer> stripped
 	{
-		json::stack::checkpoint checkpoint
-		{
-			*data.out
-		};
+		size(snapshot)
+	};
 
-		json::stack::object object
-		{
-			*data.out, item.member_name()
-		};
+	db::write(column, key, snapshot::strip(stripped, json::object{snapshot}));
+	++stores;
+}
 
-		if(item.polylog(data))
+/// Drop the snapshots of the user's other filters on the same device, and
+/// of the user's devices which no longer exist.
+void
+ircd::m::sync::snapshot::evict(const data &data,
+                               const string_view &key)
+{
+	char buf[384];
+	const string_view prefix
+	{
+		fmt::sprintf
 		{
-			ret = true;
-			data.out->invalidate_checkpoints();
+			buf, "%s ", string_view{data.user.user_id}
 		}
-		else checkpoint.committing(false);
+	};
 
-		return true;
-	});
+	const m::user::devices devices
+	{
+		data.user
+	};
 
-	if(ret)
+	std::vector<std::string> stale;
+	for(auto it(column.lower_bound(prefix)); bool(it); ++it)
 	{
-		const int64_t next_batch
+		const string_view &other
 		{
-			data.phased?
-				int64_t(data.range.first) - 1L:
-				int64_t(data.range.second)
+			it->first
 		};
 
-		char buf[64];
-		assert(data.phased || next_batch >= 0L);
-		const string_view &next_batch_token
+		if(!startswith(other, prefix))
+			break;
+
+		const string_view device_id
 		{
-			// The polylog phased since token. We pack two numbers separted by a '_'
-			// character which cannot be urlencoded atm. The first is the usual
-			// since token integer, which is negative for phased initial sync. The
-			// second part is the next_batch upper-bound integer which is a snapshot
-			// of the server's sequence number when the phased sync started.
-			data.phased?
-				make_since(buf, m::events::range{uint64_t(next_batch), data.range.second}):
+			token(lstrip(other, prefix), ' ', 0)
+		};
 
-			// The normal integer since token.
-				make_since(buf, next_batch)
+		if(other != key && (device_id == data.device_id || !devices.has(device_id)))
+			stale.emplace_back(other);
+	}
+
+	for(const auto &other : stale)
+		db::del(column, other);
+}
+
+/// What's only meaningful once isn't stored: to_device messages are
+/// consumed by the device, and typing and the one-time key counts are stale
+/// by the time the snapshot is served again. Receipts are kept; a new one
+/// brings its room into the delta.
+ircd::string_view
+ircd::m::sync::snapshot::strip(const mutable_buffer &buf,
+                               const json::object &response)
+{
+	json::stack out{buf};
+	json::stack::object top{out};
+	for(const auto &[key, val] : response)
+	{
+		if(key == "to_device" || key == "device_one_time_keys_count")
+			continue;
+
+		if(key != "rooms")
+		{
+			json::stack::member
+			{
+				top, key, val
+			};
+
+			continue;
+		}
+
+		json::stack::object rooms
+		{
+			top, "rooms"
 		};
 
-		json::stack::member
+		for(const auto &[membership, rooms_] : json::object(val))
 		{
-			*data.out, "next_batch", json::value
+			json::stack::object category
 			{
-				next_batch_token, json::STRING
+				rooms, membership
+			};
+
+			for(const auto &[room_id, room_] : json::object(rooms_))
+			{
+				json::stack::object room
+				{
+					category, room_id
+				};
+
+				for(const auto &[prop, prop_val] : json::object(room_))
+				{
+					if(prop != "ephemeral")
+					{
+						json::stack::member
+						{
+							room, prop, prop_val
+						};
+
+						continue;
+					}
+
+					json::stack::object ephemeral
+					{
+						room, "ephemeral"
+					};
+
+					json::stack::array events
+					{
+						ephemeral, "events"
+					};
+
+					for(const json::object event : json::array(json::object(prop_val).get("events")))
+						if(json::string(event.get("type")) == "m.receipt")
+							events.append(event);
+				}
 			}
-		};
+		}
 	}
 
-	if(!ret)
-		checkpoint.committing(false);
+	top.~object();
+	return out.completed();
+}
 
-	const auto &log_level
+ircd::string_view
+ircd::m::sync::snapshot::make_key(const mutable_buffer &buf,
+                                  const data &data)
+{
+	assert(data.args);
+	const string_view &filter
 	{
-		!data.phased && stats::info?
-			log::level::INFO:
-			log::level::DEBUG
+		data.args->filter_id
 	};
 
-	log::logf
+	// An inline filter too large for the key has no snapshot.
+	const size_t required
 	{
-		log, log_level,
-		"request %s polylog commit:%b complete @%ld",
-		loghead(data),
-		ret,
-		data.phased?
-			data.range.first:
-			data.range.second
+		size(data.user.user_id) + 1 + size(data.device_id) + 1 + size(filter)
 	};
 
-	return ret;
-}
-catch(const std::exception &e)
-{
-	log::error
+	if(required >= size(buf))
+		return {};
+
+	return fmt::sprintf
 	{
-		log, "polylog %s FAILED :%s",
-		loghead(data),
-		e.what()
+		buf, "%s %s %s",
+		string_view{data.user.user_id},
+		string_view{data.device_id},
+		filter,
 	};
-
-	throw;
 }
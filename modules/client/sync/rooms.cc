@@ -10,22 +10,105 @@
 
 namespace ircd::m::sync
 {
+	struct rooms_worker;
+
 	static bool should_ignore(const data &);
 
+	static bool _rooms_polylog_room_items(data &, const m::room &);
 	static bool _rooms_polylog_room(data &, const m::room &);
+	static bool _rooms_polylog_batch(data &, json::stack::object &, const vector_view<rooms_worker> &);
+	static bool _rooms_polylog_concurrent(data &, json::stack::object &);
 	static bool _rooms_polylog(data &, const string_view &membership, int64_t &phase);
 	static bool rooms_polylog(data &);
 
 	static bool _rooms_linear(data &, const string_view &membership);
 	static bool rooms_linear(data &);
 
+	extern conf::item<size_t> rooms_polylog_concurrency;
+	extern conf::item<size_t> rooms_polylog_buffer_size;
+	extern conf::item<size_t> rooms_pool_size;
+	extern const ctx::pool::opts rooms_pool_opts;
+	extern ctx::pool rooms_pool;
 	extern item rooms;
 }
 
+/// One room of a concurrent polylog sync. Each worker has its own sync::data
+/// because the handlers scope their state into it; the room is rendered into
+/// the worker's own buffer to be merged into the response in order.
+struct ircd::m::sync::rooms_worker
+{
+	std::unique_ptr<sync::data> data;
+	unique_buffer<mutable_buffer> buf;
+	m::room::id::buf room_id;
+	string_view rendered;
+	bool failed {false};
+
+	void operator()();
+};
+
 ircd::mapi::header
 IRCD_MODULE
 {
-	"Client Sync :Rooms"
+	"Client Sync :Rooms", []
+	{
+		ircd::m::sync::rooms_pool.set(size_t(ircd::m::sync::rooms_pool_size));
+	}, []
+	{
+		ircd::m::sync::rooms_pool.terminate();
+		ircd::m::sync::rooms_pool.join();
+	}
+};
+
+decltype(ircd::m::sync::rooms_pool_opts)
+ircd::m::sync::rooms_pool_opts
+{
+	ctx::DEFAULT_STACK_SIZE, 0, -1, 0
+};
+
+decltype(ircd::m::sync::rooms_pool)
+ircd::m::sync::rooms_pool
+{
+	"m.sync.rooms", rooms_pool_opts
+};
+
+decltype(ircd::m::sync::rooms_polylog_concurrency)
+ircd::m::sync::rooms_polylog_concurrency
+{
+	{ "name",     "ircd.client.sync.rooms.polylog.concurrency" },
+	{ "default",  8L                                           },
+	{ "help",
+
+	R"(
+	Maximum number of rooms composed concurrently for one polylog sync
+	request. This bounds the share of the database one request can occupy.
+	A value of 0 or 1 composes rooms one at a time.
+	)"}
+};
+
+decltype(ircd::m::sync::rooms_polylog_buffer_size)
+ircd::m::sync::rooms_polylog_buffer_size
+{
+	{ "name",     "ircd.client.sync.rooms.polylog.buffer_size" },
+	{ "default",  long(128_KiB)                                },
+	{ "help",
+
+	R"(
+	Size of the buffer each room is composed into during a concurrent polylog
+	sync. A room which does not fit is composed again directly into the
+	response after the others.
+	)"}
+};
+
+decltype(ircd::m::sync::rooms_pool_size)
+ircd::m::sync::rooms_pool_size
+{
+	{
+		{ "name",     "ircd.client.sync.rooms.pool.size" },
+		{ "default",  32L                                },
+	}, []
+	{
+		rooms_pool.set(size_t(rooms_pool_size));
+	}
 };
 
 decltype(ircd::m::sync::rooms)
@@ -154,6 +237,16 @@ ircd::m::sync::_rooms_polylog(data &data,
 		*data.out, membership
 	};
 
+	const bool concurrent
+	{
+		!data.phased
+		&& !data.prefetch
+		&& size_t(rooms_polylog_concurrency) > 1
+	};
+
+	if(concurrent)
+		return _rooms_polylog_concurrent(data, object);
+
 	bool ret{false};
 	const user::rooms::closure_bool closure{[&data, &ret, &phase]
 	(const m::room &room, const string_view &membership_)
@@ -208,6 +301,155 @@ ircd::m::sync::_rooms_polylog(data &data,
 	return ret;
 }
 
+/// Rooms are composed concurrently in batches of up to the configured
+/// concurrency. Each batch is merged into the output in the order the rooms
+/// were iterated before the next batch is started.
+bool
+ircd::m::sync::_rooms_polylog_concurrent(data &data,
+                                         json::stack::object &object)
+{
+	assert(data.out);
+	const size_t concurrency
+	{
+		rooms_polylog_concurrency
+	};
+
+	// Each room must fit into the response buffer when it's merged.
+	const size_t buffer_size
+	{
+		std::min(size_t(rooms_polylog_buffer_size), size(data.out->buf.base) / 2)
+	};
+
+	std::vector<rooms_worker> workers(concurrency);
+	size_t count(0);
+	bool ret{false};
+	data.user_rooms.for_each(data.membership, user::rooms::closure_bool{[&]
+	(const m::room &room, const string_view &membership)
+	{
+		auto &worker(workers.at(count++));
+		if(!worker.data)
+		{
+			worker.data = std::make_unique<sync::data>
+			(
+				data.user,
+				data.range,
+				data.client,
+				nullptr,
+				data.stats,
+				data.args,
+				data.device_id
+			);
+
+			worker.buf = unique_buffer<mutable_buffer>{buffer_size};
+		}
+
+		worker.data->membership = data.membership;
+		worker.room_id = room.room_id;
+		if(count < workers.size())
+			return true;
+
+		ret |= _rooms_polylog_batch(data, object, vector_view<rooms_worker>(workers.data(), count));
+		count = 0;
+		return true;
+	}});
+
+	if(count)
+		ret |= _rooms_polylog_batch(data, object, vector_view<rooms_worker>(workers.data(), count));
+
+	return ret;
+}
+
+bool
+ircd::m::sync::_rooms_polylog_batch(data &data,
+                                    json::stack::object &object,
+                                    const vector_view<rooms_worker> &workers)
+{
+	ctx::concurrent_for_each<rooms_worker>
+	{
+		rooms_pool, workers, [](rooms_worker &worker)
+		{
+			worker();
+		}
+	};
+
+	bool ret{false};
+	for(auto &worker : workers)
+	{
+		// The room didn't fit in the worker's buffer; compose it here.
+		if(worker.failed)
+		{
+			const m::room room
+			{
+				worker.room_id
+			};
+
+			ret |= _rooms_polylog_room(data, room);
+			continue;
+		}
+
+		if(!worker.rendered)
+			continue;
+
+		json::stack::member
+		{
+			object, worker.room_id, json::value
+			{
+				worker.rendered, json::OBJECT
+			}
+		};
+
+		data.out->invalidate_checkpoints();
+		ret = true;
+	}
+
+	return ret;
+}
+
+void
+ircd::m::sync::rooms_worker::operator()()
+{
+	assert(data);
+	rendered = {};
+	failed = false;
+
+	const m::room room
+	{
+		room_id
+	};
+
+	const scope_restore their_room
+	{
+		data->room, &room
+	};
+
+	if(should_ignore(*data))
+		return;
+
+	json::stack out
+	{
+		buf
+	};
+
+	const scope_restore their_out
+	{
+		data->out, &out
+	};
+
+	bool ret{false};
+	{
+		json::stack::object top
+		{
+			out
+		};
+
+		ret = _rooms_polylog_room_items(*data, room);
+	}
+
+	failed = out.failed();
+	if(ret && !failed)
+		rendered = out.completed();
+}
+
 bool
 ircd::m::sync::_rooms_polylog_room(data &data,
                                    const m::room &room)
@@ -230,6 +472,21 @@ ircd::m::sync::_rooms_polylog_room(data &data,
 		*data.out, room.room_id
 	};
 
+	const bool ret
+	{
+		_rooms_polylog_room_items(data, room)
+	};
+
+	if(!ret)
+		checkpoint.committing(false);
+
+	return ret;
+}
+
+bool
+ircd::m::sync::_rooms_polylog_room_items(data &data,
+                                         const m::room &room)
+{
 	const auto &[top_event_id, top_depth, top_event_idx]
 	{
 		m::top(std::nothrow, room)
@@ -269,9 +526,6 @@ ircd::m::sync::_rooms_polylog_room(data &data,
 		return true;
 	});
 
-	if(!ret)
-		checkpoint.committing(false);
-
 	return ret;
 }
 
@@ -303,16 +303,20 @@ ircd::m::sync::_room_timeline_polylog_events(data &data,
 	if(i > 1 && it)
 		--i, ++it;
 
+	// Gather the indexes on the way back up so the events can be fetched
+	// with batched queries.
+	std::vector<m::event::idx> idxs;
+	idxs.reserve(std::max(i, 0L));
 	if(i > 0 && it)
 		for(++it; i > 0 && it; --i, ++it)
-		{
-			const m::event &event
-			{
-				*it
-			};
+			idxs.emplace_back(it.event_idx());
 
-			ret |= _room_timeline_append(data, array, it.event_idx(), event);
-		}
+	m::seek(std::nothrow, idxs, [&data, &array, &ret]
+	(const m::event::idx &event_idx, const m::event &event)
+	{
+		ret |= _room_timeline_append(data, array, event_idx, event);
+		return true;
+	});
 
 	return m::event_id(std::nothrow, event_idx);
 }
@@ -11053,6 +11053,14 @@ console_cmd__room__auth(opt &out, const string_view &line)
 	return true;
 }
 
+bool
+console_cmd__room__auth__rebuild(opt &out, const string_view &line)
+{
+	m::room::auth::chain::rebuild();
+	out << "done" << std::endl;
+	return true;
+}
+
 bool
 console_cmd__room__stats(opt &out, const string_view &line)
 {
@@ -15647,6 +15655,62 @@ console_cmd__well_known__matrix__server(opt &out, const string_view &line)
 	return true;
 }
 
+//
+// search
+//
+
+bool
+console_cmd__search(opt &out, const string_view &line)
+{
+	const params param{line, " ",
+	{
+		"room_id", "terms",
+	}};
+
+	const auto &room_id
+	{
+		m::room_id(param.at("room_id"))
+	};
+
+	std::vector<std::string> terms;
+	m::search::terms(tokens_after(line, ' ', 0), [&terms]
+	(const string_view &term)
+	{
+		terms.emplace_back(term);
+		return true;
+	});
+
+	const std::vector<string_view> terms_view
+	(
+		begin(terms), end(terms)
+	);
+
+	m::search::query(room_id, terms_view, [&out]
+	(const m::event::idx &event_idx, const size_t &matched)
+	{
+		out
+		<< std::setw(10) << std::right << event_idx
+		<< " " << std::setw(3) << std::right << matched
+		<< " " << m::event_id(std::nothrow, event_idx)
+		<< std::endl;
+		return true;
+	});
+
+	return true;
+}
+
+bool
+console_cmd__search__rebuild(opt &out, const string_view &line)
+{
+	const size_t count
+	{
+		m::search::rebuild()
+	};
+
+	out << "done " << count << std::endl;
+	return true;
+}
+
 //
 // bridge
 //
@@ -117,15 +117,21 @@ get__backfill(client &client,
 		top, "pdus"
 	};
 
-	size_t count{0};
-	for(; it && count < limit; ++count, --it)
+	// Gather the page of indexes first so the events can be fetched with
+	// batched queries rather than one at a time.
+	std::vector<m::event::idx> page;
+	page.reserve(limit);
+	for(; it && page.size() < limit; --it)
+		page.emplace_back(it.event_idx());
+
+	m::seek(std::nothrow, page, [&pdus, &request]
+	(const m::event::idx &event_idx, const m::event &event)
 	{
-		const m::event &event(*it);
-		if(!visible(event, request.node_id))
-			continue;
+		if(visible(event, request.node_id))
+			pdus.append(event);
 
-		pdus.append(event);
-	}
+		return true;
+	});
 
 	return std::move(response);
 }
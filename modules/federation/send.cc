@@ -54,6 +54,13 @@ fetch_prev
 	{ "default",  true                              },
 };
 
+conf::item<bool>
+pipeline
+{
+	{ "name",     "ircd.federation.send.pipeline" },
+	{ "default",  true                            },
+};
+
 void
 handle_edu(client &client,
            const m::resource::request::object<m::txn> &request,
@@ -95,6 +102,7 @@ handle_pdus(client &client,
 	vmopts.phase.set(m::vm::phase::FETCH_PREV, bool(fetch_prev));
 	vmopts.phase.set(m::vm::phase::FETCH_STATE, bool(fetch_state));
 	vmopts.fetch_prev_wait_count = -1;
+	vmopts.pipeline = bool(pipeline);
 	m::vm::eval eval
 	{
 		pdus, vmopts
@@ -10,21 +10,28 @@
 
 using namespace ircd;
 
-struct unit;
 struct txndata;
 struct txn;
 struct node;
 
-struct unit
-:std::enable_shared_from_this<unit>
+/// Type of a unit in the outbound queue; the first byte of the value. A PDU
+/// is followed by its event_idx; an EDU by its JSON, since it is not stored
+/// elsewhere.
+///
+/// NOTE: These values are written to the database.
+enum unit
+:char
 {
-	enum type { PDU, EDU, FAILURE };
-
-	enum type type;
-	std::string s;
+	PDU = 'P',
+	EDU = 'E',
+};
 
-	unit(std::string s, const enum type &type);
-	unit(const m::event &event);
+/// Disposition of a txn by the remote.
+enum class txn_result
+{
+	ACCEPTED,   ///< The units are removed from the queue.
+	REJECTED,   ///< Permanently; the units are dropped from the queue.
+	FAILED,     ///< The units are kept and retried after a backoff.
 };
 
 struct txndata
@@ -45,29 +52,48 @@ struct txn
 {
 	struct node *node;
 	steady_point timeout;
+	uint64_t end;
+	std::vector<std::shared_ptr<const std::string>> pdus;
 	char headers[8_KiB];
 
 	txn(struct node &node,
 	    std::string content,
-	    m::fed::send::opts opts)
+	    m::fed::send::opts opts,
+	    const uint64_t &end,
+	    std::vector<std::shared_ptr<const std::string>> pdus)
 	:txndata{std::move(content)}
 	,send{this->txnid, string_view{this->content}, this->headers, std::move(opts)}
 	,node{&node}
-	,timeout{now<steady_point>()} //TODO: conf
+	,timeout{now<steady_point>()}
+	,end{end}
+	,pdus{std::move(pdus)}
 	{}
 };
 
+/// The queue of a node is the range [head, tail) of sequence numbers in the
+/// outbound column under its remote. Units are removed once the remote has
+/// accepted the txn containing them. Units pushed to a database txn which
+/// isn't yet committed follow the tail until they're committed.
 struct node
 {
-	std::deque<std::shared_ptr<unit>> q;
 	std::array<char, rfc3986::DOMAIN_BUFSIZE> rembuf;
 	string_view remote;
 	m::node::room room;
 	server::request::opts sopts;
 	txn *curtxn {nullptr};
+	bool flushing {false};
+	uint64_t head {0};
+	uint64_t tail {0};
+	uint64_t pushed {0};
+	milliseconds backoff {0ms};
+	steady_point retry;
 
 	bool flush();
-	void push(std::shared_ptr<unit>);
+	void push(db::txn &, const string_view &unit);
+	void committed(const bool &);
+	void trim();
+	void sent(const uint64_t &end);
+	void failed();
 
 	node(const string_view &remote)
 	:remote{ircd::strlcpy{mutable_buffer{rembuf}, remote}}
@@ -78,22 +104,158 @@ struct node
 std::list<txn> txns;
 std::map<std::string, node, std::less<>> nodes;
 
+/// PDUs rendered for txns, shared by the txns to every remote. An entry is
+/// alive while a txn holds it, so an event fanned out to a room renders once.
+std::unordered_map<m::event::idx, std::weak_ptr<const std::string>> pdus;
+
+static void sender_init();
+static void sender_fini();
+static void load();
+static std::shared_ptr<const std::string> render_pdu(const m::event::idx &);
+static std::shared_ptr<const std::string> render_pdu(const m::event &);
+static void render_gc();
+static string_view queue_key(const mutable_buffer &, const string_view &remote, const uint64_t &seq);
+static std::pair<string_view, uint64_t> queue_key(const string_view &key);
+
 void remove_node(const node &);
+static node &get_node(const string_view &remote);
+static void recv_retry();
 static void recv_timeout(txn &, node &);
 static void recv_timeouts();
-static bool recv_handle(txn &, node &);
+static txn_result recv_handle(txn &, node &);
 static void recv();
 static void recv_worker();
 ctx::dock recv_action;
 
-static void send_from_user(const m::event &, const m::user::id &user_id);
-static void send_to_user(const m::event &, const m::user::id &user_id);
-static void send_to_room(const m::event &, const m::room::id &room_id);
-static void send(const m::event &);
+using pushed_nodes = std::vector<node *>;
+
+static std::string make_unit(const m::event &);
+static void push(db::txn &, pushed_nodes &, const string_view &remote, const string_view &unit);
+static void send_from_user(db::txn &, pushed_nodes &, const m::event &, const m::user::id &user_id);
+static void send_to_user(db::txn &, pushed_nodes &, const m::event &, const m::user::id &user_id);
+static void send_to_room(db::txn &, pushed_nodes &, const m::event &, const m::room::id &room_id);
+static void send(db::txn &, pushed_nodes &, const m::event &);
 static void send_worker();
 
 static void handle_notify(const m::event &, m::vm::eval &);
 
+mapi::header
+IRCD_MODULE
+{
+	"federation sender", sender_init, sender_fini
+};
+
+conf::item<size_t>
+txn_pdus_max
+{
+	{ "name",     "ircd.federation.sender.txn.pdus.max" },
+	{ "default",  50L                                   },
+};
+
+conf::item<size_t>
+txn_edus_max
+{
+	{ "name",     "ircd.federation.sender.txn.edus.max" },
+	{ "default",  100L                                  },
+};
+
+conf::item<seconds>
+txn_timeout
+{
+	{ "name",     "ircd.federation.sender.txn.timeout" },
+	{ "default",  45L                                  },
+};
+
+conf::item<milliseconds>
+backoff_min
+{
+	{ "name",     "ircd.federation.sender.backoff.min" },
+	{ "default",  5000L                                },
+};
+
+conf::item<milliseconds>
+backoff_max
+{
+	{ "name",     "ircd.federation.sender.backoff.max" },
+	{ "default",  3600000L                             },
+};
+
+/// Units queued to one remote beyond this drop the oldest; a remote gone
+/// for that long has to catch up by other means.
+conf::item<size_t>
+queue_max
+{
+	{ "name",     "ircd.federation.sender.queue.max" },
+	{ "default",  65536L                             },
+};
+
+/// Events notified are queued to the remotes in batches of up to this many
+/// with one database write.
+conf::item<size_t>
+batch_max
+{
+	{ "name",     "ircd.federation.sender.batch.max" },
+	{ "default",  64L                                },
+};
+
+// Outbound column
+db::descriptor
+outbound_descriptor
+{
+	// name
+	"outbound",
+
+	// explain
+	R"(
+	Queue of units to be sent to each remote. The key is the remote's
+	hostname, a null byte, and a 64 bit big-endian sequence number. The
+	value is a type byte followed by the event_idx of a PDU or the JSON
+	of an EDU. Units are deleted when the remote accepts them.
+	)",
+
+	// typing
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	{},      // options
+	{},      // comparaor
+	{},      // prefix transform
+	false,   // drop column
+
+	// cache size
+	0,
+
+	// cache size compressed
+	0,
+
+	// bloom_bits
+	0,
+
+	// expect hit
+	false,
+
+	// block_size
+	4_KiB,
+
+	// meta block size
+	512,
+};
+
+db::description
+description
+{
+	{ "default" }, // requirement of RocksDB
+
+	outbound_descriptor,
+};
+
+std::shared_ptr<db::database>
+outbound_database;
+
+db::column
+outbound;
+
 context
 sender
 {
@@ -106,18 +268,63 @@ receiver
 	"m.fedsnd.R", 1_MiB, &recv_worker, context::POST,
 };
 
-mapi::header
-IRCD_MODULE
+void
+sender_init()
 {
-	"federation sender", nullptr,
-	[]
+	static const std::string dbopts;
+	outbound_database = std::make_shared<db::database>("federation", dbopts, description);
+	outbound = db::column{*outbound_database, "outbound"};
+	load();
+}
+
+void
+sender_fini()
+{
+	sender.terminate();
+	receiver.terminate();
+	sender.join();
+	receiver.join();
+
+	// The database close contains pthread_join()'s within RocksDB which
+	// deadlock under certain conditions when called during a dlclose()
+	// (i.e static destruction of this module). Therefor we must manually
+	// close the db here first.
+	outbound = db::column{};
+	outbound_database = std::shared_ptr<db::database>{};
+}
+
+/// Recover the queues left in the outbound column from a previous run. This
+/// must precede any push. The nodes are flushed by the retry in the receiver.
+void
+load()
+{
+	size_t count(0);
+	for(auto it(outbound.begin()); bool(it); ++it)
 	{
-		sender.terminate();
-		receiver.terminate();
-		sender.join();
-		receiver.join();
+		const auto &[remote, seq]
+		{
+			queue_key(it->first)
+		};
+
+		auto &node
+		{
+			get_node(remote)
+		};
+
+		if(node.head == node.tail)
+			node.head = seq;
+
+		node.tail = seq + 1;
+		++count;
 	}
-};
+
+	if(count) log::info
+	{
+		m::log, "Federation sender recovered %zu queued units to %zu servers.",
+		count,
+		nodes.size(),
+	};
+}
 
 std::deque<std::pair<std::string, m::event::id::buf>>
 notified_queue;
@@ -180,23 +387,72 @@ send_worker()
 			return !notified_queue.empty();
 		});
 
-		const unwind pop{[]
+		// The units of everything notified so far are queued to the remotes
+		// with one database write; the remotes are flushed after it.
+		db::txn txn
 		{
-			assert(!notified_queue.empty());
-			notified_queue.pop_front();
-		}};
+			*outbound_database
+		};
 
-		const auto &[event_, event_id]
+		// The PDUs queued are rendered once here for all of their remotes
+		// and held until the remotes are flushed.
+		std::vector<std::shared_ptr<const std::string>> rendered;
+		pushed_nodes pushed;
+		for(size_t i(0); i < size_t(batch_max) && !notified_queue.empty(); ++i) try
 		{
-			notified_queue.front()
-		};
+			const unwind pop{[]
+			{
+				assert(!notified_queue.empty());
+				notified_queue.pop_front();
+			}};
 
-		const m::event event
+			const auto &[event_, event_id]
+			{
+				notified_queue.front()
+			};
+
+			const m::event event
+			{
+				json::object{event_}, event_id
+			};
+
+			const size_t deltas
+			{
+				txn.size()
+			};
+
+			send(txn, pushed, event);
+			if(event.event_id && txn.size() > deltas)
+				if(auto pdu{render_pdu(event)})
+					rendered.emplace_back(std::move(pdu));
+		}
+		catch(const ctx::interrupted &)
 		{
-			json::object{event_}, event_id
-		};
+			throw;
+		}
+		catch(const std::exception &e)
+		{
+			log::error
+			{
+				"sender worker: %s", e.what()
+			};
+		}
+
+		bool committed(false);
+		const unwind commit{[&pushed, &committed]
+		{
+			for(auto *const &node : pushed)
+				node->committed(committed);
+		}};
+
+		if(txn.size())
+			txn();
 
-		send(event);
+		committed = true;
+	}
+	catch(const ctx::interrupted &)
+	{
+		throw;
 	}
 	catch(const std::exception &e)
 	{
@@ -208,7 +464,9 @@ send_worker()
 }
 
 void
-send(const m::event &event)
+send(db::txn &txn,
+     pushed_nodes &pushed,
+     const m::event &event)
 {
 	const auto &type
 	{
@@ -235,7 +493,7 @@ send(const m::event &event)
 
 	// target is every remote server in a room
 	if(valid(m::id::ROOM, room_id))
-		return send_to_room(event, m::room::id{room_id});
+		return send_to_room(txn, pushed, event, m::room::id{room_id});
 
 	// target is remote server hosting user/device
 	if(type == "m.direct_to_device")
@@ -246,17 +504,19 @@ send(const m::event &event)
 		};
 
 		if(valid(m::id::USER, target))
-			return send_to_user(event, m::user::id(target));
+			return send_to_user(txn, pushed, event, m::user::id(target));
 	}
 
 	// target is every remote server from every room a user is joined to.
 	if(valid(m::id::USER, sender))
-		return send_from_user(event, m::user::id{sender});
+		return send_from_user(txn, pushed, event, m::user::id{sender});
 }
 
 /// EDU and PDU path where the target is a room
 void
-send_to_room(const m::event &event,
+send_to_room(db::txn &txn,
+             pushed_nodes &pushed,
+             const m::event &event,
              const m::room::id &room_id)
 {
 	const m::room room
@@ -269,9 +529,9 @@ send_to_room(const m::event &event,
 		room
 	};
 
-	// Unit is not allocated until we find another server in the room.
-	std::shared_ptr<struct unit> unit;
-	const auto each_origin{[&unit, &event]
+	// Unit is not made until we find another server in the room.
+	std::optional<std::string> unit;
+	const auto each_origin{[&txn, &pushed, &unit, &event]
 	(const string_view &origin)
 	{
 		if(my_host(origin))
@@ -280,24 +540,13 @@ send_to_room(const m::event &event,
 		if(m::fed::errant(origin))
 			return;
 
-		auto it
-		{
-			nodes.lower_bound(origin)
-		};
-
-		if(it == end(nodes) || it->first != origin)
-			it = nodes.emplace_hint(it, origin, origin);
-
-		auto &node
-		{
-			it->second
-		};
-
 		if(!unit)
-			unit = std::make_shared<struct unit>(event);
+			unit = make_unit(event);
 
-		node.push(unit);
-		node.flush();
+		if(unit->empty())
+			return;
+
+		push(txn, pushed, origin, *unit);
 	}};
 
 	// Iterate all servers with a joined user
@@ -325,7 +574,9 @@ send_to_room(const m::event &event,
 
 /// EDU path where the target is a user/device
 void
-send_to_user(const m::event &event,
+send_to_user(db::txn &txn,
+             pushed_nodes &pushed,
+             const m::event &event,
              const m::user::id &user_id)
 {
 	const string_view &origin
@@ -339,32 +590,23 @@ send_to_user(const m::event &event,
 	if(m::fed::errant(origin))
 		return;
 
-	auto it
-	{
-		nodes.lower_bound(origin)
-	};
-
-	if(it == end(nodes) || it->first != origin)
-		it = nodes.emplace_hint(it, origin, origin);
-
-	auto &node
+	const std::string unit
 	{
-		it->second
+		make_unit(event)
 	};
 
-	auto unit
-	{
-		std::make_shared<struct unit>(event)
-	};
+	if(unit.empty())
+		return;
 
-	node.push(std::move(unit));
-	node.flush();
+	push(txn, pushed, origin, unit);
 }
 
 /// EDU path where the he target is every server from every room the sender
 /// is joined to.
 void
-send_from_user(const m::event &event,
+send_from_user(db::txn &txn,
+               pushed_nodes &pushed,
+               const m::event &event,
                const m::user::id &user_id)
 {
 	const m::user::servers servers
@@ -372,8 +614,16 @@ send_from_user(const m::event &event,
 		user_id
 	};
 
+	const std::string unit
+	{
+		make_unit(event)
+	};
+
+	if(unit.empty())
+		return;
+
 	// Iterate all of the servers visible in this user's joined rooms.
-	servers.for_each("join", [&user_id, &event]
+	servers.for_each("join", [&txn, &pushed, &unit]
 	(const string_view &origin)
 	{
 		if(my_host(origin))
@@ -382,82 +632,268 @@ send_from_user(const m::event &event,
 		if(m::fed::errant(origin))
 			return true;
 
-		auto it
+		push(txn, pushed, origin, unit);
+		return true;
+	});
+}
+
+/// The value of the event in the outbound column. A PDU is referenced by its
+/// event_idx; empty if the event can't be found.
+std::string
+make_unit(const m::event &event)
+{
+	if(!event.event_id)
+	{
+		const json::strung edu
 		{
-			nodes.lower_bound(origin)
+			json::members
+			{
+				{ "content",   json::get<"content"_>(event)  },
+				{ "edu_type",  json::get<"type"_>(event)     },
+			}
 		};
 
-		if(it == end(nodes) || it->first != origin)
-			it = nodes.emplace_hint(it, origin, origin);
+		std::string ret(1, char(unit::EDU));
+		ret.append(string_view{edu});
+		return ret;
+	}
 
-		auto &node
+	const m::event::idx event_idx
+	{
+		m::index(std::nothrow, event.event_id)
+	};
+
+	if(unlikely(!event_idx))
+	{
+		log::derror
 		{
-			it->second
+			m::log, "Federation sender cannot queue unindexed %s",
+			string_view{event.event_id},
 		};
 
-		auto unit
+		return {};
+	}
+
+	std::string ret(1, char(unit::PDU));
+	ret.append(byte_view<string_view>{event_idx});
+	return ret;
+}
+
+node &
+get_node(const string_view &remote)
+{
+	auto it
+	{
+		nodes.lower_bound(remote)
+	};
+
+	if(it == end(nodes) || it->first != remote)
+		it = nodes.emplace_hint(it, remote, remote);
+
+	return it->second;
+}
+
+void
+push(db::txn &txn,
+     pushed_nodes &pushed,
+     const string_view &remote,
+     const string_view &unit)
+{
+	auto &node
+	{
+		get_node(remote)
+	};
+
+	if(!node.pushed)
+		pushed.emplace_back(&node);
+
+	node.push(txn, unit);
+}
+
+void
+node::push(db::txn &txn,
+           const string_view &unit)
+{
+	char buf[rfc3986::DOMAIN_BUFSIZE + 16];
+	db::txn::append
+	{
+		txn, outbound,
 		{
-			std::make_shared<struct unit>(event)
-		};
+			db::op::SET,
+			queue_key(buf, remote, tail + pushed),
+			unit,
+		}
+	};
 
-		node.push(unit);
-		node.flush();
-		return true;
-	});
+	++pushed;
 }
 
+/// The database txn with the units pushed was written (or not); the units
+/// are now in the queue and flushed.
 void
-node::push(std::shared_ptr<unit> su)
+node::committed(const bool &ok)
 {
-	q.emplace_back(std::move(su));
+	if(ok)
+		tail += pushed;
+
+	pushed = 0;
+	if(!ok)
+		return;
+
+	trim();
+	flush();
 }
 
+/// Drop the oldest units beyond the queue::max. Units of an outstanding txn
+/// are left until it finishes.
+void
+node::trim()
+{
+	const size_t max
+	{
+		std::max(size_t(queue_max), 1UL)
+	};
+
+	if(curtxn || flushing || tail - head <= max)
+		return;
+
+	const uint64_t end
+	{
+		tail - max
+	};
+
+	log::dwarning
+	{
+		m::log, "Federation sender dropping %lu units queued to %s beyond %zu.",
+		end - head,
+		remote,
+		max,
+	};
+
+	char buf[2][rfc3986::DOMAIN_BUFSIZE + 16];
+	const std::pair<string_view, string_view> range
+	{
+		queue_key(buf[0], remote, head),
+		queue_key(buf[1], remote, end),
+	};
+
+	db::del(outbound, range);
+	head = end;
+}
+
+/// Send the units at the front of the queue in a txn, up to the limits of
+/// the specification. Nothing is sent while a txn is outstanding or the
+/// remote is backing off. The txn is built by one context at a time; the
+/// sender and the receiver both flush.
 bool
 node::flush()
 try
 {
-	if(q.empty())
+	if(curtxn || flushing || head >= tail)
 		return true;
 
-	if(curtxn)
+	if(retry > now<steady_point>())
 		return true;
 
-	size_t pdus{0}, edus{0};
-	for(const auto &unit : q) switch(unit->type)
+	const scope_restore flushing
 	{
-		case unit::PDU:   ++pdus;  break;
-		case unit::EDU:   ++edus;  break;
-		default:                   break;
-	}
+		this->flushing, true
+	};
+
+	// The iteration may yield; anything queued meanwhile waits its turn.
+	const uint64_t tail
+	{
+		this->tail
+	};
 
-	size_t pc(0), ec(0);
-	std::vector<json::value> units(pdus + edus);
-	for(const auto &unit : q) switch(unit->type)
+	char buf[rfc3986::DOMAIN_BUFSIZE + 16];
+	std::vector<std::shared_ptr<const std::string>> pdus;
+	std::vector<std::string> edus;
+	uint64_t end(head);
+	for(auto it(outbound.lower_bound(queue_key(buf, remote, head))); bool(it); ++it)
 	{
-		case unit::PDU:
-			units.at(pc++) = string_view{unit->s};
+		const auto &[key, val]
+		{
+			*it
+		};
+
+		const auto &[remote, seq]
+		{
+			queue_key(key)
+		};
+
+		if(remote != this->remote || seq >= tail)
 			break;
 
-		case unit::EDU:
-			units.at(pdus + ec++) = string_view{unit->s};
+		assert(!empty(val));
+		const auto type{unit(val[0])};
+		if(type == unit::PDU && pdus.size() >= size_t(txn_pdus_max))
 			break;
 
-		default:
+		if(type == unit::EDU && edus.size() >= size_t(txn_edus_max))
 			break;
+
+		end = seq + 1;
+		if(type == unit::EDU)
+		{
+			edus.emplace_back(val.substr(1));
+			continue;
+		}
+
+		const m::event::idx event_idx
+		{
+			byte_view<m::event::idx>(val.substr(1))
+		};
+
+		auto pdu
+		{
+			render_pdu(event_idx)
+		};
+
+		if(unlikely(!pdu))
+		{
+			log::dwarning
+			{
+				m::log, "Federation sender skipping missing event idx:%lu to '%s'",
+				event_idx,
+				this->remote,
+			};
+
+			continue;
+		}
+
+		pdus.emplace_back(std::move(pdu));
+	}
+
+	// Everything in range was skipped or missing; drop it and carry on.
+	if(pdus.empty() && edus.empty())
+	{
+		sent(tail);
+		this->flushing = false;
+		return flush();
 	}
 
+	// The units were rendered by us; they're not validated again.
+	std::vector<json::value> units;
+	units.reserve(pdus.size() + edus.size());
+	for(const auto &pdu : pdus)
+		units.emplace_back(string_view{*pdu}, json::OBJECT);
+
+	for(const auto &edu : edus)
+		units.emplace_back(string_view{edu}, json::OBJECT);
+
 	m::fed::send::opts opts;
 	opts.remote = remote;
 	opts.sopts = &sopts;
 
 	const vector_view<const json::value> pduv
 	{
-		units.data(), units.data() + pc
+		units.data(), units.data() + pdus.size()
 	};
 
 	const vector_view<const json::value> eduv
 	{
-		units.data() + pdus, units.data() + pdus + ec
+		units.data() + pdus.size(), units.data() + units.size()
 	};
 
 	std::string content
@@ -465,22 +901,26 @@ try
 		m::txn::create(pduv, eduv)
 	};
 
-	txns.emplace_back(*this, std::move(content), std::move(opts));
+	const size_t pdus_count(pdus.size()), edus_count(edus.size());
+	txns.emplace_back(*this, std::move(content), std::move(opts), end, std::move(pdus));
 	const unwind_nominal_assertion na;
 	curtxn = &txns.back();
-	q.clear();
 	log::debug
 	{
 		m::log, "sending txn %s pdus:%zu edus:%zu to '%s'",
 		curtxn->txnid,
-		pdus,
-		edus,
+		pdus_count,
+		edus_count,
 		this->remote,
 	};
 
 	recv_action.notify_one();
 	return true;
 }
+catch(const ctx::interrupted &)
+{
+	throw;
+}
 catch(const std::exception &e)
 {
 	log::error
@@ -488,22 +928,67 @@ catch(const std::exception &e)
 		"flush error to %s :%s", remote, e.what()
 	};
 
+	failed();
 	return false;
 }
 
+/// The units before end were accepted by the remote. Some may have been
+/// trimmed from the queue while they were rendered.
+void
+node::sent(const uint64_t &end)
+{
+	assert(end <= tail);
+	if(end > head)
+	{
+		char buf[2][rfc3986::DOMAIN_BUFSIZE + 16];
+		const std::pair<string_view, string_view> range
+		{
+			queue_key(buf[0], remote, head),
+			queue_key(buf[1], remote, end),
+		};
+
+		db::del(outbound, range);
+		head = end;
+	}
+
+	backoff = 0ms;
+	retry = steady_point{};
+}
+
+/// The units are kept in the queue and retried after a backoff which is
+/// doubled for each consecutive failure.
+void
+node::failed()
+{
+	backoff = std::clamp(backoff * 2, milliseconds(backoff_min), milliseconds(backoff_max));
+	retry = now<steady_point>() + backoff;
+	log::dwarning
+	{
+		m::log, "Federation sender backing off %s for %ld seconds with %lu units queued.",
+		remote,
+		duration_cast<seconds>(backoff).count(),
+		tail - head,
+	};
+}
+
 void
 __attribute__((noreturn))
 recv_worker()
 {
 	while(1)
 	{
-		recv_action.wait([]
+		recv_action.wait_for(seconds(2), []
 		{
 			return !txns.empty();
 		});
 
-		recv();
-		recv_timeouts();
+		if(!txns.empty())
+		{
+			recv();
+			recv_timeouts();
+		}
+
+		recv_retry();
 	}
 }
 
@@ -537,17 +1022,32 @@ try
 
 	assert(txn.node);
 	auto &node{*txn.node};
-	const auto ret
+	const auto result
 	{
 		recv_handle(txn, node)
 	};
 
+	const auto end
+	{
+		txn.end
+	};
+
 	node.curtxn = nullptr;
 	txns.erase(it);
 
-	if(!ret)
-		return;
+	if(result == txn_result::FAILED)
+		return node.failed();
 
+	if(result == txn_result::REJECTED)
+		log::error
+		{
+			m::log, "Federation sender dropping %lu units rejected by %s.",
+			end - node.head,
+			node.remote,
+		};
+
+	node.sent(end);
+	node.trim();
 	node.flush();
 }
 catch(const std::exception &e)
@@ -559,7 +1059,11 @@ catch(const std::exception &e)
 	};
 }
 
-bool
+/// A txn rejected with a client error won't be accepted by sending it
+/// again; anything else (i.e a server error, a timeout, rate limiting or a
+/// network error) is retried. Authorization errors are retried too since
+/// they're often from the remote failing to fetch our keys.
+txn_result
 recv_handle(txn &txn,
             node &node)
 try
@@ -604,7 +1108,7 @@ try
 		};
 	});
 
-	return true;
+	return txn_result::ACCEPTED;
 }
 catch(const http::error &e)
 {
@@ -618,7 +1122,18 @@ catch(const http::error &e)
 		e.what()
 	};
 
-	return false;
+	const bool rejected
+	{
+		e.code >= 400 && e.code < 500
+		&& e.code != http::UNAUTHORIZED
+		&& e.code != http::FORBIDDEN
+		&& e.code != http::REQUEST_TIMEOUT
+		&& e.code != http::TOO_MANY_REQUESTS
+	};
+
+	return rejected?
+		txn_result::REJECTED:
+		txn_result::FAILED;
 }
 catch(const std::exception &e)
 {
@@ -630,7 +1145,7 @@ catch(const std::exception &e)
 		e.what()
 	};
 
-	return false;
+	return txn_result::FAILED;
 }
 
 void
@@ -646,7 +1161,7 @@ recv_timeouts()
 	{
 		auto &txn(*it);
 		assert(txn.node);
-		if(txn.timeout + seconds(45) < now) //TODO: conf
+		if(txn.timeout + seconds(txn_timeout) < now)
 			recv_timeout(txn, *txn.node);
 	}
 }
@@ -665,58 +1180,140 @@ recv_timeout(txn &txn,
 	cancel(txn);
 }
 
+/// Flush the nodes with units queued whose backoff has expired; this is how
+/// a remote catches up after it recovers.
 void
-remove_node(const node &node)
+recv_retry()
 {
-	const auto it
+	const auto &now
 	{
-		nodes.find(node.remote)
+		ircd::now<steady_point>()
 	};
 
-	assert(it != end(nodes));
-	nodes.erase(it);
-}
+	for(auto &[remote, node] : nodes)
+		if(!node.curtxn && node.head < node.tail && node.retry <= now)
+			node.flush();
 
-//
-// unit
-//
+	render_gc();
+}
 
-unit::unit(const m::event &event)
-:type
+/// The PDU as sent in a txn; null if the event can't be found.
+std::shared_ptr<const std::string>
+render_pdu(const m::event::idx &event_idx)
 {
-	event.event_id? PDU: EDU
+	const auto it
+	{
+		pdus.find(event_idx)
+	};
+
+	if(it != end(pdus))
+		if(auto ret{it->second.lock()})
+			return ret;
+
+	// The fetch may yield; the iterator is not used past here.
+	const m::event::fetch event
+	{
+		std::nothrow, event_idx
+	};
+
+	if(unlikely(!event.valid))
+		return {};
+
+	auto ret
+	{
+		std::make_shared<const std::string>(json::strung{event})
+	};
+
+	pdus[event_idx] = ret;
+	return ret;
 }
-,s{[this, &event]
-() -> std::string
+
+/// Render the PDU of an event at hand into the cache; the other remotes
+/// find it there.
+std::shared_ptr<const std::string>
+render_pdu(const m::event &event)
 {
-	switch(this->type)
+	const m::event::idx event_idx
 	{
-		case PDU:
-			return json::strung{event};
+		m::index(std::nothrow, event.event_id)
+	};
 
-		case EDU:
-			return json::strung{json::members
-			{
-				{ "content",   json::get<"content"_>(event)  },
-				{ "edu_type",  json::get<"type"_>(event)     },
-			}};
+	if(unlikely(!event_idx))
+		return {};
 
-		default:
-			return {};
-	}
-}()}
+	const auto it
+	{
+		pdus.find(event_idx)
+	};
+
+	if(it != end(pdus))
+		if(auto ret{it->second.lock()})
+			return ret;
+
+	auto ret
+	{
+		std::make_shared<const std::string>(json::strung{event})
+	};
+
+	pdus[event_idx] = ret;
+	return ret;
+}
+
+void
+render_gc()
 {
+	for(auto it(begin(pdus)); it != end(pdus); )
+		if(it->second.expired())
+			it = pdus.erase(it);
+		else
+			++it;
 }
 
-unit::unit(std::string s,
-           const enum type &type)
-:type
+void
+remove_node(const node &node)
 {
-	type
+	const auto it
+	{
+		nodes.find(node.remote)
+	};
+
+	assert(it != end(nodes));
+	nodes.erase(it);
 }
-,s
+
+string_view
+queue_key(const mutable_buffer &buf,
+          const string_view &remote,
+          const uint64_t &seq)
 {
-	std::move(s)
+	const uint64_t seq_
+	{
+		util::hton(seq)
+	};
+
+	mutable_buffer out{buf};
+	consume(out, copy(out, remote));
+	consume(out, copy(out, "\0"_sv));
+	consume(out, copy(out, byte_view<string_view>{seq_}));
+	return string_view
+	{
+		data(buf), data(out)
+	};
 }
+
+std::pair<string_view, uint64_t>
+queue_key(const string_view &key)
 {
+	assert(size(key) > sizeof(uint64_t));
+	const auto pos
+	{
+		size(key) - sizeof(uint64_t) - 1
+	};
+
+	assert(key[pos] == '\0');
+	return
+	{
+		key.substr(0, pos),
+		util::ntoh(byte_view<uint64_t>(key.substr(pos + 1))),
+	};
 }
@@ -10,20 +10,88 @@
 
 namespace ircd::m::push
 {
+	struct program;
+	struct program_cond;
+	struct program_rule;
+	using memo = std::map<string_view, bool>;
+
+	static bool event_match_compiled(const event &, const program_cond &);
+	static bool test(const event &, const user::id &, const program_cond &, memo &);
+	static bool matching(const event &, const user::id &, const program_rule &, memo &);
 	static void execute(const event &, vm::eval &, const user::id &, const path &, const rule &, const event::idx &);
-	static bool matching(const event &, vm::eval &, const user::id &, const path &, const rule &);
-	static bool handle_kind(const event &, vm::eval &, const user::id &, const path &);
-	static void handle_rules(const event &, vm::eval &, const user::id &, const string_view &scope);
+	static void compile_rule(program &, const event::idx &, const path &, const json::object &);
+	static std::shared_ptr<const program> compile(const user::id &);
+	static std::shared_ptr<const program> get_program(const user::id &);
+	static void handle_rules(const m::event &, vm::eval &);
 	static void handle_event(const m::event &, vm::eval &);
+
+	extern conf::item<size_t> programs_max;
+	extern stats::item<uint64_t> programs_hits;
+	extern stats::item<uint64_t> programs_misses;
+	extern hookfn<vm::eval &> hook_rules;
 	extern hookfn<vm::eval &> hook_event;
+
+	static std::map<std::string, std::shared_ptr<const program>, std::less<>> programs;
+	static std::shared_ptr<const program> default_program;
+	static uint64_t programs_gen;
 }
 
+/// A condition of a compiled rule. The memo_key is set when the result of
+/// the condition does not depend on the user, so it is evaluated once per
+/// event for every user with the same condition.
+struct ircd::m::push::program_cond
+{
+	push::cond cond;
+	size_t kind {0};
+	string_view memo_key;
+	string_view key_top;
+	std::vector<string_view> key_path;
+	std::optional<globular_imatch> glob;
+};
+
+struct ircd::m::push::program_rule
+{
+	push::path path;
+	push::rule rule;
+	event::idx rule_idx {0};
+	std::vector<program_cond> conds;
+};
+
+/// The push rules of a user compiled for evaluation: the rules in the order
+/// of evaluation with their conditions decoded and their patterns prepared.
+/// The rules reference the text owned here. Users without rules of their
+/// own share the program of the server defaults.
+struct ircd::m::push::program
+{
+	std::list<std::string> text;
+	std::vector<program_rule> rules;
+};
+
 ircd::mapi::header
 IRCD_MODULE
 {
 	"Matrix 13.13 :Push Notifications",
 };
 
+decltype(ircd::m::push::programs_max)
+ircd::m::push::programs_max
+{
+	{ "name",     "ircd.m.push.programs.max" },
+	{ "default",  16384L                     },
+};
+
+decltype(ircd::m::push::programs_hits)
+ircd::m::push::programs_hits
+{
+	{ "name", "ircd.m.push.programs.hits" },
+};
+
+decltype(ircd::m::push::programs_misses)
+ircd::m::push::programs_misses
+{
+	{ "name", "ircd.m.push.programs.misses" },
+};
+
 decltype(ircd::m::push::hook_event)
 ircd::m::push::hook_event
 {
@@ -33,6 +101,56 @@ ircd::m::push::hook_event
 	}
 };
 
+/// Invalidates the compiled program of a user when one of their push rules
+/// is set or redacted in their user room.
+decltype(ircd::m::push::hook_rules)
+ircd::m::push::hook_rules
+{
+	handle_rules,
+	{
+		{ "_site",   "vm.effect"  },
+		{ "origin",  my_host()    },
+	}
+};
+
+void
+ircd::m::push::handle_rules(const m::event &event,
+                            vm::eval &eval)
+{
+	const string_view &type
+	{
+		json::get<"type"_>(event)
+	};
+
+	const bool rule
+	{
+		startswith(type, rule::type_prefix)
+	};
+
+	const bool redaction
+	{
+		!rule && type == "m.room.redaction" && json::get<"redacts"_>(event)
+	};
+
+	if(!rule && !redaction)
+		return;
+
+	char type_buf[event::TYPE_MAX_SIZE];
+	if(redaction)
+		if(!startswith(m::get(std::nothrow, at<"redacts"_>(event), "type", type_buf), rule::type_prefix))
+			return;
+
+	// The rules are sent to the user's room by the user.
+	++programs_gen;
+	const auto it
+	{
+		programs.find(at<"sender"_>(event))
+	};
+
+	if(it != end(programs))
+		programs.erase(it);
+}
+
 void
 ircd::m::push::handle_event(const m::event &event,
                             vm::eval &eval)
@@ -51,22 +169,58 @@ try
 		at<"room_id"_>(event)
 	};
 
+	const m::user::id &sender
+	{
+		at<"sender"_>(event)
+	};
+
 	const m::room::members members
 	{
 		room_id
 	};
 
-	members.for_each("join", my_host(), [&event, &eval]
+	// Results of conditions not particular to a user are shared by all of
+	// the members; the actions are executed after every member is matched.
+	memo memo;
+	std::vector<std::tuple<user::id::buf, std::shared_ptr<const program>, const program_rule *>> matched;
+	members.for_each("join", my_host(), [&event, &room_id, &sender, &memo, &matched]
 	(const user::id &user_id, const event::idx &membership_event_idx)
 	{
 		// r0.6.0-13.13.15 Homeservers MUST NOT notify the Push Gateway for
 		// events that the user has sent themselves.
-		if(user_id == at<"sender"_>(event))
+		if(user_id == sender)
 			return true;
 
-		handle_rules(event, eval, user_id, "global");
+		const auto program
+		{
+			get_program(user_id)
+		};
+
+		for(const auto &rule : program->rules)
+		{
+			const auto &[scope, kind, ruleid]
+			{
+				rule.path
+			};
+
+			if(kind == "room" && ruleid != room_id)
+				continue;
+
+			if(kind == "sender" && ruleid != sender)
+				continue;
+
+			if(!matching(event, user_id, rule, memo))
+				continue;
+
+			matched.emplace_back(user_id, program, &rule);
+			break;
+		}
+
 		return true;
 	});
+
+	for(const auto &[user_id, program, rule] : matched)
+		execute(event, eval, user_id, rule->path, rule->rule, rule->rule_idx);
 }
 catch(const ctx::interrupted &)
 {
@@ -82,86 +236,109 @@ catch(const std::exception &e)
 	};
 }
 
-void
-ircd::m::push::handle_rules(const event &event,
-                            vm::eval &eval,
-                            const user::id &user_id,
-                            const string_view &scope)
+bool
+ircd::m::push::matching(const event &event,
+                        const user::id &user_id,
+                        const program_rule &rule,
+                        memo &memo)
+try
+{
+	if(!json::get<"enabled"_>(rule.rule))
+		return false;
+
+	for(const auto &cond : rule.conds)
+		if(!test(event, user_id, cond, memo))
+			return false;
+
+	return true;
+}
+catch(const ctx::interrupted &)
 {
-	const push::path path[]
+	throw;
+}
+catch(const std::exception &e)
+{
+	const auto &[scope, kind, ruleid]
 	{
-		{ scope, "override",   string_view{}         },
-		{ scope, "content",    string_view{}         },
-		{ scope, "room",       at<"room_id"_>(event) },
-		{ scope, "sender",     at<"sender"_>(event)  },
-		{ scope, "underride",  string_view{}         },
+		rule.path
 	};
 
-	for(const auto &p : path)
-		if(!handle_kind(event, eval, user_id, p))
-			break;
+	log::error
+	{
+		log, "Push rule matching in %s for %s at { %s, %s, %s } :%s",
+		string_view{event.event_id},
+		string_view{user_id},
+		scope,
+		kind,
+		ruleid,
+		e.what(),
+	};
+
+	return false;
 }
 
 bool
-ircd::m::push::handle_kind(const event &event,
-                           vm::eval &eval,
-                           const user::id &user_id,
-                           const path &path)
+ircd::m::push::test(const event &event,
+                    const user::id &user_id,
+                    const program_cond &cond,
+                    memo &memo)
 {
-	const user::pushrules pushrules
+	if(cond.memo_key)
 	{
-		user_id
-	};
+		const auto it(memo.find(cond.memo_key));
+		if(it != end(memo))
+			return it->second;
+	}
 
-	return pushrules.for_each(path, [&event, &eval, &user_id]
-	(const auto &event_idx, const auto &path, const auto &rule)
+	match::opts opts;
+	opts.user_id = user_id;
+	const bool ret
 	{
-		if(matching(event, eval, user_id, path, rule))
-		{
-			execute(event, eval, user_id, path, rule, event_idx);
-			return false; // false to break due to match
-		}
-		else return true;
-	});
+		cond.kind == 0?
+			event_match_compiled(event, cond):
+			match::cond_kind[cond.kind](event, cond.cond, opts)
+	};
+
+	if(cond.memo_key)
+		memo.emplace(cond.memo_key, ret);
+
+	return ret;
 }
 
+/// The event_match condition with its key path split and its pattern
+/// classified when compiled.
 bool
-ircd::m::push::matching(const event &event,
-                        vm::eval &eval,
-                        const user::id &user_id,
-                        const path &path,
-                        const rule &rule)
+ircd::m::push::event_match_compiled(const event &event,
+                                    const program_cond &cond)
 try
 {
-	const auto &[scope, kind, ruleid]
+	string_view value
 	{
-		path
+		json::get(event, cond.key_top, json::object{})
 	};
 
-	if(!json::get<"enabled"_>(rule))
-		return false;
-
-	push::match::opts opts;
-	opts.user_id = user_id;
-	const push::match match
+	for(const auto &key : cond.key_path)
 	{
-		event, rule, opts
-	};
+		if(!json::type(value, json::OBJECT))
+			break;
 
-	#if 0
-	log::debug
+		value = json::object(value)[key];
+		if(likely(!json::type(value, json::STRING)))
+			continue;
+
+		value = json::string(value);
+		break;
+	}
+
+	const auto &pattern
 	{
-		log, "event %s rule { %s, %s, %s } for %s %s",
-		string_view{event.event_id},
-		scope,
-		kind,
-		ruleid,
-		string_view{user_id},
-		bool(match)? "MATCH"_sv : string_view{}
+		json::get<"pattern"_>(cond.cond)
 	};
-	#endif
 
-	return bool(match);
+	 //TODO: XXX spec leading/trailing; not imatch
+	return cond.glob?
+		(*cond.glob)(value):
+		iequals(pattern, value);
 }
 catch(const ctx::interrupted &)
 {
@@ -169,23 +346,200 @@ catch(const ctx::interrupted &)
 }
 catch(const std::exception &e)
 {
+	log::error
+	{
+		log, "Push condition 'event_match' %s :%s",
+		string_view{event.event_id},
+		e.what(),
+	};
+
+	return false;
+}
+
+//
+// program
+//
+
+std::shared_ptr<const ircd::m::push::program>
+ircd::m::push::get_program(const user::id &user_id)
+{
+	const auto it
+	{
+		programs.find(user_id)
+	};
+
+	if(it != end(programs))
+	{
+		++programs_hits;
+		return it->second;
+	}
+
+	++programs_misses;
+	const auto gen
+	{
+		programs_gen
+	};
+
+	auto program
+	{
+		compile(user_id)
+	};
+
+	// The rules changed while they were read; the result isn't kept.
+	if(gen != programs_gen || !size_t(programs_max))
+		return program;
+
+	if(programs.size() >= size_t(programs_max))
+		programs.erase(begin(programs));
+
+	programs.emplace(std::string{user_id}, program);
+	return program;
+}
+
+std::shared_ptr<const ircd::m::push::program>
+ircd::m::push::compile(const user::id &user_id)
+{
+	static const string_view kinds[]
+	{
+		"override", "content", "room", "sender", "underride",
+	};
+
+	const user::pushrules pushrules
+	{
+		user_id
+	};
+
+	bool custom(false);
+	auto ret(std::make_shared<program>());
+	for(const auto &kind : kinds)
+		pushrules.for_each(path{"global", kind, {}}, [&ret, &custom, &kind]
+		(const event::idx &rule_idx, const path &path, const json::object &rule)
+		{
+			const auto &[scope, _kind, ruleid]
+			{
+				path
+			};
+
+			custom |= rule_idx != 0;
+			compile_rule(*ret, rule_idx, {"global", kind, ruleid}, rule);
+			return true;
+		});
+
+	if(custom)
+		return ret;
+
+	if(!default_program)
+		default_program = std::move(ret);
+
+	return default_program;
+}
+
+void
+ircd::m::push::compile_rule(program &program,
+                            const event::idx &rule_idx,
+                            const path &path,
+                            const json::object &object)
+{
+	auto &rule
+	{
+		program.rules.emplace_back()
+	};
+
 	const auto &[scope, kind, ruleid]
 	{
 		path
 	};
 
-	log::error
+	rule.rule_idx = rule_idx;
+	rule.rule = push::rule
 	{
-		log, "Push rule matching in %s for %s at { %s, %s, %s } :%s",
-		string_view{event.event_id},
-		string_view{user_id},
-		scope,
-		kind,
-		ruleid,
-		e.what(),
+		json::object{program.text.emplace_back(object)}
 	};
 
-	return false;
+	rule.path =
+	{
+		scope, kind, program.text.emplace_back(ruleid)
+	};
+
+	const auto add{[&rule]
+	(const push::cond &cond, const string_view &source)
+	{
+		auto &c
+		{
+			rule.conds.emplace_back()
+		};
+
+		const string_view &kind
+		{
+			json::get<"kind"_>(cond)
+		};
+
+		c.cond = cond;
+		c.kind = indexof(kind, string_views(match::cond_kind_name));
+		assert(c.kind <= sizeof(match::cond_kind_name) / sizeof(string_view));
+		switch(c.kind)
+		{
+			case 0: // event_match
+			{
+				const auto &[top, path]
+				{
+					split(json::get<"key"_>(cond), '.')
+				};
+
+				c.key_top = top;
+				tokens(path, '.', [&c](const string_view &key)
+				{
+					c.key_path.emplace_back(key);
+				});
+
+				// A pattern without glob characters is compared directly;
+				// otherwise its matcher is built here once for the rule.
+				const auto &pattern(json::get<"pattern"_>(cond));
+				if(has(pattern, '*') || has(pattern, '?'))
+					c.glob.emplace(pattern);
+
+				c.memo_key = source;
+				break;
+			}
+
+			// The result depends on the user.
+			case 2: // contains_user_mxid
+			case 3: // state_key_user_mxid
+			case 4: // contains_display_name
+				break;
+
+			default:
+				c.memo_key = source;
+				break;
+		}
+	}};
+
+	// A pattern is an event_match condition on the body.
+	if(json::get<"pattern"_>(rule.rule))
+	{
+		const string_view &pattern
+		{
+			json::get<"pattern"_>(rule.rule)
+		};
+
+		const string_view &source
+		{
+			program.text.emplace_back(fmt::snstringf
+			{
+				pattern.size() + 16, "pattern %s", pattern
+			})
+		};
+
+		add(push::cond
+		{
+			{ "kind",     "event_match"   },
+			{ "key",      "content.body"  },
+			{ "pattern",  pattern         },
+		}, source);
+	}
+
+	for(const json::object cond : json::get<"conditions"_>(rule.rule))
+		add(push::cond{cond}, cond);
 }
 
 void
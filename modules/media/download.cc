@@ -12,6 +12,13 @@
 
 using namespace ircd;
 
+conf::item<size_t>
+download_stream_step
+{
+	{ "name",     "ircd.media.download.stream.step" },
+	{ "default",  long(1_MiB)                       },
+};
+
 m::resource
 download_resource
 {
@@ -32,6 +39,10 @@ download_resource__legacy
 	}
 };
 
+static std::pair<size_t, size_t>
+download_range(const string_view &range,
+               const size_t &file_size);
+
 static m::resource::response
 get__download_local(client &client,
                     const m::resource::request &request,
@@ -127,48 +138,215 @@ get__download_local(client &client,
 		};
 	});
 
-	static const auto &addl_headers
+	const auto range
+	{
+		download_range(request.head.range, file_size)
+	};
+
+	// The size of the file is sent with the error so the client can retry.
+	if(range.first >= range.second && file_size)
+	{
+		char headers_buf[64];
+		const json::strung error
+		{
+			json::members
+			{
+				{ "errcode", "M_INVALID_RANGE"                      },
+				{ "error",   "Range is not satisfiable for the file." },
+			}
+		};
+
+		return m::resource::response
+		{
+			client,
+			string_view{error},
+			"application/json; charset=utf-8",
+			http::RANGE_NOT_SATISFIABLE,
+			fmt::sprintf
+			{
+				headers_buf, "Content-Range: bytes */%zu\r\n",
+				file_size,
+			}
+		};
+	}
+
+	const bool partial
+	{
+		range.second - range.first < file_size
+	};
+
+	char headers_buf[256];
+	const string_view addl_headers
 	{
-		"Cache-Control: public, max-age=31536000, immutable\r\n"_sv
+		partial?
+			fmt::sprintf
+			{
+				headers_buf,
+				"Cache-Control: public, max-age=31536000, immutable\r\n"
+				"Accept-Ranges: bytes\r\n"
+				"Content-Range: bytes %zu-%zu/%zu\r\n",
+				range.first,
+				range.second - 1,
+				file_size,
+			}:
+			fmt::sprintf
+			{
+				headers_buf,
+				"Cache-Control: public, max-age=31536000, immutable\r\n"
+				"Accept-Ranges: bytes\r\n",
+			}
 	};
 
 	// Send HTTP head to client
 	m::resource::response
 	{
 		client,
-		http::OK,
+		partial? http::PARTIAL_CONTENT: http::OK,
 		content_type,
-		file_size,
+		range.second - range.first,
 		addl_headers,
 	};
 
-	size_t sent{0}, read
+	// When the file is still being downloaded the blocks written so far are
+	// sent, then more are awaited. Each step resumes from the block where
+	// the last one ended.
+	size_t sent{0}, read{0};
+	m::media::file::position position;
+	for(size_t pos(range.first); pos < range.second; )
 	{
-		m::media::file::read(room, [&client, &sent]
-		(const string_view &block)
+		const auto it
 		{
-			sent += write_all(*client.sock, block);
-		})
-	};
+			m::media::downloading.find(room.room_id)
+		};
+
+		const std::shared_ptr<m::media::transfer> xfer
+		{
+			it != end(m::media::downloading)?
+				it->second:
+				nullptr
+		};
+
+		if(xfer && xfer->written <= pos)
+		{
+			const size_t want
+			{
+				std::min(range.second, pos + size_t(download_stream_step))
+			};
+
+			m::media::downloading_dock.wait([&xfer, &want]
+			{
+				return xfer->finished || xfer->written >= want;
+			});
+
+			if(xfer->written <= pos)
+				break;
+
+			continue;
+		}
+
+		const size_t available
+		{
+			xfer?
+				std::min(range.second, xfer->written):
+				range.second
+		};
+
+		const size_t count
+		{
+			m::media::file::read(room, {pos, available}, position, [&client, &sent]
+			(const string_view &block)
+			{
+				sent += client.write_all(block);
+			})
+		};
+
+		read += count;
+		pos += count;
+		if(!count)
+			break;
+	}
 
-	if(unlikely(read != file_size))
+	if(unlikely(read != range.second - range.first))
 		log::error
 		{
 			m::media::log, "File %s/%s [%s] size mismatch: expected %zu got %zu",
 			server,
 			file,
 			string_view{room.room_id},
-			file_size,
+			range.second - range.first,
 			read
 		};
 
 	// Have to kill client here after failing content length expectation.
-	if(unlikely(read != file_size))
+	if(unlikely(read != range.second - range.first))
 		client.close(net::dc::RST, net::close_ignore);
 
 	return {};
 }
 
+/// Parse a single range of the Range header into [first, last+1); the whole
+/// file is returned when there is no range or it can't be parsed, including
+/// a last position before the first. An empty range is returned when the
+/// range starts past the end of the file.
+std::pair<size_t, size_t>
+download_range(const string_view &range,
+               const size_t &file_size)
+{
+	const std::pair<size_t, size_t> whole
+	{
+		0UL, file_size
+	};
+
+	if(!startswith(range, "bytes="))
+		return whole;
+
+	const string_view spec
+	{
+		lstrip(range, "bytes=")
+	};
+
+	// Multiple ranges are not supported; the whole file is sent instead.
+	if(has(spec, ','))
+		return whole;
+
+	const auto &[first, last]
+	{
+		split(strip(spec), '-')
+	};
+
+	if(!first && lex_castable<size_t>(last))
+	{
+		const size_t suffix(lex_cast<size_t>(last));
+		return
+		{
+			file_size - std::min(suffix, file_size), file_size
+		};
+	}
+
+	if(!lex_castable<size_t>(first))
+		return whole;
+
+	const size_t begin
+	{
+		lex_cast<size_t>(first)
+	};
+
+	if(last && (!lex_castable<size_t>(last) || lex_cast<size_t>(last) < begin))
+		return whole;
+
+	const size_t end
+	{
+		last?
+			std::min(lex_cast<size_t>(last) + 1, file_size):
+			file_size
+	};
+
+	if(begin >= end)
+		return {begin, begin};
+
+	return {begin, end};
+}
+
 static m::resource::method
 method_get
 {
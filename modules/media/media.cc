@@ -111,12 +111,131 @@ ircd::m::media::blocks_descriptor
 	60s * 60 * 24 * 42,
 };
 
+decltype(ircd::m::media::thumbnails_cache_enable)
+ircd::m::media::thumbnails_cache_enable
+{
+	{ "name",     "ircd.media.thumbnails.cache.enable" },
+	{ "default",  true                                 },
+};
+
+decltype(ircd::m::media::thumbnails_used_cache_enable)
+ircd::m::media::thumbnails_used_cache_enable
+{
+	{ "name",     "ircd.media.thumbnails_used.cache.enable" },
+	{ "default",  true                                      },
+};
+
+// Thumbnails column
+decltype(ircd::m::media::thumbnails_descriptor)
+ircd::m::media::thumbnails_descriptor
+{
+	// name
+	"thumbnails",
+
+	// explain
+	R"(
+	Key-value store of generated thumbnails. The key is the mxc path of
+	the original file and the method and dimensions of the thumbnail. The
+	value is the content type, a null byte, and the thumbnail.
+	)",
+
+	// typing
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	{},      // options
+	{},      // comparaor
+	{},      // prefix transform
+	false,   // drop column
+
+	bool(thumbnails_cache_enable)? -1 : 0,
+
+	// cache size for compressed assets
+	0,
+
+	// bloom_bits
+	10,
+
+	// expect hit
+	false,
+
+	// block_size
+	64_KiB,
+
+	// meta block size
+	512,
+
+	// compression
+	{}, // no compression
+
+	// compactor
+	{},
+
+	// compaction priority algorithm
+	"kOldestSmallestSeqFirst"s,
+};
+
+// Thumbnails used column
+decltype(ircd::m::media::thumbnails_used_descriptor)
+ircd::m::media::thumbnails_used_descriptor
+{
+	// name
+	"thumbnails_used",
+
+	// explain
+	R"(
+	Key-value store of the use of generated thumbnails. The key is the key
+	of the thumbnail. The value is the time the thumbnail was last used and
+	the size of the thumbnail as 64 bit integers. The thumbnail cache is
+	evicted by a scan of this column rather than of the thumbnails.
+	)",
+
+	// typing
+	{
+		typeid(string_view), typeid(string_view)
+	},
+
+	{},      // options
+	{},      // comparaor
+	{},      // prefix transform
+	false,   // drop column
+
+	bool(thumbnails_used_cache_enable)? -1 : 0,
+
+	// cache size for compressed assets
+	0,
+
+	// bloom_bits
+	10,
+
+	// expect hit
+	false,
+
+	// block_size
+	4_KiB,
+
+	// meta block size
+	512,
+
+	// compression
+	{}, // no compression
+
+	// compactor
+	{},
+
+	// compaction priority algorithm
+	"kOldestSmallestSeqFirst"s,
+};
+
 decltype(ircd::m::media::description)
 ircd::m::media::description
 {
 	{ "default" }, // requirement of RocksDB
 
 	blocks_descriptor,
+	thumbnails_descriptor,
+	thumbnails_used_descriptor,
 };
 
 decltype(ircd::m::media::blocks_cache_size)
@@ -151,6 +270,38 @@ ircd::m::media::blocks_cache_comp_size
 	}
 };
 
+decltype(ircd::m::media::thumbnails_cache_size)
+ircd::m::media::thumbnails_cache_size
+{
+	{
+		{ "name",     "ircd.media.thumbnails.cache.size" },
+		{ "default",  long(16_MiB)                       },
+	}, []
+	{
+		if(!thumbnails)
+			return;
+
+		const size_t &value{thumbnails_cache_size};
+		db::capacity(db::cache(thumbnails), value);
+	}
+};
+
+decltype(ircd::m::media::thumbnails_used_cache_size)
+ircd::m::media::thumbnails_used_cache_size
+{
+	{
+		{ "name",     "ircd.media.thumbnails_used.cache.size" },
+		{ "default",  long(4_MiB)                             },
+	}, []
+	{
+		if(!thumbnails_used)
+			return;
+
+		const size_t &value{thumbnails_used_cache_size};
+		db::capacity(db::cache(thumbnails_used), value);
+	}
+};
+
 decltype(ircd::m::media::blocks_prefetch)
 ircd::m::media::blocks_prefetch
 {
@@ -171,12 +322,21 @@ ircd::m::media::database;
 decltype(ircd::m::media::blocks)
 ircd::m::media::blocks;
 
+decltype(ircd::m::media::thumbnails)
+ircd::m::media::thumbnails;
+
+decltype(ircd::m::media::thumbnails_used)
+ircd::m::media::thumbnails_used;
+
 decltype(ircd::m::media::downloading)
 ircd::m::media::downloading;
 
 decltype(ircd::m::media::downloading_dock)
 ircd::m::media::downloading_dock;
 
+decltype(ircd::m::media::downloaders)
+ircd::m::media::downloaders;
+
 //
 // init
 //
@@ -187,11 +347,15 @@ ircd::m::media::init()
 	static const std::string dbopts;
 	database = std::make_shared<db::database>("media", dbopts, description);
 	blocks = db::column{*database, "blocks"};
+	thumbnails = db::column{*database, "thumbnails"};
+	thumbnails_used = db::column{*database, "thumbnails_used"};
 
 	// The conf setter callbacks must be manually executed after
 	// the database was just loaded to set the cache size.
 	conf::reset("ircd.media.blocks.cache.size");
 	conf::reset("ircd.media.blocks.cache_comp.size");
+	conf::reset("ircd.media.thumbnails.cache.size");
+	conf::reset("ircd.media.thumbnails_used.cache.size");
 
 	// conditions to load the magick.so module
 	const bool enable_magick
@@ -217,6 +381,20 @@ ircd::m::media::fini()
 {
 	magick_support.reset();
 
+	// The download workers are detached; they're interrupted and waited for
+	// here since they use the database.
+	for(auto *const &worker : downloaders)
+		ctx::interrupt(*worker);
+
+	downloading_dock.wait([]
+	{
+		return downloaders.empty();
+	});
+
+	// The thumbnail evictor uses the database.
+	thumbnail::evictor.terminate();
+	thumbnail::evictor.join();
+
 	// The database close contains pthread_join()'s within RocksDB which
 	// deadlock under certain conditions when called during a dlclose()
 	// (i.e static destruction of this module). Therefor we must manually
@@ -249,41 +427,359 @@ ircd::m::media::file::download(const mxc &mxc,
 	return room_id;
 }
 
+/// Download a remote file into its room. The download takes place in its
+/// own context and this returns once the file has started to be written,
+/// so the caller can stream the file while the download continues; see
+/// the downloading map. Concurrent calls for the same file share the same
+/// download.
 ircd::m::room
 IRCD_MODULE_EXPORT
 ircd::m::media::file::download(const mxc &mxc,
                                const m::user::id &user_id,
                                const m::room::id &room_id,
                                string_view remote)
-try
 {
-	auto iit
+	std::shared_ptr<transfer> xfer;
+	auto it
 	{
-		downloading.emplace(room_id)
+		downloading.lower_bound(room_id)
 	};
 
-	if(!iit.second)
+	if(it == end(downloading) || it->first != room_id)
 	{
-		downloading_dock.wait([&room_id]
+		xfer = std::make_shared<transfer>();
+		it = downloading.emplace_hint(it, std::string(room_id), xfer);
+		if(exists(room_id))
 		{
-			return !downloading.count(room_id);
-		});
+			xfer->finished = true;
+			downloading.erase(room_id);
+			downloading_dock.notify_all();
+			return room_id;
+		}
 
-		return room_id;
+		// The worker is detached; it's tracked in the downloaders until it
+		// finishes so the module can wait for it.
+		context worker
+		{
+			"media.download", 512_KiB, context::POST,
+			[
+				xfer,
+				server(std::string(mxc.server)),
+				mediaid(std::string(mxc.mediaid)),
+				user_id(std::string(user_id)),
+				room_id(std::string(room_id)),
+				remote(std::string(remote?: mxc.server))
+			]
+			{
+				download_worker(*xfer, {server, mediaid}, user_id, room_id, remote);
+			}
+		};
+
+		downloaders.emplace(worker.detach());
 	}
+	else xfer = it->second;
+
+	// Without a content-length the size is only known once the transfer is
+	// finished; the file can't be served until then.
+	downloading_dock.wait([&xfer]
+	{
+		return (xfer->started && xfer->length) || xfer->finished;
+	});
+
+	if(xfer->eptr)
+		std::rethrow_exception(xfer->eptr);
 
-	const unwind uw{[&iit]
+	return room_id;
+}
+
+void
+ircd::m::media::download_worker(transfer &xfer,
+                                const mxc &mxc,
+                                const m::user::id &user_id,
+                                const m::room::id &room_id,
+                                const string_view &remote)
+{
+	const unwind finish{[&xfer, &room_id]
 	{
-		downloading.erase(iit.first);
+		xfer.finished = true;
+		downloading.erase(room_id);
+		downloaders.erase(ctx::current);
 		downloading_dock.notify_all();
 	}};
 
-	if(exists(room_id))
-		return room_id;
+	try
+	{
+		try
+		{
+			download_stream(xfer, mxc, user_id, room_id, remote);
+		}
+		catch(const server::buffer_overrun &e)
+		{
+			// The remote didn't send a content-length; the whole file is
+			// buffered instead.
+			if(xfer.started)
+				throw;
 
-	if(!remote)
-		remote = mxc.server;
+			download_buffered(xfer, mxc, user_id, room_id, remote);
+		}
+	}
+	catch(const std::exception &e)
+	{
+		log::derror
+		{
+			log, "Download %s/%s from '%s' to %s :%s",
+			mxc.server,
+			mxc.mediaid,
+			remote,
+			string_view{room_id},
+			e.what(),
+		};
+
+		xfer.eptr = std::current_exception();
+	}
+}
+
+/// The content is received into a small buffer and truncated; the progress
+/// callback collects all of it to be written into blocks as they fill.
+void
+ircd::m::media::download_stream(transfer &xfer,
+                                const mxc &mxc,
+                                const m::user::id &user_id,
+                                const m::room::id &room_id,
+                                const string_view &remote)
+try
+{
+	static const size_t block_size
+	{
+		32_KiB
+	};
+
+	static const server::request::opts sopts
+	{
+		[] { server::request::opts ret; ret.truncate_content = true; return ret; }()
+	};
 
+	const unique_buffer<mutable_buffer> buf
+	{
+		16_KiB + 16_KiB + block_size
+	};
+
+	std::string pending;
+	mutable_buffer out{buf, 16_KiB};
+	fed::request::opts fedopts;
+	fedopts.remote = remote;
+	fedopts.sopts = &sopts;
+	fedopts.in.head = mutable_buffer{buf + 16_KiB, 16_KiB};
+	fedopts.in.content = mutable_buffer{buf + 16_KiB + 16_KiB, block_size};
+	fedopts.in.progress = [&pending]
+	(const const_buffer &buffer, const const_buffer &)
+	{
+		pending.append(data(buffer), size(buffer));
+	};
+
+	json::get<"method"_>(fedopts.request) = "GET";
+	json::get<"uri"_>(fedopts.request) = fmt::sprintf
+	{
+		out, "/_matrix/media/r0/download/%s/%s",
+		mxc.server,
+		mxc.mediaid,
+	};
+	consume(out, size(json::get<"uri"_>(fedopts.request)));
+
+	fed::request remote_request
+	{
+		out, std::move(fedopts)
+	};
+
+	m::vm::copts vmopts;
+	vmopts.history = false;
+	const m::room room
+	{
+		room_id, &vmopts
+	};
+
+	const unwind_exceptional purge{[&xfer, &room]
+	{
+		if(xfer.started)
+			m::room::purge(room);
+	}};
+
+	// The room is created and the file stat is written once the first block
+	// is received; the content type is determined from it. The size is only
+	// written here when the remote sent a content-length.
+	const auto start{[&xfer, &remote_request, &room, &user_id, &mxc, &remote, &pending]
+	{
+		const http::response::head head
+		{
+			server::in::gethead(remote_request)
+		};
+
+		char mime_type_buf[64];
+		const auto &content_type
+		{
+			magic::mime(mime_type_buf, const_buffer{pending.data(), std::min(pending.size(), block_size)})
+		};
+
+		if(content_type != head.content_type) log::dwarning
+		{
+			log, "Server %s claims thumbnail %s is '%s' but we think it is '%s'",
+			remote,
+			mxc.mediaid,
+			head.content_type,
+			content_type,
+		};
+
+		create(room, user_id, "file");
+		xfer.started = true;
+
+		//TODO: TXN
+		send(room, user_id, "ircd.file.stat", "type", json::members
+		{
+			{ "value", content_type }
+		});
+
+		//TODO: TXN
+		if(head.content_length)
+			send(room, user_id, "ircd.file.stat", "size", json::members
+			{
+				{ "value", long(head.content_length) }
+			});
+
+		xfer.length = head.content_length;
+		downloading_dock.notify_all();
+	}};
+
+	const auto flush{[&xfer, &room, &user_id, &pending]
+	(const bool &last)
+	{
+		while(pending.size() >= block_size || (last && !pending.empty()))
+		{
+			// The pending buffer can grow while the block is written.
+			const std::string block
+			{
+				pending, 0, std::min(pending.size(), block_size)
+			};
+
+			pending.erase(0, size(block));
+			block::set(room, user_id, const_buffer{block});
+			xfer.written += size(block);
+			downloading_dock.notify_all();
+		}
+	}};
+
+	size_t received(0);
+	auto activity(now<steady_point>());
+	for(bool done(false); !done; )
+	{
+		// Once started, blocks already received are written without waiting;
+		// the server has no means to stop reading, so the pending content is
+		// bounded by failing the download when the writes can't keep up or,
+		// before starting, when the response isn't one to be written.
+		const milliseconds interval
+		{
+			xfer.started && pending.size() >= block_size?
+				0ms: milliseconds(download_flush_interval)
+		};
+
+		done = remote_request.wait(interval, std::nothrow);
+		if(xfer.written + pending.size() > received)
+		{
+			received = xfer.written + pending.size();
+			activity = now<steady_point>();
+		}
+
+		if(pending.size() > size_t(download_pending_max))
+			throw m::error
+			{
+				http::SERVICE_UNAVAILABLE, "M_MEDIA_DOWNLOAD_OVERRUN",
+				"Server '%s' sent media for '%s/%s' faster than %zu bytes could be written",
+				remote,
+				mxc.server,
+				mxc.mediaid,
+				pending.size(),
+			};
+
+		else if(!done && now<steady_point>() - activity > seconds(download_timeout))
+			throw m::error
+			{
+				http::GATEWAY_TIMEOUT, "M_MEDIA_DOWNLOAD_TIMEOUT",
+				"Server '%s' did not respond with media for '%s/%s' in time",
+				remote,
+				mxc.server,
+				mxc.mediaid
+			};
+
+		// The code is only known once the request is done; otherwise the
+		// head is checked before starting.
+		if(done)
+			remote_request.get();
+
+		if(!xfer.started && !done && pending.size() < block_size)
+			continue;
+
+		if(!xfer.started && !done)
+		{
+			const http::response::head head
+			{
+				server::in::gethead(remote_request)
+			};
+
+			if(head.status != "200")
+				continue;
+		}
+
+		if(!xfer.started)
+			start();
+
+		flush(done);
+	}
+
+	// Chunked content is as long as what was received.
+	if(!xfer.length)
+	{
+		//TODO: TXN
+		send(room, user_id, "ircd.file.stat", "size", json::members
+		{
+			{ "value", long(xfer.written) }
+		});
+
+		xfer.length = xfer.written;
+	}
+
+	if(unlikely(xfer.written != xfer.length))
+		throw m::error
+		{
+			http::BAD_GATEWAY, "M_MEDIA_INCOMPLETE",
+			"Server '%s' sent %zu of %zu bytes for '%s/%s'",
+			remote,
+			xfer.written,
+			xfer.length,
+			mxc.server,
+			mxc.mediaid,
+		};
+}
+catch(const ircd::server::unavailable &e)
+{
+	throw m::error
+	{
+		http::BAD_GATEWAY, "M_MEDIA_UNAVAILABLE",
+		"Server '%s' is not available for media for '%s/%s' :%s",
+		remote,
+		mxc.server,
+		mxc.mediaid,
+		e.what()
+	};
+}
+
+/// Download the whole file into memory and then write it to the room. This
+/// is used when the remote doesn't send a content-length.
+void
+ircd::m::media::download_buffered(transfer &xfer,
+                                  const mxc &mxc,
+                                  const m::user::id &user_id,
+                                  const m::room::id &room_id,
+                                  const string_view &remote)
+{
 	const unique_buffer<mutable_buffer> buf
 	{
 		16_KiB
@@ -291,7 +787,7 @@ try
 
 	const auto pair
 	{
-		download(buf, mxc, remote)
+		file::download(buf, mxc, remote)
 	};
 
 	const auto &head
@@ -332,24 +828,13 @@ try
 		m::room::purge(room);
 	}};
 
+	xfer.length = size(content);
 	const size_t written
 	{
 		file::write(room, user_id, content, content_type)
 	};
 
-	return room;
-}
-catch(const ircd::server::unavailable &e)
-{
-	throw m::error
-	{
-		http::BAD_GATEWAY, "M_MEDIA_UNAVAILABLE",
-		"Server '%s' is not available for media for '%s/%s' :%s",
-		remote,
-		mxc.server,
-		mxc.mediaid,
-		e.what()
-	};
+	xfer.written = written;
 }
 
 decltype(ircd::m::media::download_timeout)
@@ -359,6 +844,20 @@ ircd::m::media::download_timeout
 	{ "default",  30L                           },
 };
 
+decltype(ircd::m::media::download_flush_interval)
+ircd::m::media::download_flush_interval
+{
+	{ "name",     "ircd.media.download.flush.interval" },
+	{ "default",  100L                                 },
+};
+
+decltype(ircd::m::media::download_pending_max)
+ircd::m::media::download_pending_max
+{
+	{ "name",     "ircd.media.download.pending.max" },
+	{ "default",  long(16_MiB)                      },
+};
+
 std::pair
 <
 	ircd::http::response::head,
@@ -464,16 +963,41 @@ size_t
 IRCD_MODULE_EXPORT
 ircd::m::media::file::read(const m::room &room,
                            const closure &closure)
+{
+	return read(room, {0UL, -1UL}, closure);
+}
+
+size_t
+IRCD_MODULE_EXPORT
+ircd::m::media::file::read(const m::room &room,
+                           const std::pair<size_t, size_t> &range,
+                           const closure &closure)
+{
+	position pos;
+	return read(room, range, pos, closure);
+}
+
+/// Read the bytes of the file in the range [first, second) starting from
+/// the position, which must not be past the first byte of the range. Blocks
+/// before the range are skipped by their size without being fetched; the
+/// blocks at the boundaries of the range are sliced.
+size_t
+IRCD_MODULE_EXPORT
+ircd::m::media::file::read(const m::room &room,
+                           const std::pair<size_t, size_t> &range,
+                           position &pos,
+                           const closure &closure)
 {
 	static const event::fetch::opts fopts
 	{
 		event::keys::include { "content", "type" }
 	};
 
+	assert(pos.offset <= range.first);
 	size_t ret{0};
 	room::events it
 	{
-		room, 1, &fopts
+		room, pos.depth, &fopts
 	};
 
 	if(!it)
@@ -482,17 +1006,19 @@ ircd::m::media::file::read(const m::room &room,
 	size_t events_fetched(0), events_prefetched(0);
 	room::events epf
 	{
-		room, 1, &fopts
+		room, pos.depth, &fopts
 	};
 
 	size_t blocks_fetched(0), blocks_prefetched(0);
 	room::events bpf
 	{
-		room, 1, &fopts
+		room, pos.depth, &fopts
 	};
 
-	for(; it; ++it)
+	size_t offset(pos.offset), prefetch_offset(pos.offset);
+	for(; it && offset < range.second; ++it)
 	{
+		pos = { it.depth(), offset };
 		for(; bpf && blocks_prefetched < blocks_fetched + blocks_prefetch; ++bpf)
 		{
 			for(; epf && events_prefetched < events_fetched + events_prefetch; ++epf)
@@ -507,6 +1033,18 @@ ircd::m::media::file::read(const m::room &room,
 			if(at<"type"_>(event) != "ircd.file.block")
 				continue;
 
+			const auto &block_size
+			{
+				at<"content"_>(event).get<size_t>("size")
+			};
+
+			prefetch_offset += block_size;
+			if(prefetch_offset <= range.first)
+				continue;
+
+			if(prefetch_offset - block_size >= range.second)
+				continue;
+
 			const json::string &hash
 			{
 				at<"content"_>(event).at("hash")
@@ -537,6 +1075,11 @@ ircd::m::media::file::read(const m::room &room,
 			at<"content"_>(event).get<size_t>("size")
 		};
 
+		const size_t block_offset(offset);
+		offset += block_size;
+		if(offset <= range.first)
+			continue;
+
 		const auto handle{[&](const const_buffer &block)
 		{
 			if(unlikely(size(block) != block_size))
@@ -552,7 +1095,22 @@ ircd::m::media::file::read(const m::room &room,
 				};
 
 			assert(size(block) == block_size);
-			ret += size(block);
+			const size_t first
+			{
+				std::max(range.first, block_offset) - block_offset
+			};
+
+			const size_t last
+			{
+				std::min(range.second, offset) - block_offset
+			};
+
+			const const_buffer slice
+			{
+				data(block) + first, last - first
+			};
+
+			ret += size(slice);
 
 			#if 0
 			log::debug
@@ -569,7 +1127,7 @@ ircd::m::media::file::read(const m::room &room,
 			};
 			#endif
 
-			closure(block);
+			closure(slice);
 		}};
 
 		if(unlikely(!block::get(hash, handle)))
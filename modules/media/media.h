@@ -11,9 +11,13 @@
 namespace ircd::m::media
 {
 	struct magick;
+	struct transfer;
 
 	static void init();
 	static void fini();
+	static void download_buffered(transfer &, const mxc &, const m::user::id &, const m::room::id &, const string_view &remote);
+	static void download_stream(transfer &, const mxc &, const m::user::id &, const m::room::id &, const string_view &remote);
+	static void download_worker(transfer &, const mxc &, const m::user::id &, const m::room::id &, const string_view &remote);
 
 	extern log::log log;
 	extern std::unique_ptr<m::media::magick> magick_support;
@@ -22,18 +26,41 @@ namespace ircd::m::media
 	extern conf::item<bool> blocks_cache_comp_enable;
 	extern conf::item<size_t> blocks_cache_size;
 	extern conf::item<size_t> blocks_cache_comp_size;
+	extern conf::item<bool> thumbnails_cache_enable;
+	extern conf::item<size_t> thumbnails_cache_size;
+	extern conf::item<bool> thumbnails_used_cache_enable;
+	extern conf::item<size_t> thumbnails_used_cache_size;
 	extern conf::item<size_t> blocks_prefetch;
 	extern conf::item<size_t> events_prefetch;
 	extern const db::descriptor blocks_descriptor;
+	extern const db::descriptor thumbnails_descriptor;
+	extern const db::descriptor thumbnails_used_descriptor;
 	extern const db::description description;
 	extern std::shared_ptr<db::database> database;
 	extern db::column blocks;
+	extern db::column thumbnails;
+	extern db::column thumbnails_used;
 
 	extern conf::item<seconds> download_timeout;
-	extern std::set<m::room::id> downloading;
+	extern conf::item<milliseconds> download_flush_interval;
+	extern conf::item<size_t> download_pending_max;
+	extern std::map<std::string, std::shared_ptr<transfer>, std::less<>> downloading;
 	extern ctx::dock downloading_dock;
+	extern std::set<ctx::ctx *> downloaders;
 }
 
+/// A remote file being downloaded into its room. The blocks are written to
+/// the room as they are received; readers can stream the file up to the
+/// bytes written while the download continues.
+struct ircd::m::media::transfer
+{
+	size_t length {0};
+	size_t written {0};
+	bool started {false};
+	bool finished {false};
+	std::exception_ptr eptr;
+};
+
 namespace ircd::m::media::thumbnail
 {
 	extern conf::item<bool> enable;
@@ -44,4 +71,11 @@ namespace ircd::m::media::thumbnail
 	extern conf::item<size_t> height_max;
 	extern conf::item<std::string> mime_whitelist;
 	extern conf::item<std::string> mime_blacklist;
+	extern conf::item<bool> cache_enable;
+	extern conf::item<size_t> cache_size;
+	extern conf::item<seconds> cache_touch;
+	extern conf::item<seconds> cache_evict_interval;
+	extern std::set<std::string, std::less<>> generating;
+	extern ctx::dock generating_dock;
+	extern ctx::context evictor;
 }
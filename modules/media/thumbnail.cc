@@ -69,6 +69,101 @@ ircd::m::media::thumbnail::mime_blacklist
 	{ "default",  ""                                      },
 };
 
+decltype(ircd::m::media::thumbnail::cache_enable)
+ircd::m::media::thumbnail::cache_enable
+{
+	{ "name",     "ircd.m.media.thumbnail.cache.enable" },
+	{ "default",  true                                  },
+};
+
+decltype(ircd::m::media::thumbnail::cache_size)
+ircd::m::media::thumbnail::cache_size
+{
+	{ "name",     "ircd.m.media.thumbnail.cache.size" },
+	{ "default",  long(1_GiB)                         },
+};
+
+decltype(ircd::m::media::thumbnail::cache_touch)
+ircd::m::media::thumbnail::cache_touch
+{
+	{ "name",     "ircd.m.media.thumbnail.cache.touch" },
+	{ "default",  long(60 * 60 * 24)                   },
+};
+
+decltype(ircd::m::media::thumbnail::cache_evict_interval)
+ircd::m::media::thumbnail::cache_evict_interval
+{
+	{ "name",     "ircd.m.media.thumbnail.cache.evict.interval" },
+	{ "default",  long(60 * 60)                                 },
+};
+
+decltype(ircd::m::media::thumbnail::generating)
+ircd::m::media::thumbnail::generating;
+
+decltype(ircd::m::media::thumbnail::generating_dock)
+ircd::m::media::thumbnail::generating_dock;
+
+static void
+evict_worker();
+
+decltype(ircd::m::media::thumbnail::evictor)
+ircd::m::media::thumbnail::evictor
+{
+	"media.thumbnail", 256_KiB, &evict_worker, context::POST
+};
+
+/// Thumbnail dimensions are rounded up to one of these sizes so requests for
+/// similar sizes share the same thumbnail.
+static const size_t
+thumbnail_buckets[]
+{
+	32, 48, 64, 96, 128, 192, 256, 320, 480, 640, 800, 960, 1280, 1536,
+};
+
+static size_t
+thumbnail_bucket(const size_t &dimension,
+                 const size_t &max);
+
+static string_view
+thumbnail_key(const mutable_buffer &out,
+              const m::media::mxc &,
+              const string_view &method,
+              const pair<size_t> &dimension);
+
+static bool
+thumbnail_get(const string_view &key,
+              const std::function<void (const string_view &, const const_buffer &)> &);
+
+static void
+thumbnail_set(const string_view &key,
+              const string_view &content_type,
+              const const_buffer &);
+
+static void
+thumbnail_used(const string_view &key,
+               const size_t &size);
+
+static void
+thumbnail_index(const string_view &key,
+                const int64_t &time,
+                const size_t &size);
+
+static void
+evict_load();
+
+/// The thumbnails of the cache ordered by the time of their last use. The
+/// evictor loads it from the thumbnails_used column once; it's kept by every
+/// use after that, so eviction takes the oldest without a scan. It's bounded
+/// by the cache it describes.
+static std::map<std::string, std::pair<int64_t, size_t>, std::less<>>
+thumbnail_uses;
+
+static std::set<std::pair<int64_t, string_view>>
+thumbnail_order;
+
+static size_t
+thumbnail_total;
+
 m::resource
 thumbnail_resource__legacy
 {
@@ -144,6 +239,12 @@ get__thumbnail(client &client,
 		m::media::file::download(mxc, user_id)
 	};
 
+	// The thumbnailer requires the whole file.
+	m::media::downloading_dock.wait([&room_id]
+	{
+		return !m::media::downloading.count(room_id);
+	});
+
 	return get__thumbnail_local(client, request, mxc, room_id);
 }
 
@@ -238,35 +339,6 @@ get__thumbnail_local(client &client,
 		};
 	});
 
-	const unique_buffer<mutable_buffer> buf
-	{
-		file_size
-	};
-
-	size_t copied(0);
-	const auto sink{[&buf, &copied]
-	(const const_buffer &block)
-	{
-		copied += copy(buf + copied, block);
-	}};
-
-	const size_t read_size
-	{
-		m::media::file::read(room, sink)
-	};
-
-	if(unlikely(read_size != file_size || file_size != copied))
-		throw ircd::error
-		{
-			"File %s/%s [%s] size mismatch: expected %zu got %zu copied %zu",
-			mxc.server,
-			mxc.mediaid,
-			string_view{room.room_id},
-			file_size,
-			read_size,
-			copied
-		};
-
 	const bool available
 	{
 		m::media::magick_support
@@ -331,14 +403,60 @@ get__thumbnail_local(client &client,
 		"Cache-Control: public, max-age=31536000, immutable\r\n"_sv
 	};
 
+	const auto read{[&mxc, &room, &file_size]
+	{
+		unique_buffer<mutable_buffer> buf
+		{
+			file_size
+		};
+
+		size_t copied(0);
+		const auto sink{[&buf, &copied]
+		(const const_buffer &block)
+		{
+			copied += copy(buf + copied, block);
+		}};
+
+		const size_t read_size
+		{
+			m::media::file::read(room, sink)
+		};
+
+		if(unlikely(read_size != file_size || file_size != copied))
+			throw ircd::error
+			{
+				"File %s/%s [%s] size mismatch: expected %zu got %zu copied %zu",
+				mxc.server,
+				mxc.mediaid,
+				string_view{room.room_id},
+				file_size,
+				read_size,
+				copied
+			};
+
+		return buf;
+	}};
+
 	if(fallback)
 		return m::resource::response
 		{
-			client, buf, content_type, http::OK, addl_headers
+			client, read(), content_type, http::OK, addl_headers
 		};
 
-	const auto closure{[&client, &content_type]
-	(const const_buffer &buf)
+	const pair<size_t> bucket
+	{
+		thumbnail_bucket(dimension.first, width_max),
+		thumbnail_bucket(dimension.second, height_max),
+	};
+
+	char keybuf[512];
+	const string_view &key
+	{
+		thumbnail_key(keybuf, mxc, method, bucket)
+	};
+
+	const auto respond{[&client]
+	(const string_view &content_type, const const_buffer &buf)
 	{
 		m::resource::response
 		{
@@ -346,16 +464,313 @@ get__thumbnail_local(client &client,
 		};
 	}};
 
+	if(cache_enable && thumbnail_get(key, respond))
+		return {}; // responded from closure.
+
+	// Concurrent requests for the same thumbnail wait for the first to
+	// generate it, then find it in the cache.
+	while(generating.count(key))
+	{
+		generating_dock.wait([&key]
+		{
+			return !generating.count(key);
+		});
+
+		if(cache_enable && thumbnail_get(key, respond))
+			return {}; // responded from closure.
+	}
+
+	generating.emplace(key);
+	const auto release{[&key]
+	{
+		const auto it(generating.find(key));
+		if(it == end(generating))
+			return;
+
+		generating.erase(it);
+		generating_dock.notify_all();
+	}};
+
+	const unwind released{[&release]
+	{
+		release();
+	}};
+
+	const auto closure{[&key, &content_type, &respond, &release]
+	(const const_buffer &buf)
+	{
+		if(cache_enable)
+			thumbnail_set(key, content_type, buf);
+
+		release();
+		respond(content_type, buf);
+	}};
+
 	if(method == "crop")
 		magick::thumbcrop
 		{
-			buf, dimension, closure
+			read(), bucket, closure
 		};
 	else
 		magick::thumbnail
 		{
-			buf, dimension, closure
+			read(), bucket, closure
 		};
 
 	return {}; // responded from closure.
 }
+
+size_t
+thumbnail_bucket(const size_t &dimension,
+                 const size_t &max)
+{
+	const auto it
+	{
+		std::lower_bound(begin(thumbnail_buckets), end(thumbnail_buckets), dimension)
+	};
+
+	return it != end(thumbnail_buckets)?
+		std::min(*it, max):
+		std::min(dimension, max);
+}
+
+string_view
+thumbnail_key(const mutable_buffer &out,
+              const m::media::mxc &mxc,
+              const string_view &method,
+              const pair<size_t> &dimension)
+{
+	char pathbuf[384];
+	return fmt::sprintf
+	{
+		out, "%s%c%s %zux%zu",
+		mxc.path(pathbuf),
+		'\0',
+		method,
+		dimension.first,
+		dimension.second,
+	};
+}
+
+/// The closure is called with the content type and the thumbnail if it is
+/// in the cache. The time it was last used is updated when it is older than
+/// the cache::touch interval.
+bool
+thumbnail_get(const string_view &key,
+              const std::function<void (const string_view &, const const_buffer &)> &closure)
+{
+	std::string value;
+	const bool found
+	{
+		m::media::thumbnails(key, std::nothrow, [&value]
+		(const string_view &val)
+		{
+			value = val;
+		})
+	};
+
+	if(!found)
+		return false;
+
+	const auto &[content_type, content]
+	{
+		split(value, '\0')
+	};
+
+	int64_t used[2] {0, 0};
+	m::media::thumbnails_used(key, std::nothrow, [&used]
+	(const string_view &val)
+	{
+		copy(mutable_buffer(reinterpret_cast<char *>(used), sizeof(used)), val);
+	});
+
+	if(ircd::time() - used[0] > seconds(cache_touch).count())
+		thumbnail_used(key, size(content));
+
+	closure(content_type, content);
+	return true;
+}
+
+void
+thumbnail_set(const string_view &key,
+              const string_view &content_type,
+              const const_buffer &content)
+{
+	std::string value;
+	value.reserve(size(content_type) + 1 + size(content));
+	value.append(content_type);
+	value.push_back('\0');
+	value.append(data(content), size(content));
+
+	const int64_t used[2]
+	{
+		ircd::time(),
+		int64_t(size(content)),
+	};
+
+	db::txn txn
+	{
+		*m::media::database
+	};
+
+	db::txn::append
+	{
+		txn, m::media::thumbnails,
+		{
+			db::op::SET, key, value
+		}
+	};
+
+	db::txn::append
+	{
+		txn, m::media::thumbnails_used,
+		{
+			db::op::SET, key, string_view
+			{
+				reinterpret_cast<const char *>(used), sizeof(used)
+			}
+		}
+	};
+
+	txn();
+	thumbnail_index(key, used[0], size(content));
+}
+
+void
+thumbnail_used(const string_view &key,
+               const size_t &size)
+{
+	const int64_t used[2]
+	{
+		ircd::time(),
+		int64_t(size),
+	};
+
+	db::write(m::media::thumbnails_used, key, const_buffer
+	{
+		reinterpret_cast<const char *>(used), sizeof(used)
+	});
+
+	thumbnail_index(key, used[0], size);
+}
+
+void
+thumbnail_index(const string_view &key,
+                const int64_t &time,
+                const size_t &size)
+{
+	auto it
+	{
+		thumbnail_uses.find(key)
+	};
+
+	if(it != end(thumbnail_uses))
+	{
+		const auto &[time_, size_] {it->second};
+		thumbnail_order.erase({time_, it->first});
+		thumbnail_total -= it->first.size() + size_;
+		it->second = {time, size};
+	}
+	else it = thumbnail_uses.emplace(std::string(key), std::make_pair(time, size)).first;
+
+	thumbnail_order.emplace(time, it->first);
+	thumbnail_total += it->first.size() + size;
+}
+
+/// Periodically remove the least recently used thumbnails when the cache is
+/// over its size. The oldest are taken from the front of the index; each is
+/// removed from both columns in one transaction.
+void
+evict_worker()
+{
+	bool loaded(false);
+	while(1)
+	{
+		ctx::sleep(seconds(cache_evict_interval));
+		if(!m::media::thumbnails_used)
+			continue;
+
+		if(!loaded)
+		{
+			evict_load();
+			loaded = true;
+		}
+
+		const size_t total(thumbnail_total), entries(thumbnail_uses.size());
+		size_t removed(0), count(0);
+		while(thumbnail_total > size_t(cache_size) && !thumbnail_order.empty())
+		{
+			const std::string key
+			{
+				std::get<string_view>(*begin(thumbnail_order))
+			};
+
+			const auto it
+			{
+				thumbnail_uses.find(key)
+			};
+
+			assert(it != end(thumbnail_uses));
+			const auto &[time, size] {it->second};
+			removed += key.size() + size;
+			thumbnail_order.erase(begin(thumbnail_order));
+			thumbnail_total -= key.size() + size;
+			thumbnail_uses.erase(it);
+
+			db::txn txn
+			{
+				*m::media::database
+			};
+
+			db::txn::append
+			{
+				txn, m::media::thumbnails,
+				{
+					db::op::DELETE, key
+				}
+			};
+
+			db::txn::append
+			{
+				txn, m::media::thumbnails_used,
+				{
+					db::op::DELETE, key
+				}
+			};
+
+			txn();
+			++count;
+		}
+
+		if(count)
+			log::info
+			{
+				m::media::log, "Evicted %zu of %zu thumbnails; %zu of %zu bytes.",
+				count,
+				entries,
+				removed,
+				total,
+			};
+	}
+}
+
+/// The index is loaded by the one scan of the thumbnails_used column. Uses
+/// indexed while the scan yields are newer than what it finds for them.
+void
+evict_load()
+{
+	for(auto it(m::media::thumbnails_used.begin()); bool(it); ++it)
+	{
+		const auto &[key, val]
+		{
+			*it
+		};
+
+		if(thumbnail_uses.count(key))
+			continue;
+
+		int64_t used[2] {0, 0};
+		copy(mutable_buffer(reinterpret_cast<char *>(used), sizeof(used)), val);
+		thumbnail_index(key, used[0], size_t(used[1]));
+	}
+}
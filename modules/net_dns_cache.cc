@@ -10,17 +10,56 @@
 
 namespace ircd::net::dns::cache
 {
+	struct hot;
+
 	static void handle(const m::event &, m::vm::eval &);
 
+	static string_view hot_key(const mutable_buffer &, const string_view &type, const string_view &state_key);
+	static bool hot_expired(const hot &);
+	static hot hot_set(const string_view &key, const json::object &content, const time_t &ts);
+	static void hot_touch(hot &);
+	static void hot_erase(std::map<std::string, hot, std::less<>>::iterator);
+	static bool hot_load(const string_view &type, const string_view &state_key, const m::event::idx &, hot &);
+	static bool fetch(const string_view &type, const string_view &state_key, hot &);
+	static void warm();
+	static void purge();
+	static size_t flush();
+	static void writeback_worker();
+
+	static bool write(const string_view &type, const string_view &state_key, const json::object &content);
+	static bool commit(const string_view &type, const string_view &state_key, const json::object &content);
 	static bool put(const string_view &type, const string_view &state_key, const records &rrs);
 	static bool put(const string_view &type, const string_view &state_key, const uint &code, const string_view &msg);
 
+	extern conf::item<size_t> hot_size;
+	extern conf::item<seconds> writeback_interval;
+	extern stats::item<uint64_t> hot_hits;
+	extern stats::item<uint64_t> hot_misses;
+	extern stats::item<uint64_t> writebacks;
+	extern std::map<std::string, hot, std::less<>> hot_cache;
+	extern std::list<string_view> hot_lru;
+	extern std::map<std::string, std::shared_ptr<const std::string>, std::less<>> writeback_queue;
+	extern ctx::dock writeback_dock;
+	extern ctx::context writeback_context;
 	extern const m::room::id::buf dns_room_id;
 	extern m::hookfn<m::vm::eval &> hook;
 
+	static string_view writeback_key;
+	static bool warmed, evicted;
 	static void init(), fini();
 }
 
+/// Entry of the in-memory tier of the cache. The content is the same JSON
+/// object stored in the room, i.e. the records are in an array at the
+/// empty key; the timestamp is when the records were resolved. The entry's
+/// position in the use order is kept for eviction when the tier is full.
+struct ircd::net::dns::cache::hot
+{
+	std::shared_ptr<const std::string> content;
+	time_t ts {0};
+	std::list<string_view>::iterator used;
+};
+
 ircd::mapi::header
 IRCD_MODULE
 {
@@ -45,6 +84,57 @@ ircd::net::dns::cache::hook
 	}
 };
 
+decltype(ircd::net::dns::cache::hot_size)
+ircd::net::dns::cache::hot_size
+{
+	{ "name",     "ircd.net.dns.cache.hot.size" },
+	{ "default",  65536L                        },
+};
+
+decltype(ircd::net::dns::cache::writeback_interval)
+ircd::net::dns::cache::writeback_interval
+{
+	{ "name",     "ircd.net.dns.cache.writeback.interval" },
+	{ "default",  5L                                      },
+};
+
+decltype(ircd::net::dns::cache::hot_hits)
+ircd::net::dns::cache::hot_hits
+{
+	{ "name", "ircd.net.dns.cache.hot.hits" },
+};
+
+decltype(ircd::net::dns::cache::hot_misses)
+ircd::net::dns::cache::hot_misses
+{
+	{ "name", "ircd.net.dns.cache.hot.misses" },
+};
+
+decltype(ircd::net::dns::cache::writebacks)
+ircd::net::dns::cache::writebacks
+{
+	{ "name", "ircd.net.dns.cache.writebacks" },
+};
+
+decltype(ircd::net::dns::cache::hot_cache)
+ircd::net::dns::cache::hot_cache;
+
+/// Keys of the hot tier from the least to the most recently used.
+decltype(ircd::net::dns::cache::hot_lru)
+ircd::net::dns::cache::hot_lru;
+
+decltype(ircd::net::dns::cache::writeback_queue)
+ircd::net::dns::cache::writeback_queue;
+
+decltype(ircd::net::dns::cache::writeback_dock)
+ircd::net::dns::cache::writeback_dock;
+
+decltype(ircd::net::dns::cache::writeback_context)
+ircd::net::dns::cache::writeback_context
+{
+	"dns.cache", 256_KiB, &writeback_worker, context::POST,
+};
+
 void
 ircd::net::dns::cache::init()
 {
@@ -69,6 +159,12 @@ ircd::net::dns::cache::fini()
 	{
 		return waiting.empty();
 	});
+
+	// Records still queued are written before the worker goes away; a batch
+	// the worker is writing is completed by it before it's joined.
+	flush();
+	writeback_context.terminate();
+	writeback_context.join();
 }
 
 bool
@@ -166,16 +262,7 @@ try
 	rr0.~object();
 	array.~array();
 	content.~object();
-	const m::room room
-	{
-		dns_room_id
-	};
-
-	if(unlikely(!exists(room)))
-		create(room, m::me(), "internal");
-
-	send(room, m::me(), type, state_key, json::object(out.completed()));
-	return true;
+	return commit(type, state_key, json::object(out.completed()));
 }
 catch(const http::error &e)
 {
@@ -294,16 +381,7 @@ try
 
 	array.~array();
 	content.~object();
-	const m::room room
-	{
-		dns_room_id
-	};
-
-	if(unlikely(!exists(room)))
-		create(room, m::me(), "internal");
-
-	send(room, m::me(), type, state_key, json::object{out.completed()});
-	return true;
+	return commit(type, state_key, json::object{out.completed()});
 }
 catch(const http::error &e)
 {
@@ -372,46 +450,24 @@ ircd::net::dns::cache::get(const hostport &hp,
 			host(hp)
 	};
 
-	const m::room::state state
-	{
-		dns_room_id
-	};
-
-	const m::event::idx &event_idx
-	{
-		state.get(std::nothrow, type, state_key)
-	};
-
-	if(!event_idx)
+	hot entry;
+	if(!fetch(type, state_key, entry))
 		return false;
 
-	time_t origin_server_ts;
-	if(!m::get<time_t>(event_idx, "origin_server_ts", origin_server_ts))
+	// If all records are expired then skip; otherwise since this closure
+	// expects a single array we reveal both expired and valid records.
+	if(hot_expired(entry))
 		return false;
 
-	bool ret{false};
-	const time_t ts{origin_server_ts / 1000L};
-	m::get(std::nothrow, event_idx, "content", [&hp, &closure, &ret, &ts]
-	(const json::object &content)
+	const json::array &rrs
 	{
-		const json::array &rrs
-		{
-			content.get("")
-		};
-
-		// If all records are expired then skip; otherwise since this closure
-		// expects a single array we reveal both expired and valid records.
-		ret = !std::all_of(begin(rrs), end(rrs), [&ts]
-		(const json::object &rr)
-		{
-			return expired(rr, ts);
-		});
+		json::object(*entry.content).get("")
+	};
 
-		if(ret && closure)
-			closure(hp, rrs);
-	});
+	if(closure)
+		closure(hp, rrs);
 
-	return ret;
+	return true;
 }
 
 bool
@@ -434,39 +490,25 @@ ircd::net::dns::cache::for_each(const hostport &hp,
 			host(hp)
 	};
 
-	const m::room::state state
-	{
-		dns_room_id
-	};
+	hot entry;
+	if(!fetch(type, state_key, entry))
+		return false;
 
-	const m::event::idx &event_idx
+	const json::array &rrs
 	{
-		state.get(std::nothrow, type, state_key)
+		json::object(*entry.content).get("")
 	};
 
-	if(!event_idx)
-		return false;
-
-	time_t origin_server_ts;
-	if(!m::get<time_t>(event_idx, "origin_server_ts", origin_server_ts))
-		return false;
-
-	bool ret{true};
-	const time_t ts{origin_server_ts / 1000L};
-	m::get(std::nothrow, event_idx, "content", [&state_key, &closure, &ret, &ts]
-	(const json::object &content)
+	for(const json::object rr : rrs)
 	{
-		for(const json::object rr : json::array(content.get("")))
-		{
-			if(expired(rr, ts))
-				continue;
+		if(expired(rr, entry.ts))
+			continue;
 
-			if(!(ret = closure(state_key, rr)))
-				break;
-		}
-	});
+		if(!closure(state_key, rr))
+			return false;
+	}
 
-	return ret;
+	return true;
 }
 
 bool
@@ -529,9 +571,26 @@ try
 		json::get<"state_key"_>(event)
 	};
 
+	// Records put by this server were already given to the waiters and the
+	// hot tier when they were resolved; this is only their write-back to the
+	// room. Only a record written to the room by other means is handled.
+	char keybuf[128 + rfc1035::NAME_BUFSIZE * 2];
+	const string_view &key
+	{
+		hot_key(keybuf, type, state_key)
+	};
+
+	if(key == writeback_key)
+		return;
+
+	const auto entry
+	{
+		hot_set(key, json::get<"content"_>(event), json::get<"origin_server_ts"_>(event) / 1000L)
+	};
+
 	const json::array &rrs
 	{
-		json::get<"content"_>(event).get("")
+		json::object(*entry.content).get("")
 	};
 
 	waiter::call(rfc1035::qtype.at(lstrip(type, "ircd.dns.rrs.")), state_key, rrs);
@@ -544,6 +603,357 @@ catch(const std::exception &e)
 	};
 }
 
+//
+// hot tier
+//
+
+void
+ircd::net::dns::cache::writeback_worker()
+try
+{
+	warm();
+	while(1)
+	{
+		writeback_dock.wait([]
+		{
+			return !writeback_queue.empty();
+		});
+
+		// Records resolved in the interim are written with this batch; a
+		// record put more than once in the interval is written once.
+		ctx::sleep(seconds(writeback_interval));
+		{
+			const ctx::uninterruptible ui;
+			flush();
+		}
+
+		purge();
+	}
+}
+catch(const ctx::interrupted &)
+{
+	throw;
+}
+catch(const std::exception &e)
+{
+	log::critical
+	{
+		log, "cache writeback worker :%s",
+		e.what(),
+	};
+}
+
+/// Load every record in the room into the hot tier with one pass over the
+/// room state. Until this completes a miss of the hot tier queries the room.
+void
+ircd::net::dns::cache::warm()
+try
+{
+	size_t count(0);
+	const m::room::state state
+	{
+		dns_room_id
+	};
+
+	state.for_each(m::room::state::type_prefix{"ircd.dns.rrs."}, [&count]
+	(const string_view &type, const string_view &state_key, const m::event::idx &event_idx)
+	{
+		hot entry;
+		count += hot_load(type, state_key, event_idx, entry);
+		return true;
+	});
+
+	purge();
+	warmed = true;
+	log::info
+	{
+		log, "cache loaded %zu of %zu records from %s",
+		hot_cache.size(),
+		count,
+		string_view{dns_room_id},
+	};
+}
+catch(const ctx::interrupted &)
+{
+	throw;
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		log, "cache warmup from %s :%s",
+		string_view{dns_room_id},
+		e.what(),
+	};
+}
+
+/// Remove the entries where all records are expired.
+void
+ircd::net::dns::cache::purge()
+{
+	for(auto it(begin(hot_cache)); it != end(hot_cache); )
+		if(hot_expired(it->second))
+			hot_erase(it++);
+		else
+			++it;
+}
+
+/// Write the queued records to the room.
+size_t
+ircd::net::dns::cache::flush()
+{
+	auto queue
+	{
+		std::move(writeback_queue)
+	};
+
+	writeback_queue.clear();
+
+	size_t ret(0);
+	for(const auto &[key, content] : queue)
+	{
+		const auto &[type, state_key]
+		{
+			split(key, ' ')
+		};
+
+		const scope_restore writing
+		{
+			writeback_key, string_view{key}
+		};
+
+		ret += write(type, state_key, json::object{*content});
+	}
+
+	writebacks += ret;
+	return ret;
+}
+
+/// Make the records available to the hot tier and the waiters immediately,
+/// and queue them to be written to the room.
+bool
+ircd::net::dns::cache::commit(const string_view &type,
+                              const string_view &state_key,
+                              const json::object &content)
+{
+	char keybuf[128 + rfc1035::NAME_BUFSIZE * 2];
+	const string_view &key
+	{
+		hot_key(keybuf, type, state_key)
+	};
+
+	const auto entry
+	{
+		hot_set(key, content, ircd::time())
+	};
+
+	auto it(writeback_queue.lower_bound(key));
+	if(it == end(writeback_queue) || it->first != key)
+		it = writeback_queue.emplace_hint(it, std::string{key}, nullptr);
+
+	it->second = entry.content;
+	writeback_dock.notify_one();
+
+	const json::array &rrs
+	{
+		json::object(*entry.content).get("")
+	};
+
+	waiter::call(rfc1035::qtype.at(lstrip(type, "ircd.dns.rrs.")), state_key, rrs);
+	return true;
+}
+
+bool
+ircd::net::dns::cache::write(const string_view &type,
+                             const string_view &state_key,
+                             const json::object &content)
+try
+{
+	const m::room room
+	{
+		dns_room_id
+	};
+
+	if(unlikely(!exists(room)))
+		create(room, m::me(), "internal");
+
+	send(room, m::me(), type, state_key, content);
+	return true;
+}
+catch(const ctx::interrupted &)
+{
+	throw;
+}
+catch(const std::exception &e)
+{
+	log::error
+	{
+		log, "cache write (%s, %s) :%s",
+		type,
+		state_key,
+		e.what(),
+	};
+
+	return false;
+}
+
+/// Find the records in the hot tier, or else in the room. After the hot
+/// tier is loaded from the room and while nothing was evicted from it, the
+/// room has nothing more and is not queried.
+bool
+ircd::net::dns::cache::fetch(const string_view &type,
+                             const string_view &state_key,
+                             hot &ret)
+{
+	char keybuf[128 + rfc1035::NAME_BUFSIZE * 2];
+	const string_view &key
+	{
+		hot_key(keybuf, type, state_key)
+	};
+
+	const auto it
+	{
+		hot_cache.find(key)
+	};
+
+	if(it != end(hot_cache))
+	{
+		hot_touch(it->second);
+		ret = it->second;
+		++hot_hits;
+		return true;
+	}
+
+	++hot_misses;
+	if(warmed && !evicted)
+		return false;
+
+	const m::room::state state
+	{
+		dns_room_id
+	};
+
+	const m::event::idx &event_idx
+	{
+		state.get(std::nothrow, type, state_key)
+	};
+
+	if(!event_idx)
+		return false;
+
+	return hot_load(type, state_key, event_idx, ret);
+}
+
+bool
+ircd::net::dns::cache::hot_load(const string_view &type,
+                                const string_view &state_key,
+                                const m::event::idx &event_idx,
+                                hot &ret)
+{
+	time_t origin_server_ts;
+	if(!m::get<time_t>(event_idx, "origin_server_ts", origin_server_ts))
+		return false;
+
+	bool found{false};
+	m::get(std::nothrow, event_idx, "content", [&]
+	(const json::object &content)
+	{
+		char keybuf[128 + rfc1035::NAME_BUFSIZE * 2];
+		const string_view &key
+		{
+			hot_key(keybuf, type, state_key)
+		};
+
+		// Records put while the room was read are more recent.
+		const auto it
+		{
+			hot_cache.find(key)
+		};
+
+		ret = it != end(hot_cache)?
+			it->second:
+			hot_set(key, content, origin_server_ts / 1000L);
+
+		found = true;
+	});
+
+	return found;
+}
+
+ircd::net::dns::cache::hot
+ircd::net::dns::cache::hot_set(const string_view &key,
+                               const json::object &content,
+                               const time_t &ts)
+{
+	auto it(hot_cache.lower_bound(key));
+	if(it == end(hot_cache) || it->first != key)
+	{
+		// Expired entries are purged periodically; when the tier is still
+		// full the least recently used entry is dropped. The room has to be
+		// queried on a miss from then on.
+		if(hot_cache.size() >= size_t(hot_size) && !hot_lru.empty())
+		{
+			const auto victim(hot_cache.find(hot_lru.front()));
+			if(victim == it)
+				++it;
+
+			hot_erase(victim);
+			evicted = true;
+		}
+
+		it = hot_cache.emplace_hint(it, std::string{key}, hot{});
+		it->second.used = hot_lru.emplace(end(hot_lru), it->first);
+	}
+	else hot_touch(it->second);
+
+	it->second.content = std::make_shared<const std::string>(content);
+	it->second.ts = ts;
+	return it->second;
+}
+
+void
+ircd::net::dns::cache::hot_touch(hot &entry)
+{
+	hot_lru.splice(end(hot_lru), hot_lru, entry.used);
+}
+
+void
+ircd::net::dns::cache::hot_erase(std::map<std::string, hot, std::less<>>::iterator it)
+{
+	assert(it != end(hot_cache));
+	hot_lru.erase(it->second.used);
+	hot_cache.erase(it);
+}
+
+bool
+ircd::net::dns::cache::hot_expired(const hot &entry)
+{
+	assert(entry.content);
+	const json::array &rrs
+	{
+		json::object(*entry.content).get("")
+	};
+
+	return std::all_of(begin(rrs), end(rrs), [&entry]
+	(const json::object &rr)
+	{
+		return expired(rr, entry.ts);
+	});
+}
+
+ircd::string_view
+ircd::net::dns::cache::hot_key(const mutable_buffer &buf,
+                               const string_view &type,
+                               const string_view &state_key)
+{
+	return fmt::sprintf
+	{
+		buf, "%s %s",
+		type,
+		state_key,
+	};
+}
+
 //
 // cache room creation
 //
@@ -10,8 +10,19 @@
 
 namespace ircd::stats
 {
+	using family_map = std::map<std::string, std::vector<const item<void> *>>;
+
+	template<class... args> static void print(window_buffer &, const string_view &format, args&&...);
+	static string_view metric_name(const mutable_buffer &, const string_view &);
+	static string_view escape(const mutable_buffer &, const string_view &, const bool &quote);
+	static string_view labels(const mutable_buffer &, const item<void> &, const string_view &extra = {});
+	static void write_histogram(window_buffer &, const string_view &name, const item<void> &);
+	static void write_summary(window_buffer &, const string_view &name, const item<void> &);
+	static void write_family(resource::response::chunked &, window_buffer &, const string_view &family, const std::vector<const item<void> *> &);
+	static void flush(resource::response::chunked &, window_buffer &, const bool &force = false);
 	static resource::response get_stats(client &, const resource::request &);
 
+	extern const double summary_quantiles[3];
 	extern resource::method method_get;
 	extern resource stats_resource;
 }
@@ -37,42 +48,339 @@ ircd::stats::method_get
 	stats_resource, "GET", get_stats
 };
 
+decltype(ircd::stats::summary_quantiles)
+ircd::stats::summary_quantiles
+{
+	0.50, 0.90, 0.99
+};
+
+/// Prometheus text exposition format (version 0.0.4). Items are grouped by
+/// their family so each metric has one HELP and TYPE; the output is flushed
+/// to the client as the buffer fills.
 ircd::resource::response
 ircd::stats::get_stats(client &client,
                        const resource::request &request)
 {
 	resource::response::chunked response
 	{
-		client, http::OK, "text/plain"
+		client, http::OK, "text/plain; version=0.0.4"
+	};
+
+	family_map families;
+	for(const auto &[name, item] : items)
+	{
+		const json::string family
+		{
+			(*item)["family"]
+		};
+
+		families[family? std::string(family): std::string(name)].emplace_back(item);
+	}
+
+	window_buffer out
+	{
+		response.buf
+	};
+
+	for(const auto &[family, members] : families)
+		write_family(response, out, family, members);
+
+	flush(response, out, true);
+	return std::move(response);
+}
+
+/// The buffer is flushed to the client once it's half full; that leaves room
+/// for the largest item (a histogram is about 70 lines).
+void
+ircd::stats::flush(resource::response::chunked &response,
+                   window_buffer &out,
+                   const bool &force)
+{
+	if(!force && out.remaining() > size(response.buf) / 2)
+		return;
+
+	response.flush(out.completed());
+	out = window_buffer{response.buf};
+}
+
+void
+ircd::stats::write_family(resource::response::chunked &response,
+                          window_buffer &out,
+                          const string_view &family,
+                          const std::vector<const item<void> *> &members)
+{
+	assert(!members.empty());
+	const auto &first
+	{
+		*members.front()
+	};
+
+	char name_buf[256], desc_buf[1024];
+	const string_view name
+	{
+		metric_name(name_buf, family)
 	};
 
-	const time_t ts
+	const bool summary
 	{
-		ircd::time<milliseconds>()
+		first["summary"] == "true"
 	};
 
-	for(const auto &[name_, item] : items)
+	const string_view type
 	{
-		char buf[256], name[2][128], val[64];
-		const string_view _name
+		first.type != typeid(histogram)?
+			"untyped"_sv:
+		summary?
+			"summary"_sv:
+			"histogram"_sv
+	};
+
+	const json::string desc
+	{
+		first["desc"]
+	};
+
+	if(desc)
+		print(out, "# HELP %s %s\n",
+		      name,
+		      escape(desc_buf, desc, false));
+
+	print(out, "# TYPE %s %s\n", name, type);
+
+	for(const auto *const &item : members)
+	{
+		if(item->type == typeid(histogram) && summary)
+			write_summary(out, name, *item);
+		else if(item->type == typeid(histogram))
+			write_histogram(out, name, *item);
+		else
+		{
+			char label_buf[512], val_buf[64];
+			print(out, "%s%s %s\n",
+			      name,
+			      labels(label_buf, *item),
+			      string(val_buf, *item));
+		}
+
+		flush(response, out);
+	}
+}
+
+void
+ircd::stats::write_histogram(window_buffer &out,
+                             const string_view &name,
+                             const item<void> &item_)
+{
+	const auto &val
+	{
+		dynamic_cast<const item<histogram> &>(item_).val
+	};
+
+	// Buckets are only written up to the highest one in use.
+	size_t last(0);
+	for(size_t i(0); i < histogram::BUCKETS - 1; ++i)
+		if(val.bucket[i].load(std::memory_order_relaxed))
+			last = i;
+
+	char label_buf[512], le_buf[64];
+	uint64_t cum(0);
+	for(size_t i(0); i <= last; ++i)
+	{
+		cum += val.bucket[i].load(std::memory_order_relaxed);
+		const string_view le
 		{
-			replace(name[0], name_, '.', '_')
+			fmt::sprintf
+			{
+				le_buf, "le=\"%lu\"", histogram::bucket_max(i)
+			}
 		};
 
-		const string_view line
+		print(out, "%s_bucket%s %lu\n",
+		      name,
+		      labels(label_buf, item_, le),
+		      cum);
+	}
+
+	const uint64_t count
+	{
+		val.count.load(std::memory_order_relaxed)
+	};
+
+	print(out, "%s_bucket%s %lu\n",
+	      name,
+	      labels(label_buf, item_, "le=\"+Inf\""),
+	      count);
+
+	const string_view label
+	{
+		labels(label_buf, item_)
+	};
+
+	print(out, "%s_sum%s %lu\n%s_count%s %lu\n",
+	      name,
+	      label,
+	      val.sum.load(std::memory_order_relaxed),
+	      name,
+	      label,
+	      count);
+}
+
+void
+ircd::stats::write_summary(window_buffer &out,
+                           const string_view &name,
+                           const item<void> &item_)
+{
+	const auto &val
+	{
+		dynamic_cast<const item<histogram> &>(item_).val
+	};
+
+	char label_buf[512], q_buf[64];
+	for(const auto &q : summary_quantiles)
+	{
+		const string_view quantile
 		{
-			buf,
-			::snprintf
-			(
-				buf, sizeof(buf), "%s %s %lu\n",
-				data(strlcpy(name[1], _name)),
-				data(string(val, *item)),
-				ts
-			)
+			fmt::sprintf
+			{
+				q_buf, "quantile=\"%.2lf\"", q
+			}
 		};
 
-		response.write(line);
+		print(out, "%s%s %lu\n",
+		      name,
+		      labels(label_buf, item_, quantile),
+		      val.quantile(q));
 	}
 
-	return std::move(response);
+	const string_view label
+	{
+		labels(label_buf, item_)
+	};
+
+	print(out, "%s_sum%s %lu\n%s_count%s %lu\n",
+	      name,
+	      label,
+	      val.sum.load(std::memory_order_relaxed),
+	      name,
+	      label,
+	      val.count.load(std::memory_order_relaxed));
+}
+
+/// Label set of the item from its 'labels' feature, with any extra label
+/// (already formatted) appended. Empty when there are no labels.
+ircd::string_view
+ircd::stats::labels(const mutable_buffer &buf,
+                    const item<void> &item,
+                    const string_view &extra)
+{
+	const json::object labels
+	{
+		item["labels"]
+	};
+
+	mutable_buffer out{buf};
+	for(const auto &[key, val] : labels)
+	{
+		char name_buf[64], val_buf[256];
+		consume(out, copy(out, size(out) == size(buf)? "{"_sv: ","_sv));
+		consume(out, copy(out, metric_name(name_buf, key)));
+		consume(out, copy(out, "=\""_sv));
+		consume(out, copy(out, escape(val_buf, json::string(val), true)));
+		consume(out, copy(out, "\""_sv));
+	}
+
+	if(extra)
+	{
+		consume(out, copy(out, size(out) == size(buf)? "{"_sv: ","_sv));
+		consume(out, copy(out, extra));
+	}
+
+	if(size(out) != size(buf))
+		consume(out, copy(out, "}"_sv));
+
+	return string_view
+	{
+		data(buf), data(out)
+	};
+}
+
+/// Prometheus metric and label names are [a-zA-Z_:][a-zA-Z0-9_:]*
+ircd::string_view
+ircd::stats::metric_name(const mutable_buffer &buf,
+                         const string_view &name)
+{
+	size_t len(0);
+	if((!name || std::isdigit(name[0])) && len < size(buf))
+		buf[len++] = '_';
+
+	for(const char &c : name)
+		if(len < size(buf))
+			buf[len++] = std::isalnum(c) || c == ':'? c: '_';
+
+	return string_view
+	{
+		data(buf), len
+	};
+}
+
+/// HELP text escapes backslash and newline; label values also escape the
+/// double-quote. Runs of whitespace (the descriptions are often indented
+/// multi-line strings) are collapsed to one space.
+ircd::string_view
+ircd::stats::escape(const mutable_buffer &buf,
+                    const string_view &str_,
+                    const bool &quote)
+{
+	const string_view str
+	{
+		quote? str_: strip(str_, " \t\n"_sv)
+	};
+
+	size_t len(0);
+	for(size_t i(0); i < size(str) && len + 2 < size(buf); ++i)
+	{
+		const char &c(str[i]);
+		if(!quote && (c == '\n' || c == '\t' || c == ' '))
+		{
+			if(len && buf[len - 1] != ' ')
+				buf[len++] = ' ';
+
+			continue;
+		}
+
+		if(c == '\n')
+		{
+			buf[len++] = '\\';
+			buf[len++] = 'n';
+			continue;
+		}
+
+		if(c == '\\' || (quote && c == '"'))
+			buf[len++] = '\\';
+
+		buf[len++] = c;
+	}
+
+	return string_view
+	{
+		data(buf), len
+	};
+}
+
+template<class... args>
+void
+ircd::stats::print(window_buffer &out,
+                   const string_view &format,
+                   args&&... a)
+{
+	out([&format, &a...](const mutable_buffer &buf) -> const_buffer
+	{
+		return string_view
+		{
+			fmt::sprintf
+			{
+				buf, format, std::forward<args>(a)...
+			}
+		};
+	});
 }